@@ -57,6 +57,7 @@ LSMASHVideoSource::LSMASHVideoSource
     int                 direct_rendering,
     int                 stacked_format,
     enum AVPixelFormat  pixel_format,
+    int                 conv_threads,
     IScriptEnvironment *env
 )
 {
@@ -76,6 +77,8 @@ LSMASHVideoSource::LSMASHVideoSource
     get_video_track( source, track_number, threads, env );
     lsmash_discard_boxes( vdh.root );
     prepare_video_decoding( direct_rendering, stacked_format, pixel_format, env );
+    if( lw_setup_video_slice_threads( &voh.scaler, conv_threads ) < 0 )
+        env->ThrowError( "LSMASHVideoSource: failed to create threads for pixel format conversion." );
 }
 
 LSMASHVideoSource::~LSMASHVideoSource()
@@ -95,7 +98,7 @@ uint32_t LSMASHVideoSource::open_file( const char *source, IScriptEnvironment *e
     lhp->level    = LW_LOG_FATAL;
     lhp->show_log = throw_error;
     lsmash_movie_parameters_t movie_param;
-    vdh.root = libavsmash_open_file( &format_ctx, source, &file_param, &movie_param, lhp );
+    vdh.root = libavsmash_open_file( source, &file_param, &movie_param, lhp );
     return movie_param.number_of_tracks;
 }
 
@@ -149,14 +152,11 @@ void LSMASHVideoSource::get_video_track( const char *source, uint32_t track_numb
         vi.fps_numerator   = (unsigned int)fps_num;
         vi.fps_denominator = (unsigned int)fps_den;
     }
-    /* libavformat */
-    for( i = 0; i < format_ctx->nb_streams && format_ctx->streams[i]->codec->codec_type != AVMEDIA_TYPE_VIDEO; i++ );
-    if( i == format_ctx->nb_streams )
-        env->ThrowError( "LSMASHVideoSource: failed to find stream by libavformat." );
     /* libavcodec */
-    AVStream       *stream = format_ctx->streams[i];
-    AVCodecContext *ctx    = stream->codec;
-    vdh.config.ctx = ctx;
+    AVCodecContext *ctx = libavsmash_get_codec_context( &format_ctx, source, &vdh.config, AVMEDIA_TYPE_VIDEO );
+    if( !ctx )
+        env->ThrowError( "LSMASHVideoSource: failed to get the decoder context." );
+    libavsmash_open_sample_input( vdh.root, vdh.track_ID, source, &vdh.config );
     AVCodec *codec = libavsmash_find_decoder( &vdh.config );
     if( !codec )
         env->ThrowError( "LSMASHVideoSource: failed to find %s decoder.", codec->name );
@@ -199,7 +199,7 @@ PVideoFrame __stdcall LSMASHVideoSource::GetFrame( int n, IScriptEnvironment *en
     config->lh.priv = env;
     if( config->error )
         return env->NewVideoFrame( vi );
-    if( libavsmash_get_video_frame( &vdh, sample_number, vi.num_frames ) < 0 )
+    if( libavsmash_get_video_frame( &vdh, &voh, sample_number, vi.num_frames ) < 0 )
         return env->NewVideoFrame( vi );
     PVideoFrame as_frame;
     if( make_frame( &voh, config->ctx, vdh.frame_buffer, as_frame, env ) < 0 )
@@ -243,7 +243,7 @@ uint32_t LSMASHAudioSource::open_file( const char *source, IScriptEnvironment *e
     lhp->level    = LW_LOG_FATAL;
     lhp->show_log = throw_error;
     lsmash_movie_parameters_t movie_param;
-    adh.root = libavsmash_open_file( &format_ctx, source, &file_param, &movie_param, lhp );
+    adh.root = libavsmash_open_file( source, &file_param, &movie_param, lhp );
     return movie_param.number_of_tracks;
 }
 
@@ -374,14 +374,11 @@ void LSMASHAudioSource::get_audio_track( const char *source, uint32_t track_numb
             aoh.skip_decoded_samples = ctd_shift + get_start_time( adh.root, adh.track_ID );
         }
     }
-    /* libavformat */
-    for( i = 0; i < format_ctx->nb_streams && format_ctx->streams[i]->codec->codec_type != AVMEDIA_TYPE_AUDIO; i++ );
-    if( i == format_ctx->nb_streams )
-        env->ThrowError( "LSMASHAudioSource: failed to find stream by libavformat." );
     /* libavcodec */
-    AVStream       *stream = format_ctx->streams[i];
-    AVCodecContext *ctx    = stream->codec;
-    adh.config.ctx = ctx;
+    AVCodecContext *ctx = libavsmash_get_codec_context( &format_ctx, source, &adh.config, AVMEDIA_TYPE_AUDIO );
+    if( !ctx )
+        env->ThrowError( "LSMASHAudioSource: failed to get the decoder context." );
+    libavsmash_open_sample_input( adh.root, adh.track_ID, source, &adh.config );
     AVCodec *codec = libavsmash_find_decoder( &adh.config );
     if( !codec )
         env->ThrowError( "LSMASHAudioSource: failed to find %s decoder.", codec->name );
@@ -437,12 +434,14 @@ AVSValue __cdecl CreateLSMASHVideoSource( AVSValue args, void *user_data, IScrip
     int         direct_rendering       = args[5].AsBool( false ) ? 1 : 0;
     int         stacked_format         = args[6].AsBool( false ) ? 1 : 0;
     enum AVPixelFormat pixel_format    = get_av_output_pixel_format( args[7].AsString( NULL ) );
+    int         conv_threads           = args[8].AsInt( 1 );
     threads                = threads >= 0 ? threads : 0;
     seek_mode              = CLIP_VALUE( seek_mode, 0, 2 );
     forward_seek_threshold = CLIP_VALUE( forward_seek_threshold, 1, 999 );
     direct_rendering      &= (pixel_format == AV_PIX_FMT_NONE);
+    conv_threads           = CLIP_VALUE( conv_threads, 0, 64 );
     return new LSMASHVideoSource( source, track_number, threads, seek_mode, forward_seek_threshold,
-                                  direct_rendering, stacked_format, pixel_format, env );
+                                  direct_rendering, stacked_format, pixel_format, conv_threads, env );
 }
 
 AVSValue __cdecl CreateLSMASHAudioSource( AVSValue args, void *user_data, IScriptEnvironment *env )
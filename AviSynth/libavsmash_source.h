@@ -63,6 +63,7 @@ public:
         int                 direct_rendering,
         int                 stacked_format,
         enum AVPixelFormat  pixel_format,
+        int                 conv_threads,
         IScriptEnvironment *env
     );
     ~LSMASHVideoSource();
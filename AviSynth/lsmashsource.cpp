@@ -56,7 +56,7 @@ extern "C" __declspec(dllexport) const char * __stdcall AvisynthPluginInit2( ISc
     env->AddFunction
     (
         "LSMASHVideoSource",
-        "[source]s[track]i[threads]i[seek_mode]i[seek_threshold]i[dr]b[stacked]b[format]s",
+        "[source]s[track]i[threads]i[seek_mode]i[seek_threshold]i[dr]b[stacked]b[format]s[conv_threads]i",
         CreateLSMASHVideoSource,
         0
     );
@@ -72,7 +72,7 @@ extern "C" __declspec(dllexport) const char * __stdcall AvisynthPluginInit2( ISc
     env->AddFunction
     (
         "LWLibavVideoSource",
-        "[source]s[stream_index]i[threads]i[cache]b[seek_mode]i[seek_threshold]i[dr]b[repeat]b[dominance]i[stacked]b[format]s",
+        "[source]s[stream_index]i[threads]i[cache]b[seek_mode]i[seek_threshold]i[dr]b[repeat]b[dominance]i[stacked]b[format]s[cache_dir]s[readahead]i[shared_demux]b[sparse_index]b[conv_threads]i",
         CreateLWLibavVideoSource,
         0
     );
@@ -80,7 +80,7 @@ extern "C" __declspec(dllexport) const char * __stdcall AvisynthPluginInit2( ISc
     env->AddFunction
     (
         "LWLibavAudioSource",
-        "[source]s[stream_index]i[cache]b[av_sync]b[layout]s[rate]i",
+        "[source]s[stream_index]i[cache]b[av_sync]b[layout]s[rate]i[cache_dir]s[readahead]i[shared_demux]b",
         CreateLWLibavAudioSource,
         0
     );
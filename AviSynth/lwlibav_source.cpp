@@ -42,6 +42,9 @@ extern "C"
 
 #pragma warning( disable:4996 )
 
+/* the number of packets read ahead if 'shared_demux' is set without 'readahead' */
+#define LWLIBAV_DEFAULT_SHARED_READAHEAD 64
+
 LWLibavVideoSource::LWLibavVideoSource
 (
     lwlibav_option_t   *opt,
@@ -50,6 +53,9 @@ LWLibavVideoSource::LWLibavVideoSource
     int                 direct_rendering,
     int                 stacked_format,
     enum AVPixelFormat  pixel_format,
+    int                 readahead,
+    int                 shared_demux,
+    int                 conv_threads,
     IScriptEnvironment *env
 )
 {
@@ -97,10 +103,16 @@ LWLibavVideoSource::LWLibavVideoSource
     vi.fps_denominator = (unsigned int)fps_den;
     /* */
     prepare_video_decoding( direct_rendering, stacked_format, pixel_format, env );
+    if( lw_setup_video_slice_threads( &voh.scaler, conv_threads ) < 0 )
+        env->ThrowError( "LWLibavVideoSource: failed to create threads for pixel format conversion." );
+    /* Start reading packets ahead of the decoder. */
+    if( lwlibav_start_readahead( (lwlibav_decode_handler_t *)&vdh, readahead, shared_demux ? lwh.file_path : NULL ) < 0 )
+        env->ThrowError( "LWLibavVideoSource: failed to start reading packets ahead." );
 }
 
 LWLibavVideoSource::~LWLibavVideoSource()
 {
+    lwlibav_stop_background_indexing( &lwh );
     lwlibav_cleanup_video_decode_handler( &vdh );
     lwlibav_cleanup_video_output_handler( &voh );
     if( lwh.file_path )
@@ -163,6 +175,8 @@ LWLibavAudioSource::LWLibavAudioSource
     lwlibav_option_t   *opt,
     uint64_t            channel_layout,
     int                 sample_rate,
+    int                 readahead,
+    int                 shared_demux,
     IScriptEnvironment *env
 )
 {
@@ -192,6 +206,9 @@ LWLibavAudioSource::LWLibavAudioSource
         env->ThrowError( "LWLibavAudioSource: failed to get the audio track." );
     adh.lh = lh;
     prepare_audio_decoding( channel_layout, sample_rate, env );
+    /* Start reading packets ahead of the decoder. */
+    if( lwlibav_start_readahead( (lwlibav_decode_handler_t *)&adh, readahead, shared_demux ? lwh.file_path : NULL ) < 0 )
+        env->ThrowError( "LWLibavAudioSource: failed to start reading packets ahead." );
 }
 
 LWLibavAudioSource::~LWLibavAudioSource()
@@ -265,9 +282,15 @@ AVSValue __cdecl CreateLWLibavVideoSource( AVSValue args, void *user_data, IScri
     int         field_dominance        = args[8].AsInt( 0 );
     int         stacked_format         = args[9].AsBool( false ) ? 1 : 0;
     enum AVPixelFormat pixel_format    = get_av_output_pixel_format( args[10].AsString( NULL ) );
+    const char *cache_dir              = args[11].AsString( NULL );
+    int         readahead              = args[12].AsInt( 0 );
+    int         shared_demux           = args[13].AsBool( false ) ? 1 : 0;
+    int         sparse_index           = args[14].AsBool( false ) ? 1 : 0;
+    int         conv_threads           = args[15].AsInt( 1 );
     /* Set LW-Libav options. */
     lwlibav_option_t opt;
     opt.file_path         = source;
+    opt.cache_dir         = cache_dir;
     opt.threads           = threads >= 0 ? threads : 0;
     opt.av_sync           = 0;
     opt.no_create_index   = no_create_index;
@@ -277,10 +300,14 @@ AVSValue __cdecl CreateLWLibavVideoSource( AVSValue args, void *user_data, IScri
     opt.force_audio_index = -1;
     opt.apply_repeat_flag = apply_repeat_flag;
     opt.field_dominance   = CLIP_VALUE( field_dominance, 0, 2 );    /* 0: Obey source flags, 1: TFF, 2: BFF */
+    opt.sparse_index      = sparse_index;
     seek_mode              = CLIP_VALUE( seek_mode, 0, 2 );
     forward_seek_threshold = CLIP_VALUE( forward_seek_threshold, 1, 999 );
     direct_rendering      &= (pixel_format == AV_PIX_FMT_NONE);
-    return new LWLibavVideoSource( &opt, seek_mode, forward_seek_threshold, direct_rendering, stacked_format, pixel_format, env );
+    readahead              = shared_demux && readahead == 0 ? LWLIBAV_DEFAULT_SHARED_READAHEAD : CLIP_VALUE( readahead, 0, 4096 );
+    conv_threads           = CLIP_VALUE( conv_threads, 0, 64 );
+    return new LWLibavVideoSource( &opt, seek_mode, forward_seek_threshold, direct_rendering, stacked_format, pixel_format,
+                                   readahead, shared_demux, conv_threads, env );
 }
 
 AVSValue __cdecl CreateLWLibavAudioSource( AVSValue args, void *user_data, IScriptEnvironment *env )
@@ -294,9 +321,13 @@ AVSValue __cdecl CreateLWLibavAudioSource( AVSValue args, void *user_data, IScri
     int         av_sync         = args[3].AsBool( false ) ? 1 : 0;
     const char *layout_string   = args[4].AsString( NULL );
     uint32_t    sample_rate     = args[5].AsInt( 0 );
+    const char *cache_dir       = args[6].AsString( NULL );
+    int         readahead       = args[7].AsInt( 0 );
+    int         shared_demux    = args[8].AsBool( false ) ? 1 : 0;
     /* Set LW-Libav options. */
     lwlibav_option_t opt;
     opt.file_path         = source;
+    opt.cache_dir         = cache_dir;
     opt.threads           = 0;
     opt.av_sync           = av_sync;
     opt.no_create_index   = no_create_index;
@@ -306,6 +337,8 @@ AVSValue __cdecl CreateLWLibavAudioSource( AVSValue args, void *user_data, IScri
     opt.force_audio_index = stream_index >= 0 ? stream_index : -1;
     opt.apply_repeat_flag = 0;
     opt.field_dominance   = 0;
+    opt.sparse_index      = 0;
     uint64_t channel_layout = layout_string ? av_get_channel_layout( layout_string ) : 0;
-    return new LWLibavAudioSource( &opt, channel_layout, sample_rate, env );
+    readahead = shared_demux && readahead == 0 ? LWLIBAV_DEFAULT_SHARED_READAHEAD : CLIP_VALUE( readahead, 0, 4096 );
+    return new LWLibavAudioSource( &opt, channel_layout, sample_rate, readahead, shared_demux, env );
 }
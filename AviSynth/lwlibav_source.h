@@ -52,6 +52,9 @@ public:
         int                 direct_rendering,
         int                 stacked_format,
         enum AVPixelFormat  pixel_format,
+        int                 readahead,
+        int                 shared_demux,
+        int                 conv_threads,
         IScriptEnvironment *env
     );
     ~LWLibavVideoSource();
@@ -82,6 +85,8 @@ public:
         lwlibav_option_t   *opt,
         uint64_t            channel_layout,
         int                 sample_rate,
+        int                 readahead,
+        int                 shared_demux,
         IScriptEnvironment *env
     );
     ~LWLibavAudioSource();
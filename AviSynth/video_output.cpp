@@ -52,8 +52,8 @@ extern "C"
 #define FFMPEG_HIGH_DEPTH_SUPPORT 0
 #endif
 
-static const int sse2_available = lw_check_sse2();
-static const int avx2_available = VC_HAS_AVX2 && lw_check_avx2();
+static const int sse2_available = !!(lw_get_simd_flags() & LW_SIMD_SSE2);
+static const int avx2_available = VC_HAS_AVX2 && (lw_get_simd_flags() & LW_SIMD_AVX2);
 
 static void make_black_background_planar_yuv
 (
@@ -114,16 +114,14 @@ static void make_black_background_packed_all_zero
  * So, I think it's OK that we always use swscale instead. */
 static inline int convert_av_pixel_format
 (
-    struct SwsContext *sws_ctx,
-    int                height,
-    AVFrame           *av_frame,
-    AVPicture         *av_picture
+    lw_video_scaler_handler_t *vshp,
+    AVFrame                   *av_frame,
+    AVPicture                 *av_picture
 )
 {
-    int ret = sws_scale( sws_ctx,
-                         (const uint8_t * const *)av_frame->data, av_frame->linesize,
-                         0, height,
-                         av_picture->data, av_picture->linesize );
+    int ret = lw_scale_video_frame( vshp,
+                                    (const uint8_t * const *)av_frame->data, av_frame->linesize,
+                                    av_picture->data, av_picture->linesize );
     return ret > 0 ? ret : -1;
 }
 
@@ -151,7 +149,7 @@ static int make_frame_planar_yuv
 {
     AVPicture av_picture = { { { NULL } } };
     as_assign_planar_yuv( as_frame, &av_picture );
-    return convert_av_pixel_format( vohp->scaler.sws_ctx, height, av_frame, &av_picture );
+    return convert_av_pixel_format( &vohp->scaler, av_frame, &av_picture );
 }
 
 static int make_frame_planar_yuv_stacked
@@ -175,7 +173,7 @@ static int make_frame_planar_yuv_stacked
         }
     else
     {
-        if( convert_av_pixel_format( vshp->sws_ctx, height, av_frame, &as_vohp->scaled ) < 0 )
+        if( convert_av_pixel_format( vshp, av_frame, &as_vohp->scaled ) < 0 )
             return -1;
         src_picture = as_vohp->scaled;
     }
@@ -246,7 +244,7 @@ static int make_frame_packed_yuv
     AVPicture av_picture = { { { NULL } } };
     av_picture.data    [0] = as_frame->GetWritePtr();
     av_picture.linesize[0] = as_frame->GetPitch   ();
-    return convert_av_pixel_format( vohp->scaler.sws_ctx, height, av_frame, &av_picture );
+    return convert_av_pixel_format( &vohp->scaler, av_frame, &av_picture );
 }
 
 static int make_frame_packed_rgb
@@ -260,7 +258,7 @@ static int make_frame_packed_rgb
     AVPicture av_picture = { { { NULL } } };
     av_picture.data    [0] = as_frame->GetWritePtr() + as_frame->GetPitch() * (as_frame->GetHeight() - 1);
     av_picture.linesize[0] = -as_frame->GetPitch();
-    return convert_av_pixel_format( vohp->scaler.sws_ctx, height, av_frame, &av_picture );
+    return convert_av_pixel_format( &vohp->scaler, av_frame, &av_picture );
 }
 
 enum AVPixelFormat get_av_output_pixel_format
@@ -456,10 +454,11 @@ int make_frame
 )
 {
     lw_video_scaler_handler_t *vshp = &vohp->scaler;
-    if( !vshp->enabled && av_frame->opaque )
+    if( av_frame->opaque )
     {
         /* Render a video frame from the decoder directly. */
         as_video_buffer_handler_t *as_vbhp = (as_video_buffer_handler_t *)av_frame->opaque;
+        lw_split_dr_chroma( vshp, av_frame, &as_vbhp->chroma_split );
         as_frame = as_vbhp->as_frame_buffer;
         return 0;
     }
@@ -477,17 +476,9 @@ int make_frame
      || vshp->input_yuv_range    != yuv_range )
     {
         /* Update scaler. */
-        vshp->sws_ctx = update_scaler_configuration( vshp->sws_ctx, vshp->flags,
-                                                     ctx->width, ctx->height,
-                                                     *input_pixel_format, vshp->output_pixel_format,
-                                                     ctx->colorspace, yuv_range );
-        if( !vshp->sws_ctx )
+        if( update_scaler_handler( vshp, ctx->width, ctx->height,
+                                   *input_pixel_format, ctx->colorspace, yuv_range ) < 0 )
             return -1;
-        vshp->input_width        = ctx->width;
-        vshp->input_height       = ctx->height;
-        vshp->input_pixel_format = *input_pixel_format;
-        vshp->input_colorspace   = ctx->colorspace;
-        vshp->input_yuv_range    = yuv_range;
     }
     /* Render a video frame through the scaler from the decoder. */
     as_frame = env->NewVideoFrame( *as_vohp->vi, 32 );
@@ -497,53 +488,21 @@ int make_frame
     return as_vohp->make_frame( vohp, ctx->height, av_frame, as_frame );
 }
 
-static int as_check_dr_available
+static lw_dr_layout_t as_get_dr_layout
 (
-    AVCodecContext    *ctx,
-    enum AVPixelFormat pixel_format,
-    int                stacked_format
+    lw_video_output_handler_t *vohp,
+    AVCodecContext            *ctx,
+    enum AVPixelFormat         pixel_format
 )
 {
-    if( !(ctx->codec->capabilities & CODEC_CAP_DR1) )
-        return 0;
-    static const struct
-    {
-        enum AVPixelFormat pixel_format;
-        int                stacked_support;
-    } dr_support_table[] =
-        {
-            { AV_PIX_FMT_YUV420P,     0 },
-            { AV_PIX_FMT_YUV420P9LE,  1 },
-            { AV_PIX_FMT_YUV420P10LE, 1 },
-            { AV_PIX_FMT_YUV420P16LE, 1 },
-            { AV_PIX_FMT_YUV422P,     0 },
-            { AV_PIX_FMT_YUV422P9LE,  1 },
-            { AV_PIX_FMT_YUV422P10LE, 1 },
-            { AV_PIX_FMT_YUV422P16LE, 1 },
-            { AV_PIX_FMT_YUV444P,     0 },
-            { AV_PIX_FMT_YUV444P9LE,  1 },
-            { AV_PIX_FMT_YUV444P10LE, 1 },
-            { AV_PIX_FMT_YUV444P16LE, 1 },
-            { AV_PIX_FMT_YUV410P,     0 },
-            { AV_PIX_FMT_YUV411P,     0 },
-            { AV_PIX_FMT_YUYV422,     0 },
-            { AV_PIX_FMT_GRAY8,       0 },
-            { AV_PIX_FMT_BGR24,       0 },
-            { AV_PIX_FMT_BGRA,        0 },
-#if FFMPEG_HIGH_DEPTH_SUPPORT
-            { AV_PIX_FMT_YUV420P12LE, 1 },
-            { AV_PIX_FMT_YUV420P14LE, 1 },
-            { AV_PIX_FMT_YUV422P12LE, 1 },
-            { AV_PIX_FMT_YUV422P14LE, 1 },
-            { AV_PIX_FMT_YUV444P12LE, 1 },
-            { AV_PIX_FMT_YUV444P14LE, 1 },
-#endif
-            { AV_PIX_FMT_NONE,        0 }
-        };
-    for( int i = 0; dr_support_table[i].pixel_format != AV_PIX_FMT_NONE; i++ )
-        if( dr_support_table[i].pixel_format == pixel_format )
-            return !(dr_support_table[i].stacked_support && stacked_format);
-    return 0;
+    as_video_output_handler_t *as_vohp = (as_video_output_handler_t *)vohp->private_handler;
+    int host_caps = LW_DR_CAP_PLANAR_YUV | LW_DR_CAP_GRAY8 | LW_DR_CAP_PACKED_YUV422 | LW_DR_CAP_PACKED_RGB | LW_DR_CAP_SEMI_PLANAR;
+    if( !as_vohp->stacked_format )
+        host_caps |= LW_DR_CAP_PLANAR_YUV_DEEP | LW_DR_CAP_PLANAR_YUV_12_14;
+    enum AVPixelFormat host_pixel_format;
+    lw_dr_layout_t layout = lw_get_dr_layout( ctx, pixel_format, host_caps, &host_pixel_format );
+    /* The frame buffers are allocated in the pixel format of the clip. */
+    return host_pixel_format == vohp->scaler.output_pixel_format ? layout : LW_DR_LAYOUT_NONE;
 }
 
 static void as_video_release_buffer_handler
@@ -575,15 +534,21 @@ static int as_video_get_buffer
     int             flags
 )
 {
+    av_frame->opaque = NULL;
     lw_video_output_handler_t *lw_vohp = (lw_video_output_handler_t *)ctx->opaque;
     as_video_output_handler_t *as_vohp = (as_video_output_handler_t *)lw_vohp->private_handler;
     lw_video_scaler_handler_t *vshp    = &lw_vohp->scaler;
-    vshp->enabled = 0;
     enum AVPixelFormat pix_fmt = ctx->pix_fmt;
     avoid_yuv_scale_conversion( &pix_fmt );
-    if( vshp->input_pixel_format != pix_fmt
-     || !as_check_dr_available( ctx, pix_fmt, as_vohp->stacked_format ) )
-        vshp->enabled = 1;
+    int aligned_width  = ctx->width << (as_vohp->bitdepth_minus_8 ? 1 : 0);
+    int aligned_height = ctx->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2( ctx, &aligned_width, &aligned_height, linesize_align );
+    /* Fall back to the scaler for this frame if the decoder can't write into the AviSynth frame buffer. */
+    lw_dr_layout_t layout = as_get_dr_layout( lw_vohp, ctx, pix_fmt );
+    vshp->enabled = layout == LW_DR_LAYOUT_NONE
+                 || aligned_width  > lw_vohp->output_width
+                 || aligned_height > lw_vohp->output_height;
     if( vshp->enabled )
         return avcodec_default_get_buffer2( ctx, av_frame, 0 );
     /* New AviSynth video frame buffer. */
@@ -595,9 +560,7 @@ static int as_video_get_buffer
     }
     av_frame->opaque = as_vbhp;
     as_vbhp->as_frame_buffer = as_vohp->env->NewVideoFrame( *as_vohp->vi, 32 );
-    int aligned_width  = ctx->width << (as_vohp->bitdepth_minus_8 ? 1 : 0);
-    int aligned_height = ctx->height;
-    avcodec_align_dimensions2( ctx, &aligned_width, &aligned_height, av_frame->linesize );
+    as_vbhp->chroma_split.pending = 0;
     if( lw_vohp->output_width != aligned_width || lw_vohp->output_height != aligned_height )
         as_vohp->make_black_background( as_vbhp->as_frame_buffer, as_vohp->bitdepth_minus_8 );
     /* Create frame buffers for the decoder.
@@ -636,6 +599,22 @@ static int as_video_get_buffer
     } while( 0 )
     if( as_vohp->vi->pixel_type & VideoInfo::CS_INTERLEAVED )
         CREATE_PLANE_BUFFER( 0, );
+    else if( layout == LW_DR_LAYOUT_SEMI_PLANAR )
+    {
+        /* The decoder writes the interleaved chroma into an intermediate buffer.
+         * It is split into the chroma planes when the frame is output. */
+        CREATE_PLANE_BUFFER( 0, PLANAR_Y );
+        if( lw_alloc_dr_chroma_plane( lw_vohp, av_frame, aligned_width, aligned_height ) < 0 )
+            goto fail;
+        lw_dr_chroma_split_t *split = &as_vbhp->chroma_split;
+        split->data    [0] = as_vbhp->as_frame_buffer->GetWritePtr( PLANAR_U );
+        split->data    [1] = as_vbhp->as_frame_buffer->GetWritePtr( PLANAR_V );
+        split->linesize[0] = as_vbhp->as_frame_buffer->GetPitch( PLANAR_U );
+        split->linesize[1] = as_vbhp->as_frame_buffer->GetPitch( PLANAR_V );
+        split->width       = MIN( (aligned_width  + 1) >> 1, as_vbhp->as_frame_buffer->GetRowSize( PLANAR_U ) );
+        split->height      = MIN( (aligned_height + 1) >> 1, as_vbhp->as_frame_buffer->GetHeight ( PLANAR_U ) );
+        split->pending     = 1;
+    }
     else
         for( int i = 0; i < 3; i++ )
         {
@@ -689,7 +668,7 @@ func_get_buffer_t *as_setup_video_rendering
     vi->height = output_height << (as_vohp->bitdepth_minus_8 &&  as_vohp->stacked_format ? 1 : 0);
     enum AVPixelFormat input_pixel_format = ctx->pix_fmt;
     avoid_yuv_scale_conversion( &input_pixel_format );
-    direct_rendering &= as_check_dr_available( ctx, input_pixel_format, as_vohp->stacked_format );
+    direct_rendering &= (as_get_dr_layout( vohp, ctx, input_pixel_format ) != LW_DR_LAYOUT_NONE);
     lw_video_scaler_handler_t *vshp = &vohp->scaler;
     if( initialize_scaler_handler( vshp, ctx, !direct_rendering, SWS_FAST_BILINEAR, vshp->output_pixel_format ) < 0 )
         env->ThrowError( "%s: failed to initialize scaler handler.", filter_name );
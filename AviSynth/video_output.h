@@ -53,7 +53,8 @@ typedef struct
 
 typedef struct
 {
-    PVideoFrame as_frame_buffer;
+    PVideoFrame          as_frame_buffer;
+    lw_dr_chroma_split_t chroma_split;      /* for semi-planar frames */
 } as_video_buffer_handler_t;
 
 enum AVPixelFormat get_av_output_pixel_format
@@ -31,7 +31,7 @@
 #include <libavutil/mem.h>
 
 #include "../common/lwsimd.h"
-#include "colorspace_simd.h"
+#include "../common/colorspace_simd.h"
 #include "video_output.h"
 
 static void convert_yuv16le_to_lw48
@@ -66,47 +66,6 @@ static void convert_yuv16le_to_lw48
     }
 }
 
-static void convert_yuv16le_to_yc48
-(
-    uint8_t  *buf,
-    int       buf_linesize,
-    uint8_t **dst_data,
-    int      *dst_linesize,
-    int       output_rowsize,
-    int       output_height,
-    int       full_range
-)
-{
-    uint32_t offset = 0;
-    while( output_height-- )
-    {
-        uint8_t *p_buf = buf;
-        uint8_t *p_dst[3] = { dst_data[0] + offset, dst_data[1] + offset, dst_data[2] + offset };
-        for( int i = 0; i < output_rowsize; i += YC48_SIZE )
-        {
-            static const uint32_t y_coef   [2] = {  1197,   4770 };
-            static const uint32_t y_shift  [2] = {    14,     16 };
-            static const uint32_t uv_coef  [2] = {  4682,   4662 };
-            static const uint32_t uv_offset[2] = { 32768, 589824 };
-            uint16_t y  = (((int32_t)((p_dst[0][0] | (p_dst[0][1] << 8)) * y_coef[full_range])) >> y_shift[full_range]) - 299;
-            uint16_t cb = ((int32_t)(((p_dst[1][0] | (p_dst[1][1] << 8)) - 32768) * uv_coef[full_range] + uv_offset[full_range])) >> 16;
-            uint16_t cr = ((int32_t)(((p_dst[2][0] | (p_dst[2][1] << 8)) - 32768) * uv_coef[full_range] + uv_offset[full_range])) >> 16;
-            p_dst[0] += 2;
-            p_dst[1] += 2;
-            p_dst[2] += 2;
-            p_buf[0] = y;
-            p_buf[1] = y >> 8;
-            p_buf[2] = cb;
-            p_buf[3] = cb >> 8;
-            p_buf[4] = cr;
-            p_buf[5] = cr >> 8;
-            p_buf += YC48_SIZE;
-        }
-        buf    += buf_linesize;
-        offset += dst_linesize[0];
-    }
-}
-
 static void convert_packed_chroma_to_planar
 (
     AVPicture *planar_chroma,
@@ -129,228 +88,6 @@ static void convert_packed_chroma_to_planar
     }
 }
 
-static void inline __attribute__((always_inline)) convert_yuv420ple_i_to_yuv444p16le
-(
-    uint8_t  **dst,
-    const int *dst_linesize,
-    uint8_t  **pic_data,
-    int       *pic_linesize,
-    int        output_rowsize,
-    int        height,
-    int        bit_depth
-)
-{
-    const int lshft = 16 - bit_depth;
-    /* copy luma */
-    {
-        uint16_t *ptr_src_line = (uint16_t *)pic_data[0];
-        uint16_t *ptr_dst_line = (uint16_t *)dst[0];
-        const int dst_line_len = dst_linesize[0] / sizeof(uint16_t);
-        const int src_line_len = pic_linesize[0] / sizeof(uint16_t);
-        const int luma_width = (output_rowsize / sizeof(uint16_t));
-        for( int y = 0; y < height; y++ )
-            for( int x = 0; x < luma_width; x++ )
-                ptr_dst_line[y*dst_line_len+x] = ptr_src_line[y*src_line_len+x] << lshft;
-    }
-    /* chroma upsampling for interlaced yuv420 */
-    const int src_chroma_width = (output_rowsize / sizeof(uint16_t)) / 2;
-    for( int i_color = 1; i_color < 3; i_color++ )
-    {
-        uint16_t *ptr_src_line = (uint16_t *)pic_data[i_color];
-        uint16_t *ptr_dst_line = (uint16_t *)dst[i_color];
-        const int dst_line_len = dst_linesize[i_color] / sizeof(uint16_t);
-        const int src_line_len = pic_linesize[i_color] / sizeof(uint16_t);
-        /* first 2 lines */
-        int x;
-        uint16_t tmp[2][4];
-        uint64_t *tmp0 = (uint64_t *)tmp[0], *tmp1 = (uint64_t *)tmp[1];
-
-    /* this inner loop branch should be deleted by forced inline expansion and "lshft" constant propagation. */
-#define INTERPOLATE_CHROMA( k, x ) \
-    { \
-        int chroma0 = (5 * ptr_src_line[0 * src_line_len + x] + 3 * ptr_src_line[2 * src_line_len + x]); \
-        int chroma1 = (7 * ptr_src_line[1 * src_line_len + x] + 1 * ptr_src_line[3 * src_line_len + x]); \
-        int chroma2 = (1 * ptr_src_line[0 * src_line_len + x] + 7 * ptr_src_line[2 * src_line_len + x]); \
-        int chroma3 = (3 * ptr_src_line[1 * src_line_len + x] + 5 * ptr_src_line[3 * src_line_len + x]); \
-        if( lshft - 3 < 0 ) \
-        { \
-            tmp[k][0] = (chroma0 + (1<<(2-lshft))) >> (3-lshft); \
-            tmp[k][1] = (chroma1 + (1<<(2-lshft))) >> (3-lshft); \
-            tmp[k][2] = (chroma2 + (1<<(2-lshft))) >> (3-lshft); \
-            tmp[k][3] = (chroma3 + (1<<(2-lshft))) >> (3-lshft); \
-        } \
-        else if( lshft - 3 > 0 ) \
-        { \
-            tmp[k][0] = chroma0 << (lshft-3); \
-            tmp[k][1] = chroma1 << (lshft-3); \
-            tmp[k][2] = chroma2 << (lshft-3); \
-            tmp[k][3] = chroma3 << (lshft-3); \
-        } \
-        else \
-        { \
-            tmp[k][0] = chroma0; \
-            tmp[k][1] = chroma1; \
-            tmp[k][2] = chroma2; \
-            tmp[k][3] = chroma3; \
-        } \
-    }
-#define PUT_CHROMA( x, line ) \
-    { \
-        ptr_dst_line[dst_line_len * line + 2 * x + 0] = tmp[0][line]; \
-        ptr_dst_line[dst_line_len * line + 2 * x + 1] = (tmp[0][line] + tmp[1][line]) >> 1; \
-    }
-
-        tmp[0][0] = ptr_src_line[0] << lshft;
-        tmp[0][1] = ptr_src_line[src_line_len] << lshft;
-        for( x = 0; x < src_chroma_width - 1; x++ )
-        {
-            tmp[1][0] = ptr_src_line[x+1] << lshft;
-            tmp[1][1] = ptr_src_line[x+1 + src_line_len] << lshft;
-            for( int i = 0; i < 2; i++ )
-                PUT_CHROMA( x, i );
-            *tmp0 = *tmp1;
-        }
-        for( int i = 0; i < 2; i++ )
-            PUT_CHROMA( x, i );
-        ptr_dst_line += (dst_line_len << 1);
-
-        /* 5,3,7,1 - interlaced yuv420 to yuv422 interpolation with 1,1 - yuv422 to yuv444 interpolation. */
-        for( int y = 2; y < height - 2; y += 4, ptr_dst_line += (dst_line_len << 2), ptr_src_line += (src_line_len << 1) )
-        {
-            INTERPOLATE_CHROMA( 0, 0 );
-            for( x = 0; x < src_chroma_width - 1; x++ )
-            {
-                INTERPOLATE_CHROMA( 1, x+1 );
-                for( int i = 0; i < 4; i++ )
-                    PUT_CHROMA( x, i );
-                *tmp0 = *tmp1;
-            }
-            for( int i = 0; i < 4; i++ )
-                PUT_CHROMA( x, i );
-        }
-
-        /* last 2 lines */
-        tmp[0][0] = ptr_src_line[0] << lshft;
-        tmp[0][1] = ptr_src_line[src_line_len] << lshft;
-        for( x = 0; x < src_chroma_width - 1; x++ )
-        {
-            tmp[1][0] = ptr_src_line[x+1] << lshft;
-            tmp[1][1] = ptr_src_line[x+1 + src_line_len] << lshft;
-            for( int i = 0; i < 2; i++ )
-                PUT_CHROMA( x, i );
-            *tmp0 = *tmp1;
-        }
-        for( int i = 0; i < 2; i++ )
-            PUT_CHROMA( x, i );
-#undef INTERPOLATE_CHROMA
-#undef PUT_CHROMA
-    }
-}
-
-static void convert_yuv420p9le_i_to_yuv444p16le
-(
-    uint8_t  **dst,
-    const int *dst_linesize,
-    uint8_t  **pic_data,
-    int       *pic_linesize,
-    int        output_rowsize,
-    int        height
-)
-{
-    convert_yuv420ple_i_to_yuv444p16le( dst, dst_linesize, pic_data, pic_linesize, output_rowsize, height, 9 );
-}
-
-static void convert_yuv420p10le_i_to_yuv444p16le
-(
-    uint8_t  **dst,
-    const int *dst_linesize,
-    uint8_t  **pic_data,
-    int       *pic_linesize,
-    int        output_rowsize,
-    int        height
-)
-{
-    convert_yuv420ple_i_to_yuv444p16le( dst, dst_linesize, pic_data, pic_linesize, output_rowsize, height, 10 );
-}
-
-static void convert_yuv420p16le_i_to_yuv444p16le
-(
-    uint8_t  **dst,
-    const int *dst_linesize,
-    uint8_t  **pic_data,
-    int       *pic_linesize,
-    int        output_rowsize,
-    int        height
-)
-{
-    convert_yuv420ple_i_to_yuv444p16le( dst, dst_linesize, pic_data, pic_linesize, output_rowsize, height, 16 );
-}
-
-static void convert_yv12i_to_yuy2
-(
-    uint8_t  *buf,
-    int       buf_linesize,
-    uint8_t **pic_data,
-    int      *pic_linesize,
-    int       output_rowsize,
-    int       height
-)
-{
-    uint8_t *pic_y = pic_data[0];
-    uint8_t *pic_u = pic_data[1];
-    uint8_t *pic_v = pic_data[2];
-#define INTERPOLATE_CHROMA( x, chroma, offset ) \
-    { \
-        buf[0 * buf_linesize + 4 * x + offset] = (5 * chroma[0*pic_linesize[1] + x] + 3 * chroma[2 * pic_linesize[1] + x] + 4) >> 3; \
-        buf[1 * buf_linesize + 4 * x + offset] = (7 * chroma[1*pic_linesize[1] + x] + 1 * chroma[3 * pic_linesize[1] + x] + 4) >> 3; \
-        buf[2 * buf_linesize + 4 * x + offset] = (1 * chroma[0*pic_linesize[1] + x] + 7 * chroma[2 * pic_linesize[1] + x] + 4) >> 3; \
-        buf[3 * buf_linesize + 4 * x + offset] = (3 * chroma[1*pic_linesize[1] + x] + 5 * chroma[3 * pic_linesize[1] + x] + 4) >> 3; \
-    }
-#define COPY_CHROMA( x, chroma, offset ) \
-    { \
-        buf[               4 * x + offset] = chroma[                  x]; \
-        buf[buf_linesize + 4 * x + offset] = chroma[pic_linesize[1] + x]; \
-    }
-    /* Copy all luma (Y). */
-    int luma_width = output_rowsize / YUY2_SIZE;
-    for( int y = 0; y < height; y++ )
-    {
-        for( int x = 0; x < luma_width; x++ )
-            buf[y * buf_linesize + 2 * x] = pic_y[x];
-        pic_y += pic_linesize[0];
-    }
-    /* Copy first 2 lines */
-    int chroma_width = luma_width / 2;
-    for( int x = 0; x < chroma_width; x++ )
-    {
-        COPY_CHROMA( x, pic_u, 1 );
-        COPY_CHROMA( x, pic_v, 3 );
-    }
-    buf += buf_linesize * 2;
-    /* Interpolate interlaced yv12 to yuy2 with suggestion in MPEG-2 spec. */
-    int four_buf_linesize = buf_linesize * 4;
-    int four_chroma_linesize = pic_linesize[1] * 2;
-    for( int y = 2; y < height - 2; y += 4 )
-    {
-        for( int x = 0; x < chroma_width; x++ )
-        {
-            INTERPOLATE_CHROMA( x, pic_u, 1 );      /* U */
-            INTERPOLATE_CHROMA( x, pic_v, 3 );      /* V */
-        }
-        buf   += four_buf_linesize;
-        pic_u += four_chroma_linesize;
-        pic_v += four_chroma_linesize;
-    }
-    /* Copy last 2 lines. */
-    for( int x = 0; x < chroma_width; x++ )
-    {
-        COPY_CHROMA( x, pic_u, 1 );
-        COPY_CHROMA( x, pic_v, 3 );
-    }
-#undef INTERPOLATE_CHROMA
-#undef COPY_CHROMA
-}
-
 static int to_yuv16le
 (
     struct SwsContext *sws_ctx,
@@ -379,9 +116,7 @@ static int to_yuv16le
             }
     if( yuv420_index != -1 )
     {
-        static int sse41_available = -1;
-        if( sse41_available == -1 )
-            sse41_available = lw_check_sse41();
+        int sse41_available = !!(lw_get_simd_flags() & LW_SIMD_SSE41);
         yuv420_list[yuv420_index].convert[sse41_available]
         (
             yuv444p16->data, yuv444p16->linesize,
@@ -424,9 +159,8 @@ int to_yuv16le_to_yc48
     int output_rowsize = vshp->input_width * YC48_SIZE;
     int output_height  = to_yuv16le( vshp->sws_ctx, picture, yuv444p16, vshp->input_width, vshp->input_height );
     /* Convert planar YUV 4:4:4 48bpp little-endian into YC48. */
-    static int simd_available = -1;
-    if( simd_available == -1 )
-        simd_available = lw_check_sse2() + ( lw_check_sse2() && lw_check_sse41() );
+    int simd_flags     = lw_get_simd_flags();
+    int simd_available = !!(simd_flags & LW_SIMD_SSE2) + !!(simd_flags & LW_SIMD_SSE41);
     static void (*func_yuv16le_to_yc48[3])( uint8_t *, int, uint8_t **, int *, int, int, int ) = { convert_yuv16le_to_yc48, convert_yuv16le_to_yc48_sse2, convert_yuv16le_to_yc48_sse4_1 };
     func_yuv16le_to_yc48[simd_available * (((vohp->output_linesize | (size_t)buf) & 15) == 0)]
         ( buf, vohp->output_linesize, yuv444p16->data, yuv444p16->linesize, output_rowsize, output_height, vshp->input_yuv_range );
@@ -510,11 +244,15 @@ int to_yuy2
         }
         /* Interlaced YV12 to YUY2 conversion */
         output_rowsize = vshp->input_width * YUY2_SIZE;
-        static int ssse3_available = -1;
-        if( ssse3_available == -1 )
-            ssse3_available = lw_check_ssse3();
+        int simd_flags = lw_get_simd_flags();
+#if LW_SIMD_AVX2_ENABLED
+        static void (*func_yv12i_to_yuy2[3])( uint8_t*, int, uint8_t**, int*, int, int ) = { convert_yv12i_to_yuy2, convert_yv12i_to_yuy2_ssse3, convert_yv12i_to_yuy2_avx2 };
+        int simd_index = (simd_flags & LW_SIMD_AVX2) ? 2 : !!(simd_flags & LW_SIMD_SSSE3);
+#else
         static void (*func_yv12i_to_yuy2[2])( uint8_t*, int, uint8_t**, int*, int, int ) = { convert_yv12i_to_yuy2, convert_yv12i_to_yuy2_ssse3 };
-        func_yv12i_to_yuy2[ssse3_available]( buf, vohp->output_linesize, av_picture.data, av_picture.linesize, output_rowsize, vshp->input_height );
+        int simd_index = !!(simd_flags & LW_SIMD_SSSE3);
+#endif
+        func_yv12i_to_yuy2[simd_index]( buf, vohp->output_linesize, av_picture.data, av_picture.linesize, output_rowsize, vshp->input_height );
     }
     else
     {
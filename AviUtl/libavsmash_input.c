@@ -65,6 +65,7 @@ typedef struct libavsmash_handler_tag
     lsmash_movie_parameters_t         movie_param;
     uint32_t                          number_of_tracks;
     AVFormatContext                  *format_ctx;
+    char                             *file_name;    /* for opening libavformat as a fallback */
     int                               threads;
     /* Video stuff */
     libavsmash_video_info_handler_t   vih;
@@ -90,12 +91,21 @@ static void *open_file( char *file_name, reader_option_t *opt )
     lh.level    = LW_LOG_QUIET;
     lh.show_log = au_message_box_desktop;
     /* Open file. */
-    hp->root = libavsmash_open_file( &hp->format_ctx, file_name, &hp->file_param, &hp->movie_param, &lh );
+    hp->root = libavsmash_open_file( file_name, &hp->file_param, &hp->movie_param, &lh );
     if( !hp->root )
     {
         free( hp );
         return NULL;
     }
+    hp->file_name = (char *)lw_malloc_zero( strlen( file_name ) + 1 );
+    if( !hp->file_name )
+    {
+        lsmash_close_file( &hp->file_param );
+        lsmash_destroy_root( hp->root );
+        free( hp );
+        return NULL;
+    }
+    strcpy( hp->file_name, file_name );
     hp->number_of_tracks = hp->movie_param.number_of_tracks;
     hp->threads          = opt->threads;
     hp->av_sync          = opt->av_sync;
@@ -225,18 +235,16 @@ static int get_first_track_of_type( lsmash_handler_t *h, uint32_t type )
             hp->aoh.skip_decoded_samples = ctd_shift + get_start_time( hp->root, track_ID );
         }
     }
-    /* libavformat */
+    /* libavcodec */
     type = (type == ISOM_MEDIA_HANDLER_TYPE_VIDEO_TRACK) ? AVMEDIA_TYPE_VIDEO : AVMEDIA_TYPE_AUDIO;
-    for( i = 0; i < hp->format_ctx->nb_streams && hp->format_ctx->streams[i]->codec->codec_type != type; i++ );
-    if( i == hp->format_ctx->nb_streams )
+    codec_configuration_t *config = type == AVMEDIA_TYPE_VIDEO ? &hp->vdh.config : &hp->adh.config;
+    AVCodecContext        *ctx    = libavsmash_get_codec_context( &hp->format_ctx, hp->file_name, config, (enum AVMediaType)type );
+    if( !ctx )
     {
-        DEBUG_MESSAGE_BOX_DESKTOP( MB_ICONERROR | MB_OK, "Failed to find stream by libavformat." );
+        DEBUG_MESSAGE_BOX_DESKTOP( MB_ICONERROR | MB_OK, "Failed to get the decoder context." );
         return -1;
     }
-    /* libavcodec */
-    AVCodecContext        *ctx    = hp->format_ctx->streams[i]->codec;
-    codec_configuration_t *config = type == AVMEDIA_TYPE_VIDEO ? &hp->vdh.config : &hp->adh.config;
-    config->ctx = ctx;
+    libavsmash_open_sample_input( hp->root, track_ID, hp->file_name, config );
     AVCodec *codec = libavsmash_find_decoder( config );
     if( !codec )
     {
@@ -411,7 +419,7 @@ static int read_video( lsmash_handler_t *h, int sample_number, void *buf )
         au_video_output_handler_t *au_vohp = (au_video_output_handler_t *)vohp->private_handler;
         memcpy( buf, au_vohp->back_ground, vohp->output_frame_size );
     }
-    if( libavsmash_get_video_frame( vdhp, sample_number, h->video_sample_count ) < 0 )
+    if( libavsmash_get_video_frame( vdhp, vohp, sample_number, h->video_sample_count ) < 0 )
         return 0;
     return convert_colorspace( vohp, vdhp->config.ctx, vdhp->frame_buffer, buf );
 }
@@ -472,6 +480,7 @@ static void close_file( void *private_stuff )
         avformat_close_input( &hp->format_ctx );
     lsmash_close_file( &hp->file_param );
     lsmash_destroy_root( hp->root );
+    free( hp->file_name );
     free( hp );
 }
 
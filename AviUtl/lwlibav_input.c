@@ -89,6 +89,7 @@ static void *open_file( char *file_path, reader_option_t *opt )
     /* Set options. */
     lwlibav_option_t lwlibav_opt;
     lwlibav_opt.file_path         = file_path;
+    lwlibav_opt.cache_dir         = NULL;
     lwlibav_opt.threads           = opt->threads;
     lwlibav_opt.av_sync           = opt->av_sync;
     lwlibav_opt.no_create_index   = opt->no_create_index;
@@ -98,6 +99,7 @@ static void *open_file( char *file_path, reader_option_t *opt )
     lwlibav_opt.force_audio_index = opt->force_audio_index;
     lwlibav_opt.apply_repeat_flag = opt->video_opt.apply_repeat_flag;
     lwlibav_opt.field_dominance   = opt->video_opt.field_dominance;
+    lwlibav_opt.sparse_index      = 0;
     /* Set up progress indicator. */
     progress_indicator_t indicator;
     indicator.open   = open_indicator;
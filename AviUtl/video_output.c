@@ -251,17 +251,9 @@ int convert_colorspace
      || vshp->input_yuv_range    != yuv_range )
     {
         /* Update scaler. */
-        vshp->sws_ctx = update_scaler_configuration( vshp->sws_ctx, vshp->flags,
-                                                     ctx->width, ctx->height,
-                                                     *input_pixel_format, vshp->output_pixel_format,
-                                                     ctx->colorspace, yuv_range );
-        if( !vshp->sws_ctx )
+        if( update_scaler_handler( vshp, ctx->width, ctx->height,
+                                   *input_pixel_format, ctx->colorspace, yuv_range ) < 0 )
             return 0;
-        vshp->input_width        = ctx->width;
-        vshp->input_height       = ctx->height;
-        vshp->input_pixel_format = *input_pixel_format;
-        vshp->input_colorspace   = ctx->colorspace;
-        vshp->input_yuv_range    = yuv_range;
         memcpy( buf, au_vohp->back_ground, vohp->output_frame_size );
     }
     if( au_vohp->convert_colorspace( vohp, picture, buf ) < 0 )
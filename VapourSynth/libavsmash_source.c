@@ -45,6 +45,7 @@ typedef struct
     lsmash_file_parameters_t          file_param;
     AVFormatContext                  *format_ctx;
     uint32_t                          media_timescale;
+    uint32_t                          prefetch;
 } lsmas_handler_t;
 
 static void VS_CC vs_filter_init( VSMap *in, VSMap *out, void **instance_data, VSNode *node, VSCore *core, const VSAPI *vsapi )
@@ -196,6 +197,21 @@ static int prepare_video_decoding( lsmas_handler_t *hp, VSCore *core, const VSAP
     return 0;
 }
 
+typedef struct
+{
+    uint32_t sample_number;
+    AVFrame *frame;
+} prefetch_request_t;
+
+static int keep_requested_frame( void *priv, uint32_t sample_number, AVFrame *frame )
+{
+    /* The other frames have been put into the frame cache by the decoding. */
+    prefetch_request_t *request = (prefetch_request_t *)priv;
+    if( request && sample_number == request->sample_number && !request->frame )
+        request->frame = av_frame_clone( frame );
+    return 0;
+}
+
 static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason, void **instance_data, void **frame_data, VSFrameContext *frame_ctx, VSCore *core, const VSAPI *vsapi )
 {
     if( activation_reason != arInitial )
@@ -220,7 +236,24 @@ static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason
     vs_vohp->frame_ctx = frame_ctx;
     vs_vohp->core      = core;
     vs_vohp->vsapi     = vsapi;
-    if( libavsmash_get_video_frame( vdhp, sample_number, vi->numFrames ) < 0 )
+    if( hp->prefetch && vohp->frame_cache.max_size && !lw_get_cached_video_frame( &vohp->frame_cache, sample_number ) )
+    {
+        /* Decode the requested frame and the following ones in a single pass, and then get the requested one from the frame cache.
+         * The requested frame is put back into the cache in case the following ones evicted it.
+         * Failure here is not an error since the requested frame is decoded again below if not cached. */
+        uint32_t sample_numbers[VS_MAX_PREFETCH_FRAMES + 1];
+        uint32_t count = vs_list_prefetch_frames( sample_numbers, sample_number, hp->prefetch, vi->numFrames );
+        prefetch_request_t request = { sample_number, NULL };
+        libavsmash_get_video_frames( vdhp, vohp, sample_numbers, count, vi->numFrames, keep_requested_frame, &request );
+        if( request.frame )
+        {
+            lw_cache_video_frame( &vohp->frame_cache, sample_number, request.frame );
+            av_frame_free( &request.frame );
+        }
+        if( config->error )
+            return NULL;
+    }
+    if( libavsmash_get_video_frame( vdhp, vohp, sample_number, vi->numFrames ) < 0 )
         return NULL;
     /* Output video frame. */
     AVFrame    *av_frame = vdhp->frame_buffer;
@@ -256,13 +289,13 @@ static uint32_t open_file
 )
 {
     lsmash_movie_parameters_t movie_param;
-    hp->vdh.root = libavsmash_open_file( &hp->format_ctx, source, &hp->file_param, &movie_param, lhp );
+    hp->vdh.root = libavsmash_open_file( source, &hp->file_param, &movie_param, lhp );
     if( !hp->vdh.root )
         return 0;
     return movie_param.number_of_tracks;
 }
 
-static int get_video_track( lsmas_handler_t *hp, uint32_t track_number, int threads, uint32_t number_of_tracks )
+static int get_video_track( lsmas_handler_t *hp, const char *source, uint32_t track_number, int threads, uint32_t number_of_tracks )
 {
     libavsmash_video_decode_handler_t *vdhp = &hp->vdh;
     lw_log_handler_t                  *lhp  = &vdhp->config.lh;
@@ -328,17 +361,14 @@ static int get_video_track( lsmas_handler_t *hp, uint32_t track_number, int thre
     hp->vi.fpsNum       = 25;
     hp->vi.fpsDen       = 1;
     libavsmash_setup_timestamp_info( vdhp, &hp->vi.fpsNum, &hp->vi.fpsDen, hp->vi.numFrames );
-    /* libavformat */
-    for( i = 0; i < hp->format_ctx->nb_streams && hp->format_ctx->streams[i]->codec->codec_type != AVMEDIA_TYPE_VIDEO; i++ );
-    if( i == hp->format_ctx->nb_streams )
+    /* libavcodec */
+    AVCodecContext *ctx = libavsmash_get_codec_context( &hp->format_ctx, source, &vdhp->config, AVMEDIA_TYPE_VIDEO );
+    if( !ctx )
     {
-        set_error( lhp, LW_LOG_FATAL, "lsmas: failed to find stream by libavformat." );
+        set_error( lhp, LW_LOG_FATAL, "lsmas: failed to get the decoder context." );
         return -1;
     }
-    /* libavcodec */
-    AVStream       *stream = hp->format_ctx->streams[i];
-    AVCodecContext *ctx    = stream->codec;
-    vdhp->config.ctx = ctx;
+    libavsmash_open_sample_input( vdhp->root, vdhp->track_ID, source, &vdhp->config );
     AVCodec *codec = libavsmash_find_decoder( &vdhp->config );
     if( !codec )
     {
@@ -405,6 +435,9 @@ void VS_CC vs_libavsmashsource_create( const VSMap *in, VSMap *out, void *user_d
     int64_t seek_threshold;
     int64_t variable_info;
     int64_t direct_rendering;
+    int64_t frame_cache;
+    int64_t prefetch;
+    int64_t conv_threads;
     const char *format;
     set_option_int64 ( &track_number,     0,    "track",          in, vsapi );
     set_option_int64 ( &threads,          0,    "threads",        in, vsapi );
@@ -412,6 +445,9 @@ void VS_CC vs_libavsmashsource_create( const VSMap *in, VSMap *out, void *user_d
     set_option_int64 ( &seek_threshold,   10,   "seek_threshold", in, vsapi );
     set_option_int64 ( &variable_info,    0,    "variable",       in, vsapi );
     set_option_int64 ( &direct_rendering, 0,    "dr",             in, vsapi );
+    set_option_int64 ( &frame_cache,      0,    "frame_cache",    in, vsapi );
+    set_option_int64 ( &prefetch,         0,    "prefetch",       in, vsapi );
+    set_option_int64 ( &conv_threads,     1,    "conv_threads",   in, vsapi );
     set_option_string( &format,           NULL, "format",         in, vsapi );
     threads                         = threads >= 0 ? threads : 0;
     vdhp->seek_mode                 = CLIP_VALUE( seek_mode,      0, 2 );
@@ -419,6 +455,14 @@ void VS_CC vs_libavsmashsource_create( const VSMap *in, VSMap *out, void *user_d
     vs_vohp->variable_info          = CLIP_VALUE( variable_info,  0, 1 );
     vs_vohp->direct_rendering       = CLIP_VALUE( direct_rendering,  0, 1 ) && !format;
     vs_vohp->vs_output_pixel_format = vs_vohp->variable_info ? pfNone : get_vs_output_pixel_format( format );
+    lw_setup_video_frame_cache( &vohp->frame_cache, CLIP_VALUE( frame_cache, 0, 65536 ) );
+    hp->prefetch = CLIP_VALUE( prefetch, 0, VS_MAX_PREFETCH_FRAMES );
+    if( lw_setup_video_slice_threads( &vohp->scaler, CLIP_VALUE( conv_threads, 0, 64 ) ) < 0 )
+    {
+        vs_filter_free( hp, core, vsapi );
+        set_error( &lh, LW_LOG_FATAL, "lsmas: failed to create threads for pixel format conversion." );
+        return;
+    }
     if( track_number && track_number > number_of_tracks )
     {
         vs_filter_free( hp, core, vsapi );
@@ -426,7 +470,7 @@ void VS_CC vs_libavsmashsource_create( const VSMap *in, VSMap *out, void *user_d
         return;
     }
     /* Get video track. */
-    if( get_video_track( hp, track_number, threads, number_of_tracks ) < 0 )
+    if( get_video_track( hp, file_name, track_number, threads, number_of_tracks ) < 0 )
     {
         vs_filter_free( hp, core, vsapi );
         return;
@@ -439,6 +483,9 @@ void VS_CC vs_libavsmashsource_create( const VSMap *in, VSMap *out, void *user_d
         vs_filter_free( hp, core, vsapi );
         return;
     }
+    /* Prefetch no more frames than the frame cache holds. */
+    if( vdhp->first_valid_frame )
+        hp->prefetch = vs_fit_prefetch_frames( hp->prefetch, vohp->frame_cache.max_size, lw_get_video_frame_buffer_size( vdhp->first_valid_frame ) );
     vsapi->createFilter( in, out, "LibavSMASHSource", vs_filter_init, vs_filter_get_frame, vs_filter_free, fmSerial, 0, hp, core );
     return;
 }
@@ -23,7 +23,12 @@
 
 #include <stdio.h>
 
+/* Libav (LGPL or GPL) */
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+
 #include "lsmashsource.h"
+#include "../common/lwlibav_dec.h"
 
 void set_error
 (
@@ -50,6 +55,124 @@ void set_error
     }
 }
 
+int vs_init_decoder_pool
+(
+    vs_decoder_pool_t *pool,
+    int                count,
+    uint32_t           frame_count
+)
+{
+    pool->slots = (vs_decoder_slot_t *)lw_malloc_zero( count * sizeof(vs_decoder_slot_t) );
+    if( !pool->slots )
+        return -1;
+    if( lw_mutex_init( &pool->mutex ) < 0 )
+    {
+        lw_freep( &pool->slots );
+        return -1;
+    }
+    if( lw_cond_init( &pool->cond ) < 0 )
+    {
+        lw_mutex_destroy( &pool->mutex );
+        lw_freep( &pool->slots );
+        return -1;
+    }
+    /* Assign each instance to a contiguous region of the timeline in advance. */
+    for( int i = 0; i < count; i++ )
+        pool->slots[i].last_frame_number = (uint32_t)((uint64_t)frame_count * i / count);
+    pool->count = count;
+    return 0;
+}
+
+/* Return the number of frames to be decoded to get the requested frame by an instance. */
+static inline uint32_t get_decoding_cost
+(
+    vs_decoder_slot_t *slot,
+    uint32_t           frame_number,
+    uint32_t           rap_number
+)
+{
+    if( slot->last_frame_number <= frame_number && slot->last_frame_number >= rap_number )
+        /* Continue decoding from the last requested frame. */
+        return frame_number - slot->last_frame_number;
+    /* Seek to the random accessible point. */
+    return frame_number - MIN( rap_number, frame_number ) + 1;
+}
+
+/* Return the index of the acquired instance.
+ * If a busy instance is cheaper than any idle one, wait for it since requests are likely sequential. */
+int vs_acquire_decoder
+(
+    vs_decoder_pool_t *pool,
+    uint32_t           frame_number,
+    uint32_t           rap_number
+)
+{
+    lw_mutex_lock( &pool->mutex );
+    int index;
+    while( 1 )
+    {
+        int      best_idle = -1;
+        uint32_t idle_cost = UINT32_MAX;
+        uint32_t idle_dist = UINT32_MAX;
+        uint32_t busy_cost = UINT32_MAX;
+        for( int i = 0; i < pool->count; i++ )
+        {
+            vs_decoder_slot_t *slot = &pool->slots[i];
+            uint32_t cost = get_decoding_cost( slot, frame_number, rap_number );
+            if( slot->busy )
+            {
+                busy_cost = MIN( busy_cost, cost );
+                continue;
+            }
+            /* Among equally cheap instances, prefer the one closest to the requested frame to keep regions contiguous. */
+            uint32_t dist = slot->last_frame_number > frame_number
+                          ? slot->last_frame_number - frame_number
+                          : frame_number - slot->last_frame_number;
+            if( cost < idle_cost || (cost == idle_cost && dist < idle_dist) )
+            {
+                best_idle = i;
+                idle_cost = cost;
+                idle_dist = dist;
+            }
+        }
+        if( best_idle >= 0 && idle_cost <= busy_cost )
+        {
+            index = best_idle;
+            break;
+        }
+        lw_cond_wait( &pool->cond, &pool->mutex );
+    }
+    pool->slots[index].busy              = 1;
+    pool->slots[index].last_frame_number = frame_number;
+    lw_mutex_unlock( &pool->mutex );
+    return index;
+}
+
+void vs_release_decoder
+(
+    vs_decoder_pool_t *pool,
+    int                index
+)
+{
+    lw_mutex_lock( &pool->mutex );
+    pool->slots[index].busy = 0;
+    lw_cond_broadcast( &pool->cond );
+    lw_mutex_unlock( &pool->mutex );
+}
+
+void vs_cleanup_decoder_pool
+(
+    vs_decoder_pool_t *pool
+)
+{
+    if( !pool->slots )
+        return;
+    lw_cond_destroy( &pool->cond );
+    lw_mutex_destroy( &pool->mutex );
+    lw_freep( &pool->slots );
+    pool->count = 0;
+}
+
 extern void VS_CC vs_libavsmashsource_create( const VSMap *in, VSMap *out, void *user_data, VSCore *core, const VSAPI *vsapi );
 extern void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data, VSCore *core, const VSAPI *vsapi );
 
@@ -64,7 +187,9 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit( VSConfigPlugin config_func, VSRegis
         1,
         plugin
     );
-#define COMMON_OPTS "threads:int:opt;seek_mode:int:opt;seek_threshold:int:opt;variable:int:opt;format:data:opt;dr:int:opt;"
+    /* Decoders are opened and closed concurrently by decoder instances and indexing threads. */
+    lw_register_lock_manager();
+#define COMMON_OPTS "threads:int:opt;seek_mode:int:opt;seek_threshold:int:opt;variable:int:opt;format:data:opt;dr:int:opt;frame_cache:int:opt;prefetch:int:opt;conv_threads:int:opt;"
     register_func
     (
         "LibavSMASHSource",
@@ -76,7 +201,7 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit( VSConfigPlugin config_func, VSRegis
     register_func
     (
         "LWLibavSource",
-        "source:data;stream_index:int:opt;cache:int:opt;" COMMON_OPTS "repeat:int:opt;dominance:int:opt;",
+        "source:data;stream_index:int:opt;cache:int:opt;" COMMON_OPTS "repeat:int:opt;dominance:int:opt;decoders:int:opt;keyframes:int:opt;cache_dir:data:opt;readahead:int:opt;sparse_index:int:opt;",
         vs_lwlibavsource_create,
         NULL,
         plugin
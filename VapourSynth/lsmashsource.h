@@ -24,6 +24,7 @@
 #include "VapourSynth.h"
 
 #include "../common/utils.h"
+#include "../common/lwthread.h"
 
 typedef struct
 {
@@ -55,3 +56,66 @@ static inline void set_option_string( const char **opt, const char *default_valu
     if( e )
         *opt = default_value;
 }
+
+/* The frames following a requested one are decoded together and left in the frame cache if 'prefetch' is set. */
+#define VS_MAX_PREFETCH_FRAMES 256
+
+/* Fill frame_numbers with the requested frame and the following ones to prefetch, and return the number of them. */
+static inline uint32_t vs_list_prefetch_frames( uint32_t *frame_numbers, uint32_t frame_number, uint32_t prefetch, uint32_t frame_count )
+{
+    uint32_t count = 0;
+    for( uint32_t i = frame_number; i <= frame_count && count <= prefetch; i++ )
+        frame_numbers[count++] = i;
+    return count;
+}
+
+/* Return the number of frames to prefetch which fit in the frame cache of 'cache_size' bytes with frames of 'frame_size' bytes.
+ * The requested frame and one more frame for a repeated field are cached together with the prefetched ones. */
+static inline uint32_t vs_fit_prefetch_frames( uint32_t prefetch, size_t cache_size, size_t frame_size )
+{
+    if( frame_size == 0 )
+        return prefetch;
+    size_t capacity = cache_size / frame_size;
+    return capacity > 2 ? (uint32_t)MIN( (size_t)prefetch, capacity - 2 ) : 0;
+}
+
+/* Pool of independent decoder instances for frame parallel requests.
+ * Each request is routed to the instance that can reach the requested frame with the least decoding. */
+typedef struct
+{
+    uint32_t last_frame_number;     /* the frame number requested at the last time */
+    int      busy;
+} vs_decoder_slot_t;
+
+typedef struct
+{
+    int                count;
+    vs_decoder_slot_t *slots;
+    lw_mutex_t         mutex;
+    lw_cond_t          cond;
+} vs_decoder_pool_t;
+
+int vs_init_decoder_pool
+(
+    vs_decoder_pool_t *pool,
+    int                count,
+    uint32_t           frame_count
+);
+
+int vs_acquire_decoder
+(
+    vs_decoder_pool_t *pool,
+    uint32_t           frame_number,
+    uint32_t           rap_number
+);
+
+void vs_release_decoder
+(
+    vs_decoder_pool_t *pool,
+    int                index
+);
+
+void vs_cleanup_decoder_pool
+(
+    vs_decoder_pool_t *pool
+);
@@ -76,12 +76,24 @@ void lw_cleanup_audio_output_handler( lw_audio_output_handler_t *aohp ){ };
 #include "../common/lwlibav_audio.h"
 #include "../common/lwindex.h"
 
+typedef struct
+{
+    lwlibav_video_decode_handler_t vdh;
+    lwlibav_video_output_handler_t voh;
+} lwlibav_decoder_instance_t;
+
 typedef struct
 {
     VSVideoInfo                    vi;
     lwlibav_file_handler_t         lwh;
     lwlibav_video_decode_handler_t vdh;
     lwlibav_video_output_handler_t voh;
+    uint32_t                       prefetch;
+    int                            keyframes;
+    /* Frame parallel decoding */
+    int                            decoder_count;
+    lwlibav_decoder_instance_t    *instances;   /* (decoder_count - 1) instances in addition to the above */
+    vs_decoder_pool_t              pool;
 } lwlibav_handler_t;
 
 static void VS_CC vs_filter_init( VSMap *in, VSMap *out, void **instance_data, VSNode *node, VSCore *core, const VSAPI *vsapi )
@@ -134,12 +146,16 @@ static void set_frame_properties
     vsapi->propSetInt( props, "_FieldBased", !!av_frame->interlaced_frame, paReplace );
 }
 
-static int prepare_video_decoding( lwlibav_handler_t *hp, VSCore *core, const VSAPI *vsapi )
+static int prepare_video_decoding
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    VSVideoInfo                    *vi,
+    VSCore                         *core,
+    const VSAPI                    *vsapi
+)
 {
-    lwlibav_video_decode_handler_t *vdhp = &hp->vdh;
-    lwlibav_video_output_handler_t *vohp = &hp->voh;
-    VSVideoInfo                    *vi   = &hp->vi;
-    lw_log_handler_t               *lhp  = &vdhp->lh;
+    lw_log_handler_t *lhp = &vdhp->lh;
     /* Import AVIndexEntrys. */
     if( lwlibav_import_av_index_entry( (lwlibav_decode_handler_t *)vdhp ) < 0 )
         return -1;
@@ -179,15 +195,49 @@ static int prepare_video_decoding( lwlibav_handler_t *hp, VSCore *core, const VS
     return 0;
 }
 
-static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason, void **instance_data, void **frame_data, VSFrameContext *frame_ctx, VSCore *core, const VSAPI *vsapi )
+static int is_video_frame_cached
+(
+    lwlibav_video_output_handler_t *vohp,
+    uint32_t                        frame_number
+)
+{
+    if( vohp->repeat_control )
+    {
+        lw_video_frame_order_t *order = &vohp->frame_order_list[frame_number];
+        return lw_get_cached_video_frame( &vohp->frame_cache, order->top    )
+            && lw_get_cached_video_frame( &vohp->frame_cache, order->bottom );
+    }
+    return lw_get_cached_video_frame( &vohp->frame_cache, frame_number ) != NULL;
+}
+
+typedef struct
+{
+    uint32_t frame_number;
+    AVFrame *frame;
+} prefetch_request_t;
+
+static int keep_requested_frame( void *priv, uint32_t frame_number, AVFrame *frame )
+{
+    /* The other frames have been put into the frame cache by the decoding. */
+    prefetch_request_t *request = (prefetch_request_t *)priv;
+    if( request && frame_number == request->frame_number && !request->frame )
+        request->frame = av_frame_clone( frame );
+    return 0;
+}
+
+static const VSFrameRef *get_frame
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    VSVideoInfo                    *vi,
+    uint32_t                        frame_number,
+    uint32_t                        prefetch,
+    int                             keyframes,
+    VSFrameContext                 *frame_ctx,
+    VSCore                         *core,
+    const VSAPI                    *vsapi
+)
 {
-    if( activation_reason != arInitial )
-        return NULL;
-    lwlibav_handler_t *hp = (lwlibav_handler_t *)*instance_data;
-    VSVideoInfo       *vi = &hp->vi;
-    uint32_t frame_number = MIN( n + 1, vi->numFrames );    /* frame_number is 1-origin. */
-    lwlibav_video_decode_handler_t *vdhp = &hp->vdh;
-    lwlibav_video_output_handler_t *vohp = &hp->voh;
     if( vdhp->error )
         return vsapi->newVideoFrame( vi->format, vi->width, vi->height, NULL, core );
     /* Set up VapourSynth error handler. */
@@ -203,8 +253,39 @@ static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason
     vs_vohp->core      = core;
     vs_vohp->vsapi     = vsapi;
     vdhp->ctx->opaque = vohp;
-    if( lwlibav_get_video_frame( vdhp, vohp, frame_number ) < 0 )
-        return NULL;
+    uint32_t key_number = 0;
+    if( keyframes )
+    {
+        /* Output the keyframe at or before the requested frame, or the nearest one, decoded alone. */
+        uint32_t presentation_number = vohp->repeat_control ? vohp->frame_order_list[frame_number].top : frame_number;
+        if( keyframes == 2 )
+            presentation_number = lwlibav_find_nearest_keyframe( vdhp, presentation_number );
+        if( lwlibav_get_video_keyframe( vdhp, presentation_number, &key_number ) < 0 )
+            return NULL;
+    }
+    else
+    {
+        if( prefetch && vohp->frame_cache.max_size && !is_video_frame_cached( vohp, frame_number ) )
+        {
+            /* Decode the requested frame and the following ones in a single pass, and then get the requested one from the frame cache.
+             * The requested frame is put back into the cache in case the following ones evicted it.
+             * With the repeat control, the output frame is made from the cached fields, which the window fitting in the cache keeps.
+             * Failure here is not an error since the requested frame is decoded again below if not cached. */
+            uint32_t frame_numbers[VS_MAX_PREFETCH_FRAMES + 1];
+            uint32_t count = vs_list_prefetch_frames( frame_numbers, frame_number, prefetch, vi->numFrames );
+            prefetch_request_t request = { frame_number, NULL };
+            lwlibav_get_video_frames( vdhp, vohp, frame_numbers, count, keep_requested_frame, vohp->repeat_control ? NULL : &request );
+            if( request.frame )
+            {
+                lw_cache_video_frame( &vohp->frame_cache, frame_number, request.frame );
+                av_frame_free( &request.frame );
+            }
+            if( vdhp->error )
+                return NULL;
+        }
+        if( lwlibav_get_video_frame( vdhp, vohp, frame_number ) < 0 )
+            return NULL;
+    }
     /* Output the video frame. */
     AVFrame    *av_frame = vdhp->frame_buffer;
     VSFrameRef *vs_frame = make_frame( vohp, vdhp->ctx, av_frame );
@@ -214,14 +295,97 @@ static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason
         return vsapi->newVideoFrame( vi->format, vi->width, vi->height, NULL, core );
     }
     set_frame_properties( vdhp, vi, av_frame, vs_frame, vsapi );
+    if( keyframes )
+        /* The 0-origin number of the frame actually output */
+        vsapi->propSetInt( vsapi->getFramePropsRW( vs_frame ), "KeyFrameNumber", key_number - 1, paReplace );
+    return vs_frame;
+}
+
+static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason, void **instance_data, void **frame_data, VSFrameContext *frame_ctx, VSCore *core, const VSAPI *vsapi )
+{
+    if( activation_reason != arInitial )
+        return NULL;
+    lwlibav_handler_t *hp = (lwlibav_handler_t *)*instance_data;
+    VSVideoInfo       *vi = &hp->vi;
+    uint32_t frame_number = MIN( n + 1, vi->numFrames );    /* frame_number is 1-origin. */
+    if( hp->decoder_count <= 1 )
+        return get_frame( &hp->vdh, &hp->voh, vi, frame_number, hp->prefetch, hp->keyframes, frame_ctx, core, vsapi );
+    /* Route the request to the decoder instance which reaches the requested frame with the least decoding. */
+    uint32_t presentation_number = hp->voh.repeat_control ? hp->voh.frame_order_list[frame_number].top : frame_number;
+    uint32_t rap_number;
+    lwlibav_find_random_accessible_point( &hp->vdh, presentation_number, 0, &rap_number );
+    /* The decoder pool tracks the instances in presentation order. */
+    rap_number = lwlibav_get_presentation_rap_number( &hp->vdh, rap_number );
+    int index = vs_acquire_decoder( &hp->pool, presentation_number, rap_number );
+    const VSFrameRef *vs_frame = index == 0
+                               ? get_frame( &hp->vdh, &hp->voh, vi, frame_number, hp->prefetch, hp->keyframes, frame_ctx, core, vsapi )
+                               : get_frame( &hp->instances[index - 1].vdh, &hp->instances[index - 1].voh, vi, frame_number, hp->prefetch, hp->keyframes, frame_ctx, core, vsapi );
+    vs_release_decoder( &hp->pool, index );
     return vs_frame;
 }
 
+static int open_decoder_instances
+(
+    lwlibav_handler_t *hp,
+    int                frame_cache
+)
+{
+    hp->instances = (lwlibav_decoder_instance_t *)lw_malloc_zero( (hp->decoder_count - 1) * sizeof(lwlibav_decoder_instance_t) );
+    if( !hp->instances )
+        return -1;
+    vs_video_output_handler_t *vs_vohp = (vs_video_output_handler_t *)hp->voh.private_handler;
+    for( int i = 0; i < hp->decoder_count - 1; i++ )
+    {
+        lwlibav_video_decode_handler_t *vdhp = &hp->instances[i].vdh;
+        lwlibav_video_output_handler_t *vohp = &hp->instances[i].voh;
+        /* Take over the repeat control from the first instance. */
+        vohp->repeat_control       = hp->voh.repeat_control;
+        vohp->repeat_correction_ts = hp->voh.repeat_correction_ts;
+        vohp->frame_count          = hp->voh.frame_count;
+        vohp->frame_order_count    = hp->voh.frame_order_count;
+        vohp->frame_order_list     = hp->voh.frame_order_list;
+        for( int j = 0; j < REPEAT_CONTROL_CACHE_NUM; j++ )
+        {
+            vohp->frame_cache_numbers[j] = hp->voh.frame_cache_numbers[j];
+            if( hp->voh.frame_cache_buffers[j] )
+            {
+                vohp->frame_cache_buffers[j] = av_frame_alloc();
+                if( !vohp->frame_cache_buffers[j] )
+                    return -1;
+            }
+        }
+        lw_setup_video_frame_cache( &vohp->frame_cache, frame_cache );
+        vs_video_output_handler_t *instance_vs_vohp = vs_allocate_video_output_handler( vohp );
+        if( !instance_vs_vohp )
+            return -1;
+        instance_vs_vohp->variable_info          = vs_vohp->variable_info;
+        instance_vs_vohp->direct_rendering       = vs_vohp->direct_rendering;
+        instance_vs_vohp->vs_output_pixel_format = vs_vohp->vs_output_pixel_format;
+        /* Open the demuxer and the decoder of this instance. */
+        if( lwlibav_open_video_decoder_instance( vdhp, &hp->vdh, hp->lwh.file_path, hp->lwh.threads ) < 0 )
+            return -1;
+    }
+    return vs_init_decoder_pool( &hp->pool, hp->decoder_count, hp->vi.numFrames );
+}
+
 static void VS_CC vs_filter_free( void *instance_data, VSCore *core, const VSAPI *vsapi )
 {
     lwlibav_handler_t *hp = (lwlibav_handler_t *)instance_data;
     if( !hp )
         return;
+    if( hp->instances )
+    {
+        for( int i = 0; i < hp->decoder_count - 1; i++ )
+        {
+            lwlibav_close_video_decoder_instance( &hp->instances[i].vdh );
+            /* The frame order list is owned by the first decoder instance. */
+            hp->instances[i].voh.frame_order_list = NULL;
+            lwlibav_cleanup_video_output_handler( &hp->instances[i].voh );
+        }
+        lw_freep( &hp->instances );
+    }
+    vs_cleanup_decoder_pool( &hp->pool );
+    lwlibav_stop_background_indexing( &hp->lwh );
     lwlibav_cleanup_video_decode_handler( &hp->vdh );
     lwlibav_cleanup_video_output_handler( &hp->voh );
     if( hp->lwh.file_path )
@@ -277,7 +441,15 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     int64_t direct_rendering;
     int64_t apply_repeat_flag;
     int64_t field_dominance;
+    int64_t frame_cache;
+    int64_t prefetch;
+    int64_t keyframes;
+    int64_t decoders;
+    int64_t readahead;
+    int64_t sparse_index;
+    int64_t conv_threads;
     const char *format;
+    const char *cache_dir;
     set_option_int64 ( &stream_index,     -1,    "stream_index",   in, vsapi );
     set_option_int64 ( &threads,           0,    "threads",        in, vsapi );
     set_option_int64 ( &cache_index,       1,    "cache",          in, vsapi );
@@ -287,10 +459,19 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     set_option_int64 ( &direct_rendering,  0,    "dr",             in, vsapi );
     set_option_int64 ( &apply_repeat_flag, 0,    "repeat",         in, vsapi );
     set_option_int64 ( &field_dominance,   0,    "dominance",      in, vsapi );
+    set_option_int64 ( &frame_cache,       0,    "frame_cache",    in, vsapi );
+    set_option_int64 ( &prefetch,          0,    "prefetch",       in, vsapi );
+    set_option_int64 ( &keyframes,         0,    "keyframes",      in, vsapi );
+    set_option_int64 ( &decoders,          1,    "decoders",       in, vsapi );
+    set_option_int64 ( &readahead,         0,    "readahead",      in, vsapi );
+    set_option_int64 ( &sparse_index,      0,    "sparse_index",   in, vsapi );
+    set_option_int64 ( &conv_threads,      1,    "conv_threads",   in, vsapi );
     set_option_string( &format,            NULL, "format",         in, vsapi );
+    set_option_string( &cache_dir,         NULL, "cache_dir",      in, vsapi );
     /* Set options. */
     lwlibav_option_t opt;
     opt.file_path         = file_path;
+    opt.cache_dir         = cache_dir;
     opt.threads           = threads >= 0 ? threads : 0;
     opt.av_sync           = 0;
     opt.no_create_index   = !cache_index;
@@ -300,11 +481,15 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     opt.force_audio_index = -1;
     opt.apply_repeat_flag = apply_repeat_flag;
     opt.field_dominance   = CLIP_VALUE( field_dominance, 0, 2 );    /* 0: Obey source flags, 1: TFF, 2: BFF */
+    opt.sparse_index      = CLIP_VALUE( sparse_index, 0, 1 );
     vdhp->seek_mode                 = CLIP_VALUE( seek_mode,         0, 2 );
     vdhp->forward_seek_threshold    = CLIP_VALUE( seek_threshold,    1, 999 );
     vs_vohp->variable_info          = CLIP_VALUE( variable_info,     0, 1 );
     vs_vohp->direct_rendering       = CLIP_VALUE( direct_rendering,  0, 1 ) && !format;
     vs_vohp->vs_output_pixel_format = vs_vohp->variable_info ? pfNone : get_vs_output_pixel_format( format );
+    lw_setup_video_frame_cache( &vohp->frame_cache, CLIP_VALUE( frame_cache, 0, 65536 ) );
+    hp->prefetch  = CLIP_VALUE( prefetch,  0, VS_MAX_PREFETCH_FRAMES );
+    hp->keyframes = CLIP_VALUE( keyframes, 0, 2 );  /* 0: All frames, 1: Preceding keyframe, 2: Nearest keyframe */
     /* Set up progress indicator. */
     progress_indicator_t indicator;
     indicator.open   = NULL;
@@ -334,12 +519,57 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     hp->vi.fpsNum    = 25;
     hp->vi.fpsDen    = 1;
     lwlibav_setup_timestamp_info( lwhp, vdhp, vohp, &hp->vi.fpsNum, &hp->vi.fpsDen );
+    /* Open additional decoder instances sharing the frame and index tables for frame parallel requests.
+     * These have to be opened before the first instance consumes the AVIndexEntrys. */
+    hp->decoder_count = CLIP_VALUE( decoders, 1, 64 );
+    if( hp->decoder_count > 1 && open_decoder_instances( hp, CLIP_VALUE( frame_cache, 0, 65536 ) ) < 0 )
+    {
+        vs_filter_free( hp, core, vsapi );
+        set_error( &lh, LW_LOG_FATAL, "lsmas: failed to open decoder instances." );
+        return;
+    }
     /* Set up decoders for this stream. */
-    if( prepare_video_decoding( hp, core, vsapi ) < 0 )
+    if( prepare_video_decoding( vdhp, vohp, &hp->vi, core, vsapi ) < 0 )
     {
         vs_filter_free( hp, core, vsapi );
         return;
     }
-    vsapi->createFilter( in, out, "LWLibavSource", vs_filter_init, vs_filter_get_frame, vs_filter_free, fmSerial, 0, hp, core );
+    /* Prefetch no more frames than the frame cache holds. */
+    if( vdhp->first_valid_frame )
+        hp->prefetch = vs_fit_prefetch_frames( hp->prefetch, vohp->frame_cache.max_size, lw_get_video_frame_buffer_size( vdhp->first_valid_frame ) );
+    for( int i = 0; i < hp->decoder_count - 1; i++ )
+    {
+        /* All instances output frames in the same format, so the video info of the first one is kept. */
+        VSVideoInfo vi = hp->vi;
+        if( prepare_video_decoding( &hp->instances[i].vdh, &hp->instances[i].voh, &vi, core, vsapi ) < 0 )
+        {
+            vs_filter_free( hp, core, vsapi );
+            return;
+        }
+    }
+    /* Set up the threads converting the output pixel format of each decoder instance. */
+    for( int i = 0; i < hp->decoder_count; i++ )
+    {
+        lwlibav_video_output_handler_t *instance_vohp = i == 0 ? &hp->voh : &hp->instances[i - 1].voh;
+        if( lw_setup_video_slice_threads( &instance_vohp->scaler, CLIP_VALUE( conv_threads, 0, 64 ) ) < 0 )
+        {
+            vs_filter_free( hp, core, vsapi );
+            set_error( &lh, LW_LOG_FATAL, "lsmas: failed to create threads for pixel format conversion." );
+            return;
+        }
+    }
+    /* Start reading packets ahead of each decoder instance. */
+    for( int i = 0; i < hp->decoder_count; i++ )
+    {
+        lwlibav_decode_handler_t *dhp = (lwlibav_decode_handler_t *)(i == 0 ? &hp->vdh : &hp->instances[i - 1].vdh);
+        if( lwlibav_start_readahead( dhp, CLIP_VALUE( readahead, 0, 4096 ), NULL ) < 0 )
+        {
+            vs_filter_free( hp, core, vsapi );
+            set_error( &lh, LW_LOG_FATAL, "lsmas: failed to start reading packets ahead." );
+            return;
+        }
+    }
+    vsapi->createFilter( in, out, "LWLibavSource", vs_filter_init, vs_filter_get_frame, vs_filter_free,
+                         hp->decoder_count > 1 ? fmParallelRequests : fmSerial, 0, hp, core );
     return;
 }
@@ -31,6 +31,8 @@
 #include "VapourSynth.h"
 
 #include "../common/utils.h"
+#include "../common/lwsimd.h"
+#include "../common/colorspace_simd.h"
 
 #include "video_output.h"
 
@@ -103,7 +105,7 @@ static void make_frame_planar_yuv
             0
         }
     };
-    sws_scale( vshp->sws_ctx, (const uint8_t* const*)av_picture->data, av_picture->linesize, 0, vshp->input_height, vs_picture.data, vs_picture.linesize );
+    lw_scale_video_frame( vshp, (const uint8_t* const*)av_picture->data, av_picture->linesize, vs_picture.data, vs_picture.linesize );
 }
 
 static void make_frame_planar_rgb
@@ -134,17 +136,68 @@ static void make_frame_planar_rgb
         }
 
     };
-    sws_scale( vshp->sws_ctx, (const uint8_t* const*)av_picture->data, av_picture->linesize, 0, vshp->input_height, vs_picture.data, vs_picture.linesize );
+    lw_scale_video_frame( vshp, (const uint8_t* const*)av_picture->data, av_picture->linesize, vs_picture.data, vs_picture.linesize );
 }
 
-static void make_frame_planar_rgb8
+/* Get the fastest available function deinterleaving packed RGB into planar RGB. */
+static func_deinterleave_packed_rgb_to_planar *get_deinterleave_packed_rgb_func( void )
+{
+#if LW_SIMD_X86
+    int simd_flags = lw_get_simd_flags();
+#if LW_SIMD_AVX2_ENABLED
+    if( simd_flags & LW_SIMD_AVX2 )
+        return deinterleave_packed_rgb_to_planar_avx2;
+#endif
+    if( simd_flags & LW_SIMD_SSSE3 )
+        return deinterleave_packed_rgb_to_planar_ssse3;
+#endif
+    return deinterleave_packed_rgb_to_planar_c;
+}
+
+typedef struct
+{
+    func_deinterleave_packed_rgb_to_planar *deinterleave;
+    uint8_t                               **dst_data;
+    int                                     dst_linesize;
+    const uint8_t                          *src_data;
+    int                                     src_linesize;
+    int                                     width;
+    int                                     height;
+    int                                     num_components;
+    int                                     sample_size;
+    const int                              *component_offset;
+} vs_deinterleave_packed_rgb_t;
+
+static void deinterleave_packed_rgb_slice
+(
+    int   thread_id,
+    int   thread_num,
+    void *param1,
+    void *param2
+)
+{
+    vs_deinterleave_packed_rgb_t *slice = (vs_deinterleave_packed_rgb_t *)param1;
+    int start;
+    int end;
+    lw_get_video_slice_range( slice->height, thread_id, thread_num, &start, &end );
+    uint8_t *dst_data[3] =
+        {
+            slice->dst_data[0] + start * slice->dst_linesize,
+            slice->dst_data[1] + start * slice->dst_linesize,
+            slice->dst_data[2] + start * slice->dst_linesize
+        };
+    slice->deinterleave( dst_data, slice->dst_linesize, slice->src_data + start * slice->src_linesize, slice->src_linesize,
+                         slice->width, end - start, slice->num_components, slice->sample_size, slice->component_offset );
+}
+
+static void make_frame_planar_rgb_from_packed
 (
     lw_video_scaler_handler_t *vshp,
     AVFrame                   *av_picture,
     const component_reorder_t *component_reorder,
     VSFrameRef                *vs_frame,
-    VSFrameContext            *frame_ctx,
-    const VSAPI               *vsapi
+    const VSAPI               *vsapi,
+    int                        sample_size
 )
 {
     uint8_t *vs_frame_data[3] =
@@ -154,31 +207,31 @@ static void make_frame_planar_rgb8
             vsapi->getWritePtr( vs_frame, 2 )
         };
     const VSFormat *vs_format = vsapi->getFrameFormat( vs_frame );
-    int av_num_components = vs_format->numPlanes + (component_reorder[3] == -1 ? 0 : 1);
-    int vs_frame_linesize = vsapi->getStride( vs_frame, 0 );
-    int vs_pixel_offset   = 0;
-    int av_pixel_offset   = 0;
-    for( int i = 0; i < vshp->input_height; i++ )
-    {
-        uint8_t *av_pixel   = av_picture->data[0] + av_pixel_offset;
-        uint8_t *av_pixel_r = av_pixel + component_reorder[0];
-        uint8_t *av_pixel_g = av_pixel + component_reorder[1];
-        uint8_t *av_pixel_b = av_pixel + component_reorder[2];
-        uint8_t *vs_pixel_r = vs_frame_data[0] + vs_pixel_offset;
-        uint8_t *vs_pixel_g = vs_frame_data[1] + vs_pixel_offset;
-        uint8_t *vs_pixel_b = vs_frame_data[2] + vs_pixel_offset;
-        for( int j = 0; j < vshp->input_width; j++ )
-        {
-            *(vs_pixel_r++) = *av_pixel_r;
-            *(vs_pixel_g++) = *av_pixel_g;
-            *(vs_pixel_b++) = *av_pixel_b;
-            av_pixel_r += av_num_components;
-            av_pixel_g += av_num_components;
-            av_pixel_b += av_num_components;
-        }
-        av_pixel_offset += av_picture->linesize[0];
-        vs_pixel_offset += vs_frame_linesize;
-    }
+    vs_deinterleave_packed_rgb_t slice;
+    slice.deinterleave     = get_deinterleave_packed_rgb_func();
+    slice.dst_data         = vs_frame_data;
+    slice.dst_linesize     = vsapi->getStride( vs_frame, 0 );
+    slice.src_data         = av_picture->data[0];
+    slice.src_linesize     = av_picture->linesize[0];
+    slice.width            = vshp->input_width;
+    slice.height           = vshp->input_height;
+    slice.num_components   = vs_format->numPlanes + (component_reorder[3] == -1 ? 0 : 1);
+    slice.sample_size      = sample_size;
+    slice.component_offset = component_reorder;
+    lw_run_video_slices( vshp, deinterleave_packed_rgb_slice, &slice, NULL );
+}
+
+static void make_frame_planar_rgb8
+(
+    lw_video_scaler_handler_t *vshp,
+    AVFrame                   *av_picture,
+    const component_reorder_t *component_reorder,
+    VSFrameRef                *vs_frame,
+    VSFrameContext            *frame_ctx,
+    const VSAPI               *vsapi
+)
+{
+    make_frame_planar_rgb_from_packed( vshp, av_picture, component_reorder, vs_frame, vsapi, 1 );
 }
 
 static void make_frame_planar_rgb16
@@ -191,38 +244,7 @@ static void make_frame_planar_rgb16
     const VSAPI               *vsapi
 )
 {
-    uint8_t *vs_frame_data[3] =
-        {
-            vsapi->getWritePtr( vs_frame, 0 ),
-            vsapi->getWritePtr( vs_frame, 1 ),
-            vsapi->getWritePtr( vs_frame, 2 )
-        };
-    const VSFormat *vs_format = vsapi->getFrameFormat( vs_frame );
-    int av_num_components = vs_format->numPlanes + (component_reorder[3] == -1 ? 0 : 1);
-    int vs_frame_linesize = vsapi->getStride( vs_frame, 0 );
-    int vs_pixel_offset   = 0;
-    int av_pixel_offset   = 0;
-    for( int i = 0; i < vshp->input_height; i++ )
-    {
-        uint16_t *av_pixel   = (uint16_t *)(av_picture->data[0] + av_pixel_offset);
-        uint16_t *av_pixel_r = av_pixel + component_reorder[0];
-        uint16_t *av_pixel_g = av_pixel + component_reorder[1];
-        uint16_t *av_pixel_b = av_pixel + component_reorder[2];
-        uint16_t *vs_pixel_r = (uint16_t *)(vs_frame_data[0] + vs_pixel_offset);
-        uint16_t *vs_pixel_g = (uint16_t *)(vs_frame_data[1] + vs_pixel_offset);
-        uint16_t *vs_pixel_b = (uint16_t *)(vs_frame_data[2] + vs_pixel_offset);
-        for( int j = 0; j < vshp->input_width; j++ )
-        {
-            *(vs_pixel_r++) = *av_pixel_r;
-            *(vs_pixel_g++) = *av_pixel_g;
-            *(vs_pixel_b++) = *av_pixel_b;
-            av_pixel_r += av_num_components;
-            av_pixel_g += av_num_components;
-            av_pixel_b += av_num_components;
-        }
-        av_pixel_offset += av_picture->linesize[0];
-        vs_pixel_offset += vs_frame_linesize;
-    }
+    make_frame_planar_rgb_from_packed( vshp, av_picture, component_reorder, vs_frame, vsapi, 2 );
 }
 
 VSPresetFormat get_vs_output_pixel_format( const char *format_name )
@@ -327,6 +349,7 @@ static const component_reorder_t *get_component_reorder( enum AVPixelFormat av_o
             { AV_PIX_FMT_GBRP10LE,    {  1,  2,  0, -1 } },
             { AV_PIX_FMT_GBRP16LE,    {  1,  2,  0, -1 } },
             { AV_PIX_FMT_RGB24,       {  0,  1,  2, -1 } },
+            { AV_PIX_FMT_BGR24,       {  2,  1,  0, -1 } },
             { AV_PIX_FMT_ARGB,        {  1,  2,  3,  0 } },
             { AV_PIX_FMT_RGBA,        {  0,  1,  2,  3 } },
             { AV_PIX_FMT_ABGR,        {  3,  2,  1,  0 } },
@@ -531,8 +554,9 @@ VSFrameRef *new_output_video_frame
 
 typedef struct
 {
-    VSFrameRef  *vs_frame_buffer;
-    const VSAPI *vsapi;
+    VSFrameRef          *vs_frame_buffer;
+    const VSAPI         *vsapi;
+    lw_dr_chroma_split_t chroma_split;  /* for semi-planar frames */
 } vs_video_buffer_handler_t;
 
 VSFrameRef *make_frame
@@ -546,11 +570,12 @@ VSFrameRef *make_frame
     VSFrameContext *frame_ctx = vs_vohp->frame_ctx;
     VSCore         *core      = vs_vohp->core;
     const VSAPI    *vsapi     = vs_vohp->vsapi;
-    if( vs_vohp->direct_rendering && !vohp->scaler.enabled && av_frame->opaque )
+    if( vs_vohp->direct_rendering && av_frame->opaque )
     {
         /* Render from the decoder directly. */
         vs_video_buffer_handler_t *vs_vbhp = (vs_video_buffer_handler_t *)av_frame->opaque;
-        return vs_vbhp ? (VSFrameRef *)vs_vbhp->vsapi->cloneFrameRef( vs_vbhp->vs_frame_buffer ) : NULL;
+        lw_split_dr_chroma( &vohp->scaler, av_frame, &vs_vbhp->chroma_split );
+        return (VSFrameRef *)vs_vbhp->vsapi->cloneFrameRef( vs_vbhp->vs_frame_buffer );
     }
     if( !vs_vohp->make_frame )
         return NULL;
@@ -568,21 +593,13 @@ VSFrameRef *make_frame
      || vshp->input_yuv_range    != yuv_range )
     {
         /* Update scaler. */
-        vshp->sws_ctx = update_scaler_configuration( vshp->sws_ctx, vshp->flags,
-                                                     ctx->width, ctx->height,
-                                                     *input_pixel_format, vshp->output_pixel_format,
-                                                     ctx->colorspace, yuv_range );
-        if( !vshp->sws_ctx )
+        if( update_scaler_handler( vshp, ctx->width, ctx->height,
+                                   *input_pixel_format, ctx->colorspace, yuv_range ) < 0 )
         {
             if( frame_ctx )
                 vsapi->setFilterError( "lsmas: failed to update scaler settings.", frame_ctx );
             return NULL;
         }
-        vshp->input_width        = ctx->width;
-        vshp->input_height       = ctx->height;
-        vshp->input_pixel_format = *input_pixel_format;
-        vshp->input_colorspace   = ctx->colorspace;
-        vshp->input_yuv_range    = yuv_range;
     }
     /* Make video frame. */
     VSFrameRef *vs_frame = new_output_video_frame( vohp, vshp->input_width, vshp->input_height, *input_pixel_format, frame_ctx, core, vsapi );
@@ -593,41 +610,19 @@ VSFrameRef *make_frame
     return vs_frame;
 }
 
-static int vs_check_dr_available
+static lw_dr_layout_t vs_get_dr_layout
 (
-    AVCodecContext    *ctx,
-    enum AVPixelFormat pixel_format
+    AVCodecContext     *ctx,
+    enum AVPixelFormat  pixel_format,
+    enum AVPixelFormat *host_pixel_format
 )
 {
-    if( !(ctx->codec->capabilities & CODEC_CAP_DR1) )
-        return 0;
-    static enum AVPixelFormat dr_support_pix_fmt[] =
-        {
-            AV_PIX_FMT_YUV420P,
-            AV_PIX_FMT_YUV422P,
-            AV_PIX_FMT_YUV444P,
-            AV_PIX_FMT_YUV410P,
-            AV_PIX_FMT_YUV411P,
-            AV_PIX_FMT_YUV440P,
-            AV_PIX_FMT_YUV420P9LE,
-            AV_PIX_FMT_YUV422P9LE,
-            AV_PIX_FMT_YUV444P9LE,
-            AV_PIX_FMT_YUV420P10LE,
-            AV_PIX_FMT_YUV422P10LE,
-            AV_PIX_FMT_YUV444P10LE,
-            AV_PIX_FMT_YUV420P16LE,
-            AV_PIX_FMT_YUV422P16LE,
-            AV_PIX_FMT_YUV444P16LE,
-            AV_PIX_FMT_GBRP,
-            AV_PIX_FMT_GBRP9LE,
-            AV_PIX_FMT_GBRP10LE,
-            AV_PIX_FMT_GBRP16LE,
-            AV_PIX_FMT_NONE
-        };
-    for( int i = 0; dr_support_pix_fmt[i] != AV_PIX_FMT_NONE; i++ )
-        if( dr_support_pix_fmt[i] == pixel_format )
-            return 1;
-    return 0;
+    static const int host_caps = LW_DR_CAP_PLANAR_YUV
+                               | LW_DR_CAP_PLANAR_YUV440
+                               | LW_DR_CAP_PLANAR_YUV_DEEP
+                               | LW_DR_CAP_PLANAR_RGB
+                               | LW_DR_CAP_SEMI_PLANAR;
+    return lw_get_dr_layout( ctx, pixel_format, host_caps, host_pixel_format );
 }
 
 static void vs_video_release_buffer_handler
@@ -697,9 +692,24 @@ static int vs_video_get_buffer
     vs_video_output_handler_t *vs_vohp = (vs_video_output_handler_t *)lw_vohp->private_handler;
     enum AVPixelFormat pix_fmt = ctx->pix_fmt;
     avoid_yuv_scale_conversion( &pix_fmt );
-    if( (!vs_vohp->variable_info && lw_vohp->scaler.input_pixel_format != pix_fmt)
-     || !vs_check_dr_available( ctx, pix_fmt ) )
+    int aligned_width  = ctx->width;
+    int aligned_height = ctx->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2( ctx, &aligned_width, &aligned_height, linesize_align );
+    enum AVPixelFormat host_pixel_format;
+    lw_dr_layout_t layout = vs_get_dr_layout( ctx, pix_fmt, &host_pixel_format );
+    if( layout != LW_DR_LAYOUT_NONE && !vs_vohp->variable_info )
+    {
+        /* The frame buffer is a copy of the background frame, so it has to be in the format and resolution of the clip. */
+        if( (pix_fmt != lw_vohp->scaler.input_pixel_format && determine_colorspace_conversion( lw_vohp, pix_fmt ) < 0)
+         || host_pixel_format != lw_vohp->scaler.output_pixel_format
+         || aligned_width     >  lw_vohp->output_width
+         || aligned_height    >  lw_vohp->output_height )
+            layout = LW_DR_LAYOUT_NONE;
+    }
+    if( layout == LW_DR_LAYOUT_NONE )
     {
+        /* Fall back to the scaler for this frame. */
         lw_vohp->scaler.enabled = 1;
         return avcodec_default_get_buffer2( ctx, av_frame, 0 );
     }
@@ -713,10 +723,9 @@ static int vs_video_get_buffer
         return AVERROR( ENOMEM );
     }
     av_frame->opaque = vs_vbhp;
-    av_frame->width  = ctx->width;
-    av_frame->height = ctx->height;
+    av_frame->width  = aligned_width;
+    av_frame->height = aligned_height;
     av_frame->format = ctx->pix_fmt;
-    avcodec_align_dimensions2( ctx, &av_frame->width, &av_frame->height, av_frame->linesize );
     VSFrameRef *vs_frame_buffer = new_output_video_frame( lw_vohp, av_frame->width, av_frame->height, pix_fmt,
                                                           vs_vohp->frame_ctx, vs_vohp->core, vs_vohp->vsapi );
     if( !vs_frame_buffer )
@@ -725,8 +734,9 @@ static int vs_video_get_buffer
         av_frame_unref( av_frame );
         return AVERROR( ENOMEM );
     }
-    vs_vbhp->vs_frame_buffer = vs_frame_buffer;
-    vs_vbhp->vsapi           = vs_vohp->vsapi;
+    vs_vbhp->vs_frame_buffer      = vs_frame_buffer;
+    vs_vbhp->vsapi                = vs_vohp->vsapi;
+    vs_vbhp->chroma_split.pending = 0;
     /* Create frame buffers for the decoder.
      * The callback vs_video_release_buffer_handler() shall be called when no reference to the video buffer handler is present.
      * The callback vs_video_unref_buffer_handler() decrements the reference-counter by 1. */
@@ -740,10 +750,30 @@ static int vs_video_get_buffer
         av_frame_unref( av_frame );
         return AVERROR( ENOMEM );
     }
-    vs_vohp->component_reorder = get_component_reorder( pix_fmt );
-    for( int i = 0; i < 3; i++ )
-        if( vs_create_plane_buffer( vs_vbhp, vs_buffer_handler, av_frame, i, vs_vohp->component_reorder[i] ) < 0 )
+    vs_vohp->component_reorder = get_component_reorder( host_pixel_format );
+    if( layout == LW_DR_LAYOUT_SEMI_PLANAR )
+    {
+        /* The decoder writes the interleaved chroma into an intermediate buffer.
+         * It is split into the chroma planes when the frame is output. */
+        if( vs_create_plane_buffer( vs_vbhp, vs_buffer_handler, av_frame, 0, vs_vohp->component_reorder[0] ) < 0
+         || lw_alloc_dr_chroma_plane( lw_vohp, av_frame, av_frame->width, av_frame->height ) < 0 )
             goto fail;
+        const VSAPI          *vsapi = vs_vbhp->vsapi;
+        lw_dr_chroma_split_t *split = &vs_vbhp->chroma_split;
+        for( int i = 0; i < 2; i++ )
+        {
+            int vs_plane = vs_vohp->component_reorder[i + 1];
+            split->data    [i] = vsapi->getWritePtr( vs_frame_buffer, vs_plane );
+            split->linesize[i] = vsapi->getStride  ( vs_frame_buffer, vs_plane );
+        }
+        split->width   = MIN( (av_frame->width  + 1) >> 1, vsapi->getFrameWidth ( vs_frame_buffer, 1 ) );
+        split->height  = MIN( (av_frame->height + 1) >> 1, vsapi->getFrameHeight( vs_frame_buffer, 1 ) );
+        split->pending = 1;
+    }
+    else
+        for( int i = 0; i < 3; i++ )
+            if( vs_create_plane_buffer( vs_vbhp, vs_buffer_handler, av_frame, i, vs_vohp->component_reorder[i] ) < 0 )
+                goto fail;
     /* Here, a variable 'vs_buffer_handler' itself is not referenced by any pointer. */
     av_buffer_unref( &vs_buffer_handler );
     av_frame->nb_extended_buf = 0;
@@ -765,7 +795,7 @@ func_get_buffer_t *setup_video_rendering
 )
 {
     vs_video_output_handler_t *vs_vohp = (vs_video_output_handler_t *)lw_vohp->private_handler;
-    vs_vohp->direct_rendering &= vs_check_dr_available( ctx, ctx->pix_fmt );
+    vs_vohp->direct_rendering &= (vs_get_dr_layout( ctx, ctx->pix_fmt, NULL ) != LW_DR_LAYOUT_NONE);
     if( vs_vohp->variable_info )
     {
         vi->format = NULL;
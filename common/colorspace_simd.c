@@ -23,10 +23,327 @@
  * Don't distribute it if its license is GPL. */
 
 #include <stdint.h>
+#include <string.h>
 
-#include "../common/utils.h"
-#include "../common/lwsimd.h"
+#include "utils.h"
+#include "lwsimd.h"
+#include "colorspace_simd.h"
 
+/* The C versions, which are also the references of the SIMD versions below. */
+#define YUY2_SIZE 2
+#define YC48_SIZE 6
+
+void convert_yuv16le_to_yc48
+(
+    uint8_t  *buf,
+    int       buf_linesize,
+    uint8_t **dst_data,
+    int      *dst_linesize,
+    int       output_rowsize,
+    int       output_height,
+    int       full_range
+)
+{
+    uint32_t offset = 0;
+    while( output_height-- )
+    {
+        uint8_t *p_buf = buf;
+        uint8_t *p_dst[3] = { dst_data[0] + offset, dst_data[1] + offset, dst_data[2] + offset };
+        for( int i = 0; i < output_rowsize; i += YC48_SIZE )
+        {
+            static const uint32_t y_coef   [2] = {  1197,   4770 };
+            static const uint32_t y_shift  [2] = {    14,     16 };
+            static const uint32_t uv_coef  [2] = {  4682,   4662 };
+            static const uint32_t uv_offset[2] = { 32768, 589824 };
+            uint16_t y  = (((int32_t)((p_dst[0][0] | (p_dst[0][1] << 8)) * y_coef[full_range])) >> y_shift[full_range]) - 299;
+            uint16_t cb = ((int32_t)(((p_dst[1][0] | (p_dst[1][1] << 8)) - 32768) * uv_coef[full_range] + uv_offset[full_range])) >> 16;
+            uint16_t cr = ((int32_t)(((p_dst[2][0] | (p_dst[2][1] << 8)) - 32768) * uv_coef[full_range] + uv_offset[full_range])) >> 16;
+            p_dst[0] += 2;
+            p_dst[1] += 2;
+            p_dst[2] += 2;
+            p_buf[0] = y;
+            p_buf[1] = y >> 8;
+            p_buf[2] = cb;
+            p_buf[3] = cb >> 8;
+            p_buf[4] = cr;
+            p_buf[5] = cr >> 8;
+            p_buf += YC48_SIZE;
+        }
+        buf    += buf_linesize;
+        offset += dst_linesize[0];
+    }
+}
+
+static void LW_FORCEINLINE convert_yuv420ple_i_to_yuv444p16le
+(
+    uint8_t  **dst,
+    const int *dst_linesize,
+    uint8_t  **pic_data,
+    int       *pic_linesize,
+    int        output_rowsize,
+    int        height,
+    int        bit_depth
+)
+{
+    const int lshft = 16 - bit_depth;
+    /* copy luma */
+    {
+        uint16_t *ptr_src_line = (uint16_t *)pic_data[0];
+        uint16_t *ptr_dst_line = (uint16_t *)dst[0];
+        const int dst_line_len = dst_linesize[0] / sizeof(uint16_t);
+        const int src_line_len = pic_linesize[0] / sizeof(uint16_t);
+        const int luma_width = (output_rowsize / sizeof(uint16_t));
+        for( int y = 0; y < height; y++ )
+            for( int x = 0; x < luma_width; x++ )
+                ptr_dst_line[y*dst_line_len+x] = ptr_src_line[y*src_line_len+x] << lshft;
+    }
+    /* chroma upsampling for interlaced yuv420 */
+    const int src_chroma_width = (output_rowsize / sizeof(uint16_t)) / 2;
+    for( int i_color = 1; i_color < 3; i_color++ )
+    {
+        uint16_t *ptr_src_line = (uint16_t *)pic_data[i_color];
+        uint16_t *ptr_dst_line = (uint16_t *)dst[i_color];
+        const int dst_line_len = dst_linesize[i_color] / sizeof(uint16_t);
+        const int src_line_len = pic_linesize[i_color] / sizeof(uint16_t);
+        /* first 2 lines */
+        int x;
+        uint16_t tmp[2][4];
+
+    /* this inner loop branch should be deleted by forced inline expansion and "lshft" constant propagation. */
+#define INTERPOLATE_CHROMA( k, x ) \
+    { \
+        int chroma0 = (5 * ptr_src_line[0 * src_line_len + x] + 3 * ptr_src_line[2 * src_line_len + x]); \
+        int chroma1 = (7 * ptr_src_line[1 * src_line_len + x] + 1 * ptr_src_line[3 * src_line_len + x]); \
+        int chroma2 = (1 * ptr_src_line[0 * src_line_len + x] + 7 * ptr_src_line[2 * src_line_len + x]); \
+        int chroma3 = (3 * ptr_src_line[1 * src_line_len + x] + 5 * ptr_src_line[3 * src_line_len + x]); \
+        if( lshft - 3 < 0 ) \
+        { \
+            tmp[k][0] = (chroma0 + (1<<(2-lshft))) >> (3-lshft); \
+            tmp[k][1] = (chroma1 + (1<<(2-lshft))) >> (3-lshft); \
+            tmp[k][2] = (chroma2 + (1<<(2-lshft))) >> (3-lshft); \
+            tmp[k][3] = (chroma3 + (1<<(2-lshft))) >> (3-lshft); \
+        } \
+        else if( lshft - 3 > 0 ) \
+        { \
+            tmp[k][0] = chroma0 << (lshft-3); \
+            tmp[k][1] = chroma1 << (lshft-3); \
+            tmp[k][2] = chroma2 << (lshft-3); \
+            tmp[k][3] = chroma3 << (lshft-3); \
+        } \
+        else \
+        { \
+            tmp[k][0] = chroma0; \
+            tmp[k][1] = chroma1; \
+            tmp[k][2] = chroma2; \
+            tmp[k][3] = chroma3; \
+        } \
+    }
+#define PUT_CHROMA( x, line ) \
+    { \
+        ptr_dst_line[dst_line_len * line + 2 * x + 0] = tmp[0][line]; \
+        ptr_dst_line[dst_line_len * line + 2 * x + 1] = (tmp[0][line] + tmp[1][line] + 1) >> 1; \
+    }
+
+        tmp[0][0] = ptr_src_line[0] << lshft;
+        tmp[0][1] = ptr_src_line[src_line_len] << lshft;
+        for( x = 0; x < src_chroma_width - 1; x++ )
+        {
+            tmp[1][0] = ptr_src_line[x+1] << lshft;
+            tmp[1][1] = ptr_src_line[x+1 + src_line_len] << lshft;
+            for( int i = 0; i < 2; i++ )
+                PUT_CHROMA( x, i );
+            memcpy( tmp[0], tmp[1], sizeof(tmp[0]) );
+        }
+        /* The last column is interpolated with itself. */
+        memcpy( tmp[1], tmp[0], sizeof(tmp[1]) );
+        for( int i = 0; i < 2; i++ )
+            PUT_CHROMA( x, i );
+        ptr_dst_line += (dst_line_len << 1);
+
+        /* 5,3,7,1 - interlaced yuv420 to yuv422 interpolation with 1,1 - yuv422 to yuv444 interpolation. */
+        for( int y = 2; y < height - 2; y += 4, ptr_dst_line += (dst_line_len << 2), ptr_src_line += (src_line_len << 1) )
+        {
+            INTERPOLATE_CHROMA( 0, 0 );
+            for( x = 0; x < src_chroma_width - 1; x++ )
+            {
+                INTERPOLATE_CHROMA( 1, x+1 );
+                for( int i = 0; i < 4; i++ )
+                    PUT_CHROMA( x, i );
+                memcpy( tmp[0], tmp[1], sizeof(tmp[0]) );
+            }
+            memcpy( tmp[1], tmp[0], sizeof(tmp[1]) );
+            for( int i = 0; i < 4; i++ )
+                PUT_CHROMA( x, i );
+        }
+
+        /* last 2 lines */
+        tmp[0][0] = ptr_src_line[0] << lshft;
+        tmp[0][1] = ptr_src_line[src_line_len] << lshft;
+        for( x = 0; x < src_chroma_width - 1; x++ )
+        {
+            tmp[1][0] = ptr_src_line[x+1] << lshft;
+            tmp[1][1] = ptr_src_line[x+1 + src_line_len] << lshft;
+            for( int i = 0; i < 2; i++ )
+                PUT_CHROMA( x, i );
+            memcpy( tmp[0], tmp[1], sizeof(tmp[0]) );
+        }
+        memcpy( tmp[1], tmp[0], sizeof(tmp[1]) );
+        for( int i = 0; i < 2; i++ )
+            PUT_CHROMA( x, i );
+#undef INTERPOLATE_CHROMA
+#undef PUT_CHROMA
+    }
+}
+
+void convert_yuv420p9le_i_to_yuv444p16le
+(
+    uint8_t  **dst,
+    const int *dst_linesize,
+    uint8_t  **pic_data,
+    int       *pic_linesize,
+    int        output_rowsize,
+    int        height
+)
+{
+    convert_yuv420ple_i_to_yuv444p16le( dst, dst_linesize, pic_data, pic_linesize, output_rowsize, height, 9 );
+}
+
+void convert_yuv420p10le_i_to_yuv444p16le
+(
+    uint8_t  **dst,
+    const int *dst_linesize,
+    uint8_t  **pic_data,
+    int       *pic_linesize,
+    int        output_rowsize,
+    int        height
+)
+{
+    convert_yuv420ple_i_to_yuv444p16le( dst, dst_linesize, pic_data, pic_linesize, output_rowsize, height, 10 );
+}
+
+void convert_yuv420p16le_i_to_yuv444p16le
+(
+    uint8_t  **dst,
+    const int *dst_linesize,
+    uint8_t  **pic_data,
+    int       *pic_linesize,
+    int        output_rowsize,
+    int        height
+)
+{
+    convert_yuv420ple_i_to_yuv444p16le( dst, dst_linesize, pic_data, pic_linesize, output_rowsize, height, 16 );
+}
+
+void convert_yv12i_to_yuy2
+(
+    uint8_t  *buf,
+    int       buf_linesize,
+    uint8_t **pic_data,
+    int      *pic_linesize,
+    int       output_rowsize,
+    int       height
+)
+{
+    uint8_t *pic_y = pic_data[0];
+    uint8_t *pic_u = pic_data[1];
+    uint8_t *pic_v = pic_data[2];
+#define INTERPOLATE_CHROMA( x, chroma, offset ) \
+    { \
+        buf[0 * buf_linesize + 4 * x + offset] = (5 * chroma[0*pic_linesize[1] + x] + 3 * chroma[2 * pic_linesize[1] + x] + 4) >> 3; \
+        buf[1 * buf_linesize + 4 * x + offset] = (7 * chroma[1*pic_linesize[1] + x] + 1 * chroma[3 * pic_linesize[1] + x] + 4) >> 3; \
+        buf[2 * buf_linesize + 4 * x + offset] = (1 * chroma[0*pic_linesize[1] + x] + 7 * chroma[2 * pic_linesize[1] + x] + 4) >> 3; \
+        buf[3 * buf_linesize + 4 * x + offset] = (3 * chroma[1*pic_linesize[1] + x] + 5 * chroma[3 * pic_linesize[1] + x] + 4) >> 3; \
+    }
+#define COPY_CHROMA( x, chroma, offset ) \
+    { \
+        buf[               4 * x + offset] = chroma[                  x]; \
+        buf[buf_linesize + 4 * x + offset] = chroma[pic_linesize[1] + x]; \
+    }
+    /* Copy all luma (Y). */
+    int luma_width = output_rowsize / YUY2_SIZE;
+    for( int y = 0; y < height; y++ )
+    {
+        for( int x = 0; x < luma_width; x++ )
+            buf[y * buf_linesize + 2 * x] = pic_y[x];
+        pic_y += pic_linesize[0];
+    }
+    /* Copy first 2 lines */
+    int chroma_width = luma_width / 2;
+    for( int x = 0; x < chroma_width; x++ )
+    {
+        COPY_CHROMA( x, pic_u, 1 );
+        COPY_CHROMA( x, pic_v, 3 );
+    }
+    buf += buf_linesize * 2;
+    /* Interpolate interlaced yv12 to yuy2 with suggestion in MPEG-2 spec. */
+    int four_buf_linesize = buf_linesize * 4;
+    int four_chroma_linesize = pic_linesize[1] * 2;
+    for( int y = 2; y < height - 2; y += 4 )
+    {
+        for( int x = 0; x < chroma_width; x++ )
+        {
+            INTERPOLATE_CHROMA( x, pic_u, 1 );      /* U */
+            INTERPOLATE_CHROMA( x, pic_v, 3 );      /* V */
+        }
+        buf   += four_buf_linesize;
+        pic_u += four_chroma_linesize;
+        pic_v += four_chroma_linesize;
+    }
+    /* Copy last 2 lines. */
+    for( int x = 0; x < chroma_width; x++ )
+    {
+        COPY_CHROMA( x, pic_u, 1 );
+        COPY_CHROMA( x, pic_v, 3 );
+    }
+#undef INTERPOLATE_CHROMA
+#undef COPY_CHROMA
+}
+
+void deinterleave_packed_rgb_to_planar_c
+(
+    uint8_t      **dst_data,
+    int            dst_linesize,
+    const uint8_t *src_data,
+    int            src_linesize,
+    int            width,
+    int            height,
+    int            num_components,
+    int            sample_size,
+    const int     *component_offset
+)
+{
+    for( int i = 0; i < height; i++ )
+    {
+        const uint8_t *src = src_data + i * src_linesize;
+        if( sample_size == 1 )
+            for( int j = 0; j < 3; j++ )
+            {
+                const uint8_t *src_pixel = src + component_offset[j];
+                uint8_t       *dst_pixel = dst_data[j] + i * dst_linesize;
+                for( int k = 0; k < width; k++ )
+                {
+                    *(dst_pixel++) = *src_pixel;
+                    src_pixel += num_components;
+                }
+            }
+        else
+            for( int j = 0; j < 3; j++ )
+            {
+                const uint16_t *src_pixel = (const uint16_t *)src + component_offset[j];
+                uint16_t       *dst_pixel = (uint16_t *)(dst_data[j] + i * dst_linesize);
+                for( int k = 0; k < width; k++ )
+                {
+                    *(dst_pixel++) = *src_pixel;
+                    src_pixel += num_components;
+                }
+            }
+    }
+}
+
+#undef YUY2_SIZE
+#undef YC48_SIZE
+
+#if LW_SIMD_X86
 #ifdef __GNUC__
 #pragma GCC target ("ssse3")
 #endif
@@ -204,6 +521,130 @@ void LW_FUNC_ALIGN convert_yv12i_to_yuy2_ssse3
     }
 }
 
+/* Set up the pshufb masks gathering each of R, G and B from num_components 16-byte blocks of packed pixels. */
+static void setup_deinterleave_shuffle
+(
+    uint8_t    shuffle[3][4][16],
+    int        num_components,
+    int        sample_size,
+    const int *component_offset
+)
+{
+    for( int c = 0; c < 3; c++ )
+        for( int k = 0; k < num_components; k++ )
+            for( int i = 0; i < 16; i++ )
+            {
+                int src = ((i / sample_size) * num_components + component_offset[c]) * sample_size + (i % sample_size) - 16 * k;
+                shuffle[c][k][i] = (src >= 0 && src < 16) ? src : 0x80;
+            }
+}
+
+static void LW_FORCEINLINE deinterleave_packed_rgb_remainder
+(
+    uint8_t      **dst,
+    const uint8_t *src,
+    int            x,
+    int            width,
+    const int      num_components,
+    const int      sample_size,
+    const int     *component_offset
+)
+{
+    for( ; x < width; x++ )
+        for( int c = 0; c < 3; c++ )
+        {
+            const uint8_t *p = src + (x * num_components + component_offset[c]) * sample_size;
+            if( sample_size == 2 )
+                ((uint16_t *)dst[c])[x] = *(const uint16_t *)p;
+            else
+                dst[c][x] = *p;
+        }
+}
+
+/* Deinterleave 16 bytes of each component, i.e. 16 8-bit or 8 16-bit pixels, from num_components 16-byte blocks. */
+static void LW_FORCEINLINE deinterleave_packed_rgb_block_ssse3
+(
+    uint8_t      **dst,
+    int            dst_offset,
+    const uint8_t *src,
+    uint8_t        shuffle[3][4][16],
+    const int      num_components
+)
+{
+    __m128i x0 = _mm_loadu_si128( (__m128i *)(src +  0) );
+    __m128i x1 = _mm_loadu_si128( (__m128i *)(src + 16) );
+    __m128i x2 = _mm_loadu_si128( (__m128i *)(src + 32) );
+    __m128i x3 = num_components == 4 ? _mm_loadu_si128( (__m128i *)(src + 48) ) : _mm_setzero_si128();
+    for( int c = 0; c < 3; c++ )
+    {
+        __m128i x4 = _mm_or_si128( _mm_shuffle_epi8( x0, _mm_load_si128( (__m128i *)shuffle[c][0] ) ),
+                                   _mm_shuffle_epi8( x1, _mm_load_si128( (__m128i *)shuffle[c][1] ) ) );
+        x4 = _mm_or_si128( x4, _mm_shuffle_epi8( x2, _mm_load_si128( (__m128i *)shuffle[c][2] ) ) );
+        if( num_components == 4 )
+            x4 = _mm_or_si128( x4, _mm_shuffle_epi8( x3, _mm_load_si128( (__m128i *)shuffle[c][3] ) ) );
+        _mm_storeu_si128( (__m128i *)(dst[c] + dst_offset), x4 );
+    }
+}
+
+/* the inner loop branches should be deleted by forced inline expansion and constant propagation. */
+static void LW_FUNC_ALIGN LW_FORCEINLINE deinterleave_packed_rgb_ssse3
+(
+    uint8_t      **dst_data,
+    int            dst_linesize,
+    const uint8_t *src_data,
+    int            src_linesize,
+    int            width,
+    int            height,
+    const int      num_components,
+    const int      sample_size,
+    const int     *component_offset
+)
+{
+    uint8_t LW_ALIGN(16) shuffle[3][4][16];
+    setup_deinterleave_shuffle( shuffle, num_components, sample_size, component_offset );
+    const int step       = 16 / sample_size;
+    const int simd_width = width - width % step;
+    for( int y = 0; y < height; y++ )
+    {
+        uint8_t *dst[3] = { dst_data[0] + y * dst_linesize, dst_data[1] + y * dst_linesize, dst_data[2] + y * dst_linesize };
+        const uint8_t *src = src_data + y * src_linesize;
+        for( int x = 0; x < simd_width; x += step )
+            deinterleave_packed_rgb_block_ssse3( dst, x * sample_size, src + x * num_components * sample_size, shuffle, num_components );
+        deinterleave_packed_rgb_remainder( dst, src, simd_width, width, num_components, sample_size, component_offset );
+    }
+}
+
+/* SSSE3 version of the deinterleave from packed RGB into planar RGB
+ * component_offset[0], [1] and [2] are the positions of R, G and B in a packed pixel. */
+void LW_FUNC_ALIGN deinterleave_packed_rgb_to_planar_ssse3
+(
+    uint8_t      **dst_data,
+    int            dst_linesize,
+    const uint8_t *src_data,
+    int            src_linesize,
+    int            width,
+    int            height,
+    int            num_components,
+    int            sample_size,
+    const int     *component_offset
+)
+{
+    if( num_components == 4 )
+    {
+        if( sample_size == 2 )
+            deinterleave_packed_rgb_ssse3( dst_data, dst_linesize, src_data, src_linesize, width, height, 4, 2, component_offset );
+        else
+            deinterleave_packed_rgb_ssse3( dst_data, dst_linesize, src_data, src_linesize, width, height, 4, 1, component_offset );
+    }
+    else
+    {
+        if( sample_size == 2 )
+            deinterleave_packed_rgb_ssse3( dst_data, dst_linesize, src_data, src_linesize, width, height, 3, 2, component_offset );
+        else
+            deinterleave_packed_rgb_ssse3( dst_data, dst_linesize, src_data, src_linesize, width, height, 3, 1, component_offset );
+    }
+}
+
 #ifdef __GNUC__
 #pragma GCC target ("sse4.1")
 #endif
@@ -221,6 +662,12 @@ static void LW_FUNC_ALIGN LW_FORCEINLINE convert_yuv420ple_i_to_yuv444p16le_sse4
     const int  bit_depth
 )
 {
+    if( output_rowsize < 32 )
+    {
+        /* The chroma loops below load 8 samples per line at least. */
+        convert_yuv420ple_i_to_yuv444p16le( dst, dst_linesize, pic_data, pic_linesize, output_rowsize, height, bit_depth );
+        return;
+    }
     const int lshft = 16 - bit_depth;
     /* copy luma */
     {
@@ -259,7 +706,7 @@ static void LW_FUNC_ALIGN LW_FORCEINLINE convert_yuv420ple_i_to_yuv444p16le_sse4
         { 5, 3, 5, 3, 5, 3, 5, 3 }, { 7, 1, 7, 1, 7, 1, 7, 1 },
         { 1, 7, 1, 7, 1, 7, 1, 7 }, { 3, 5, 3, 5, 3, 5, 3, 5 },
     };
-    const __m128i x_add = _mm_set1_epi32(1<<(2-lshft));
+    const __m128i x_add = _mm_set1_epi32(lshft < 3 ? 1<<(2-lshft) : 0);
     /* chroma upsampling for interlaced yuv420 */
     const int src_chroma_width = (output_rowsize / sizeof(uint16_t)) / 2;
     for( int i_color = 1; i_color < 3; i_color++ )
@@ -740,3 +1187,257 @@ void LW_FUNC_ALIGN convert_yuv16le_to_yc48_sse4_1
 {
     convert_yuv16le_to_yc48_simd( buf, buf_linesize, dst_data, dst_linesize, output_rowsize, output_height, full_range, 1 );
 }
+
+#if LW_SIMD_AVX2_ENABLED
+#ifdef __GNUC__
+#pragma GCC target ("avx2")
+#endif
+#include <immintrin.h>
+
+/* dst = (coef[0] * a + coef[1] * b + 4) >> 3 for each 8-bit sample */
+static LW_FORCEINLINE __m128i interpolate_chroma_sse( __m128i a, __m128i b, __m128i coef )
+{
+    __m128i lo = _mm_maddubs_epi16( _mm_unpacklo_epi8( a, b ), coef );
+    __m128i hi = _mm_maddubs_epi16( _mm_unpackhi_epi8( a, b ), coef );
+    lo = _mm_srai_epi16( _mm_add_epi16( lo, _mm_set1_epi16( 4 ) ), 3 );
+    hi = _mm_srai_epi16( _mm_add_epi16( hi, _mm_set1_epi16( 4 ) ), 3 );
+    return _mm_packus_epi16( lo, hi );
+}
+
+static LW_FORCEINLINE __m256i interpolate_chroma_avx2( __m256i a, __m256i b, __m256i coef )
+{
+    /* The in-lane unpacks are undone by the in-lane pack, so the order of samples is kept. */
+    __m256i lo = _mm256_maddubs_epi16( _mm256_unpacklo_epi8( a, b ), coef );
+    __m256i hi = _mm256_maddubs_epi16( _mm256_unpackhi_epi8( a, b ), coef );
+    lo = _mm256_srai_epi16( _mm256_add_epi16( lo, _mm256_set1_epi16( 4 ) ), 3 );
+    hi = _mm256_srai_epi16( _mm256_add_epi16( hi, _mm256_set1_epi16( 4 ) ), 3 );
+    return _mm256_packus_epi16( lo, hi );
+}
+
+/* Interleave 32 luma samples and 16 samples of each chroma into 64 bytes of YUY2. */
+static LW_FORCEINLINE void store_yuy2_sse( uint8_t *dst, const uint8_t *y, __m128i u, __m128i v )
+{
+    __m128i uv0 = _mm_unpacklo_epi8( u, v );
+    __m128i uv1 = _mm_unpackhi_epi8( u, v );
+    __m128i y0  = _mm_loadu_si128( (__m128i *)(y +  0) );
+    __m128i y1  = _mm_loadu_si128( (__m128i *)(y + 16) );
+    _mm_storeu_si128( (__m128i *)(dst +  0), _mm_unpacklo_epi8( y0, uv0 ) );
+    _mm_storeu_si128( (__m128i *)(dst + 16), _mm_unpackhi_epi8( y0, uv0 ) );
+    _mm_storeu_si128( (__m128i *)(dst + 32), _mm_unpacklo_epi8( y1, uv1 ) );
+    _mm_storeu_si128( (__m128i *)(dst + 48), _mm_unpackhi_epi8( y1, uv1 ) );
+}
+
+/* Interleave 64 luma samples and 32 samples of each chroma into 128 bytes of YUY2.
+ * Reordering 64-bit blocks as 0,2,1,3 in advance makes the in-lane unpacks work as the full-width ones. */
+static LW_FORCEINLINE void store_yuy2_avx2( uint8_t *dst, const uint8_t *y, __m256i u, __m256i v )
+{
+    u = _mm256_permute4x64_epi64( u, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+    v = _mm256_permute4x64_epi64( v, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+    __m256i uv0 = _mm256_permute4x64_epi64( _mm256_unpacklo_epi8( u, v ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+    __m256i uv1 = _mm256_permute4x64_epi64( _mm256_unpackhi_epi8( u, v ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+    __m256i y0  = _mm256_permute4x64_epi64( _mm256_loadu_si256( (__m256i *)(y +  0) ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+    __m256i y1  = _mm256_permute4x64_epi64( _mm256_loadu_si256( (__m256i *)(y + 32) ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+    _mm256_storeu_si256( (__m256i *)(dst +  0), _mm256_unpacklo_epi8( y0, uv0 ) );
+    _mm256_storeu_si256( (__m256i *)(dst + 32), _mm256_unpackhi_epi8( y0, uv0 ) );
+    _mm256_storeu_si256( (__m256i *)(dst + 64), _mm256_unpacklo_epi8( y1, uv1 ) );
+    _mm256_storeu_si256( (__m256i *)(dst + 96), _mm256_unpackhi_epi8( y1, uv1 ) );
+}
+
+/* Convert a line of YV12 into YUY2.
+ * If uv_offset is not 0, the chroma is interpolated with the line placed at uv_offset by coef.
+ * Unless exact, the output is written up to the next multiple of 64 bytes like the SSSE3 version.
+ * the inner loop branches should be deleted by forced inline expansion and constant propagation. */
+static void LW_FUNC_ALIGN LW_FORCEINLINE convert_yv12i_to_yuy2_line_avx2
+(
+    uint8_t       *dst,
+    const uint8_t *y,
+    const uint8_t *u,
+    const uint8_t *v,
+    const int      uv_offset,
+    const uint8_t *coef,
+    int            output_rowsize,
+    const int      exact
+)
+{
+    uint8_t *dst_fin = dst + (output_rowsize & ~127);
+    for( ; dst < dst_fin; dst += 128, y += 64, u += 32, v += 32 )
+    {
+        __m256i ymm0 = _mm256_loadu_si256( (__m256i *)u );
+        __m256i ymm1 = _mm256_loadu_si256( (__m256i *)v );
+        if( uv_offset )
+        {
+            __m256i ymm2 = _mm256_load_si256( (__m256i *)coef );
+            ymm0 = interpolate_chroma_avx2( ymm0, _mm256_loadu_si256( (__m256i *)(u + uv_offset) ), ymm2 );
+            ymm1 = interpolate_chroma_avx2( ymm1, _mm256_loadu_si256( (__m256i *)(v + uv_offset) ), ymm2 );
+        }
+        store_yuy2_avx2( dst, y, ymm0, ymm1 );
+    }
+    dst_fin += exact ? (output_rowsize & 64) : (output_rowsize & 127);
+    for( ; dst < dst_fin; dst += 64, y += 32, u += 16, v += 16 )
+    {
+        __m128i xmm0 = _mm_loadu_si128( (__m128i *)u );
+        __m128i xmm1 = _mm_loadu_si128( (__m128i *)v );
+        if( uv_offset )
+        {
+            __m128i xmm2 = _mm_load_si128( (__m128i *)coef );
+            xmm0 = interpolate_chroma_sse( xmm0, _mm_loadu_si128( (__m128i *)(u + uv_offset) ), xmm2 );
+            xmm1 = interpolate_chroma_sse( xmm1, _mm_loadu_si128( (__m128i *)(v + uv_offset) ), xmm2 );
+        }
+        store_yuy2_sse( dst, y, xmm0, xmm1 );
+    }
+    if( exact )
+        for( dst_fin += (output_rowsize & 63); dst < dst_fin; dst += 4, y += 2, u += 1, v += 1 )
+        {
+            dst[0] = y[0];
+            dst[1] = u[0];
+            dst[2] = y[1];
+            dst[3] = v[0];
+        }
+}
+
+/* AVX2 version of func convert_yv12i_to_yuy2 */
+void LW_FUNC_ALIGN convert_yv12i_to_yuy2_avx2
+(
+    uint8_t  *buf,
+    int       buf_linesize,
+    uint8_t **pic_data,
+    int      *pic_linesize,
+    int       output_rowsize,
+    int       height
+)
+{
+    static const uint8_t LW_ALIGN(32) Array_5371[4][32] = {
+        { 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3 },
+        { 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1 },
+        { 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7, 1, 7 },
+        { 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5 }
+    };
+    const int y_pitch  = pic_linesize[0];
+    const int uv_pitch = pic_linesize[1];
+    uint8_t *y_line   = pic_data[0];
+    uint8_t *u_line   = pic_data[1];
+    uint8_t *v_line   = pic_data[2];
+    uint8_t *dst_line = buf;
+    /* copy first 2 lines */
+    uint8_t *dst_line_fin = buf + buf_linesize * 2;
+    for( ; dst_line < dst_line_fin; dst_line += buf_linesize, y_line += y_pitch, u_line += uv_pitch, v_line += uv_pitch )
+        convert_yv12i_to_yuy2_line_avx2( dst_line, y_line, u_line, v_line, 0, NULL, output_rowsize, 0 );
+    /* 5,3,7,1 interlaced yv12 to yuy2 interpolation */
+    u_line = pic_data[1];
+    v_line = pic_data[2];
+    dst_line_fin = buf + buf_linesize * (height - 2);
+    for( ; dst_line < dst_line_fin; dst_line += (buf_linesize << 2), y_line += (y_pitch << 2), u_line += (uv_pitch << 1), v_line += (uv_pitch << 1) )
+        for( int i = 0; i < 4; i++ )
+            convert_yv12i_to_yuy2_line_avx2( dst_line + buf_linesize * i, y_line + y_pitch * i,
+                                             u_line + uv_pitch * (i & 0x01), v_line + uv_pitch * (i & 0x01),
+                                             uv_pitch << 1, Array_5371[i], output_rowsize, 0 );
+    /* copy last 2 lines */
+    dst_line_fin = buf + buf_linesize * height;
+    for( ; dst_line < dst_line_fin; dst_line += buf_linesize, y_line += y_pitch, u_line += uv_pitch, v_line += uv_pitch )
+        convert_yv12i_to_yuy2_line_avx2( dst_line, y_line, u_line, v_line, 0, NULL, output_rowsize, 1 );
+    const int background_fill_count = MIN((64 - (output_rowsize & 63)) & 63, buf_linesize - output_rowsize) >> 2;
+    if( background_fill_count )
+    {
+        static const uint32_t yuy2_background = (128<<24) + (128<<8);
+        /* background_fill are not needed for last 2 lines, since the copying of them won't overwrite. */
+        for( int j = 0; j < height - 2; j++ )
+        {
+            uint32_t *ptr = (uint32_t *)(buf + buf_linesize * j + output_rowsize);
+            for( int i = 0; i < background_fill_count; i++ )
+                ptr[i] = yuy2_background;
+        }
+    }
+}
+
+/* Deinterleave 32 bytes of each component from 2 * num_components 16-byte blocks.
+ * The lower and upper lanes handle the former and latter halves of the pixels by the same masks as SSSE3. */
+static void LW_FORCEINLINE deinterleave_packed_rgb_block_avx2
+(
+    uint8_t      **dst,
+    int            dst_offset,
+    const uint8_t *src,
+    uint8_t        shuffle[3][4][16],
+    const int      num_components
+)
+{
+    const int half = 16 * num_components;
+    __m256i ymm0 = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (__m128i *)(src +  0) ) ), _mm_loadu_si128( (__m128i *)(src + half +  0) ), 1 );
+    __m256i ymm1 = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (__m128i *)(src + 16) ) ), _mm_loadu_si128( (__m128i *)(src + half + 16) ), 1 );
+    __m256i ymm2 = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (__m128i *)(src + 32) ) ), _mm_loadu_si128( (__m128i *)(src + half + 32) ), 1 );
+    __m256i ymm3 = num_components == 4
+                 ? _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (__m128i *)(src + 48) ) ), _mm_loadu_si128( (__m128i *)(src + half + 48) ), 1 )
+                 : _mm256_setzero_si256();
+    for( int c = 0; c < 3; c++ )
+    {
+        __m256i ymm4 = _mm256_or_si256( _mm256_shuffle_epi8( ymm0, _mm256_broadcastsi128_si256( _mm_load_si128( (__m128i *)shuffle[c][0] ) ) ),
+                                        _mm256_shuffle_epi8( ymm1, _mm256_broadcastsi128_si256( _mm_load_si128( (__m128i *)shuffle[c][1] ) ) ) );
+        ymm4 = _mm256_or_si256( ymm4, _mm256_shuffle_epi8( ymm2, _mm256_broadcastsi128_si256( _mm_load_si128( (__m128i *)shuffle[c][2] ) ) ) );
+        if( num_components == 4 )
+            ymm4 = _mm256_or_si256( ymm4, _mm256_shuffle_epi8( ymm3, _mm256_broadcastsi128_si256( _mm_load_si128( (__m128i *)shuffle[c][3] ) ) ) );
+        _mm256_storeu_si256( (__m256i *)(dst[c] + dst_offset), ymm4 );
+    }
+}
+
+/* the inner loop branches should be deleted by forced inline expansion and constant propagation. */
+static void LW_FUNC_ALIGN LW_FORCEINLINE deinterleave_packed_rgb_avx2
+(
+    uint8_t      **dst_data,
+    int            dst_linesize,
+    const uint8_t *src_data,
+    int            src_linesize,
+    int            width,
+    int            height,
+    const int      num_components,
+    const int      sample_size,
+    const int     *component_offset
+)
+{
+    uint8_t LW_ALIGN(16) shuffle[3][4][16];
+    setup_deinterleave_shuffle( shuffle, num_components, sample_size, component_offset );
+    const int step         = 16 / sample_size;
+    const int avx2_width   = width - width % (2 * step);
+    const int simd_width   = width - width % step;
+    for( int y = 0; y < height; y++ )
+    {
+        uint8_t *dst[3] = { dst_data[0] + y * dst_linesize, dst_data[1] + y * dst_linesize, dst_data[2] + y * dst_linesize };
+        const uint8_t *src = src_data + y * src_linesize;
+        int x;
+        for( x = 0; x < avx2_width; x += 2 * step )
+            deinterleave_packed_rgb_block_avx2( dst, x * sample_size, src + x * num_components * sample_size, shuffle, num_components );
+        for( ; x < simd_width; x += step )
+            deinterleave_packed_rgb_block_ssse3( dst, x * sample_size, src + x * num_components * sample_size, shuffle, num_components );
+        deinterleave_packed_rgb_remainder( dst, src, simd_width, width, num_components, sample_size, component_offset );
+    }
+}
+
+/* AVX2 version of the deinterleave from packed RGB into planar RGB */
+void LW_FUNC_ALIGN deinterleave_packed_rgb_to_planar_avx2
+(
+    uint8_t      **dst_data,
+    int            dst_linesize,
+    const uint8_t *src_data,
+    int            src_linesize,
+    int            width,
+    int            height,
+    int            num_components,
+    int            sample_size,
+    const int     *component_offset
+)
+{
+    if( num_components == 4 )
+    {
+        if( sample_size == 2 )
+            deinterleave_packed_rgb_avx2( dst_data, dst_linesize, src_data, src_linesize, width, height, 4, 2, component_offset );
+        else
+            deinterleave_packed_rgb_avx2( dst_data, dst_linesize, src_data, src_linesize, width, height, 4, 1, component_offset );
+    }
+    else
+    {
+        if( sample_size == 2 )
+            deinterleave_packed_rgb_avx2( dst_data, dst_linesize, src_data, src_linesize, width, height, 3, 2, component_offset );
+        else
+            deinterleave_packed_rgb_avx2( dst_data, dst_linesize, src_data, src_linesize, width, height, 3, 1, component_offset );
+    }
+}
+#endif  /* LW_SIMD_AVX2_ENABLED */
+#endif  /* LW_SIMD_X86 */
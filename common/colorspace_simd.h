@@ -22,6 +22,27 @@
  * However, when distributing its binary file, it will be under LGPL or GPL.
  * Don't distribute it if its license is GPL. */
 
+/* The C versions are available on any architecture and are the references of the SIMD versions. */
+void convert_yuv16le_to_yc48
+(
+    uint8_t  *buf,
+    int       buf_linesize,
+    uint8_t **dst_data,
+    int      *dst_linesize,
+    int       output_rowsize,
+    int       output_height,
+    int       full_range
+);
+void convert_yv12i_to_yuy2
+(
+    uint8_t  *buf,
+    int       buf_linesize,
+    uint8_t **pic_data,
+    int      *pic_linesize,
+    int       output_rowsize,
+    int       height
+);
+
 void convert_yuv16le_to_yc48_sse2
 (
     uint8_t  *buf,
@@ -51,6 +72,15 @@ void convert_yv12i_to_yuy2_ssse3
     int       output_rowsize,
     int       height
 );
+void convert_yv12i_to_yuy2_avx2
+(
+    uint8_t  *buf,
+    int       buf_linesize,
+    uint8_t **pic_data,
+    int      *pic_linesize,
+    int       output_rowsize,
+    int       height
+);
 
 typedef void func_convert_yuv420ple_i_to_yuv444p16le
 (
@@ -62,6 +92,29 @@ typedef void func_convert_yuv420ple_i_to_yuv444p16le
     int        height
 );
 
+func_convert_yuv420ple_i_to_yuv444p16le convert_yuv420p9le_i_to_yuv444p16le;
+func_convert_yuv420ple_i_to_yuv444p16le convert_yuv420p10le_i_to_yuv444p16le;
+func_convert_yuv420ple_i_to_yuv444p16le convert_yuv420p16le_i_to_yuv444p16le;
 func_convert_yuv420ple_i_to_yuv444p16le convert_yuv420p9le_i_to_yuv444p16le_sse41;
 func_convert_yuv420ple_i_to_yuv444p16le convert_yuv420p10le_i_to_yuv444p16le_sse41;
 func_convert_yuv420ple_i_to_yuv444p16le convert_yuv420p16le_i_to_yuv444p16le_sse41;
+
+/* Deinterleave packed RGB of num_components 8-bit (sample_size = 1) or 16-bit (sample_size = 2) samples per pixel
+ * into planar R, G and B. component_offset[0], [1] and [2] are the positions of R, G and B in a packed pixel.
+ * No alignment is required. */
+typedef void func_deinterleave_packed_rgb_to_planar
+(
+    uint8_t      **dst_data,
+    int            dst_linesize,
+    const uint8_t *src_data,
+    int            src_linesize,
+    int            width,
+    int            height,
+    int            num_components,
+    int            sample_size,
+    const int     *component_offset
+);
+
+func_deinterleave_packed_rgb_to_planar deinterleave_packed_rgb_to_planar_c;
+func_deinterleave_packed_rgb_to_planar deinterleave_packed_rgb_to_planar_ssse3;
+func_deinterleave_packed_rgb_to_planar deinterleave_packed_rgb_to_planar_avx2;
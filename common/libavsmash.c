@@ -24,6 +24,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -47,7 +48,6 @@ extern "C"
 
 lsmash_root_t *libavsmash_open_file
 (
-    AVFormatContext          **p_format_ctx,
     const char                *file_name,
     lsmash_file_parameters_t  *file_param,
     lsmash_movie_parameters_t *movie_param,
@@ -82,23 +82,11 @@ lsmash_root_t *libavsmash_open_file
         strcpy( error_string, "The number of tracks equals 0.\n" );
         goto open_fail;
     }
-    /* libavformat */
+    /* libavformat is opened only if needed. See libavsmash_get_codec_context(). */
     av_register_all();
     avcodec_register_all();
-    if( avformat_open_input( p_format_ctx, file_name, NULL, NULL ) )
-    {
-        strcpy( error_string, "Failed to avformat_open_input.\n" );
-        goto open_fail;
-    }
-    if( avformat_find_stream_info( *p_format_ctx, NULL ) < 0 )
-    {
-        strcpy( error_string, "Failed to avformat_find_stream_info.\n" );
-        goto open_fail;
-    }
     return root;
 open_fail:
-    if( *p_format_ctx )
-        avformat_close_input( p_format_ctx );
     lsmash_close_file( file_param );
     lsmash_destroy_root( root );
     if( lhp->show_log )
@@ -634,6 +622,205 @@ fail:
     return -1;
 }
 
+static void set_basic_settings
+(
+    codec_configuration_t *config,
+    AVCodecContext        *ctx,
+    enum AVMediaType       codec_type,
+    enum AVCodecID         codec_id,
+    lsmash_summary_t      *summary
+)
+{
+    if( codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        lsmash_video_summary_t *video = (lsmash_video_summary_t *)summary;
+        ctx->width  = video->width;
+        ctx->height = video->height;
+        /* Here, expect appropriate pixel format will be picked in avcodec_open2(). */
+        if( video->depth >= QT_VIDEO_DEPTH_GRAYSCALE_1 && video->depth <= QT_VIDEO_DEPTH_GRAYSCALE_8 )
+            config->queue.bits_per_sample = video->depth & 0x1f;
+        else
+            config->queue.bits_per_sample = video->depth;
+        if( config->queue.bits_per_sample > 0 )
+            ctx->bits_per_coded_sample = config->queue.bits_per_sample;
+    }
+    else
+    {
+        if( codec_id != AV_CODEC_ID_AAC && codec_id != AV_CODEC_ID_DTS && codec_id != AV_CODEC_ID_EAC3 )
+        {
+            lsmash_audio_summary_t *audio = (lsmash_audio_summary_t *)summary;
+            ctx->sample_rate           = config->queue.sample_rate     ? config->queue.sample_rate     : audio->frequency;
+            ctx->bits_per_coded_sample = config->queue.bits_per_sample ? config->queue.bits_per_sample : audio->sample_size;
+            ctx->channels              = config->queue.channels        ? config->queue.channels        : audio->channels;
+        }
+        if( codec_id == AV_CODEC_ID_DTS )
+        {
+            ctx->bits_per_coded_sample = config->queue.bits_per_sample;
+            ctx->request_sample_fmt    = config->queue.bits_per_sample == 16 ? AV_SAMPLE_FMT_S16 : AV_SAMPLE_FMT_FLT;
+        }
+    }
+}
+
+/* Allocate the decoder context and set it up only from the summaries and the CODEC specific data.
+ * Return NULL if no CODEC can be derived from the summaries. */
+static AVCodecContext *alloc_codec_context_from_summaries
+(
+    codec_configuration_t *config,
+    enum AVMediaType       codec_type
+)
+{
+    uint32_t       index    = 0;
+    enum AVCodecID codec_id = AV_CODEC_ID_NONE;
+    for( uint32_t i = 0; i < config->count && codec_id == AV_CODEC_ID_NONE; i++ )
+        if( config->entries[i].summary )
+        {
+            codec_id = get_codec_id_from_description( config->entries[i].summary );
+            index    = i + 1;
+        }
+    if( codec_id == AV_CODEC_ID_NONE )
+        return NULL;
+    lsmash_summary_t *summary = config->entries[index - 1].summary;
+    AVCodecContext   *ctx     = avcodec_alloc_context3( NULL );
+    if( !ctx )
+        return NULL;
+    ctx->codec_type = codec_type;
+    ctx->codec_id   = codec_id;
+    /* This is needed by some CODECs such as UtVideo and raw video. */
+    ctx->codec_tag  = BYTE_SWAP_32( summary->sample_type.fourcc );
+    config->ctx = ctx;
+    if( prepare_new_decoder_configuration( config, index ) < 0 || config->queue.codec_id == AV_CODEC_ID_NONE )
+    {
+        av_freep( &config->queue.extradata );
+        config->queue.extradata_size = 0;
+        config->ctx = NULL;
+        av_freep( &ctx );
+        return NULL;
+    }
+    ctx->codec_id = config->queue.codec_id;
+    set_basic_settings( config, ctx, codec_type, ctx->codec_id, summary );
+    /* The decoder configuration is prepared again at the first sample, so take the extradata over here. */
+    ctx->extradata      = config->queue.extradata;
+    ctx->extradata_size = config->queue.extradata_size;
+    config->queue.extradata      = NULL;
+    config->queue.extradata_size = 0;
+    config->queue.index          = 0;
+    config->allocated_ctx        = 1;
+    return ctx;
+}
+
+AVCodecContext *libavsmash_get_codec_context
+(
+    AVFormatContext      **p_format_ctx,
+    const char            *file_name,
+    codec_configuration_t *config,
+    enum AVMediaType       codec_type
+)
+{
+    /* Usually, the summaries tell everything needed to set up the decoder.
+     * Opening the file by libavformat reads and probe-decodes large parts of the file again,
+     * which is heavy especially for fragmented movies, so this is done only as a fallback. */
+    AVCodecContext *ctx = alloc_codec_context_from_summaries( config, codec_type );
+    if( ctx )
+        return ctx;
+    char error_string[96] = { 0 };
+    if( !*p_format_ctx )
+    {
+        if( avformat_open_input( p_format_ctx, file_name, NULL, NULL ) )
+        {
+            strcpy( error_string, "Failed to avformat_open_input.\n" );
+            goto fail;
+        }
+        if( avformat_find_stream_info( *p_format_ctx, NULL ) < 0 )
+        {
+            strcpy( error_string, "Failed to avformat_find_stream_info.\n" );
+            goto fail;
+        }
+    }
+    AVFormatContext *format_ctx = *p_format_ctx;
+    unsigned int i;
+    for( i = 0; i < format_ctx->nb_streams && format_ctx->streams[i]->codec->codec_type != codec_type; i++ );
+    if( i == format_ctx->nb_streams )
+    {
+        strcpy( error_string, "Failed to find stream by libavformat.\n" );
+        goto fail;
+    }
+    config->ctx = format_ctx->streams[i]->codec;
+    return config->ctx;
+fail:
+    if( *p_format_ctx )
+        avformat_close_input( p_format_ctx );
+    if( config->lh.show_log )
+        config->lh.show_log( &config->lh, LW_LOG_FATAL, "%s", error_string );
+    return NULL;
+}
+
+int libavsmash_open_sample_input
+(
+    lsmash_root_t         *root,
+    uint32_t               track_ID,
+    const char            *file_name,
+    codec_configuration_t *config
+)
+{
+    /* The file offsets of samples in a track referring to external media data are unusable here. */
+    for( uint32_t i = 0; i < config->count; i++ )
+    {
+        if( !config->entries[i].summary )
+            continue;
+        lsmash_data_reference_t data_ref = { 0 };
+        data_ref.index = config->entries[i].summary->data_ref_index;
+        if( lsmash_get_data_reference( root, track_ID, &data_ref ) )
+            return -1;
+        int external = !!data_ref.location;
+        lsmash_cleanup_data_reference( &data_ref );
+        if( external )
+            return -1;
+    }
+    if( avio_open( &config->input_io, file_name, AVIO_FLAG_READ ) < 0 )
+    {
+        config->input_io = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Read the sample data into 'data' and the others into 'sample'. */
+static int read_sample
+(
+    lsmash_root_t         *root,
+    uint32_t               track_ID,
+    uint32_t               sample_number,
+    codec_configuration_t *config,
+    lsmash_sample_t       *sample,
+    uint8_t               *data
+)
+{
+    if( config->input_io
+     && lsmash_get_sample_info_from_media_timeline( root, track_ID, sample_number, sample ) == 0
+     && sample->length <= config->input_buffer_size
+     && avio_seek( config->input_io, (int64_t)sample->pos, SEEK_SET ) == (int64_t)sample->pos
+     && avio_read( config->input_io, data, sample->length ) == (int)sample->length )
+    {
+        sample->data = NULL;
+        return 0;
+    }
+    /* Fall back on L-SMASH, which allocates the sample data for each sample. */
+    lsmash_sample_t *copy = lsmash_get_sample_from_media_timeline( root, track_ID, sample_number );
+    if( !copy )
+        /* Reached the end of this media timeline. */
+        return 1;
+    if( copy->length > config->input_buffer_size )
+    {
+        lsmash_delete_sample( copy );
+        return -1;
+    }
+    *sample = *copy;
+    sample->data = NULL;
+    memcpy( data, copy->data, copy->length );
+    lsmash_delete_sample( copy );
+    return 0;
+}
+
 int get_sample
 (
     lsmash_root_t         *root,
@@ -666,50 +853,56 @@ int get_sample
         }
         return 0;
     }
-    lsmash_sample_t *sample = lsmash_get_sample_from_media_timeline( root, track_ID, sample_number );
-    if( !sample )
+    /* The decoder holds its own reference to the buffer of the previous packet if needed,
+     * so release ours and get a buffer back from the pool. */
+    av_buffer_unref( &config->input_buf );
+    AVBufferRef *buf = av_buffer_pool_get( config->input_pool );
+    if( !buf )
+        return -1;
+    lsmash_sample_t sample;
+    int ret = read_sample( root, track_ID, sample_number, config, &sample, buf->data );
+    if( ret )
     {
-        /* Reached the end of this media timeline. */
+        av_buffer_unref( &buf );
         pkt->data = NULL;
         pkt->size = 0;
-        return 1;
+        return ret;
     }
-    pkt->flags = sample->prop.ra_flags;     /* Set proper flags when feeding this packet into the decoder. */
-    pkt->size  = sample->length;
-    pkt->data  = config->input_buffer;
-    pkt->pts   = sample->cts;               /* Set composition timestamp to presentation timestamp field. */
-    pkt->dts   = sample->dts;
-    /* Copy sample data from L-SMASH.
-     * Set 0 to the end of the additional FF_INPUT_BUFFER_PADDING_SIZE bytes.
+    config->input_buf = buf;
+    pkt->flags = sample.prop.ra_flags;      /* Set proper flags when feeding this packet into the decoder. */
+    pkt->size  = sample.length;
+    pkt->data  = buf->data;
+    pkt->buf   = buf;                       /* The decoder can take a reference instead of copying the data. */
+    pkt->pts   = sample.cts;                /* Set composition timestamp to presentation timestamp field. */
+    pkt->dts   = sample.dts;
+    /* Set 0 to the end of the additional FF_INPUT_BUFFER_PADDING_SIZE bytes.
      * Without this, some decoders could cause wrong results. */
-    memcpy( pkt->data, sample->data, sample->length );
-    memset( pkt->data + sample->length, 0, FF_INPUT_BUFFER_PADDING_SIZE );
+    memset( pkt->data + sample.length, 0, FF_INPUT_BUFFER_PADDING_SIZE );
     /* TODO: add handling invalid indexes. */
-    if( sample->index != config->index )
+    if( sample.index != config->index )
     {
-        if( prepare_new_decoder_configuration( config, sample->index ) )
-        {
-            lsmash_delete_sample( sample );
+        if( prepare_new_decoder_configuration( config, sample.index ) )
             return -1;
-        }
         /* Queue the current packet and, instead of this, return NULL packet.
-         * The current packet will be dequeued and returned after the corresponding decoder configuration is activated. */
+         * The current packet will be dequeued and returned after the corresponding decoder configuration is activated.
+         * The queued packet keeps the reference to its buffer until another packet is queued. */
+        av_buffer_unref( &config->queue.packet.buf );
         config->queue.sample_number = sample_number;
         config->queue.packet        = *pkt;
+        config->input_buf           = NULL;
         pkt->data = NULL;
         pkt->size = 0;
+        pkt->buf  = NULL;
         if( config->queue.delay_count == 0 )
         {
             /* This NULL packet must not be sent to the decoder. */
             config->update_pending = 1;
             config->dequeue_packet = 1;
-            lsmash_delete_sample( sample );
             return 2;
         }
         else
             config->dequeue_packet = 0;
     }
-    lsmash_delete_sample( sample );
     return 0;
 }
 
@@ -770,6 +963,7 @@ void update_configuration
     const AVCodec  *codec = ctx->codec;
     void *app_specific      = ctx->opaque;
     int   refcounted_frames = ctx->refcounted_frames;
+    int   emu_edge          = ctx->flags & CODEC_FLAG_EMU_EDGE;   /* required by direct rendering */
     avcodec_close( ctx );
     if( ctx->extradata )
     {
@@ -793,34 +987,7 @@ void update_configuration
     }
     /* Set up decoder basic settings. */
     lsmash_summary_t *summary = config->entries[new_index - 1].summary;
-    if( codec->type == AVMEDIA_TYPE_VIDEO )
-    {
-        lsmash_video_summary_t *video = (lsmash_video_summary_t *)summary;
-        ctx->width  = video->width;
-        ctx->height = video->height;
-        /* Here, expect appropriate pixel format will be picked in avcodec_open2(). */
-        if( video->depth >= QT_VIDEO_DEPTH_GRAYSCALE_1 && video->depth <= QT_VIDEO_DEPTH_GRAYSCALE_8 )
-            config->queue.bits_per_sample = video->depth & 0x1f;
-        else
-            config->queue.bits_per_sample = video->depth;
-        if( config->queue.bits_per_sample > 0 )
-            ctx->bits_per_coded_sample = config->queue.bits_per_sample;
-    }
-    else
-    {
-        if( codec->id != AV_CODEC_ID_AAC && codec->id != AV_CODEC_ID_DTS && codec->id != AV_CODEC_ID_EAC3 )
-        {
-            lsmash_audio_summary_t *audio = (lsmash_audio_summary_t *)summary;
-            ctx->sample_rate           = config->queue.sample_rate     ? config->queue.sample_rate     : audio->frequency;
-            ctx->bits_per_coded_sample = config->queue.bits_per_sample ? config->queue.bits_per_sample : audio->sample_size;
-            ctx->channels              = config->queue.channels        ? config->queue.channels        : audio->channels;
-        }
-        if( codec->id == AV_CODEC_ID_DTS )
-        {
-            ctx->bits_per_coded_sample = config->queue.bits_per_sample;
-            ctx->request_sample_fmt    = config->queue.bits_per_sample == 16 ? AV_SAMPLE_FMT_S16 : AV_SAMPLE_FMT_FLT;
-        }
-    }
+    set_basic_settings( config, ctx, codec->type, codec->id, summary );
     /* AVCodecContext.codec_id is supposed to be set properly in avcodec_open2().
      * See libavsmash_flush_buffers(), why this is needed. */
     ctx->codec_id = AV_CODEC_ID_NONE;
@@ -925,6 +1092,7 @@ void update_configuration
     av_frame_free( &picture );
     /* Reopen/flush with the requested number of threads. */
     ctx->thread_count = thread_count;
+    ctx->flags       |= emu_edge;
     libavsmash_flush_buffers( config );
     if( current_sample_number == config->queue.sample_number )
         config->dequeue_packet = 1;
@@ -956,11 +1124,11 @@ int initialize_decoder_configuration
 )
 {
     /* Note: the input buffer for libavcodec's decoders must be FF_INPUT_BUFFER_PADDING_SIZE larger than the actual read bytes. */
-    uint32_t input_buffer_size = lsmash_get_max_sample_size_in_media_timeline( root, track_ID );
-    if( input_buffer_size == 0 )
+    config->input_buffer_size = lsmash_get_max_sample_size_in_media_timeline( root, track_ID );
+    if( config->input_buffer_size == 0 || config->input_buffer_size > INT_MAX - FF_INPUT_BUFFER_PADDING_SIZE )
         return -1;
-    config->input_buffer = (uint8_t *)av_mallocz( input_buffer_size + FF_INPUT_BUFFER_PADDING_SIZE );
-    if( !config->input_buffer )
+    config->input_pool = av_buffer_pool_init( config->input_buffer_size + FF_INPUT_BUFFER_PADDING_SIZE, NULL );
+    if( !config->input_pool )
         return -1;
     config->get_buffer = avcodec_default_get_buffer2;
     /* Initialize decoder configuration at the first valid sample. */
@@ -1072,8 +1240,19 @@ void cleanup_configuration
     }
     if( config->queue.extradata )
         av_free( config->queue.extradata );
-    if( config->input_buffer )
-        av_free( config->input_buffer );
+    av_buffer_unref( &config->input_buf );
+    av_buffer_unref( &config->queue.packet.buf );
+    if( config->input_io )
+        avio_close( config->input_io );
     if( config->ctx )
+    {
         avcodec_close( config->ctx );
+        if( config->allocated_ctx )
+        {
+            av_freep( &config->ctx->extradata );
+            av_freep( &config->ctx );
+        }
+    }
+    /* Buffers still referenced by frames are freed when released. */
+    av_buffer_pool_uninit( &config->input_pool );
 }
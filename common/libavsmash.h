@@ -43,10 +43,14 @@ typedef struct
     int                   error;
     int                   update_pending;
     int                   dequeue_packet;
+    int                   allocated_ctx;    /* 'ctx' is not owned by any AVFormatContext. */
     uint32_t              count;
     uint32_t              index;    /* index of the current decoder configuration */
     uint32_t              delay_count;
-    uint8_t              *input_buffer;
+    uint32_t              input_buffer_size;    /* the maximum sample size excluding the padding */
+    AVBufferPool         *input_pool;           /* pool of padded buffers to read samples into */
+    AVBufferRef          *input_buf;            /* buffer of the packet returned last */
+    AVIOContext          *input_io;             /* for reading samples directly from the file */
     AVCodecContext       *ctx;
     libavsmash_summary_t *entries;
     extended_summary_t    prefer;
@@ -79,7 +83,6 @@ static inline uint32_t get_decoder_delay
 
 lsmash_root_t *libavsmash_open_file
 (
-    AVFormatContext          **p_format_ctx,
     const char                *file_name,
     lsmash_file_parameters_t  *file_param,
     lsmash_movie_parameters_t *movie_param,
@@ -93,6 +96,27 @@ int get_summaries
     codec_configuration_t *config
 );
 
+/* Get the decoder context of the track and set it to 'config'.
+ * libavformat is opened into '*p_format_ctx' only if the CODEC can't be derived from the summaries. */
+AVCodecContext *libavsmash_get_codec_context
+(
+    AVFormatContext      **p_format_ctx,
+    const char            *file_name,
+    codec_configuration_t *config,
+    enum AVMediaType       codec_type
+);
+
+/* Open the file for reading samples directly into the buffers passed to the decoder.
+ * If not opened or the samples cannot be read directly, samples are read via L-SMASH and copied.
+ * Return 0 if opened, otherwise return -1. */
+int libavsmash_open_sample_input
+(
+    lsmash_root_t         *root,
+    uint32_t               track_ID,
+    const char            *file_name,
+    codec_configuration_t *config
+);
+
 AVCodec *libavsmash_find_decoder
 (
     codec_configuration_t *config
@@ -288,6 +288,7 @@ static uint32_t seek_video
 static int get_picture
 (
     libavsmash_video_decode_handler_t *vdhp,
+    lw_video_frame_cache_t            *cache,
     AVFrame                           *picture,
     uint32_t                           current,
     uint32_t                           goal,
@@ -304,6 +305,9 @@ static int get_picture
         else if( ret == 1 )
             /* Sample doesn't exist. */
             break;
+        if( got_picture && current - config->delay_count <= sample_count )
+            /* Frames decoded on the way to the requested one are also cached. */
+            lw_cache_video_frame( cache, current - config->delay_count, picture );
         ++current;
         if( config->update_pending )
             /* A new decoder configuration is needed. Anyway, stop getting picture. */
@@ -334,6 +338,7 @@ static int get_picture
 int libavsmash_get_video_frame
 (
     libavsmash_video_decode_handler_t *vdhp,
+    libavsmash_video_output_handler_t *vohp,
     uint32_t                           sample_number,
     uint32_t                           sample_count
 )
@@ -358,6 +363,23 @@ int libavsmash_get_video_frame
         vdhp->last_sample_number = sample_count + 1;
         goto return_frame;
     }
+    AVFrame *cached_frame = lw_get_cached_video_frame( &vohp->frame_cache, sample_number );
+    if( cached_frame )
+    {
+        /* Get the index of the decoder configuration. */
+        lsmash_sample_t sample;
+        uint32_t decoding_sample_number = get_decoding_sample_number( vdhp->order_converter, sample_number );
+        if( lsmash_get_sample_info_from_media_timeline( vdhp->root, vdhp->track_ID, decoding_sample_number, &sample ) < 0 )
+            goto video_fail;
+        config_index = sample.index;
+        /* Copy the cached video frame data. */
+        av_frame_unref( picture );
+        if( av_frame_ref( picture, cached_frame ) < 0 )
+            goto video_fail;
+        config->ctx->width  = cached_frame->width;
+        config->ctx->height = cached_frame->height;
+        goto return_frame;
+    }
     uint32_t start_number;  /* number of sample, for normal decoding, where decoding starts excluding decoding delay */
     uint32_t rap_number;    /* number of sample, for seeking, where decoding starts excluding decoding delay */
     int seek_mode = vdhp->seek_mode;
@@ -387,7 +409,7 @@ int libavsmash_get_video_frame
     int error_count = 0;
     while( start_number == 0    /* Failed to seek. */
      || config->update_pending  /* Need to update the decoder configuration to decode pictures. */
-     || get_picture( vdhp, picture, start_number, sample_number + config->delay_count, sample_count ) )
+     || get_picture( vdhp, &vohp->frame_cache, picture, start_number, sample_number + config->delay_count, sample_count ) )
     {
         if( config->update_pending )
         {
@@ -418,6 +440,7 @@ int libavsmash_get_video_frame
         start_number = seek_video( vdhp, picture, sample_number, rap_number, roll_recovery || seek_mode != SEEK_MODE_NORMAL );
     }
     vdhp->last_sample_number = sample_number;
+    lw_cache_video_frame( &vohp->frame_cache, sample_number, picture );
     config_index = config->index;
 return_frame:;
     /* Don't exceed the maximum presentation size specified for each sequence. */
@@ -435,6 +458,62 @@ video_fail:
 #undef MAX_ERROR_COUNT
 }
 
+/* Return the forward seek threshold to be used for the next request of a batch.
+ * If the decoder has already passed the random accessible point of the requested sample,
+ * continuing to decode is never slower than seeking back to it, so the whole GOP is decoded only once. */
+static uint32_t get_batch_forward_seek_threshold
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    uint32_t                           sample_number,
+    uint32_t                           sample_count
+)
+{
+    if( vdhp->last_sample_number < vdhp->first_valid_frame_number
+     || vdhp->last_sample_number > sample_count
+     || sample_number <= vdhp->last_sample_number )
+        return vdhp->forward_seek_threshold;
+    uint32_t rap_number;
+    find_random_accessible_point( vdhp, sample_number, 0, &rap_number );
+    if( rap_number > get_decoding_sample_number( vdhp->order_converter, vdhp->last_sample_number ) )
+        return vdhp->forward_seek_threshold;
+    return MAX( vdhp->forward_seek_threshold, sample_number - vdhp->last_sample_number );
+}
+
+int libavsmash_get_video_frames
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    libavsmash_video_output_handler_t *vohp,
+    const uint32_t                    *sample_numbers,
+    uint32_t                           count,
+    uint32_t                           sample_count,
+    lw_video_frame_handler_t           handler,
+    void                              *priv
+)
+{
+    if( count == 0 )
+        return 0;
+    uint32_t  plan_count;
+    uint32_t *plan = lw_plan_video_frame_batch( sample_numbers, count, &plan_count );
+    if( !plan )
+    {
+        if( vdhp->config.lh.show_log )
+            vdhp->config.lh.show_log( &vdhp->config.lh, LW_LOG_ERROR, "Failed to allocate the batch of requested video frames." );
+        return -1;
+    }
+    uint32_t forward_seek_threshold = vdhp->forward_seek_threshold;
+    int      ret = 0;
+    for( uint32_t i = 0; i < plan_count && ret == 0; i++ )
+    {
+        vdhp->forward_seek_threshold = get_batch_forward_seek_threshold( vdhp, plan[i], sample_count );
+        ret = libavsmash_get_video_frame( vdhp, vohp, plan[i], sample_count );
+        vdhp->forward_seek_threshold = forward_seek_threshold;
+        if( ret == 0 && handler( priv, plan[i], vdhp->frame_buffer ) < 0 )
+            ret = -1;
+    }
+    lw_freep( &plan );
+    return ret;
+}
+
 int libavsmash_find_first_valid_video_frame
 (
     libavsmash_video_decode_handler_t *vdhp,
@@ -69,10 +69,26 @@ static inline uint32_t get_decoding_sample_number
 int libavsmash_get_video_frame
 (
     libavsmash_video_decode_handler_t *vdhp,
+    libavsmash_video_output_handler_t *vohp,
     uint32_t                           sample_number,
     uint32_t                           sample_count
 );
 
+/* Get the samples listed in sample_numbers in a single pass and deliver each to the handler in ascending order.
+ * Duplicated numbers are delivered once. Samples sharing a GOP are decoded by one continuous decoding
+ * instead of seeking for each request, which suits prefetching and every-Nth-frame extraction.
+ * Return 0 if all the frames were delivered, or -1 on failure or abort by the handler. */
+int libavsmash_get_video_frames
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    libavsmash_video_output_handler_t *vohp,
+    const uint32_t                    *sample_numbers,
+    uint32_t                           count,
+    uint32_t                           sample_count,
+    lw_video_frame_handler_t           handler,
+    void                              *priv
+);
+
 int libavsmash_find_first_valid_video_frame
 (
     libavsmash_video_decode_handler_t *vdhp,
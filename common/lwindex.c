@@ -20,6 +20,11 @@
 
 /* This file is available under an ISC license. */
 
+/* Index files and sources can exceed 2GiB. */
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
 #include "cpp_compat.h"
 
 #ifdef __cplusplus
@@ -31,6 +36,7 @@ extern "C"
 #include <libavresample/avresample.h>   /* Resampler/Buffer */
 #include <libavutil/mathematics.h>      /* Timebase rescaler */
 #include <libavutil/pixdesc.h>
+#include <libavutil/adler32.h>
 #ifdef __cplusplus
 }
 #endif  /* __cplusplus */
@@ -43,6 +49,36 @@ extern "C"
 #include "lwlibav_audio.h"
 #include "progress.h"
 #include "lwindex.h"
+#include "lwthread.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#define lw_getpid _getpid
+#else
+#include <unistd.h>
+#define lw_getpid getpid
+#endif
+
+/* 64-bit offsets in the index file since long is 32-bit on Windows. */
+static inline int lw_fseek( FILE *file, int64_t offset, int origin )
+{
+#ifdef _WIN32
+    return _fseeki64( file, offset, origin );
+#else
+    return fseeko( file, (off_t)offset, origin );
+#endif
+}
+
+static inline int64_t lw_ftell( FILE *file )
+{
+#ifdef _WIN32
+    return _ftelli64( file );
+#else
+    return (int64_t)ftello( file );
+#endif
+}
 
 typedef struct
 {
@@ -463,6 +499,28 @@ static int poc_genarate_pts
     return 0;
 }
 
+/* Set up the closest past random accessible point of each frame in decoding order from keyframe_list
+ * so that finding the point to start decoding from takes constant time. */
+static int create_video_rap_list
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        sample_count
+)
+{
+    uint32_t *rap_list = (uint32_t *)realloc( vdhp->rap_list, (sample_count + 1) * sizeof(uint32_t) );
+    if( !rap_list )
+    {
+        if( vdhp->lh.show_log )
+            vdhp->lh.show_log( &vdhp->lh, LW_LOG_FATAL, "Failed to allocate memory." );
+        return -1;
+    }
+    vdhp->rap_list = rap_list;
+    rap_list[0] = 0;
+    for( uint32_t i = 1; i <= sample_count; i++ )
+        rap_list[i] = vdhp->keyframe_list[i] ? i : rap_list[i - 1];
+    return 0;
+}
+
 static int decide_video_seek_method
 (
     lwlibav_file_handler_t         *lwhp,
@@ -627,7 +685,7 @@ static int decide_video_seek_method
     /* Set up keyframe list: presentation order (info) -> decoding order (keyframe_list) */
     for( uint32_t i = 1; i <= sample_count; i++ )
         vdhp->keyframe_list[ info[i].sample_number ] = !!(info[i].flags & LW_VFRAME_FLAG_KEY);
-    return 0;
+    return create_video_rap_list( vdhp, sample_count );
 }
 
 static void decide_audio_seek_method
@@ -786,11 +844,11 @@ static void create_video_frame_order_list
     int             enable_repeat   = 0;
     int             complete_frame  = 1;
     int             repeat_field    = 1;
-    lw_field_info_t next_field_info = info[1].field_info;
+    lw_field_info_t next_field_info = (lw_field_info_t)info[1].field_info;
     for( uint32_t i = 1; i <= frame_count; i++, order_count++ )
     {
         int             repeat_pict = info[i].repeat_pict;
-        lw_field_info_t field_info  = info[i].field_info;
+        lw_field_info_t field_info  = (lw_field_info_t)info[i].field_info;
         int             field_shift = !(repeat_pict & 1);
         if( field_info == LW_FIELD_INFO_UNKNOWN )
         {
@@ -863,7 +921,7 @@ static void create_video_frame_order_list
     {
         /* Check repeat_pict and field dominance. */
         int             repeat_pict = info[i].repeat_pict;
-        lw_field_info_t field_info  = info[i].field_info;
+        lw_field_info_t field_info  = (lw_field_info_t)info[i].field_info;
         order_list[t_count++].top    = i;
         order_list[b_count++].bottom = i;
         if( opt->apply_repeat_flag )
@@ -1381,19 +1439,575 @@ static enum AVSampleFormat select_better_sample_format
     return a;
 }
 
-static inline void print_index
+/*
+    # Structure of Libav reader index file (text)
+    <LibavReaderIndexFile=13>
+    <InputFilePath>foobar.omo</InputFilePath>
+    <LibavReaderIndex=0x00000208,0,marumoska>
+    <ActiveVideoStreamIndex>+0000000000</ActiveVideoStreamIndex>
+    <ActiveAudioStreamIndex>-0000000001</ActiveAudioStreamIndex>
+    Index=0,Type=0,Codec=2,TimeBase=1001/24000,POS=0,PTS=2002,DTS=0,EDI=0
+    Key=1,Pic=1,POC=0,Repeat=1,Field=0,Width=1920,Height=1080,Format=yuv420p,ColorSpace=5
+    </LibavReaderIndex>
+    <StreamIndexEntries=0,0,1>
+    POS=0,TS=2002,Flags=1,Size=1024,Distance=0
+    </StreamIndexEntries>
+    <ExtraDataList=0,0,1>
+    Size=252,Codec=28,4CC=0x564d4448,Width=1920,Height=1080,Format=yuv420p,BPS=0
+    ... binary string ...
+    </ExtraDataList>
+    </LibavReaderIndexFile>
+ */
+
+/*
+    # Structure of Libav reader index file (binary)
+    All integers are stored in little-endian.
+    Every section starts at an 8-byte boundary and consists of fixed-width records,
+    so that the whole file can be mapped and any record can be addressed directly.
+    [Header]
+        0   magic                                   "LWINDEX\x1a"
+        8   version                                 INDEX_FILE_VERSION
+        12  header size                             LWINDEX_HEADER_SIZE
+        16  major version of libavutil              pixel and sample formats are stored as their values
+        20  major version of libavcodec             codec IDs are stored as their values
+        24  active video stream index
+        28  active audio stream index
+        32  active video stream index when the finalized tables were made
+        36  active audio stream index when the finalized tables were made
+        40  finalized tables are present or not, and the forced streams when they were made
+        44  number of sections
+        48  section table                           { tag, record size, offset (64-bit), record count (64-bit) }
+    [Sections]
+        INFO        input file path, demuxer flags and demuxer name
+        PKTS        video and audio packet records of all streams in reading order
+        IDXE        AVIndexEntry records
+        GRPS        group records describing which stream owns the following IDXE and EXTD records
+        EXTD        extradata records
+        BLOB        extradata payloads referred by EXTD records
+        VINF/VFRM/VKEY/VORD     video handler state, frame_list, keyframe_list and order_converter
+        AINF/AFRM               audio handler state and frame_list
+        RSUM        resume point for appending packets of a growing source file (optional)
+                        { source file size when indexed, file offset to resume demuxing from,
+                          number of the packet records preceding the resume point,
+                          Adler-32 of the source bytes checked before appending (see hash_resume_point()) }
+    The finalized tables are the results of decide_video_seek_method() and decide_audio_seek_method(),
+    and they are used as is when opening with the same stream selection, i.e. no per-frame parsing is needed.
+    Otherwise, the tables are rebuilt from the packet records.
+    The text layout is still available as an export/debug dump via lwlibav_export_index_text().
+ */
+#define LWINDEX_BINARY_MAGIC            "LWINDEX\x1a"
+#define LWINDEX_MAGIC_SIZE              8
+#define LWINDEX_HEADER_SIZE             512
+#define LWINDEX_MAX_SECTIONS            16
+#define LWINDEX_IO_BUFFER_SIZE          16384
+
+#define LWINDEX_TAG( a, b, c, d ) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+#define LWINDEX_SECTION_INFO            LWINDEX_TAG( 'I', 'N', 'F', 'O' )
+#define LWINDEX_SECTION_PKTS            LWINDEX_TAG( 'P', 'K', 'T', 'S' )
+#define LWINDEX_SECTION_IDXE            LWINDEX_TAG( 'I', 'D', 'X', 'E' )
+#define LWINDEX_SECTION_GRPS            LWINDEX_TAG( 'G', 'R', 'P', 'S' )
+#define LWINDEX_SECTION_EXTD            LWINDEX_TAG( 'E', 'X', 'T', 'D' )
+#define LWINDEX_SECTION_BLOB            LWINDEX_TAG( 'B', 'L', 'O', 'B' )
+#define LWINDEX_SECTION_VINF            LWINDEX_TAG( 'V', 'I', 'N', 'F' )
+#define LWINDEX_SECTION_VFRM            LWINDEX_TAG( 'V', 'F', 'R', 'M' )
+#define LWINDEX_SECTION_VKEY            LWINDEX_TAG( 'V', 'K', 'E', 'Y' )
+#define LWINDEX_SECTION_VORD            LWINDEX_TAG( 'V', 'O', 'R', 'D' )
+#define LWINDEX_SECTION_AINF            LWINDEX_TAG( 'A', 'I', 'N', 'F' )
+#define LWINDEX_SECTION_AFRM            LWINDEX_TAG( 'A', 'F', 'R', 'M' )
+#define LWINDEX_SECTION_RSUM            LWINDEX_TAG( 'R', 'S', 'U', 'M' )
+
+#define LWINDEX_INFO_SIZE               16
+#define LWINDEX_PACKET_RECORD_SIZE      88
+#define LWINDEX_ENTRY_RECORD_SIZE       32
+#define LWINDEX_GROUP_RECORD_SIZE       16
+#define LWINDEX_EXTRADATA_RECORD_SIZE   64
+#define LWINDEX_VIDEO_INFO_SIZE         56
+#define LWINDEX_VIDEO_FRAME_RECORD_SIZE 48
+#define LWINDEX_AUDIO_INFO_SIZE         64
+#define LWINDEX_AUDIO_FRAME_RECORD_SIZE 48
+#define LWINDEX_RESUME_INFO_SIZE        32
+#define LWINDEX_RESUME_CHECK_SIZE       (1 << 20)
+
+#define LWINDEX_GROUP_INDEX_ENTRIES     0
+#define LWINDEX_GROUP_EXTRADATA         1
+
+#define LWINDEX_FINALIZED               0x1
+#define LWINDEX_FINALIZED_FORCE_VIDEO   0x2
+#define LWINDEX_FINALIZED_FORCE_AUDIO   0x4
+
+typedef struct
+{
+    int                 stream_index;
+    int                 codec_type;
+    int                 codec_id;
+    AVRational          time_base;
+    int64_t             pos;
+    int64_t             pts;
+    int64_t             dts;
+    int                 extradata_index;
+    /* Video */
+    int                 key;
+    int                 pict_type;
+    int                 poc;
+    int                 repeat_pict;
+    int                 field_info;
+    int                 width;
+    int                 height;
+    enum AVPixelFormat  pix_fmt;
+    enum AVColorSpace   colorspace;
+    /* Audio */
+    int                 channels;
+    uint64_t            channel_layout;
+    int                 sample_rate;
+    enum AVSampleFormat sample_fmt;
+    int                 bits_per_sample;
+    int                 frame_length;
+} lwindex_packet_record_t;
+
+typedef struct
+{
+    int kind;
+    int stream_index;
+    int codec_type;
+    int count;
+} lwindex_group_t;
+
+typedef struct
+{
+    uint32_t tag;
+    uint32_t record_size;
+    uint64_t offset;
+    uint64_t count;
+} lwindex_section_t;
+
+typedef struct
+{
+    uint8_t *data;
+    size_t   size;
+    size_t   capacity;
+} lwindex_buffer_t;
+
+typedef struct
+{
+    FILE             *file;
+    char             *path;         /* destination of the index file */
+    char             *temp_path;    /* file being written, renamed to 'path' when closed without error */
+    int               text;
+    int               error;
+    int64_t           active_index_pos;
+    int               active_video_index;
+    int               active_audio_index;
+    int               section_count;
+    lwindex_section_t section[LWINDEX_MAX_SECTIONS];
+    lwindex_buffer_t  group;
+    lwindex_buffer_t  extradata;
+    lwindex_buffer_t  blob;
+    /* Resume point, which is written only if 'source_size' is set. */
+    const char       *source_path;
+    int64_t           source_size;
+    uint64_t          packet_count;
+    int64_t           video_resume_pos;
+    uint64_t          video_resume_record;
+    int64_t           audio_resume_pos;
+    uint64_t          audio_resume_record;
+} lwindex_writer_t;
+
+static inline void lwindex_put_le32
+(
+    uint8_t *p,
+    uint32_t value
+)
+{
+    p[0] = (uint8_t)(value      );
+    p[1] = (uint8_t)(value >>  8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static inline void lwindex_put_le64
 (
-    FILE       *index,
-    const char *format,
-    ...
+    uint8_t *p,
+    uint64_t value
 )
 {
-    if( !index )
-        return;
-    va_list args;
-    va_start( args, format );
-    vfprintf( index, format, args );
-    va_end( args );
+    lwindex_put_le32( p,     (uint32_t)(value      ) );
+    lwindex_put_le32( p + 4, (uint32_t)(value >> 32) );
+}
+
+static inline uint32_t lwindex_get_le32
+(
+    const uint8_t *p
+)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t lwindex_get_le64
+(
+    const uint8_t *p
+)
+{
+    return (uint64_t)lwindex_get_le32( p ) | ((uint64_t)lwindex_get_le32( p + 4 ) << 32);
+}
+
+static inline void set_packet_record
+(
+    lwindex_packet_record_t *record,
+    AVPacket                *pkt,
+    AVStream                *stream,
+    int                      extradata_index
+)
+{
+    memset( record, 0, sizeof(lwindex_packet_record_t) );
+    record->stream_index    = pkt->stream_index;
+    record->codec_type      = stream->codec->codec_type;
+    record->codec_id        = stream->codec->codec_id;
+    record->time_base       = stream->time_base;
+    record->pos             = pkt->pos;
+    record->pts             = pkt->pts;
+    record->dts             = pkt->dts;
+    record->extradata_index = extradata_index;
+}
+
+static void encode_packet_record
+(
+    uint8_t    *p,
+    const void *src
+)
+{
+    const lwindex_packet_record_t *record = (const lwindex_packet_record_t *)src;
+    memset( p, 0, LWINDEX_PACKET_RECORD_SIZE );
+    lwindex_put_le32( p +  0, record->stream_index );
+    lwindex_put_le32( p +  4, record->codec_type );
+    lwindex_put_le32( p +  8, record->codec_id );
+    lwindex_put_le32( p + 12, record->time_base.num );
+    lwindex_put_le32( p + 16, record->time_base.den );
+    lwindex_put_le32( p + 20, record->extradata_index );
+    lwindex_put_le64( p + 24, record->pos );
+    lwindex_put_le64( p + 32, record->pts );
+    lwindex_put_le64( p + 40, record->dts );
+    if( record->codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        lwindex_put_le32( p + 48, record->key );
+        lwindex_put_le32( p + 52, record->pict_type );
+        lwindex_put_le32( p + 56, record->poc );
+        lwindex_put_le32( p + 60, record->repeat_pict );
+        lwindex_put_le32( p + 64, record->field_info );
+        lwindex_put_le32( p + 68, record->width );
+        lwindex_put_le32( p + 72, record->height );
+        lwindex_put_le32( p + 76, record->pix_fmt );
+        lwindex_put_le32( p + 80, record->colorspace );
+    }
+    else
+    {
+        lwindex_put_le64( p + 48, record->channel_layout );
+        lwindex_put_le32( p + 56, record->channels );
+        lwindex_put_le32( p + 60, record->sample_rate );
+        lwindex_put_le32( p + 64, record->sample_fmt );
+        lwindex_put_le32( p + 68, record->bits_per_sample );
+        lwindex_put_le32( p + 72, record->frame_length );
+    }
+}
+
+static void decode_packet_record
+(
+    const uint8_t *p,
+    void          *dst
+)
+{
+    lwindex_packet_record_t *record = (lwindex_packet_record_t *)dst;
+    memset( record, 0, sizeof(lwindex_packet_record_t) );
+    record->stream_index    = (int32_t)lwindex_get_le32( p +  0 );
+    record->codec_type      = (int32_t)lwindex_get_le32( p +  4 );
+    record->codec_id        = (int32_t)lwindex_get_le32( p +  8 );
+    record->time_base.num   = (int32_t)lwindex_get_le32( p + 12 );
+    record->time_base.den   = (int32_t)lwindex_get_le32( p + 16 );
+    record->extradata_index = (int32_t)lwindex_get_le32( p + 20 );
+    record->pos             = (int64_t)lwindex_get_le64( p + 24 );
+    record->pts             = (int64_t)lwindex_get_le64( p + 32 );
+    record->dts             = (int64_t)lwindex_get_le64( p + 40 );
+    if( record->codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        record->key             = (int32_t)lwindex_get_le32( p + 48 );
+        record->pict_type       = (int32_t)lwindex_get_le32( p + 52 );
+        record->poc             = (int32_t)lwindex_get_le32( p + 56 );
+        record->repeat_pict     = (int32_t)lwindex_get_le32( p + 60 );
+        record->field_info      = (int32_t)lwindex_get_le32( p + 64 );
+        record->width           = (int32_t)lwindex_get_le32( p + 68 );
+        record->height          = (int32_t)lwindex_get_le32( p + 72 );
+        record->pix_fmt         = (enum AVPixelFormat)(int32_t)lwindex_get_le32( p + 76 );
+        record->colorspace      = (enum AVColorSpace)(int32_t)lwindex_get_le32( p + 80 );
+    }
+    else
+    {
+        record->channel_layout  = lwindex_get_le64( p + 48 );
+        record->channels        = (int32_t)lwindex_get_le32( p + 56 );
+        record->sample_rate     = (int32_t)lwindex_get_le32( p + 60 );
+        record->sample_fmt      = (enum AVSampleFormat)(int32_t)lwindex_get_le32( p + 64 );
+        record->bits_per_sample = (int32_t)lwindex_get_le32( p + 68 );
+        record->frame_length    = (int32_t)lwindex_get_le32( p + 72 );
+    }
+}
+
+static void encode_index_entry_record
+(
+    uint8_t    *p,
+    const void *src
+)
+{
+    const AVIndexEntry *ie = (const AVIndexEntry *)src;
+    memset( p, 0, LWINDEX_ENTRY_RECORD_SIZE );
+    lwindex_put_le64( p +  0, ie->pos );
+    lwindex_put_le64( p +  8, ie->timestamp );
+    lwindex_put_le32( p + 16, ie->flags );
+    lwindex_put_le32( p + 20, ie->size );
+    lwindex_put_le32( p + 24, ie->min_distance );
+}
+
+static void decode_index_entry_record
+(
+    const uint8_t *p,
+    void          *dst
+)
+{
+    AVIndexEntry *ie = (AVIndexEntry *)dst;
+    ie->pos          = (int64_t)lwindex_get_le64( p +  0 );
+    ie->timestamp    = (int64_t)lwindex_get_le64( p +  8 );
+    ie->flags        = (int32_t)lwindex_get_le32( p + 16 );
+    ie->size         = (int32_t)lwindex_get_le32( p + 20 );
+    ie->min_distance = (int32_t)lwindex_get_le32( p + 24 );
+}
+
+static void decode_group_record
+(
+    const uint8_t *p,
+    void          *dst
+)
+{
+    lwindex_group_t *group = (lwindex_group_t *)dst;
+    group->kind         = (int32_t)lwindex_get_le32( p +  0 );
+    group->stream_index = (int32_t)lwindex_get_le32( p +  4 );
+    group->codec_type   = (int32_t)lwindex_get_le32( p +  8 );
+    group->count        = (int32_t)lwindex_get_le32( p + 12 );
+}
+
+static void encode_video_frame_record
+(
+    uint8_t    *p,
+    const void *src
+)
+{
+    const video_frame_info_t *info = (const video_frame_info_t *)src;
+    memset( p, 0, LWINDEX_VIDEO_FRAME_RECORD_SIZE );
+    lwindex_put_le64( p +  0, info->pts );
+    lwindex_put_le64( p +  8, info->dts );
+    lwindex_put_le64( p + 16, info->file_offset );
+    lwindex_put_le32( p + 24, info->sample_number );
+    lwindex_put_le32( p + 28, info->extradata_index );
+    p[32] = (uint8_t)info->flags;
+    p[33] = (uint8_t)info->field_info;
+    lwindex_put_le32( p + 36, info->pict_type );
+    lwindex_put_le32( p + 40, info->poc );
+    lwindex_put_le32( p + 44, info->repeat_pict );
+}
+
+static void decode_video_frame_record
+(
+    const uint8_t *p,
+    void          *dst
+)
+{
+    video_frame_info_t *info = (video_frame_info_t *)dst;
+    info->pts             = (int64_t)lwindex_get_le64( p +  0 );
+    info->dts             = (int64_t)lwindex_get_le64( p +  8 );
+    info->file_offset     = (int64_t)lwindex_get_le64( p + 16 );
+    info->sample_number   = lwindex_get_le32( p + 24 );
+    info->extradata_index = (int32_t)lwindex_get_le32( p + 28 );
+    info->flags           = p[32];
+    info->field_info      = (lw_field_info_t)p[33];
+    info->pict_type       = (int32_t)lwindex_get_le32( p + 36 );
+    info->poc             = (int32_t)lwindex_get_le32( p + 40 );
+    info->repeat_pict     = (int32_t)lwindex_get_le32( p + 44 );
+}
+
+static void encode_order_converter_record
+(
+    uint8_t    *p,
+    const void *src
+)
+{
+    lwindex_put_le32( p, ((const order_converter_t *)src)->decoding_to_presentation );
+}
+
+static void decode_order_converter_record
+(
+    const uint8_t *p,
+    void          *dst
+)
+{
+    ((order_converter_t *)dst)->decoding_to_presentation = lwindex_get_le32( p );
+}
+
+static void encode_audio_frame_record
+(
+    uint8_t    *p,
+    const void *src
+)
+{
+    const audio_frame_info_t *info = (const audio_frame_info_t *)src;
+    memset( p, 0, LWINDEX_AUDIO_FRAME_RECORD_SIZE );
+    lwindex_put_le64( p +  0, info->pts );
+    lwindex_put_le64( p +  8, info->dts );
+    lwindex_put_le64( p + 16, info->file_offset );
+    lwindex_put_le32( p + 24, info->sample_number );
+    lwindex_put_le32( p + 28, info->extradata_index );
+    lwindex_put_le32( p + 32, info->length );
+    lwindex_put_le32( p + 36, info->sample_rate );
+    p[40] = info->keyframe;
+}
+
+static void decode_audio_frame_record
+(
+    const uint8_t *p,
+    void          *dst
+)
+{
+    audio_frame_info_t *info = (audio_frame_info_t *)dst;
+    info->pts             = (int64_t)lwindex_get_le64( p +  0 );
+    info->dts             = (int64_t)lwindex_get_le64( p +  8 );
+    info->file_offset     = (int64_t)lwindex_get_le64( p + 16 );
+    info->sample_number   = lwindex_get_le32( p + 24 );
+    info->extradata_index = (int32_t)lwindex_get_le32( p + 28 );
+    info->length          = (int32_t)lwindex_get_le32( p + 32 );
+    info->sample_rate     = (int32_t)lwindex_get_le32( p + 36 );
+    info->keyframe        = p[40];
+}
+
+static void print_packet_record
+(
+    FILE                          *index,
+    const lwindex_packet_record_t *record
+)
+{
+    fprintf( index, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%"PRId64",PTS=%"PRId64",DTS=%"PRId64",EDI=%d\n",
+             record->stream_index, record->codec_type, record->codec_id,
+             record->time_base.num, record->time_base.den,
+             record->pos, record->pts, record->dts, record->extradata_index );
+    if( record->codec_type == AVMEDIA_TYPE_VIDEO )
+        fprintf( index, "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d,Width=%d,Height=%d,Format=%s,ColorSpace=%d\n",
+                 record->key, record->pict_type, record->poc, record->repeat_pict, record->field_info,
+                 record->width, record->height,
+                 av_get_pix_fmt_name( record->pix_fmt ) ? av_get_pix_fmt_name( record->pix_fmt ) : "none",
+                 record->colorspace );
+    else
+        fprintf( index, "Channels=%d:0x%"PRIx64",Rate=%d,Format=%s,BPS=%d,Length=%d\n",
+                 record->channels, record->channel_layout, record->sample_rate,
+                 av_get_sample_fmt_name( record->sample_fmt ) ? av_get_sample_fmt_name( record->sample_fmt ) : "none",
+                 record->bits_per_sample, record->frame_length );
+}
+
+/* Return 1 if the line in 'buf' is not the beginning of a packet record. */
+static int scan_packet_record
+(
+    FILE                    *index,
+    char                    *buf,
+    int                      buf_size,
+    lwindex_packet_record_t *record
+)
+{
+    memset( record, 0, sizeof(lwindex_packet_record_t) );
+    if( sscanf( buf, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%"SCNd64",PTS=%"SCNd64",DTS=%"SCNd64",EDI=%d",
+                &record->stream_index, &record->codec_type, &record->codec_id,
+                &record->time_base.num, &record->time_base.den,
+                &record->pos, &record->pts, &record->dts, &record->extradata_index ) != 9 )
+        return 1;
+    if( record->codec_type != AVMEDIA_TYPE_VIDEO && record->codec_type != AVMEDIA_TYPE_AUDIO )
+        return 0;
+    if( !fgets( buf, buf_size, index ) )
+        return -1;
+    if( record->codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        char pix_fmt[64];
+        int  colorspace;
+        if( sscanf( buf, "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d,Width=%d,Height=%d,Format=%[^,],ColorSpace=%d",
+                    &record->key, &record->pict_type, &record->poc, &record->repeat_pict, &record->field_info,
+                    &record->width, &record->height, pix_fmt, &colorspace ) != 9 )
+            return -1;
+        record->pix_fmt    = av_get_pix_fmt( (const char *)pix_fmt );
+        record->colorspace = (enum AVColorSpace)colorspace;
+    }
+    else
+    {
+        char sample_fmt[64];
+        if( sscanf( buf, "Channels=%d:0x%"SCNx64",Rate=%d,Format=%[^,],BPS=%d,Length=%d",
+                    &record->channels, &record->channel_layout, &record->sample_rate,
+                    sample_fmt, &record->bits_per_sample, &record->frame_length ) != 6 )
+            return -1;
+        record->sample_fmt = av_get_sample_fmt( (const char *)sample_fmt );
+    }
+    return 0;
+}
+
+static inline int scan_av_index_entry
+(
+    const char   *buf,
+    AVIndexEntry *ie
+)
+{
+    int size;
+    int flags;
+    if( sscanf( buf, "POS=%"SCNd64",TS=%"SCNd64",Flags=%x,Size=%d,Distance=%d",
+                &ie->pos, &ie->timestamp, &flags, &size, &ie->min_distance ) != 5 )
+        return -1;
+    ie->size  = size;
+    ie->flags = flags;
+    return 0;
+}
+
+/* Scan the header line in 'buf' and read the following extradata. */
+static int scan_extradata
+(
+    FILE                *index,
+    const char          *buf,
+    int                  codec_type,
+    lwlibav_extradata_t *entry
+)
+{
+    int codec_id;
+    if( codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        char pix_fmt[64];
+        if( sscanf( buf, "Size=%d,Codec=%d,4CC=0x%x,Width=%d,Height=%d,Format=%[^,],BPS=%d",
+                    &entry->extradata_size, &codec_id, &entry->codec_tag,
+                    &entry->width, &entry->height,
+                    pix_fmt, &entry->bits_per_sample ) != 7 )
+            return -1;
+        entry->pixel_format = av_get_pix_fmt( (const char *)pix_fmt );
+    }
+    else
+    {
+        char sample_fmt[64];
+        if( sscanf( buf, "Size=%d,Codec=%d,4CC=0x%x,Layout=0x%"SCNx64",Rate=%d,Format=%[^,],BPS=%d,Align=%d",
+                    &entry->extradata_size, &codec_id, &entry->codec_tag,
+                    &entry->channel_layout, &entry->sample_rate,
+                    sample_fmt, &entry->bits_per_sample, &entry->block_align ) != 8 )
+            return -1;
+        entry->sample_format = av_get_sample_fmt( (const char *)sample_fmt );
+    }
+    entry->codec_id = (enum AVCodecID)codec_id;
+    if( entry->extradata_size > 0 )
+    {
+        entry->extradata = (uint8_t *)av_malloc( entry->extradata_size + FF_INPUT_BUFFER_PADDING_SIZE );
+        if( !entry->extradata )
+            return -1;
+        if( fread( entry->extradata, 1, entry->extradata_size, index ) != entry->extradata_size )
+        {
+            av_freep( &entry->extradata );
+            return -1;
+        }
+        memset( entry->extradata + entry->extradata_size, 0, FF_INPUT_BUFFER_PADDING_SIZE );
+    }
+    return 0;
 }
 
 static inline void write_av_index_entry
@@ -1402,8 +2016,8 @@ static inline void write_av_index_entry
     AVIndexEntry *ie
 )
 {
-    print_index( index, "POS=%"PRId64",TS=%"PRId64",Flags=%x,Size=%d,Distance=%d\n",
-                 ie->pos, ie->timestamp, ie->flags, ie->size, ie->min_distance );
+    fprintf( index, "POS=%"PRId64",TS=%"PRId64",Flags=%x,Size=%d,Distance=%d\n",
+             ie->pos, ie->timestamp, ie->flags, ie->size, ie->min_distance );
 }
 
 static void write_video_extradata
@@ -1440,635 +2054,2718 @@ static void write_audio_extradata
     fprintf( index, "\n" );
 }
 
-static void disable_video_stream( lwlibav_video_decode_handler_t *vdhp )
+static void free_extradata_entries
+(
+    lwlibav_extradata_handler_t *exhp
+)
 {
-    if( vdhp->frame_list )
-        lw_freep( &vdhp->frame_list );
-    if( vdhp->keyframe_list )
-        lw_freep( &vdhp->keyframe_list );
-    if( vdhp->order_converter )
-        lw_freep( &vdhp->order_converter );
-    if( vdhp->index_entries )
-        av_freep( &vdhp->index_entries );
-    vdhp->stream_index        = -1;
-    vdhp->index_entries_count = 0;
-    vdhp->frame_count         = 0;
+    if( !exhp->entries )
+        return;
+    for( int i = 0; i < exhp->entry_count; i++ )
+        if( exhp->entries[i].extradata )
+            av_free( exhp->entries[i].extradata );
+    lw_freep( &exhp->entries );
+    exhp->entry_count = 0;
 }
 
-static void cleanup_index_helpers( AVFormatContext *format_ctx )
+static int append_to_index_buffer
+(
+    lwindex_buffer_t *buffer,
+    const void       *data,
+    size_t            size
+)
 {
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    if( buffer->size + size > buffer->capacity )
     {
-        lwindex_helper_t *helper = (lwindex_helper_t *)format_ctx->streams[stream_index]->codec->opaque;
-        if( !helper )
-            continue;
-        if( helper->parser_ctx )
-            av_parser_close( helper->parser_ctx );
-        if( helper->bsf )
-            av_bitstream_filter_close( helper->bsf );
-        if( helper->picture )
-            av_frame_free( &helper->picture );
-        if( helper->buffer )
-            av_free( helper->buffer );
-        lwlibav_extradata_handler_t *list = &helper->exh;
-        if( list->entries )
-        {
-            for( int i = 0; i < list->entry_count; i++ )
-                if( list->entries[i].extradata )
-                    av_free( list->entries[i].extradata );
-            free( list->entries );
-        }
-        /* Free an index helper. */
-        lw_freep( &format_ctx->streams[stream_index]->codec->opaque );
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while( capacity < buffer->size + size )
+            capacity <<= 1;
+        uint8_t *temp = (uint8_t *)realloc( buffer->data, capacity );
+        if( !temp )
+            return -1;
+        buffer->data     = temp;
+        buffer->capacity = capacity;
     }
+    if( size )
+        memcpy( buffer->data + buffer->size, data, size );
+    buffer->size += size;
+    return 0;
 }
 
-static void create_index
+static int open_index_writer
 (
-    lwlibav_file_handler_t         *lwhp,
-    lwlibav_video_decode_handler_t *vdhp,
-    lwlibav_video_output_handler_t *vohp,
-    lwlibav_audio_decode_handler_t *adhp,
-    lwlibav_audio_output_handler_t *aohp,
-    AVFormatContext                *format_ctx,
-    lwlibav_option_t               *opt,
-    progress_indicator_t           *indicator,
-    progress_handler_t             *php
+    lwindex_writer_t *writer,
+    const char       *path,
+    int               text
 )
 {
-    uint32_t video_info_count = 1 << 16;
-    uint32_t audio_info_count = 1 << 16;
-    video_frame_info_t *video_info = (video_frame_info_t *)lw_malloc_zero( video_info_count * sizeof(video_frame_info_t) );
-    if( !video_info )
-        return;
-    audio_frame_info_t *audio_info = (audio_frame_info_t *)lw_malloc_zero( audio_info_count * sizeof(audio_frame_info_t) );
-    if( !audio_info )
-    {
-        free( video_info );
-        return;
-    }
-    /*
-        # Structure of Libav reader index file
-        <LibavReaderIndexFile=12>
-        <InputFilePath>foobar.omo</InputFilePath>
-        <LibavReaderIndex=0x00000208,0,marumoska>
-        <ActiveVideoStreamIndex>+0000000000</ActiveVideoStreamIndex>
-        <ActiveAudioStreamIndex>-0000000001</ActiveAudioStreamIndex>
-        Index=0,Type=0,Codec=2,TimeBase=1001/24000,POS=0,PTS=2002,DTS=0,EDI=0
-        Key=1,Pic=1,POC=0,Repeat=1,Field=0,Width=1920,Height=1080,Format=yuv420p,ColorSpace=5
-        </LibavReaderIndex>
-        <StreamIndexEntries=0,0,1>
-        POS=0,TS=2002,Flags=1,Size=1024,Distance=0
-        </StreamIndexEntries>
-        <ExtraDataList=0,0,1>
-        Size=252,Codec=28,4CC=0x564d4448,Width=1920,Height=1080,Format=yuv420p,BPS=0
-        ... binary string ...
-        </ExtraDataList>
-        </LibavReaderIndexFile>
-     */
-    char index_path[512] = { 0 };
-    sprintf( index_path, "%s.lwi", lwhp->file_path );
-    FILE *index = !opt->no_create_index ? fopen( index_path, "wb" ) : NULL;
-    if( !index && !opt->no_create_index )
-    {
-        free( video_info );
-        free( audio_info );
-        return;
-    }
-    lwhp->format_name  = (char *)format_ctx->iformat->name;
-    lwhp->format_flags = format_ctx->iformat->flags;
-    lwhp->raw_demuxer  = !!format_ctx->iformat->raw_codec_id;
-    vdhp->format       = format_ctx;
-    adhp->format       = format_ctx;
-    adhp->dv_in_avi    = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
-    int32_t video_index_pos = 0;
-    int32_t audio_index_pos = 0;
-    if( index )
+    memset( writer, 0, sizeof(lwindex_writer_t) );
+    writer->text               = text;
+    writer->active_video_index = -1;
+    writer->active_audio_index = -1;
+    writer->video_resume_pos   = -1;
+    writer->audio_resume_pos   = -1;
+    if( !path )
+        return 0;   /* Don't create any index file. */
+    /* Write into a temporary file beside the destination and rename it when completed,
+     * so that other processes sharing the destination never see a partially written file. */
+    size_t path_length = strlen( path );
+    writer->path      = (char *)lw_malloc_zero( path_length + 1 );
+    writer->temp_path = (char *)lw_malloc_zero( path_length + 64 );
+    if( !writer->path || !writer->temp_path )
+        goto fail;
+    memcpy( writer->path, path, path_length );
+    sprintf( writer->temp_path, "%s.%u.%p.tmp", path, (unsigned int)lw_getpid(), (void *)writer );
+    writer->file = fopen( writer->temp_path, "wb" );
+    if( !writer->file )
+        goto fail;
+    if( !text )
     {
-        /* Write Index file header. */
-        fprintf( index, "<LibavReaderIndexFile=%d>\n", INDEX_FILE_VERSION );
-        fprintf( index, "<InputFilePath>%s</InputFilePath>\n", lwhp->file_path );
-        fprintf( index, "<LibavReaderIndex=0x%08x,%d,%s>\n", lwhp->format_flags, lwhp->raw_demuxer, lwhp->format_name );
-        video_index_pos = ftell( index );
-        fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", -1 );
-        audio_index_pos = ftell( index );
-        fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", -1 );
+        /* Reserve the header. This is filled when closing. */
+        uint8_t header[LWINDEX_HEADER_SIZE] = { 0 };
+        if( fwrite( header, 1, LWINDEX_HEADER_SIZE, writer->file ) != LWINDEX_HEADER_SIZE )
+            writer->error = 1;
     }
+    return 0;
+fail:
+    lw_freep( &writer->path );
+    lw_freep( &writer->temp_path );
+    return -1;
+}
+
+/* Replace the file at 'path' with the one at 'temp_path'. */
+static int rename_index_file
+(
+    const char *temp_path,
+    const char *path
+)
+{
+#ifdef _WIN32
+    return MoveFileExA( temp_path, path, MOVEFILE_REPLACE_EXISTING ) ? 0 : -1;
+#else
+    return rename( temp_path, path ) ? -1 : 0;
+#endif
+}
+
+static void begin_index_section
+(
+    lwindex_writer_t *writer,
+    uint32_t          tag,
+    uint32_t          record_size
+)
+{
+    static const uint8_t padding[8] = { 0 };
+    int64_t pos = lw_ftell( writer->file );
+    if( pos < 0 || writer->section_count >= LWINDEX_MAX_SECTIONS )
+    {
+        writer->error = 1;
+        return;
+    }
+    if( pos & 7 )
+    {
+        if( fwrite( padding, 1, 8 - (pos & 7), writer->file ) != 8 - (pos & 7) )
+            writer->error = 1;
+        pos += 8 - (pos & 7);
+    }
+    lwindex_section_t *section = &writer->section[ writer->section_count++ ];
+    section->tag         = tag;
+    section->record_size = record_size;
+    section->offset      = (uint64_t)pos;
+    section->count       = 0;
+}
+
+static inline uint32_t current_index_section
+(
+    lwindex_writer_t *writer
+)
+{
+    return writer->section_count > 0 ? writer->section[ writer->section_count - 1 ].tag : 0;
+}
+
+static void write_index_records
+(
+    lwindex_writer_t *writer,
+    const void       *data,
+    uint64_t          count
+)
+{
+    if( writer->section_count == 0 )
+    {
+        writer->error = 1;
+        return;
+    }
+    lwindex_section_t *section = &writer->section[ writer->section_count - 1 ];
+    if( count > 0 && fwrite( data, section->record_size, (size_t)count, writer->file ) != count )
+        writer->error = 1;
+    section->count += count;
+}
+
+static void write_index_array
+(
+    lwindex_writer_t *writer,
+    const void       *src,
+    size_t            src_size,
+    uint64_t          count,
+    void (*encode)( uint8_t *, const void * )
+)
+{
+    uint8_t        buf[LWINDEX_IO_BUFFER_SIZE];
+    uint32_t       record_size = writer->section[ writer->section_count - 1 ].record_size;
+    uint64_t       max_count   = sizeof(buf) / record_size;
+    const uint8_t *in          = (const uint8_t *)src;
+    while( count )
+    {
+        uint64_t n = MIN( count, max_count );
+        for( uint64_t i = 0; i < n; i++ )
+        {
+            encode( buf + i * record_size, in );
+            in += src_size;
+        }
+        write_index_records( writer, buf, n );
+        count -= n;
+    }
+}
+
+static void append_index_group
+(
+    lwindex_writer_t *writer,
+    int               kind,
+    int               stream_index,
+    int               codec_type,
+    int               count
+)
+{
+    uint8_t p[LWINDEX_GROUP_RECORD_SIZE];
+    lwindex_put_le32( p +  0, kind );
+    lwindex_put_le32( p +  4, stream_index );
+    lwindex_put_le32( p +  8, codec_type );
+    lwindex_put_le32( p + 12, count );
+    if( append_to_index_buffer( &writer->group, p, LWINDEX_GROUP_RECORD_SIZE ) < 0 )
+        writer->error = 1;
+}
+
+static void write_index_file_info
+(
+    lwindex_writer_t *writer,
+    const char       *file_path,
+    int               format_flags,
+    int               raw_demuxer,
+    const char       *format_name
+)
+{
+    if( !writer->file )
+        return;
+    if( writer->text )
+    {
+        fprintf( writer->file, "<LibavReaderIndexFile=%d>\n", INDEX_FILE_VERSION );
+        fprintf( writer->file, "<InputFilePath>%s</InputFilePath>\n", file_path );
+        fprintf( writer->file, "<LibavReaderIndex=0x%08x,%d,%s>\n", format_flags, raw_demuxer, format_name );
+        writer->active_index_pos = lw_ftell( writer->file );
+        fprintf( writer->file, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", writer->active_video_index );
+        fprintf( writer->file, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", writer->active_audio_index );
+        return;
+    }
+    uint32_t file_path_length   = strlen( file_path );
+    uint32_t format_name_length = strlen( format_name );
+    uint8_t  info[LWINDEX_INFO_SIZE];
+    lwindex_put_le32( info +  0, format_flags );
+    lwindex_put_le32( info +  4, raw_demuxer );
+    lwindex_put_le32( info +  8, file_path_length );
+    lwindex_put_le32( info + 12, format_name_length );
+    begin_index_section( writer, LWINDEX_SECTION_INFO, 1 );
+    write_index_records( writer, info, LWINDEX_INFO_SIZE );
+    write_index_records( writer, file_path, file_path_length );
+    write_index_records( writer, format_name, format_name_length );
+    /* Packet records follow. */
+    begin_index_section( writer, LWINDEX_SECTION_PKTS, LWINDEX_PACKET_RECORD_SIZE );
+}
+
+static void write_index_active_stream
+(
+    lwindex_writer_t *writer,
+    int               codec_type,
+    int               stream_index
+)
+{
+    if( codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        if( writer->active_video_index != stream_index )
+            writer->video_resume_pos = -1;
+        writer->active_video_index = stream_index;
+    }
+    else
+    {
+        if( writer->active_audio_index != stream_index )
+            writer->audio_resume_pos = -1;
+        writer->active_audio_index = stream_index;
+    }
+    if( !writer->file || !writer->text )
+        return;     /* The binary header is written when closing. */
+    int64_t current_pos = lw_ftell( writer->file );
+    lw_fseek( writer->file, writer->active_index_pos, SEEK_SET );
+    fprintf( writer->file, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", writer->active_video_index );
+    fprintf( writer->file, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", writer->active_audio_index );
+    lw_fseek( writer->file, current_pos, SEEK_SET );
+}
+
+static void write_index_packet
+(
+    lwindex_writer_t              *writer,
+    const lwindex_packet_record_t *record
+)
+{
+    if( !writer->file )
+        return;
+    if( writer->text )
+    {
+        print_packet_record( writer->file, record );
+        return;
+    }
+    /* Demuxing can be resumed from the last keyframe of the active video stream,
+     * or from the last packet of the active audio stream if no video. */
+    if( record->pos >= 0 )
+    {
+        if( record->codec_type == AVMEDIA_TYPE_VIDEO && record->stream_index == writer->active_video_index && record->key )
+        {
+            writer->video_resume_pos    = record->pos;
+            writer->video_resume_record = writer->packet_count;
+        }
+        else if( record->codec_type == AVMEDIA_TYPE_AUDIO && record->stream_index == writer->active_audio_index )
+        {
+            writer->audio_resume_pos    = record->pos;
+            writer->audio_resume_record = writer->packet_count;
+        }
+    }
+    ++ writer->packet_count;
+    uint8_t p[LWINDEX_PACKET_RECORD_SIZE];
+    encode_packet_record( p, record );
+    write_index_records( writer, p, 1 );
+}
+
+static void end_index_packets
+(
+    lwindex_writer_t *writer
+)
+{
+    if( !writer->file )
+        return;
+    if( writer->text )
+        fprintf( writer->file, "</LibavReaderIndex>\n" );
+    else
+        /* AVIndexEntry records follow. */
+        begin_index_section( writer, LWINDEX_SECTION_IDXE, LWINDEX_ENTRY_RECORD_SIZE );
+}
+
+static void write_index_entries
+(
+    lwindex_writer_t *writer,
+    int               stream_index,
+    int               codec_type,
+    AVIndexEntry     *entries,
+    int               count
+)
+{
+    if( !writer->file )
+        return;
+    if( writer->text )
+    {
+        fprintf( writer->file, "<StreamIndexEntries=%d,%d,%d>\n", stream_index, codec_type, count );
+        for( int i = 0; i < count; i++ )
+            write_av_index_entry( writer->file, &entries[i] );
+        fprintf( writer->file, "</StreamIndexEntries>\n" );
+        return;
+    }
+    if( current_index_section( writer ) != LWINDEX_SECTION_IDXE )
+    {
+        writer->error = 1;
+        return;
+    }
+    write_index_array( writer, entries, sizeof(AVIndexEntry), count, encode_index_entry_record );
+    append_index_group( writer, LWINDEX_GROUP_INDEX_ENTRIES, stream_index, codec_type, count );
+}
+
+static void write_index_extradata_list
+(
+    lwindex_writer_t    *writer,
+    int                  stream_index,
+    int                  codec_type,
+    lwlibav_extradata_t *entries,
+    int                  count
+)
+{
+    if( !writer->file )
+        return;
+    if( writer->text )
+    {
+        void (*write_av_extradata)( FILE *, lwlibav_extradata_t * ) = codec_type == AVMEDIA_TYPE_VIDEO
+                                                                    ? write_video_extradata
+                                                                    : write_audio_extradata;
+        fprintf( writer->file, "<ExtraDataList=%d,%d,%d>\n", stream_index, codec_type, count );
+        for( int i = 0; i < count; i++ )
+            write_av_extradata( writer->file, &entries[i] );
+        fprintf( writer->file, "</ExtraDataList>\n" );
+        return;
+    }
+    for( int i = 0; i < count; i++ )
+    {
+        lwlibav_extradata_t *entry = &entries[i];
+        uint8_t p[LWINDEX_EXTRADATA_RECORD_SIZE] = { 0 };
+        lwindex_put_le32( p +  0, entry->extradata_size );
+        lwindex_put_le32( p +  4, entry->codec_id );
+        lwindex_put_le32( p +  8, entry->codec_tag );
+        lwindex_put_le32( p + 12, entry->width );
+        lwindex_put_le32( p + 16, entry->height );
+        lwindex_put_le32( p + 20, entry->pixel_format );
+        lwindex_put_le64( p + 24, entry->channel_layout );
+        lwindex_put_le32( p + 32, entry->sample_rate );
+        lwindex_put_le32( p + 36, entry->sample_format );
+        lwindex_put_le32( p + 40, entry->bits_per_sample );
+        lwindex_put_le32( p + 44, entry->block_align );
+        lwindex_put_le64( p + 48, writer->blob.size );
+        if( append_to_index_buffer( &writer->extradata, p, LWINDEX_EXTRADATA_RECORD_SIZE ) < 0
+         || (entry->extradata_size > 0 && append_to_index_buffer( &writer->blob, entry->extradata, entry->extradata_size ) < 0) )
+            writer->error = 1;
+    }
+    append_index_group( writer, LWINDEX_GROUP_EXTRADATA, stream_index, codec_type, count );
+}
+
+static void write_index_video_tables
+(
+    lwindex_writer_t               *writer,
+    lwlibav_video_decode_handler_t *vdhp,
+    AVRational                      time_base
+)
+{
+    if( !writer->file || writer->text )
+        return;
+    uint8_t info[LWINDEX_VIDEO_INFO_SIZE] = { 0 };
+    lwindex_put_le32( info +  0, vdhp->stream_index );
+    lwindex_put_le32( info +  4, vdhp->codec_id );
+    lwindex_put_le32( info +  8, vdhp->lw_seek_flags );
+    lwindex_put_le32( info + 12, vdhp->frame_count );
+    lwindex_put_le32( info + 16, vdhp->initial_width );
+    lwindex_put_le32( info + 20, vdhp->initial_height );
+    lwindex_put_le32( info + 24, vdhp->max_width );
+    lwindex_put_le32( info + 28, vdhp->max_height );
+    lwindex_put_le32( info + 32, vdhp->initial_pix_fmt );
+    lwindex_put_le32( info + 36, vdhp->initial_colorspace );
+    lwindex_put_le32( info + 40, time_base.num );
+    lwindex_put_le32( info + 44, time_base.den );
+    lwindex_put_le32( info + 48, vdhp->exh.current_index );
+    lwindex_put_le32( info + 52, !!vdhp->order_converter );
+    begin_index_section( writer, LWINDEX_SECTION_VINF, LWINDEX_VIDEO_INFO_SIZE );
+    write_index_records( writer, info, 1 );
+    begin_index_section( writer, LWINDEX_SECTION_VFRM, LWINDEX_VIDEO_FRAME_RECORD_SIZE );
+    write_index_array( writer, &vdhp->frame_list[1], sizeof(video_frame_info_t), vdhp->frame_count, encode_video_frame_record );
+    begin_index_section( writer, LWINDEX_SECTION_VKEY, 1 );
+    write_index_records( writer, vdhp->keyframe_list, (uint64_t)vdhp->frame_count + 1 );
+    if( vdhp->order_converter )
+    {
+        begin_index_section( writer, LWINDEX_SECTION_VORD, 4 );
+        write_index_array( writer, vdhp->order_converter, sizeof(order_converter_t), (uint64_t)vdhp->frame_count + 1, encode_order_converter_record );
+    }
+}
+
+static void write_index_audio_tables
+(
+    lwindex_writer_t               *writer,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    AVRational                      time_base,
+    int                             sample_rate
+)
+{
+    if( !writer->file || writer->text )
+        return;
+    uint8_t info[LWINDEX_AUDIO_INFO_SIZE] = { 0 };
+    lwindex_put_le32( info +  0, adhp->stream_index );
+    lwindex_put_le32( info +  4, adhp->codec_id );
+    lwindex_put_le32( info +  8, adhp->lw_seek_flags );
+    lwindex_put_le32( info + 12, adhp->frame_count );
+    lwindex_put_le32( info + 16, adhp->frame_length );
+    lwindex_put_le32( info + 20, adhp->dv_in_avi );
+    lwindex_put_le32( info + 24, time_base.num );
+    lwindex_put_le32( info + 28, time_base.den );
+    lwindex_put_le32( info + 32, sample_rate );
+    lwindex_put_le32( info + 36, adhp->exh.current_index );
+    lwindex_put_le64( info + 40, aohp->output_channel_layout );
+    lwindex_put_le32( info + 48, aohp->output_sample_format );
+    lwindex_put_le32( info + 52, aohp->output_sample_rate );
+    lwindex_put_le32( info + 56, aohp->output_bits_per_sample );
+    begin_index_section( writer, LWINDEX_SECTION_AINF, LWINDEX_AUDIO_INFO_SIZE );
+    write_index_records( writer, info, 1 );
+    begin_index_section( writer, LWINDEX_SECTION_AFRM, LWINDEX_AUDIO_FRAME_RECORD_SIZE );
+    write_index_array( writer, &adhp->frame_list[1], sizeof(audio_frame_info_t), adhp->frame_count, encode_audio_frame_record );
+}
+
+/* Hash the head of the source and the bytes just before and at the resume point.
+ * Appending takes over the packet records described by these bytes, so they have to be unchanged in the grown source.
+ * Return 0 if succeeded, or -1 if failed to read. */
+static int hash_resume_point
+(
+    const char *file_path,
+    int64_t     source_size,
+    int64_t     resume_pos,
+    uint32_t   *hash
+)
+{
+    AVIOContext *pb = NULL;
+    if( avio_open( &pb, file_path, AVIO_FLAG_READ ) < 0 )
+        return -1;
+    int64_t range[2][2] =
+        {
+            { 0, MIN( LWINDEX_RESUME_CHECK_SIZE, source_size ) },
+            { MAX( LWINDEX_RESUME_CHECK_SIZE, resume_pos - LWINDEX_RESUME_CHECK_SIZE ), MIN( source_size, resume_pos + LWINDEX_RESUME_CHECK_SIZE ) }
+        };
+    uint8_t  buf[LWINDEX_IO_BUFFER_SIZE];
+    uint32_t value = 1;     /* the initial value of Adler-32 */
+    for( int i = 0; i < 2; i++ )
+    {
+        if( range[i][0] >= range[i][1] )
+            continue;
+        if( avio_seek( pb, range[i][0], SEEK_SET ) != range[i][0] )
+            goto fail;
+        for( int64_t remaining = range[i][1] - range[i][0]; remaining > 0; )
+        {
+            int size = avio_read( pb, buf, (int)MIN( remaining, (int64_t)sizeof(buf) ) );
+            if( size <= 0 )
+                goto fail;
+            value = av_adler32_update( value, buf, size );
+            remaining -= size;
+        }
+    }
+    avio_close( pb );
+    *hash = value;
+    return 0;
+fail:
+    avio_close( pb );
+    return -1;
+}
+
+/* 'finalized' is a combination of LWINDEX_FINALIZED* flags. */
+static int close_index_writer
+(
+    lwindex_writer_t *writer,
+    int               finalized
+)
+{
+    if( !writer->file )
+        return 0;
+    if( writer->text )
+        fprintf( writer->file, "</LibavReaderIndexFile>\n" );
+    else
+    {
+        int64_t  resume_pos    = writer->active_video_index >= 0 ? writer->video_resume_pos    : writer->audio_resume_pos;
+        uint64_t resume_record = writer->active_video_index >= 0 ? writer->video_resume_record : writer->audio_resume_record;
+        uint32_t resume_hash;
+        if( writer->source_size > 0 && resume_pos >= 0 && writer->source_path
+         && hash_resume_point( writer->source_path, writer->source_size, resume_pos, &resume_hash ) == 0 )
+        {
+            uint8_t info[LWINDEX_RESUME_INFO_SIZE] = { 0 };
+            lwindex_put_le64( info +  0, writer->source_size );
+            lwindex_put_le64( info +  8, resume_pos );
+            lwindex_put_le64( info + 16, resume_record );
+            lwindex_put_le32( info + 24, resume_hash );
+            begin_index_section( writer, LWINDEX_SECTION_RSUM, LWINDEX_RESUME_INFO_SIZE );
+            write_index_records( writer, info, 1 );
+        }
+        begin_index_section( writer, LWINDEX_SECTION_GRPS, LWINDEX_GROUP_RECORD_SIZE );
+        write_index_records( writer, writer->group.data, writer->group.size / LWINDEX_GROUP_RECORD_SIZE );
+        begin_index_section( writer, LWINDEX_SECTION_EXTD, LWINDEX_EXTRADATA_RECORD_SIZE );
+        write_index_records( writer, writer->extradata.data, writer->extradata.size / LWINDEX_EXTRADATA_RECORD_SIZE );
+        begin_index_section( writer, LWINDEX_SECTION_BLOB, 1 );
+        write_index_records( writer, writer->blob.data, writer->blob.size );
+        if( !writer->error )
+        {
+            /* Write the header at last so that any incomplete file is never regarded as a valid index. */
+            uint8_t header[LWINDEX_HEADER_SIZE] = { 0 };
+            memcpy( header, LWINDEX_BINARY_MAGIC, LWINDEX_MAGIC_SIZE );
+            lwindex_put_le32( header +  8, INDEX_FILE_VERSION );
+            lwindex_put_le32( header + 12, LWINDEX_HEADER_SIZE );
+            lwindex_put_le32( header + 16, LIBAVUTIL_VERSION_MAJOR );
+            lwindex_put_le32( header + 20, LIBAVCODEC_VERSION_MAJOR );
+            lwindex_put_le32( header + 24, writer->active_video_index );
+            lwindex_put_le32( header + 28, writer->active_audio_index );
+            lwindex_put_le32( header + 32, writer->active_video_index );
+            lwindex_put_le32( header + 36, writer->active_audio_index );
+            lwindex_put_le32( header + 40, finalized );
+            lwindex_put_le32( header + 44, writer->section_count );
+            for( int i = 0; i < writer->section_count; i++ )
+            {
+                uint8_t *p = header + 48 + i * 24;
+                lwindex_put_le32( p +  0, writer->section[i].tag );
+                lwindex_put_le32( p +  4, writer->section[i].record_size );
+                lwindex_put_le64( p +  8, writer->section[i].offset );
+                lwindex_put_le64( p + 16, writer->section[i].count );
+            }
+            if( lw_fseek( writer->file, 0, SEEK_SET )
+             || fwrite( header, 1, LWINDEX_HEADER_SIZE, writer->file ) != LWINDEX_HEADER_SIZE )
+                writer->error = 1;
+        }
+    }
+    if( fclose( writer->file ) )
+        writer->error = 1;
+    writer->file = NULL;
+    if( !writer->error && rename_index_file( writer->temp_path, writer->path ) < 0 )
+        writer->error = 1;
+    if( writer->error )
+        remove( writer->temp_path );
+    lw_freep( &writer->path );
+    lw_freep( &writer->temp_path );
+    lw_freep( &writer->group.data );
+    lw_freep( &writer->extradata.data );
+    lw_freep( &writer->blob.data );
+    return writer->error ? -1 : 0;
+}
+
+/* Index construction is pipelined over three kinds of threads.
+ *   - The demuxer thread reads packets and hands a duplicated packet to the worker of its stream.
+ *   - A worker thread per video/audio stream runs the parser and the decoder, which are the expensive
+ *     part of indexing, and stores the results into the job of the packet.
+ *     Each worker decodes with its own copy of the stream's AVCodecContext so that the demuxer,
+ *     which may update the stream's one while reading, never races with it.
+ *   - The calling thread consumes the jobs in the order the packets were read and does everything
+ *     depending on the preceding packets: active stream selection, frame info and index records.
+ * Since the jobs are consumed in reading order, the order of the index records is deterministic.
+ * The number of jobs in flight is bounded to limit the memory consumption. */
+#define LWINDEX_MAX_JOBS_IN_FLIGHT 256
+
+typedef struct lwindex_job_tag lwindex_job_t;
+
+struct lwindex_job_tag
+{
+    lwindex_job_t          *next;               /* the next job in reading order */
+    lwindex_job_t          *next_in_stream;     /* the next job in the same stream */
+    AVStream               *stream;
+    enum AVCodecID          codec_id;           /* of the decoder of the worker, which is never exposed to the reader */
+    AVPacket                pkt;
+    int                     done;
+    int                     error;
+    /* Video: the properties used for the active stream selection */
+    int                     select_width;
+    int                     select_height;
+    enum AVColorSpace       select_colorspace;
+    /* Audio: the decoder delay after this packet */
+    uint32_t                delay_count;
+    lwindex_packet_record_t record;
+};
+
+typedef struct lwindex_pipeline_tag lwindex_pipeline_t;
+
+typedef struct
+{
+    lwindex_pipeline_t *pipeline;
+    AVStream           *stream;
+    AVCodecContext     *ctx;
+    lwindex_helper_t   *helper;
+    AVFrame            *picture;    /* for investigating the pixel format */
+    int                 disabled;   /* The decoder is unavailable, and the stream is skipped. */
+    int                 running;
+    lwindex_job_t      *head;
+    lwindex_job_t      *tail;
+    lw_cond_t           cond;
+    lw_thread_t         thread;
+} lwindex_worker_t;
+
+struct lwindex_pipeline_tag
+{
+    lwlibav_file_handler_t *lwhp;
+    AVFormatContext        *format_ctx;
+    lw_mutex_t              mutex;
+    lw_cond_t               job_done;   /* A job is done or the demuxer has finished. */
+    lw_cond_t               job_freed;  /* A job is consumed or the pipeline is aborted. */
+    lwindex_job_t          *head;
+    lwindex_job_t          *tail;
+    int                     jobs_in_flight;
+    int                     eof;
+    int                     abort;
+    int                     error;
+    /* The followings are touched by the demuxer thread only until it is joined. */
+    lwindex_worker_t      **worker;     /* indexed by stream index */
+    int                     worker_count;
+    lwlibav_extradata_handler_t *initial_exh;       /* extradata lists to continue, indexed by stream index */
+    int                          initial_exh_count;
+    int                     running;
+    lw_thread_t             demuxer;
+};
+
+static int process_video_job
+(
+    lwindex_worker_t *worker,
+    lwindex_job_t    *job
+)
+{
+    AVStream         *stream  = worker->stream;
+    AVCodecContext   *pkt_ctx = worker->ctx;
+    lwindex_helper_t *helper  = worker->helper;
+    AVPacket         *pkt     = &job->pkt;
+    int extradata_index = append_extradata_if_new( helper, pkt_ctx, pkt );
+    if( extradata_index < 0 )
+        return -1;
+    if( pkt_ctx->pix_fmt == AV_PIX_FMT_NONE )
+        investigate_pix_fmt_by_decoding( pkt_ctx, pkt, worker->picture );
+    job->select_width      = pkt_ctx->width;
+    job->select_height     = pkt_ctx->height;
+    job->select_colorspace = pkt_ctx->colorspace;
+    /* Get picture type. */
+    int pict_type = get_picture_type( helper, pkt_ctx, pkt );
+    if( pict_type < 0 )
+        return -1;
+    /* Get Picture Order Count. */
+    int poc = helper->parser_ctx ? helper->parser_ctx->output_picture_number : 0;
+    /* Get field information. */
+    int             repeat_pict;
+    lw_field_info_t field_info;
+    if( helper->parser_ctx )
+    {
+        repeat_pict = pkt_ctx->ticks_per_frame == 2
+                    ? helper->parser_ctx->repeat_pict
+                    : 2 * helper->parser_ctx->repeat_pict + 1;
+        if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_TOP_FIELD )
+            field_info = LW_FIELD_INFO_TOP;
+        else if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_BOTTOM_FIELD )
+            field_info = LW_FIELD_INFO_BOTTOM;
+        else
+        {
+            if( helper->parser_ctx->field_order == AV_FIELD_TT
+             || helper->parser_ctx->field_order == AV_FIELD_TB )
+                field_info = LW_FIELD_INFO_TOP;
+            else if( helper->parser_ctx->field_order == AV_FIELD_BB
+                  || helper->parser_ctx->field_order == AV_FIELD_BT )
+                field_info = LW_FIELD_INFO_BOTTOM;
+            else
+                field_info = helper->last_field_info;
+        }
+        helper->last_field_info = field_info;
+    }
+    else
+    {
+        repeat_pict = 1;
+        field_info = helper->last_field_info;
+    }
+    /* Set width, height and pixel_format for the current extradata. */
+    lwlibav_extradata_handler_t *list = &helper->exh;
+    lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
+    if( entry->width < pkt_ctx->width )
+        entry->width = pkt_ctx->width;
+    if( entry->height < pkt_ctx->height )
+        entry->height = pkt_ctx->height;
+    if( entry->pixel_format == AV_PIX_FMT_NONE )
+        entry->pixel_format = pkt_ctx->pix_fmt;
+    if( entry->bits_per_sample == 0 )
+        entry->bits_per_sample = pkt_ctx->bits_per_coded_sample;
+    if( entry->codec_id == AV_CODEC_ID_NONE )
+        entry->codec_id = pkt_ctx->codec_id;
+    if( entry->codec_tag == 0 )
+        entry->codec_tag = pkt_ctx->codec_tag;
+    /* Make a video packet info for the index file. */
+    lwindex_packet_record_t *record = &job->record;
+    set_packet_record( record, pkt, stream, extradata_index );
+    record->key         = !!(pkt->flags & AV_PKT_FLAG_KEY);
+    record->pict_type   = pict_type;
+    record->poc         = poc;
+    record->repeat_pict = repeat_pict;
+    record->field_info  = field_info;
+    record->width       = pkt_ctx->width;
+    record->height      = pkt_ctx->height;
+    record->pix_fmt     = pkt_ctx->pix_fmt;
+    record->colorspace  = pkt_ctx->colorspace;
+    return 0;
+}
+
+static inline int get_audio_bits_per_sample
+(
+    AVCodecContext *ctx
+)
+{
+    return ctx->bits_per_raw_sample   > 0 ? ctx->bits_per_raw_sample
+         : ctx->bits_per_coded_sample > 0 ? ctx->bits_per_coded_sample
+         : av_get_bytes_per_sample( ctx->sample_fmt ) << 3;
+}
+
+static int process_audio_job
+(
+    lwindex_worker_t *worker,
+    lwindex_job_t    *job
+)
+{
+    AVStream         *stream  = worker->stream;
+    AVCodecContext   *pkt_ctx = worker->ctx;
+    lwindex_helper_t *helper  = worker->helper;
+    AVPacket         *pkt     = &job->pkt;
+    int extradata_index = append_extradata_if_new( helper, pkt_ctx, pkt );
+    if( extradata_index < 0 )
+        return -1;
+    int bits_per_sample = get_audio_bits_per_sample( pkt_ctx );
+    /* Get audio frame_length. */
+    int frame_length = get_audio_frame_length( helper, pkt_ctx, pkt );
+    job->delay_count = helper->delay_count;
+    if( pkt_ctx->channel_layout == 0 )
+        pkt_ctx->channel_layout = av_get_default_channel_layout( pkt_ctx->channels );
+    /* Set channel_layout, sample_rate, sample_format and bits_per_sample for the current extradata. */
+    lwlibav_extradata_handler_t *list = &helper->exh;
+    lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
+    if( entry->channel_layout == 0 )
+        entry->channel_layout = pkt_ctx->channel_layout;
+    if( entry->sample_rate == 0 )
+        entry->sample_rate = pkt_ctx->sample_rate;
+    if( entry->sample_format == AV_SAMPLE_FMT_NONE )
+        entry->sample_format = pkt_ctx->sample_fmt;
+    if( entry->bits_per_sample == 0 )
+        entry->bits_per_sample = bits_per_sample;
+    if( entry->block_align == 0 )
+        entry->block_align = pkt_ctx->block_align;
+    if( entry->codec_id == AV_CODEC_ID_NONE )
+        entry->codec_id = pkt_ctx->codec_id;
+    if( entry->codec_tag == 0 )
+        entry->codec_tag = pkt_ctx->codec_tag;
+    /* Make an audio packet info for the index file. */
+    lwindex_packet_record_t *record = &job->record;
+    set_packet_record( record, pkt, stream, extradata_index );
+    record->channels        = pkt_ctx->channels;
+    record->channel_layout  = pkt_ctx->channel_layout;
+    record->sample_rate     = pkt_ctx->sample_rate;
+    record->sample_fmt      = pkt_ctx->sample_fmt;
+    record->bits_per_sample = bits_per_sample;
+    record->frame_length    = frame_length;
+    return 0;
+}
+
+static void *index_worker_main( void *arg )
+{
+    lwindex_worker_t   *worker   = (lwindex_worker_t *)arg;
+    lwindex_pipeline_t *pipeline = worker->pipeline;
+    int (*process_job)( lwindex_worker_t *, lwindex_job_t * )
+        = worker->ctx->codec_type == AVMEDIA_TYPE_VIDEO ? process_video_job : process_audio_job;
+    lw_mutex_lock( &pipeline->mutex );
+    while( 1 )
+    {
+        while( !worker->head && !pipeline->eof && !pipeline->abort )
+            lw_cond_wait( &worker->cond, &pipeline->mutex );
+        lwindex_job_t *job = worker->head;
+        if( !job )
+            break;
+        worker->head = job->next_in_stream;
+        if( !worker->head )
+            worker->tail = NULL;
+        /* Jobs left at abort are just marked as done. */
+        int abort = pipeline->abort;
+        lw_mutex_unlock( &pipeline->mutex );
+        if( !abort )
+            job->error = process_job( worker, job ) < 0;
+        lw_mutex_lock( &pipeline->mutex );
+        job->done = 1;
+        lw_cond_broadcast( &pipeline->job_done );
+    }
+    lw_mutex_unlock( &pipeline->mutex );
+    return NULL;
+}
+
+static void close_index_worker
+(
+    lwindex_worker_t *worker
+)
+{
+    if( worker->running )
+    {
+        lw_thread_join( &worker->thread );
+        lw_cond_destroy( &worker->cond );
+    }
+    if( worker->picture )
+        av_frame_free( &worker->picture );
+    if( worker->ctx )
+        close_stream_decoder( &worker->ctx );
+    free( worker );
+}
+
+/* Return NULL on fatal error. */
+static lwindex_worker_t *get_index_worker
+(
+    lwindex_pipeline_t *pipeline,
+    AVStream           *stream
+)
+{
+    if( stream->index >= pipeline->worker_count )
+    {
+        int worker_count = stream->index + 1;
+        lwindex_worker_t **temp = (lwindex_worker_t **)realloc( pipeline->worker, worker_count * sizeof(lwindex_worker_t *) );
+        if( !temp )
+            return NULL;
+        for( int i = pipeline->worker_count; i < worker_count; i++ )
+            temp[i] = NULL;
+        pipeline->worker       = temp;
+        pipeline->worker_count = worker_count;
+    }
+    if( pipeline->worker[ stream->index ] )
+        return pipeline->worker[ stream->index ];
+    lwindex_worker_t *worker = (lwindex_worker_t *)lw_malloc_zero( sizeof(lwindex_worker_t) );
+    if( !worker )
+        return NULL;
+    pipeline->worker[ stream->index ] = worker;
+    worker->pipeline = pipeline;
+    worker->stream   = stream;
+    worker->ctx      = avcodec_alloc_context3( NULL );
+    if( !worker->ctx )
+        return NULL;
+    if( avcodec_copy_context( worker->ctx, stream->codec ) < 0
+     || open_decoder( worker->ctx, worker->ctx->codec_id, pipeline->lwhp->threads ) )
+    {
+        worker->disabled = 1;
+        return worker;
+    }
+    /* The index helper is shared with the stream to hand the extradata list over after indexing. */
+    worker->helper = get_index_helper( pipeline->lwhp->format_name, worker->ctx, stream );
+    stream->codec->opaque = worker->ctx->opaque;
+    if( !worker->helper )
+        return NULL;
+    if( stream->index < pipeline->initial_exh_count && pipeline->initial_exh[ stream->index ].entry_count > 0 )
+    {
+        /* Continue the extradata list so that the extradata indexes of the preceding packets stay valid. */
+        worker->helper->exh = pipeline->initial_exh[ stream->index ];
+        memset( &pipeline->initial_exh[ stream->index ], 0, sizeof(lwlibav_extradata_handler_t) );
+    }
+    if( worker->ctx->codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        worker->picture = av_frame_alloc();
+        if( !worker->picture )
+            return NULL;
+    }
+    if( lw_cond_init( &worker->cond ) < 0 )
+        return NULL;
+    if( lw_thread_create( &worker->thread, index_worker_main, worker ) < 0 )
+    {
+        lw_cond_destroy( &worker->cond );
+        return NULL;
+    }
+    worker->running = 1;
+    return worker;
+}
+
+static void *index_demuxer_main( void *arg )
+{
+    lwindex_pipeline_t *pipeline   = (lwindex_pipeline_t *)arg;
+    AVFormatContext    *format_ctx = pipeline->format_ctx;
     AVPacket pkt = { 0 };
     av_init_packet( &pkt );
+    int error = 0;
+    while( 1 )
+    {
+        lw_mutex_lock( &pipeline->mutex );
+        while( pipeline->jobs_in_flight >= LWINDEX_MAX_JOBS_IN_FLIGHT && !pipeline->abort )
+            lw_cond_wait( &pipeline->job_freed, &pipeline->mutex );
+        int abort = pipeline->abort;
+        lw_mutex_unlock( &pipeline->mutex );
+        if( abort || read_av_frame( format_ctx, &pkt ) < 0 )
+            break;
+        AVStream       *stream  = format_ctx->streams[ pkt.stream_index ];
+        AVCodecContext *pkt_ctx = stream->codec;
+        if( (pkt_ctx->codec_type != AVMEDIA_TYPE_VIDEO && pkt_ctx->codec_type != AVMEDIA_TYPE_AUDIO)
+         || pkt_ctx->codec_id == AV_CODEC_ID_NONE )
+        {
+            av_free_packet( &pkt );
+            continue;
+        }
+        lwindex_worker_t *worker = get_index_worker( pipeline, stream );
+        if( worker && worker->disabled )
+        {
+            av_free_packet( &pkt );
+            continue;
+        }
+        lwindex_job_t *job = worker ? (lwindex_job_t *)lw_malloc_zero( sizeof(lwindex_job_t) ) : NULL;
+        if( !job || av_dup_packet( &pkt ) < 0 )
+        {
+            free( job );
+            av_free_packet( &pkt );
+            error = 1;
+            break;
+        }
+        /* The job takes the ownership of the packet data. */
+        job->stream   = stream;
+        job->codec_id = worker->ctx->codec_id;
+        job->pkt    = pkt;
+        av_init_packet( &pkt );
+        pkt.data = NULL;
+        pkt.size = 0;
+        lw_mutex_lock( &pipeline->mutex );
+        if( pipeline->tail )
+            pipeline->tail->next = job;
+        else
+            pipeline->head = job;
+        pipeline->tail = job;
+        if( worker->tail )
+            worker->tail->next_in_stream = job;
+        else
+            worker->head = job;
+        worker->tail = job;
+        ++ pipeline->jobs_in_flight;
+        lw_cond_signal( &worker->cond );
+        lw_mutex_unlock( &pipeline->mutex );
+    }
+    lw_mutex_lock( &pipeline->mutex );
+    pipeline->eof    = 1;
+    pipeline->error |= error;
+    for( int i = 0; i < pipeline->worker_count; i++ )
+        if( pipeline->worker[i] && pipeline->worker[i]->running )
+            lw_cond_signal( &pipeline->worker[i]->cond );
+    lw_cond_broadcast( &pipeline->job_done );
+    lw_mutex_unlock( &pipeline->mutex );
+    return NULL;
+}
+
+/* If 'initial_exh' is given, the extradata list of each stream is taken over by the worker of the stream. */
+static int start_index_pipeline
+(
+    lwindex_pipeline_t          *pipeline,
+    lwlibav_file_handler_t      *lwhp,
+    AVFormatContext             *format_ctx,
+    lwlibav_extradata_handler_t *initial_exh,
+    int                          initial_exh_count
+)
+{
+    memset( pipeline, 0, sizeof(lwindex_pipeline_t) );
+    pipeline->lwhp              = lwhp;
+    pipeline->format_ctx        = format_ctx;
+    pipeline->initial_exh       = initial_exh;
+    pipeline->initial_exh_count = initial_exh_count;
+    if( lw_mutex_init( &pipeline->mutex ) < 0 )
+        return -1;
+    if( lw_cond_init( &pipeline->job_done ) < 0 )
+    {
+        lw_mutex_destroy( &pipeline->mutex );
+        return -1;
+    }
+    if( lw_cond_init( &pipeline->job_freed ) < 0 )
+    {
+        lw_cond_destroy( &pipeline->job_done );
+        lw_mutex_destroy( &pipeline->mutex );
+        return -1;
+    }
+    if( lw_thread_create( &pipeline->demuxer, index_demuxer_main, pipeline ) < 0 )
+    {
+        lw_cond_destroy( &pipeline->job_freed );
+        lw_cond_destroy( &pipeline->job_done );
+        lw_mutex_destroy( &pipeline->mutex );
+        return -1;
+    }
+    pipeline->running = 1;
+    return 0;
+}
+
+/* Wait for the oldest job to be done and return it.
+ * Return NULL if no more jobs or the demuxer failed. */
+static lwindex_job_t *get_index_job
+(
+    lwindex_pipeline_t *pipeline
+)
+{
+    lw_mutex_lock( &pipeline->mutex );
+    while( !pipeline->error && !(pipeline->head && pipeline->head->done) && !(!pipeline->head && pipeline->eof) )
+        lw_cond_wait( &pipeline->job_done, &pipeline->mutex );
+    lwindex_job_t *job = pipeline->error ? NULL : pipeline->head;
+    if( job )
+    {
+        pipeline->head = job->next;
+        if( !pipeline->head )
+            pipeline->tail = NULL;
+    }
+    lw_mutex_unlock( &pipeline->mutex );
+    return job;
+}
+
+static void release_index_job
+(
+    lwindex_pipeline_t *pipeline,
+    lwindex_job_t      *job
+)
+{
+    av_free_packet( &job->pkt );
+    free( job );
+    lw_mutex_lock( &pipeline->mutex );
+    -- pipeline->jobs_in_flight;
+    lw_cond_signal( &pipeline->job_freed );
+    lw_mutex_unlock( &pipeline->mutex );
+}
+
+/* Stop and join all threads of the pipeline.
+ * Jobs not consumed yet are discarded.
+ * The decoders of the workers are still available until close_index_pipeline(). */
+static void stop_index_pipeline
+(
+    lwindex_pipeline_t *pipeline
+)
+{
+    if( !pipeline->running )
+        return;
+    lw_mutex_lock( &pipeline->mutex );
+    pipeline->abort = 1;
+    lw_cond_broadcast( &pipeline->job_freed );
+    lw_mutex_unlock( &pipeline->mutex );
+    lw_thread_join( &pipeline->demuxer );
+    /* Now, the demuxer has woken all workers up with eof set. */
+    for( int i = 0; i < pipeline->worker_count; i++ )
+    {
+        lwindex_worker_t *worker = pipeline->worker[i];
+        if( worker && worker->running )
+        {
+            lw_thread_join( &worker->thread );
+            lw_cond_destroy( &worker->cond );
+            worker->running = 0;
+        }
+    }
+    while( pipeline->head )
+    {
+        lwindex_job_t *job = pipeline->head;
+        pipeline->head = job->next;
+        av_free_packet( &job->pkt );
+        free( job );
+    }
+    pipeline->tail = NULL;
+    lw_cond_destroy( &pipeline->job_freed );
+    lw_cond_destroy( &pipeline->job_done );
+    lw_mutex_destroy( &pipeline->mutex );
+    pipeline->running = 0;
+}
+
+static void close_index_pipeline
+(
+    lwindex_pipeline_t *pipeline
+)
+{
+    stop_index_pipeline( pipeline );
+    for( int i = 0; i < pipeline->worker_count; i++ )
+        if( pipeline->worker[i] )
+            close_index_worker( pipeline->worker[i] );
+    free( pipeline->worker );
+    pipeline->worker       = NULL;
+    pipeline->worker_count = 0;
+}
+
+/* Flush a frame delayed by the audio decoder of the worker and make the packet info of it for the index file.
+ * Return -1 if decoding failed. */
+static int drain_index_audio_frame
+(
+    lwindex_worker_t        *worker,
+    lwindex_packet_record_t *record
+)
+{
+    AVStream         *stream  = worker->stream;
+    AVCodecContext   *pkt_ctx = worker->ctx;
+    lwindex_helper_t *helper  = worker->helper;
+    AVPacket null_pkt = { 0 };
+    av_init_packet( &null_pkt );
+    null_pkt.data = NULL;
+    null_pkt.size = 0;
+    int decode_complete;
+    if( helper->decode( pkt_ctx, helper->picture, &decode_complete, &null_pkt ) < 0 )
+        return -1;
+    memset( record, 0, sizeof(lwindex_packet_record_t) );
+    record->stream_index    = stream->index;
+    record->codec_type      = AVMEDIA_TYPE_AUDIO;
+    record->codec_id        = pkt_ctx->codec_id;
+    record->time_base       = stream->time_base;
+    record->pos             = -1;
+    record->pts             = AV_NOPTS_VALUE;
+    record->dts             = AV_NOPTS_VALUE;
+    record->extradata_index = -1;
+    record->sample_fmt      = AV_SAMPLE_FMT_NONE;
+    record->frame_length    = decode_complete ? helper->picture->nb_samples : 0;
+    return 0;
+}
+
+static void disable_video_stream( lwlibav_video_decode_handler_t *vdhp )
+{
+    if( vdhp->frame_list )
+        lw_freep( &vdhp->frame_list );
+    if( vdhp->keyframe_list )
+        lw_freep( &vdhp->keyframe_list );
+    if( vdhp->rap_list )
+        lw_freep( &vdhp->rap_list );
+    if( vdhp->order_converter )
+        lw_freep( &vdhp->order_converter );
+    if( vdhp->index_entries )
+        av_freep( &vdhp->index_entries );
+    vdhp->stream_index        = -1;
+    vdhp->index_entries_count = 0;
+    vdhp->frame_count         = 0;
+}
+
+static void cleanup_index_helpers( AVFormatContext *format_ctx )
+{
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        lwindex_helper_t *helper = (lwindex_helper_t *)format_ctx->streams[stream_index]->codec->opaque;
+        if( !helper )
+            continue;
+        if( helper->parser_ctx )
+            av_parser_close( helper->parser_ctx );
+        if( helper->bsf )
+            av_bitstream_filter_close( helper->bsf );
+        if( helper->picture )
+            av_frame_free( &helper->picture );
+        if( helper->buffer )
+            av_free( helper->buffer );
+        lwlibav_extradata_handler_t *list = &helper->exh;
+        if( list->entries )
+        {
+            for( int i = 0; i < list->entry_count; i++ )
+                if( list->entries[i].extradata )
+                    av_free( list->entries[i].extradata );
+            free( list->entries );
+        }
+        /* Free an index helper. */
+        lw_freep( &format_ctx->streams[stream_index]->codec->opaque );
+    }
+}
+
+/* Frame info tables under construction are stored in fixed size slabs.
+ * Existing entries never move while appending, so there is neither the reallocation copy
+ * nor the over-allocation of a doubling array. The slabs are merged into the final contiguous
+ * frame list only once, after the number of frames is known. */
+#define LWINDEX_FRAME_TABLE_SLAB_SHIFT 16
+#define LWINDEX_FRAME_TABLE_SLAB_SIZE  (1 << LWINDEX_FRAME_TABLE_SLAB_SHIFT)
+
+typedef struct
+{
+    size_t    entry_size;
+    uint32_t  slab_count;
+    uint32_t  slab_capacity;
+    uint8_t **slabs;
+} lwindex_frame_table_t;
+
+static void init_frame_table
+(
+    lwindex_frame_table_t *table,
+    size_t                 entry_size
+)
+{
+    memset( table, 0, sizeof(lwindex_frame_table_t) );
+    table->entry_size = entry_size;
+}
+
+static void release_frame_table
+(
+    lwindex_frame_table_t *table
+)
+{
+    for( uint32_t i = 0; i < table->slab_count; i++ )
+        free( table->slabs[i] );
+    lw_freep( &table->slabs );
+    table->slab_count    = 0;
+    table->slab_capacity = 0;
+}
+
+/* Return the entry of the given index. Slabs are allocated with zero-initialized entries on demand.
+ * Return NULL if allocation failed. */
+static void *get_frame_table_entry
+(
+    lwindex_frame_table_t *table,
+    uint32_t               index
+)
+{
+    uint32_t slab_index = index >> LWINDEX_FRAME_TABLE_SLAB_SHIFT;
+    if( slab_index >= table->slab_capacity )
+    {
+        uint32_t  capacity = MAX( slab_index + 1, table->slab_capacity * 2 );
+        uint8_t **slabs    = (uint8_t **)realloc( table->slabs, capacity * sizeof(uint8_t *) );
+        if( !slabs )
+            return NULL;
+        table->slabs         = slabs;
+        table->slab_capacity = capacity;
+    }
+    while( table->slab_count <= slab_index )
+    {
+        uint8_t *slab = (uint8_t *)lw_malloc_zero( LWINDEX_FRAME_TABLE_SLAB_SIZE * table->entry_size );
+        if( !slab )
+            return NULL;
+        table->slabs[ table->slab_count ++ ] = slab;
+    }
+    return table->slabs[slab_index] + (index & (LWINDEX_FRAME_TABLE_SLAB_SIZE - 1)) * table->entry_size;
+}
+
+/* Move the entries [0, count] into a contiguous array and release the table.
+ * An extra zeroed entry is placed at the end in the same way as the growing arrays did. */
+static void *flatten_frame_table
+(
+    lwindex_frame_table_t *table,
+    uint32_t               count
+)
+{
+    uint8_t *list = (uint8_t *)lw_malloc_zero( ((size_t)count + 2) * table->entry_size );
+    if( !list )
+        return NULL;
+    size_t remaining = ((size_t)count + 1) * table->entry_size;
+    size_t slab_size = LWINDEX_FRAME_TABLE_SLAB_SIZE * table->entry_size;
+    for( uint32_t i = 0; i < table->slab_count; i++ )
+    {
+        if( remaining > 0 )
+        {
+            size_t size = MIN( remaining, slab_size );
+            memcpy( list + i * slab_size, table->slabs[i], size );
+            remaining -= size;
+        }
+        /* Release each slab as soon as it is copied to keep the peak memory usage low. */
+        lw_freep( &table->slabs[i] );
+    }
+    release_frame_table( table );
+    return list;
+}
+
+/* Set the length of an audio frame in the table.
+ * Return 1 if the length differs from the one of the previous frame, otherwise 0. */
+static int set_audio_frame_length
+(
+    lwindex_frame_table_t *table,
+    uint32_t               frame_number,
+    int                    length
+)
+{
+    audio_frame_info_t *info = (audio_frame_info_t *)get_frame_table_entry( table, frame_number );
+    if( !info )
+        return 0;
+    info->length = length;
+    if( frame_number <= 1 )
+        return 0;
+    audio_frame_info_t *prev = (audio_frame_info_t *)get_frame_table_entry( table, frame_number - 1 );
+    return prev && prev->length != length;
+}
+
+/* The index file can be extended from the resume point only if demuxing can restart at any byte position
+ * with no header, as in MPEG-2 TS/PS and raw streams. */
+static int is_index_appendable
+(
+    AVFormatContext *format_ctx
+)
+{
+    const AVInputFormat *iformat = format_ctx->iformat;
+    if( iformat->flags & AVFMT_NO_BYTE_SEEK )
+        return 0;
+    return iformat->raw_codec_id
+        || !strcmp( iformat->name, "mpegts" )
+        || !strcmp( iformat->name, "mpegtsraw" )
+        || !strcmp( iformat->name, "mpeg" );
+}
+
+static void create_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    AVFormatContext                *format_ctx,
+    lwlibav_option_t               *opt,
+    const char                     *index_path,
+    progress_indicator_t           *indicator,
+    progress_handler_t             *php
+)
+{
+    lwindex_frame_table_t video_table;
+    lwindex_frame_table_t audio_table;
+    init_frame_table( &video_table, sizeof(video_frame_info_t) );
+    init_frame_table( &audio_table, sizeof(audio_frame_info_t) );
+    video_frame_info_t *video_info = NULL;
+    audio_frame_info_t *audio_info = NULL;
+    lwindex_writer_t writer;
+    if( open_index_writer( &writer, !opt->no_create_index ? index_path : NULL, 0 ) < 0 )
+        return;
+    lwhp->format_name  = (char *)format_ctx->iformat->name;
+    lwhp->format_flags = format_ctx->iformat->flags;
+    lwhp->raw_demuxer  = !!format_ctx->iformat->raw_codec_id;
+    vdhp->format       = format_ctx;
+    adhp->format       = format_ctx;
+    adhp->dv_in_avi    = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
+    /* Write Index file header. */
+    write_index_file_info( &writer, lwhp->file_path, lwhp->format_flags, lwhp->raw_demuxer, lwhp->format_name );
     int       video_resolution      = 0;
     int       is_attached_pic       = 0;
     uint32_t  video_sample_count    = 0;
     int64_t   last_keyframe_pts     = AV_NOPTS_VALUE;
+    enum AVPixelFormat video_pix_fmt = AV_PIX_FMT_NONE;
     uint32_t  audio_sample_count    = 0;
     int       audio_sample_rate     = 0;
     int       constant_frame_length = 1;
     uint64_t  audio_duration        = 0;
     int64_t   first_dts             = AV_NOPTS_VALUE;
     int64_t   filesize              = avio_size( format_ctx->pb );
+    /* Record the size of the source to append the packets to the index file later when the source grows. */
+    if( is_index_appendable( format_ctx ) )
+    {
+        writer.source_path = lwhp->file_path;
+        writer.source_size = filesize;
+    }
     if( indicator->open )
         indicator->open( php );
     /* Start to read frames and write the index file. */
-    while( read_av_frame( format_ctx, &pkt ) >= 0 )
+    lwindex_pipeline_t pipeline;
+    if( start_index_pipeline( &pipeline, lwhp, format_ctx, NULL, 0 ) < 0 )
+        goto fail_index;
+    while( 1 )
     {
-        AVStream       *stream  = format_ctx->streams[ pkt.stream_index ];
-        AVCodecContext *pkt_ctx = stream->codec;
-        if( pkt_ctx->codec_type != AVMEDIA_TYPE_VIDEO
-         && pkt_ctx->codec_type != AVMEDIA_TYPE_AUDIO )
-            continue;
-        if( pkt_ctx->codec_id == AV_CODEC_ID_NONE )
-            continue;
-        if( !av_codec_is_decoder( pkt_ctx->codec ) && open_decoder( pkt_ctx, pkt_ctx->codec_id, lwhp->threads ) )
-            continue;
-        lwindex_helper_t *helper = get_index_helper( lwhp->format_name, pkt_ctx, stream );
-        if( !helper )
+        lwindex_job_t *job = get_index_job( &pipeline );
+        if( !job )
         {
-            av_free_packet( &pkt );
+            if( pipeline.error )
+                goto fail_index;
+            break;
+        }
+        if( job->error )
+        {
+            release_index_job( &pipeline, job );
             goto fail_index;
         }
-        int extradata_index = append_extradata_if_new( helper, pkt_ctx, &pkt );
-        if( extradata_index < 0 )
+        AVStream                *stream = job->stream;
+        AVPacket                *pkt    = &job->pkt;
+        lwindex_packet_record_t *record = &job->record;
+        if( record->codec_type == AVMEDIA_TYPE_VIDEO )
         {
-            av_free_packet( &pkt );
+            int dv_in_avi_init = 0;
+            if( adhp->dv_in_avi    == -1
+             && vdhp->stream_index == -1
+             && record->codec_id   == AV_CODEC_ID_DVVIDEO
+             && opt->force_audio   == 0 )
+            {
+                dv_in_avi_init     = 1;
+                adhp->dv_in_avi    = 1;
+                vdhp->stream_index = pkt->stream_index;
+            }
+            /* Replace lower resolution stream with higher. Override attached picture. */
+            int higher_priority = ((job->select_width * job->select_height > video_resolution)
+                                || (is_attached_pic && !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)));
+            if( dv_in_avi_init
+             || (!opt->force_video && (vdhp->stream_index == -1 || (pkt->stream_index != vdhp->stream_index && higher_priority)))
+             || (opt->force_video && vdhp->stream_index == -1 && pkt->stream_index == opt->force_video_index) )
+            {
+                /* Update active video stream. */
+                write_index_active_stream( &writer, AVMEDIA_TYPE_VIDEO, pkt->stream_index );
+                release_frame_table( &video_table );
+                vdhp->codec_id           = job->codec_id;
+                vdhp->stream_index       = pkt->stream_index;
+                video_resolution         = job->select_width * job->select_height;
+                is_attached_pic          = !!(stream->disposition & AV_DISPOSITION_ATTACHED_PIC);
+                video_sample_count       = 0;
+                last_keyframe_pts        = AV_NOPTS_VALUE;
+                vdhp->max_width          = job->select_width;
+                vdhp->max_height         = job->select_height;
+                vdhp->initial_width      = job->select_width;
+                vdhp->initial_height     = job->select_height;
+                vdhp->initial_colorspace = job->select_colorspace;
+            }
+            /* Set video frame info if this stream is active. */
+            if( pkt->stream_index == vdhp->stream_index )
+            {
+                video_frame_info_t *info = (video_frame_info_t *)get_frame_table_entry( &video_table, ++video_sample_count );
+                if( !info )
+                {
+                    release_index_job( &pipeline, job );
+                    goto fail_index;
+                }
+                info->pts             = pkt->pts;
+                info->dts             = pkt->dts;
+                info->file_offset     = pkt->pos;
+                info->sample_number   = video_sample_count;
+                info->extradata_index = record->extradata_index;
+                info->pict_type       = record->pict_type;
+                info->poc             = record->poc;
+                info->repeat_pict     = record->repeat_pict;
+                info->field_info      = (lw_field_info_t)record->field_info;
+                if( pkt->pts != AV_NOPTS_VALUE && last_keyframe_pts != AV_NOPTS_VALUE && pkt->pts < last_keyframe_pts )
+                    info->flags |= LW_VFRAME_FLAG_LEADING;
+                if( record->key )
+                {
+                    /* For the present, treat this frame as a keyframe. */
+                    info->flags |= LW_VFRAME_FLAG_KEY;
+                    last_keyframe_pts = pkt->pts;
+                }
+                if( record->repeat_pict == 0 && record->field_info == LW_FIELD_INFO_UNKNOWN && record->pix_fmt == AV_PIX_FMT_NONE
+                 && (record->codec_id == AV_CODEC_ID_H264 || record->codec_id == AV_CODEC_ID_HEVC)
+                 && (record->width == 0 || record->height == 0) )
+                    info->flags |= LW_VFRAME_FLAG_CORRUPT;
+                /* The pixel format of the decoder after the last packet becomes the initial one. */
+                video_pix_fmt = record->pix_fmt;
+                /* Set maximum resolution. */
+                if( vdhp->max_width  < record->width )
+                    vdhp->max_width  = record->width;
+                if( vdhp->max_height < record->height )
+                    vdhp->max_height = record->height;
+            }
+            /* Write a video packet info to the index file. */
+            write_index_packet( &writer, record );
+        }
+        else
+        {
+            if( adhp->stream_index == -1 && (!opt->force_audio || (opt->force_audio && pkt->stream_index == opt->force_audio_index)) )
+            {
+                /* Update active audio stream. */
+                write_index_active_stream( &writer, AVMEDIA_TYPE_AUDIO, pkt->stream_index );
+                adhp->codec_id     = job->codec_id;
+                adhp->stream_index = pkt->stream_index;
+            }
+            /* Set audio frame info if this stream is active. */
+            if( pkt->stream_index == adhp->stream_index )
+            {
+                int frame_length = record->frame_length;
+                if( frame_length != -1 )
+                    audio_duration += frame_length;
+                if( audio_duration <= INT32_MAX )
+                {
+                    /* Set up audio frame info. */
+                    audio_frame_info_t *info = (audio_frame_info_t *)get_frame_table_entry( &audio_table, ++audio_sample_count );
+                    if( !info )
+                    {
+                        release_index_job( &pipeline, job );
+                        goto fail_index;
+                    }
+                    info->pts             = pkt->pts;
+                    info->dts             = pkt->dts;
+                    info->file_offset     = pkt->pos;
+                    info->sample_number   = audio_sample_count;
+                    info->extradata_index = record->extradata_index;
+                    info->sample_rate     = record->sample_rate;
+                    if( frame_length != -1 && audio_sample_count > job->delay_count
+                     && set_audio_frame_length( &audio_table, audio_sample_count - job->delay_count, frame_length ) )
+                        constant_frame_length = 0;
+                    if( audio_sample_rate == 0 )
+                        audio_sample_rate = record->sample_rate;
+                    if( av_get_channel_layout_nb_channels( record->channel_layout )
+                      > av_get_channel_layout_nb_channels( aohp->output_channel_layout ) )
+                        aohp->output_channel_layout = record->channel_layout;
+                    aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format, record->sample_fmt );
+                    aohp->output_sample_rate     = MAX( aohp->output_sample_rate, audio_sample_rate );
+                    aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, record->bits_per_sample );
+                }
+            }
+            /* Write an audio packet info to the index file. */
+            write_index_packet( &writer, record );
+        }
+        if( indicator->update )
+        {
+            /* Update progress dialog. */
+            int percent = 0;
+            if( first_dts == AV_NOPTS_VALUE )
+                first_dts = pkt->dts;
+            if( filesize > 0 && pkt->pos > 0 )
+                /* Update if packet's file offset is valid. */
+                percent = (int)(100.0 * ((double)pkt->pos / filesize) + 0.5);
+            else if( format_ctx->duration > 0 && first_dts != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE )
+                /* Update if packet's DTS is valid. */
+                percent = (int)(100.0
+                             * (pkt->dts - first_dts) * (stream->time_base.num / (double)stream->time_base.den)
+                             / (format_ctx->duration / AV_TIME_BASE)
+                             + 0.5);
+            const char *message = writer.file ? "Creating Index file" : "Parsing input file";
+            int abort = indicator->update( php, message, percent );
+            release_index_job( &pipeline, job );
+            if( abort )
+                goto fail_index;
+        }
+        else
+            release_index_job( &pipeline, job );
+    }
+    stop_index_pipeline( &pipeline );
+    /* Handle delay derived from the audio decoder. */
+    for( int worker_index = 0; worker_index < pipeline.worker_count; worker_index++ )
+    {
+        lwindex_worker_t *worker = pipeline.worker[worker_index];
+        if( !worker || !worker->helper || !worker->helper->decode || worker->ctx->codec_type != AVMEDIA_TYPE_AUDIO )
+            continue;
+        lwindex_helper_t *helper = worker->helper;
+        /* Flush if decoding is delayed. */
+        for( uint32_t i = 1; i <= helper->delay_count; i++ )
+        {
+            lwindex_packet_record_t record;
+            if( drain_index_audio_frame( worker, &record ) < 0 )
+                continue;
+            if( record.stream_index == adhp->stream_index )
+            {
+                audio_duration += record.frame_length;
+                if( audio_duration > INT32_MAX )
+                    break;
+                if( set_audio_frame_length( &audio_table, audio_sample_count - helper->delay_count + i, record.frame_length ) )
+                    constant_frame_length = 0;
+            }
+            write_index_packet( &writer, &record );
+        }
+    }
+    end_index_packets( &writer );
+    /* Merge the frame info tables into the frame lists of the active streams. */
+    if( vdhp->stream_index >= 0 )
+    {
+        video_info = (video_frame_info_t *)flatten_frame_table( &video_table, video_sample_count );
+        if( !video_info )
+            goto fail_index;
+    }
+    if( adhp->stream_index >= 0 )
+    {
+        audio_info = (audio_frame_info_t *)flatten_frame_table( &audio_table, audio_sample_count );
+        if( !audio_info )
             goto fail_index;
-        }
-        if( pkt_ctx->codec_type == AVMEDIA_TYPE_VIDEO )
+    }
+    /* Deallocate frame info tables of no active stream. */
+    release_frame_table( &video_table );
+    release_frame_table( &audio_table );
+    if( adhp->stream_index >= 0 )
+    {
+        /* Check the active stream is DV in AVI Type-1 or not. */
+        if( adhp->dv_in_avi == 1 && format_ctx->streams[ adhp->stream_index ]->nb_index_entries == 0 )
         {
-            if( pkt_ctx->pix_fmt == AV_PIX_FMT_NONE )
-                investigate_pix_fmt_by_decoding( pkt_ctx, &pkt, vdhp->frame_buffer );
-            int dv_in_avi_init = 0;
-            if( adhp->dv_in_avi    == -1
-             && vdhp->stream_index == -1
-             && pkt_ctx->codec_id  == AV_CODEC_ID_DVVIDEO
-             && opt->force_audio   == 0 )
-            {
-                dv_in_avi_init     = 1;
-                adhp->dv_in_avi    = 1;
-                vdhp->stream_index = pkt.stream_index;
-            }
-            /* Replace lower resolution stream with higher. Override attached picture. */
-            int higher_priority = ((pkt_ctx->width * pkt_ctx->height > video_resolution)
-                                || (is_attached_pic && !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)));
-            if( dv_in_avi_init
-             || (!opt->force_video && (vdhp->stream_index == -1 || (pkt.stream_index != vdhp->stream_index && higher_priority)))
-             || (opt->force_video && vdhp->stream_index == -1 && pkt.stream_index == opt->force_video_index) )
+            /* DV in AVI Type-1 */
+            audio_sample_count = video_info ? MIN( video_sample_count, audio_sample_count ) : 0;
+            for( uint32_t i = 1; i <= audio_sample_count; i++ )
             {
-                /* Update active video stream. */
-                if( index )
-                {
-                    int32_t current_pos = ftell( index );
-                    fseek( index, video_index_pos, SEEK_SET );
-                    fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", pkt.stream_index );
-                    fseek( index, current_pos, SEEK_SET );
-                }
-                memset( video_info, 0, (video_sample_count + 1) * sizeof(video_frame_info_t) );
-                vdhp->ctx                = pkt_ctx;
-                vdhp->codec_id           = pkt_ctx->codec_id;
-                vdhp->stream_index       = pkt.stream_index;
-                video_resolution         = pkt_ctx->width * pkt_ctx->height;
-                is_attached_pic          = !!(stream->disposition & AV_DISPOSITION_ATTACHED_PIC);
-                video_sample_count       = 0;
-                last_keyframe_pts        = AV_NOPTS_VALUE;
-                vdhp->max_width          = pkt_ctx->width;
-                vdhp->max_height         = pkt_ctx->height;
-                vdhp->initial_width      = pkt_ctx->width;
-                vdhp->initial_height     = pkt_ctx->height;
-                vdhp->initial_colorspace = pkt_ctx->colorspace;
+                audio_info[i].keyframe        = !!(video_info[i].flags & LW_VFRAME_FLAG_KEY);
+                audio_info[i].sample_number   = video_info[i].sample_number;
+                audio_info[i].pts             = video_info[i].pts;
+                audio_info[i].dts             = video_info[i].dts;
+                audio_info[i].file_offset     = video_info[i].file_offset;
+                audio_info[i].extradata_index = video_info[i].extradata_index;
             }
-            /* Get picture type. */
-            int pict_type = get_picture_type( helper, pkt_ctx, &pkt );
-            if( pict_type < 0 )
+        }
+        else
+        {
+            if( adhp->dv_in_avi == 1 && opt->force_video && opt->force_video_index == -1 )
             {
-                av_free_packet( &pkt );
-                goto fail_index;
+                /* Disable DV video stream. */
+                disable_video_stream( vdhp );
+                video_info = NULL;
             }
-            /* Get Picture Order Count. */
-            int poc = helper->parser_ctx ? helper->parser_ctx->output_picture_number : 0;
-            /* Get field information. */
-            int             repeat_pict;
-            lw_field_info_t field_info;
-            if( helper->parser_ctx )
+            adhp->dv_in_avi = 0;
+        }
+    }
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        AVStream *stream = format_ctx->streams[stream_index];
+        if( stream->codec->codec_type == AVMEDIA_TYPE_VIDEO )
+        {
+            write_index_entries( &writer, stream_index, AVMEDIA_TYPE_VIDEO, stream->index_entries, stream->nb_index_entries );
+            if( vdhp->stream_index == stream_index && stream->nb_index_entries > 0 )
             {
-                repeat_pict = pkt_ctx->ticks_per_frame == 2
-                            ? helper->parser_ctx->repeat_pict
-                            : 2 * helper->parser_ctx->repeat_pict + 1;
-                if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_TOP_FIELD )
-                    field_info = LW_FIELD_INFO_TOP;
-                else if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_BOTTOM_FIELD )
-                    field_info = LW_FIELD_INFO_BOTTOM;
-                else
-                {
-                    if( helper->parser_ctx->field_order == AV_FIELD_TT
-                     || helper->parser_ctx->field_order == AV_FIELD_TB )
-                        field_info = LW_FIELD_INFO_TOP;
-                    else if( helper->parser_ctx->field_order == AV_FIELD_BB
-                          || helper->parser_ctx->field_order == AV_FIELD_BT )
-                        field_info = LW_FIELD_INFO_BOTTOM;
-                    else
-                        field_info = helper->last_field_info;
-                }
-                helper->last_field_info = field_info;
+                vdhp->index_entries = (AVIndexEntry *)av_malloc( stream->index_entries_allocated_size );
+                if( !vdhp->index_entries )
+                    goto fail_index;
+                for( int i = 0; i < stream->nb_index_entries; i++ )
+                    vdhp->index_entries[i] = stream->index_entries[i];
+                vdhp->index_entries_count = stream->nb_index_entries;
             }
-            else
+        }
+        else if( stream->codec->codec_type == AVMEDIA_TYPE_AUDIO )
+        {
+            write_index_entries( &writer, stream_index, AVMEDIA_TYPE_AUDIO, stream->index_entries, stream->nb_index_entries );
+            if( adhp->stream_index == stream_index && stream->nb_index_entries > 0 )
             {
-                repeat_pict = 1;
-                field_info = helper->last_field_info;
+                /* Audio stream in matroska container requires index_entries for seeking.
+                 * This avoids for re-reading the file to create index_entries since the file will be closed once. */
+                adhp->index_entries = (AVIndexEntry *)av_malloc( stream->index_entries_allocated_size );
+                if( !adhp->index_entries )
+                    goto fail_index;
+                for( int i = 0; i < stream->nb_index_entries; i++ )
+                    adhp->index_entries[i] = stream->index_entries[i];
+                adhp->index_entries_count = stream->nb_index_entries;
             }
-            /* Set video frame info if this stream is active. */
-            if( pkt.stream_index == vdhp->stream_index )
+        }
+    }
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        AVStream *stream = format_ctx->streams[stream_index];
+        if( stream->codec->codec_type == AVMEDIA_TYPE_VIDEO || stream->codec->codec_type == AVMEDIA_TYPE_AUDIO )
+        {
+            lwindex_helper_t *helper = (lwindex_helper_t *)stream->codec->opaque;
+            if( !helper )
+                continue;
+            lwlibav_extradata_handler_t *list = &helper->exh;
+            write_index_extradata_list( &writer, stream_index, stream->codec->codec_type, list->entries, list->entry_count );
+            if( (stream->codec->codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
+             || (stream->codec->codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index) )
             {
-                ++video_sample_count;
-                video_info[video_sample_count].pts             = pkt.pts;
-                video_info[video_sample_count].dts             = pkt.dts;
-                video_info[video_sample_count].file_offset     = pkt.pos;
-                video_info[video_sample_count].sample_number   = video_sample_count;
-                video_info[video_sample_count].extradata_index = extradata_index;
-                video_info[video_sample_count].pict_type       = pict_type;
-                video_info[video_sample_count].poc             = poc;
-                video_info[video_sample_count].repeat_pict     = repeat_pict;
-                video_info[video_sample_count].field_info      = field_info;
-                if( pkt.pts != AV_NOPTS_VALUE && last_keyframe_pts != AV_NOPTS_VALUE && pkt.pts < last_keyframe_pts )
-                    video_info[video_sample_count].flags |= LW_VFRAME_FLAG_LEADING;
-                if( pkt.flags & AV_PKT_FLAG_KEY )
-                {
-                    /* For the present, treat this frame as a keyframe. */
-                    video_info[video_sample_count].flags |= LW_VFRAME_FLAG_KEY;
-                    last_keyframe_pts = pkt.pts;
-                }
-                if( repeat_pict == 0 && field_info == LW_FIELD_INFO_UNKNOWN && pkt_ctx->pix_fmt == AV_PIX_FMT_NONE
-                 && (pkt_ctx->codec_id == AV_CODEC_ID_H264 || pkt_ctx->codec_id == AV_CODEC_ID_HEVC)
-                 && (pkt_ctx->width == 0 || pkt_ctx->height == 0) )
-                    video_info[video_sample_count].flags |= LW_VFRAME_FLAG_CORRUPT;
-                /* Set maximum resolution. */
-                if( vdhp->max_width  < pkt_ctx->width )
-                    vdhp->max_width  = pkt_ctx->width;
-                if( vdhp->max_height < pkt_ctx->height )
-                    vdhp->max_height = pkt_ctx->height;
-                if( video_sample_count + 1 == video_info_count )
-                {
-                    video_info_count <<= 1;
-                    video_frame_info_t *temp = (video_frame_info_t *)realloc( video_info, video_info_count * sizeof(video_frame_info_t) );
-                    if( !temp )
-                    {
-                        av_free_packet( &pkt );
-                        goto fail_index;
-                    }
-                    video_info = temp;
-                }
+                lwlibav_extradata_handler_t *exhp = stream->codec->codec_type == AVMEDIA_TYPE_VIDEO ? &vdhp->exh : &adhp->exh;
+                exhp->entry_count   = list->entry_count;
+                exhp->entries       = list->entries;
+                exhp->current_index = stream->codec->codec_type == AVMEDIA_TYPE_VIDEO
+                                    ? video_info[1].extradata_index
+                                    : audio_info[1].extradata_index;
+                /* Avoid freeing entries. */
+                list->entry_count = 0;
+                list->entries     = NULL;
             }
-            /* Set width, height and pixel_format for the current extradata. */
-            if( extradata_index >= 0 )
+        }
+    }
+    if( vdhp->stream_index >= 0 )
+    {
+        vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (video_sample_count + 1) * sizeof(uint8_t) );
+        if( !vdhp->keyframe_list )
+            goto fail_index;
+        vdhp->frame_list      = video_info;
+        vdhp->frame_count     = video_sample_count;
+        vdhp->initial_pix_fmt = video_pix_fmt;
+        if( decide_video_seek_method( lwhp, vdhp, video_sample_count, format_ctx->streams[ vdhp->stream_index ]->time_base ) )
+            goto fail_index;
+        write_index_video_tables( &writer, vdhp, format_ctx->streams[ vdhp->stream_index ]->time_base );
+        /* Create the repeat control info. */
+        create_video_frame_order_list( vdhp, vohp, opt );
+    }
+    if( adhp->stream_index >= 0 )
+    {
+        adhp->frame_list   = audio_info;
+        adhp->frame_count  = audio_sample_count;
+        adhp->frame_length = constant_frame_length ? adhp->frame_list[1].length : 0;
+        decide_audio_seek_method( lwhp, adhp, audio_sample_count );
+        write_index_audio_tables( &writer, adhp, aohp, format_ctx->streams[ adhp->stream_index ]->time_base, audio_sample_rate );
+        if( opt->av_sync && vdhp->stream_index >= 0 )
+            lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp,
+                                             format_ctx->streams[ vdhp->stream_index ]->time_base,
+                                             format_ctx->streams[ adhp->stream_index ]->time_base,
+                                             audio_sample_rate );
+    }
+    close_index_pipeline( &pipeline );
+    cleanup_index_helpers( format_ctx );
+    close_index_writer( &writer, LWINDEX_FINALIZED
+                               | (opt->force_video ? LWINDEX_FINALIZED_FORCE_VIDEO : 0)
+                               | (opt->force_audio ? LWINDEX_FINALIZED_FORCE_AUDIO : 0) );
+    if( indicator->close )
+        indicator->close( php );
+    vdhp->format = NULL;
+    adhp->format = NULL;
+    return;
+fail_index:
+    close_index_pipeline( &pipeline );
+    cleanup_index_helpers( format_ctx );
+    release_frame_table( &video_table );
+    release_frame_table( &audio_table );
+    free( video_info );
+    free( audio_info );
+    if( writer.file )
+    {
+        writer.error = 1;
+        close_index_writer( &writer, 0 );
+    }
+    if( indicator->close )
+        indicator->close( php );
+    vdhp->format = NULL;
+    adhp->format = NULL;
+    return;
+}
+
+typedef struct
+{
+    lwlibav_file_handler_t         *lwhp;
+    lwlibav_video_decode_handler_t *vdhp;
+    lwlibav_video_output_handler_t *vohp;
+    lwlibav_audio_decode_handler_t *adhp;
+    lwlibav_audio_output_handler_t *aohp;
+    lwlibav_option_t               *opt;
+    int                             active_video_index;
+    int                             active_audio_index;
+    int                             video_present;
+    int                             audio_present;
+    lwindex_frame_table_t           video_table;
+    lwindex_frame_table_t           audio_table;
+    video_frame_info_t             *video_info;     /* available after finish_parsing() */
+    audio_frame_info_t             *audio_info;     /* available after finish_parsing() */
+    uint32_t                        video_sample_count;
+    int64_t                         last_keyframe_pts;
+    uint32_t                        audio_sample_count;
+    int                             audio_sample_rate;
+    int                             constant_frame_length;
+    uint64_t                        audio_duration;
+    AVRational                      video_time_base;
+    AVRational                      audio_time_base;
+} lwindex_parser_t;
+
+static int init_index_parser
+(
+    lwindex_parser_t               *parser,
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt,
+    int                             active_video_index,
+    int                             active_audio_index
+)
+{
+    memset( parser, 0, sizeof(lwindex_parser_t) );
+    parser->lwhp                  = lwhp;
+    parser->vdhp                  = vdhp;
+    parser->vohp                  = vohp;
+    parser->adhp                  = adhp;
+    parser->aohp                  = aohp;
+    parser->opt                   = opt;
+    parser->active_video_index    = active_video_index;
+    parser->active_audio_index    = active_audio_index;
+    parser->video_present         = (active_video_index >= 0);
+    parser->audio_present         = (active_audio_index >= 0);
+    parser->last_keyframe_pts     = AV_NOPTS_VALUE;
+    parser->constant_frame_length = 1;
+    adhp->dv_in_avi = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
+    vdhp->stream_index = opt->force_video ? opt->force_video_index : active_video_index;
+    adhp->stream_index = opt->force_audio ? opt->force_audio_index : active_audio_index;
+    init_frame_table( &parser->video_table, sizeof(video_frame_info_t) );
+    init_frame_table( &parser->audio_table, sizeof(audio_frame_info_t) );
+    vdhp->codec_id             = AV_CODEC_ID_NONE;
+    adhp->codec_id             = AV_CODEC_ID_NONE;
+    vdhp->initial_pix_fmt      = AV_PIX_FMT_NONE;
+    vdhp->initial_colorspace   = AVCOL_SPC_NB;
+    aohp->output_sample_format = AV_SAMPLE_FMT_NONE;
+    return 0;
+}
+
+static void abort_parsing
+(
+    lwindex_parser_t *parser
+)
+{
+    parser->vdhp->frame_list = NULL;
+    parser->adhp->frame_list = NULL;
+    release_frame_table( &parser->video_table );
+    release_frame_table( &parser->audio_table );
+    lw_freep( &parser->video_info );
+    lw_freep( &parser->audio_info );
+}
+
+static int parse_video_packet_record
+(
+    lwindex_parser_t              *parser,
+    const lwindex_packet_record_t *record
+)
+{
+    lwlibav_video_decode_handler_t *vdhp = parser->vdhp;
+    if( parser->adhp->dv_in_avi == -1 && record->codec_id == AV_CODEC_ID_DVVIDEO && !parser->opt->force_audio )
+    {
+        parser->adhp->dv_in_avi = 1;
+        if( vdhp->stream_index == -1 )
+            vdhp->stream_index = record->stream_index;
+    }
+    if( record->stream_index != vdhp->stream_index )
+        return 0;
+    if( vdhp->codec_id == AV_CODEC_ID_NONE )
+        vdhp->codec_id = (enum AVCodecID)record->codec_id;
+    if( (record->key | record->width | record->height) || record->pict_type == -1 || record->colorspace != AVCOL_SPC_NB )
+    {
+        if( vdhp->initial_width == 0 || vdhp->initial_height == 0 )
+        {
+            vdhp->initial_width  = record->width;
+            vdhp->initial_height = record->height;
+            vdhp->max_width      = record->width;
+            vdhp->max_height     = record->height;
+        }
+        else
+        {
+            if( vdhp->max_width  < record->width )
+                vdhp->max_width  = record->width;
+            if( vdhp->max_height < record->width )
+                vdhp->max_height = record->height;
+        }
+        if( vdhp->initial_pix_fmt == AV_PIX_FMT_NONE )
+            vdhp->initial_pix_fmt = record->pix_fmt;
+        if( vdhp->initial_colorspace == AVCOL_SPC_NB )
+            vdhp->initial_colorspace = record->colorspace;
+        if( parser->video_time_base.num == 0 || parser->video_time_base.den == 0 )
+            parser->video_time_base = record->time_base;
+        uint32_t            video_sample_count = ++ parser->video_sample_count;
+        video_frame_info_t *info               = (video_frame_info_t *)get_frame_table_entry( &parser->video_table, video_sample_count );
+        if( !info )
+            return -1;
+        info->pts             = record->pts;
+        info->dts             = record->dts;
+        info->file_offset     = record->pos;
+        info->sample_number   = video_sample_count;
+        info->extradata_index = record->extradata_index;
+        info->pict_type       = record->pict_type > 0 ? record->pict_type : 0;
+        info->poc             = record->poc;
+        info->repeat_pict     = record->repeat_pict;
+        info->field_info      = (lw_field_info_t)record->field_info;
+        if( record->pts != AV_NOPTS_VALUE && parser->last_keyframe_pts != AV_NOPTS_VALUE && record->pts < parser->last_keyframe_pts )
+            info->flags |= LW_VFRAME_FLAG_LEADING;
+        if( record->key )
+        {
+            info->flags |= LW_VFRAME_FLAG_KEY;
+            parser->last_keyframe_pts = record->pts;
+        }
+        if( record->repeat_pict == 0 && record->field_info == LW_FIELD_INFO_UNKNOWN
+         && record->pix_fmt == AV_PIX_FMT_NONE
+         && ((enum AVCodecID)record->codec_id == AV_CODEC_ID_H264 || (enum AVCodecID)record->codec_id == AV_CODEC_ID_HEVC)
+         && (record->width == 0 || record->height == 0) )
+            info->flags |= LW_VFRAME_FLAG_CORRUPT;
+    }
+    return 0;
+}
+
+static int parse_audio_packet_record
+(
+    lwindex_parser_t              *parser,
+    const lwindex_packet_record_t *record
+)
+{
+    lwlibav_audio_decode_handler_t *adhp = parser->adhp;
+    lwlibav_audio_output_handler_t *aohp = parser->aohp;
+    if( record->stream_index != adhp->stream_index )
+        return 0;
+    if( adhp->codec_id == AV_CODEC_ID_NONE )
+        adhp->codec_id = (enum AVCodecID)record->codec_id;
+    lwindex_frame_table_t *audio_table  = &parser->audio_table;
+    int                    frame_length = record->frame_length;
+    if( (record->channels | record->channel_layout | record->sample_rate | record->bits_per_sample) && parser->audio_duration <= INT32_MAX )
+    {
+        if( parser->audio_sample_rate == 0 )
+            parser->audio_sample_rate = record->sample_rate;
+        if( parser->audio_time_base.num == 0 || parser->audio_time_base.den == 0 )
+            parser->audio_time_base = record->time_base;
+        uint64_t layout = record->channel_layout ? record->channel_layout : av_get_default_channel_layout( record->channels );
+        if( av_get_channel_layout_nb_channels( layout )
+          > av_get_channel_layout_nb_channels( aohp->output_channel_layout ) )
+            aohp->output_channel_layout = layout;
+        aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format, record->sample_fmt );
+        aohp->output_sample_rate     = MAX( aohp->output_sample_rate, parser->audio_sample_rate );
+        aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, record->bits_per_sample );
+        uint32_t            audio_sample_count = ++ parser->audio_sample_count;
+        audio_frame_info_t *info               = (audio_frame_info_t *)get_frame_table_entry( audio_table, audio_sample_count );
+        if( !info )
+            return -1;
+        info->pts             = record->pts;
+        info->dts             = record->dts;
+        info->file_offset     = record->pos;
+        info->sample_number   = audio_sample_count;
+        info->extradata_index = record->extradata_index;
+        info->sample_rate     = record->sample_rate;
+    }
+    else
+        for( uint32_t i = 1; i <= adhp->exh.delay_count; i++ )
+        {
+            uint32_t audio_frame_number = parser->audio_sample_count - adhp->exh.delay_count + i;
+            if( audio_frame_number > parser->audio_sample_count )
+                return -1;
+            if( set_audio_frame_length( audio_table, audio_frame_number, frame_length ) )
+                parser->constant_frame_length = 0;
+            parser->audio_duration += frame_length;
+        }
+    if( frame_length == -1 )
+        ++ adhp->exh.delay_count;
+    else if( parser->audio_sample_count > adhp->exh.delay_count )
+    {
+        if( set_audio_frame_length( audio_table, parser->audio_sample_count - adhp->exh.delay_count, frame_length ) )
+            parser->constant_frame_length = 0;
+        parser->audio_duration += frame_length;
+    }
+    return 0;
+}
+
+static inline int parse_packet_record
+(
+    lwindex_parser_t              *parser,
+    const lwindex_packet_record_t *record
+)
+{
+    if( record->codec_type == AVMEDIA_TYPE_VIDEO )
+        return parse_video_packet_record( parser, record );
+    else if( record->codec_type == AVMEDIA_TYPE_AUDIO )
+        return parse_audio_packet_record( parser, record );
+    return 0;
+}
+
+/* Return -1 if the index file needs to be re-created. */
+static int check_parsed_streams
+(
+    lwindex_parser_t *parser
+)
+{
+    lwlibav_option_t *opt = parser->opt;
+    if( parser->video_present && opt->force_video && opt->force_video_index != -1
+     && (parser->video_sample_count == 0 || parser->vdhp->initial_pix_fmt == AV_PIX_FMT_NONE
+      || parser->vdhp->initial_width == 0 || parser->vdhp->initial_height == 0) )
+        return -1;
+    if( parser->audio_present && opt->force_audio && opt->force_audio_index != -1
+     && (parser->audio_sample_count == 0 || parser->audio_duration == 0) )
+        return -1;
+    return 0;
+}
+
+static inline int get_parsed_initial_extradata_index
+(
+    lwindex_parser_t *parser,
+    int               codec_type
+)
+{
+    if( codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        video_frame_info_t *info = (video_frame_info_t *)get_frame_table_entry( &parser->video_table, 1 );
+        return info ? info->extradata_index : 0;
+    }
+    else
+    {
+        audio_frame_info_t *info = (audio_frame_info_t *)get_frame_table_entry( &parser->audio_table, 1 );
+        return info ? info->extradata_index : 0;
+    }
+}
+
+/* Settle the audio frames whose lengths are still delayed by the decoder when the packets are cut off.
+ * Since the decoder restarts after the cut, they are given the length of the last settled frame. */
+static void settle_delayed_audio_frames
+(
+    lwindex_parser_t *parser
+)
+{
+    lwlibav_audio_decode_handler_t *adhp        = parser->adhp;
+    uint32_t                        delay_count = MIN( adhp->exh.delay_count, parser->audio_sample_count );
+    int                             frame_length = 0;
+    if( parser->audio_sample_count > delay_count )
+    {
+        audio_frame_info_t *info = (audio_frame_info_t *)get_frame_table_entry( &parser->audio_table, parser->audio_sample_count - delay_count );
+        if( info )
+            frame_length = info->length;
+    }
+    for( uint32_t i = 1; i <= delay_count; i++ )
+    {
+        if( set_audio_frame_length( &parser->audio_table, parser->audio_sample_count - delay_count + i, frame_length ) )
+            parser->constant_frame_length = 0;
+        parser->audio_duration += frame_length;
+    }
+    adhp->exh.delay_count = 0;
+}
+
+static int finish_parsing
+(
+    lwindex_parser_t *parser
+)
+{
+    lwlibav_file_handler_t         *lwhp = parser->lwhp;
+    lwlibav_video_decode_handler_t *vdhp = parser->vdhp;
+    lwlibav_audio_decode_handler_t *adhp = parser->adhp;
+    lwlibav_option_t               *opt  = parser->opt;
+    /* Merge the frame info tables into the frame lists. */
+    if( vdhp->stream_index >= 0 )
+    {
+        parser->video_info = (video_frame_info_t *)flatten_frame_table( &parser->video_table, parser->video_sample_count );
+        if( !parser->video_info )
+            return -1;
+    }
+    if( adhp->stream_index >= 0 )
+    {
+        parser->audio_info = (audio_frame_info_t *)flatten_frame_table( &parser->audio_table, parser->audio_sample_count );
+        if( !parser->audio_info )
+            return -1;
+    }
+    if( vdhp->stream_index >= 0 )
+    {
+        vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (parser->video_sample_count + 1) * sizeof(uint8_t) );
+        if( !vdhp->keyframe_list )
+            return -1;
+        vdhp->frame_list  = parser->video_info;
+        vdhp->frame_count = parser->video_sample_count;
+        if( decide_video_seek_method( lwhp, vdhp, parser->video_sample_count, parser->video_time_base ) )
+            return -1;
+        /* Create the repeat control info. */
+        create_video_frame_order_list( vdhp, parser->vohp, opt );
+    }
+    if( adhp->stream_index >= 0 )
+    {
+        video_frame_info_t *video_info = parser->video_info;
+        audio_frame_info_t *audio_info = parser->audio_info;
+        if( adhp->dv_in_avi == 1 && adhp->index_entries_count == 0 )
+        {
+            /* DV in AVI Type-1 */
+            parser->audio_sample_count = MIN( parser->video_sample_count, parser->audio_sample_count );
+            for( uint32_t i = 0; i <= parser->audio_sample_count; i++ )
             {
-                lwlibav_extradata_handler_t *list = &helper->exh;
-                lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
-                if( entry->width < pkt_ctx->width )
-                    entry->width = pkt_ctx->width;
-                if( entry->height < pkt_ctx->height )
-                    entry->height = pkt_ctx->height;
-                if( entry->pixel_format == AV_PIX_FMT_NONE )
-                    entry->pixel_format = pkt_ctx->pix_fmt;
-                if( entry->bits_per_sample == 0 )
-                    entry->bits_per_sample = pkt_ctx->bits_per_coded_sample;
-                if( entry->codec_id == AV_CODEC_ID_NONE )
-                    entry->codec_id = pkt_ctx->codec_id;
-                if( entry->codec_tag == 0 )
-                    entry->codec_tag = pkt_ctx->codec_tag;
+                audio_info[i].keyframe        = !!(video_info[i].flags & LW_VFRAME_FLAG_KEY);
+                audio_info[i].sample_number   = video_info[i].sample_number;
+                audio_info[i].pts             = video_info[i].pts;
+                audio_info[i].dts             = video_info[i].dts;
+                audio_info[i].file_offset     = video_info[i].file_offset;
+                audio_info[i].extradata_index = video_info[i].extradata_index;
             }
-            /* Write a video packet info to the index file. */
-            print_index( index, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%"PRId64",PTS=%"PRId64",DTS=%"PRId64",EDI=%d\n"
-                         "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d,Width=%d,Height=%d,Format=%s,ColorSpace=%d\n",
-                         pkt.stream_index, AVMEDIA_TYPE_VIDEO, pkt_ctx->codec_id,
-                         stream->time_base.num, stream->time_base.den,
-                         pkt.pos, pkt.pts, pkt.dts, extradata_index,
-                         !!(pkt.flags & AV_PKT_FLAG_KEY), pict_type, poc, repeat_pict, field_info,
-                         pkt_ctx->width, pkt_ctx->height,
-                         av_get_pix_fmt_name( pkt_ctx->pix_fmt ) ? av_get_pix_fmt_name( pkt_ctx->pix_fmt ) : "none",
-                         pkt_ctx->colorspace );
         }
         else
         {
-            if( adhp->stream_index == -1 && (!opt->force_audio || (opt->force_audio && pkt.stream_index == opt->force_audio_index)) )
+            if( adhp->dv_in_avi == 1
+             && ((!opt->force_video && parser->active_video_index == -1) || (opt->force_video && opt->force_video_index == -1)) )
             {
-                /* Update active audio stream. */
-                if( index )
-                {
-                    int32_t current_pos = ftell( index );
-                    fseek( index, audio_index_pos, SEEK_SET );
-                    fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", pkt.stream_index );
-                    fseek( index, current_pos, SEEK_SET );
-                }
-                adhp->ctx          = pkt_ctx;
-                adhp->codec_id     = pkt_ctx->codec_id;
-                adhp->stream_index = pkt.stream_index;
+                /* Disable DV video stream. */
+                disable_video_stream( vdhp );
+                parser->video_info = NULL;
             }
-            int bits_per_sample = pkt_ctx->bits_per_raw_sample   > 0 ? pkt_ctx->bits_per_raw_sample
-                                : pkt_ctx->bits_per_coded_sample > 0 ? pkt_ctx->bits_per_coded_sample
-                                : av_get_bytes_per_sample( pkt_ctx->sample_fmt ) << 3;
-            /* Get audio frame_length. */
-            int frame_length = get_audio_frame_length( helper, pkt_ctx, &pkt );
-            /* Set audio frame info if this stream is active. */
-            if( pkt.stream_index == adhp->stream_index )
+            adhp->dv_in_avi = 0;
+        }
+        adhp->frame_list   = audio_info;
+        adhp->frame_count  = parser->audio_sample_count;
+        adhp->frame_length = parser->constant_frame_length ? audio_info[1].length : 0;
+        decide_audio_seek_method( lwhp, adhp, parser->audio_sample_count );
+        if( opt->av_sync && vdhp->stream_index >= 0 )
+            lwhp->av_gap = calculate_av_gap( vdhp, parser->vohp, adhp,
+                                             parser->video_time_base, parser->audio_time_base,
+                                             parser->audio_sample_rate );
+    }
+    return 0;
+}
+
+/* Scan the line '<InputFilePath>...</InputFilePath>' of the text index file.
+ * The returned string is allocated by lw_malloc_zero(). Return NULL if failed. */
+static char *scan_input_file_path
+(
+    FILE *index
+)
+{
+    static const char open_tag [] = "<InputFilePath>";
+    static const char close_tag[] = "</InputFilePath>";
+    char tag[sizeof(close_tag)];
+    if( fread( tag, 1, strlen( open_tag ), index ) != strlen( open_tag )
+     || memcmp( tag, open_tag, strlen( open_tag ) ) )
+        return NULL;
+    int64_t start = lw_ftell( index );
+    if( start < 0 )
+        return NULL;
+    size_t length = 0;
+    for( int c = fgetc( index ); c != EOF && c != '<' && c != '\n'; c = fgetc( index ) )
+        ++length;
+    char *file_path = (char *)lw_malloc_zero( length + 1 );
+    if( !file_path )
+        return NULL;
+    if( length == 0
+     || lw_fseek( index, start, SEEK_SET )
+     || fread( file_path, 1, length, index ) != length
+     || fread( tag, 1, strlen( close_tag ), index ) != strlen( close_tag )
+     || memcmp( tag, close_tag, strlen( close_tag ) )
+     || fscanf( index, "\n" ) == EOF )
+    {
+        lw_freep( &file_path );
+        return NULL;
+    }
+    return file_path;
+}
+
+static int parse_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt,
+    FILE                           *index
+)
+{
+    /* Test to open the target file. */
+    char *file_path = scan_input_file_path( index );
+    if( !file_path )
+        return -1;
+    FILE *target = fopen( file_path, "rb" );
+    if( !target )
+    {
+        lw_freep( &file_path );
+        return -1;
+    }
+    fclose( target );
+    lwhp->file_path = file_path;
+    /* Parse the index file. */
+    char format_name[256];
+    int active_video_index;
+    int active_audio_index;
+    if( fscanf( index, "<LibavReaderIndex=0x%x,%d,%[^>]>\n", &lwhp->format_flags, &lwhp->raw_demuxer, format_name ) != 3 )
+        return -1;
+    int64_t active_index_pos = lw_ftell( index );
+    if( fscanf( index, "<ActiveVideoStreamIndex>%d</ActiveVideoStreamIndex>\n", &active_video_index ) != 1
+     || fscanf( index, "<ActiveAudioStreamIndex>%d</ActiveAudioStreamIndex>\n", &active_audio_index ) != 1 )
+        return -1;
+    lwhp->format_name = format_name;
+    char buf[1024];
+    lwindex_parser_t parser;
+    if( init_index_parser( &parser, lwhp, vdhp, vohp, adhp, aohp, opt, active_video_index, active_audio_index ) < 0 )
+        goto fail_parsing;
+    while( fgets( buf, sizeof(buf), index ) )
+    {
+        lwindex_packet_record_t record;
+        int ret = scan_packet_record( index, buf, sizeof(buf), &record );
+        if( ret > 0 )
+            break;
+        if( ret < 0 || parse_packet_record( &parser, &record ) < 0 )
+            goto fail_parsing;
+    }
+    if( check_parsed_streams( &parser ) < 0 )
+        goto fail_parsing;  /* Need to re-create the index file. */
+    if( strncmp( buf, "</LibavReaderIndex>", strlen( "</LibavReaderIndex>" ) ) )
+        goto fail_parsing;
+    /* Parse AVIndexEntry. */
+    if( !fgets( buf, sizeof(buf), index ) )
+        goto fail_parsing;
+    while( !strncmp( buf, "<StreamIndexEntries=", strlen( "<StreamIndexEntries=" ) ) )
+    {
+        int stream_index;
+        int codec_type;
+        int index_entries_count;
+        if( sscanf( buf, "<StreamIndexEntries=%d,%d,%d>", &stream_index, &codec_type, &index_entries_count ) != 3 )
+            goto fail_parsing;
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
+        if( index_entries_count > 0 )
+        {
+            lwlibav_decode_handler_t *dhp = codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index ? (lwlibav_decode_handler_t *)vdhp
+                                          : codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index ? (lwlibav_decode_handler_t *)adhp
+                                          : NULL;
+            if( dhp )
             {
-                if( frame_length != -1 )
-                    audio_duration += frame_length;
-                if( audio_duration <= INT32_MAX )
+                dhp->index_entries_count = index_entries_count;
+                dhp->index_entries = (AVIndexEntry *)av_malloc( dhp->index_entries_count * sizeof(AVIndexEntry) );
+                if( !dhp->index_entries )
+                    goto fail_parsing;
+                for( int i = 0; i < dhp->index_entries_count; i++ )
                 {
-                    /* Set up audio frame info. */
-                    ++audio_sample_count;
-                    audio_info[audio_sample_count].pts             = pkt.pts;
-                    audio_info[audio_sample_count].dts             = pkt.dts;
-                    audio_info[audio_sample_count].file_offset     = pkt.pos;
-                    audio_info[audio_sample_count].sample_number   = audio_sample_count;
-                    audio_info[audio_sample_count].extradata_index = extradata_index;
-                    audio_info[audio_sample_count].sample_rate     = pkt_ctx->sample_rate;
-                    if( frame_length != -1 && audio_sample_count > helper->delay_count )
-                    {
-                        uint32_t audio_frame_number = audio_sample_count - helper->delay_count;
-                        audio_info[audio_frame_number].length = frame_length;
-                        if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                            constant_frame_length = 0;
-                    }
-                    if( audio_sample_rate == 0 )
-                        audio_sample_rate = pkt_ctx->sample_rate;
-                    if( audio_sample_count + 1 == audio_info_count )
-                    {
-                        audio_info_count <<= 1;
-                        audio_frame_info_t *temp = (audio_frame_info_t *)realloc( audio_info, audio_info_count * sizeof(audio_frame_info_t) );
-                        if( !temp )
-                        {
-                            av_free_packet( &pkt );
-                            goto fail_index;
-                        }
-                        audio_info = temp;
-                    }
-                    if( pkt_ctx->channel_layout == 0 )
-                        pkt_ctx->channel_layout = av_get_default_channel_layout( pkt_ctx->channels );
-                    if( av_get_channel_layout_nb_channels( pkt_ctx->channel_layout )
-                      > av_get_channel_layout_nb_channels( aohp->output_channel_layout ) )
-                        aohp->output_channel_layout = pkt_ctx->channel_layout;
-                    aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format, pkt_ctx->sample_fmt );
-                    aohp->output_sample_rate     = MAX( aohp->output_sample_rate, audio_sample_rate );
-                    aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, bits_per_sample );
+                    if( scan_av_index_entry( buf, &dhp->index_entries[i] ) < 0 )
+                        break;
+                    if( !fgets( buf, sizeof(buf), index ) )
+                        goto fail_parsing;
                 }
             }
-            /* Set channel_layout, sample_rate, sample_format and bits_per_sample for the current extradata. */
-            if( extradata_index >= 0 )
-            {
-                lwlibav_extradata_handler_t *list = &helper->exh;
-                lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
-                if( entry->channel_layout == 0 )
-                    entry->channel_layout = pkt_ctx->channel_layout;
-                if( entry->sample_rate == 0 )
-                    entry->sample_rate = pkt_ctx->sample_rate;
-                if( entry->sample_format == AV_SAMPLE_FMT_NONE )
-                    entry->sample_format = pkt_ctx->sample_fmt;
-                if( entry->bits_per_sample == 0 )
-                    entry->bits_per_sample = bits_per_sample;
-                if( entry->block_align == 0 )
-                    entry->block_align = pkt_ctx->block_align;
-                if( entry->codec_id == AV_CODEC_ID_NONE )
-                    entry->codec_id = pkt_ctx->codec_id;
-                if( entry->codec_tag == 0 )
-                    entry->codec_tag = pkt_ctx->codec_tag;
-            }
-            /* Write an audio packet info to the index file. */
-            print_index( index, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%"PRId64",PTS=%"PRId64",DTS=%"PRId64",EDI=%d\n"
-                         "Channels=%d:0x%"PRIx64",Rate=%d,Format=%s,BPS=%d,Length=%d\n",
-                         pkt.stream_index, AVMEDIA_TYPE_AUDIO, pkt_ctx->codec_id,
-                         stream->time_base.num, stream->time_base.den,
-                         pkt.pos, pkt.pts, pkt.dts, extradata_index,
-                         pkt_ctx->channels, pkt_ctx->channel_layout, pkt_ctx->sample_rate,
-                         av_get_sample_fmt_name( pkt_ctx->sample_fmt ) ? av_get_sample_fmt_name( pkt_ctx->sample_fmt ) : "none",
-                         bits_per_sample, frame_length );
-        }
-        if( indicator->update )
-        {
-            /* Update progress dialog. */
-            int percent = 0;
-            if( first_dts == AV_NOPTS_VALUE )
-                first_dts = pkt.dts;
-            if( filesize > 0 && pkt.pos > 0 )
-                /* Update if packet's file offset is valid. */
-                percent = (int)(100.0 * ((double)pkt.pos / filesize) + 0.5);
-            else if( format_ctx->duration > 0 && first_dts != AV_NOPTS_VALUE && pkt.dts != AV_NOPTS_VALUE )
-                /* Update if packet's DTS is valid. */
-                percent = (int)(100.0
-                             * (pkt.dts - first_dts) * (stream->time_base.num / (double)stream->time_base.den)
-                             / (format_ctx->duration / AV_TIME_BASE)
-                             + 0.5);
-            const char *message = index ? "Creating Index file" : "Parsing input file";
-            int abort = indicator->update( php, message, percent );
-            av_free_packet( &pkt );
-            if( abort )
-                goto fail_index;
+            else
+                for( int i = 0; i < index_entries_count; i++ )
+                    if( !fgets( buf, sizeof(buf), index ) )
+                        goto fail_parsing;
         }
-        else
-            av_free_packet( &pkt );
+        if( strncmp( buf, "</StreamIndexEntries>", strlen( "</StreamIndexEntries>" ) ) )
+            goto fail_parsing;
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
     }
-    /* Handle delay derived from the audio decoder. */
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    /* Parse extradata. */
+    while( !strncmp( buf, "<ExtraDataList=", strlen( "<ExtraDataList=" ) ) )
     {
-        AVStream         *stream  = format_ctx->streams[stream_index];
-        AVCodecContext   *pkt_ctx = stream->codec;
-        lwindex_helper_t *helper  = (lwindex_helper_t *)pkt_ctx->opaque;
-        if( !helper || !helper->decode || pkt_ctx->codec_type != AVMEDIA_TYPE_AUDIO )
-            continue;
-        /* Flush if decoding is delayed. */
-        for( uint32_t i = 1; i <= helper->delay_count; i++ )
+        int stream_index;
+        int codec_type;
+        int entry_count;
+        if( sscanf( buf, "<ExtraDataList=%d,%d,%d>", &stream_index, &codec_type, &entry_count ) != 3 )
+            goto fail_parsing;
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
+        if( entry_count > 0 )
         {
-            AVPacket null_pkt = { 0 };
-            av_init_packet( &null_pkt );
-            null_pkt.data = NULL;
-            null_pkt.size = 0;
-            int decode_complete;
-            if( helper->decode( pkt_ctx, helper->picture, &decode_complete, &null_pkt ) >= 0 )
+            if( (codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
+             || (codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index) )
             {
-                int frame_length = decode_complete ? helper->picture->nb_samples : 0;
-                if( stream_index == adhp->stream_index )
+                lwlibav_extradata_handler_t *exhp = codec_type == AVMEDIA_TYPE_VIDEO ? &vdhp->exh : &adhp->exh;
+                if( !alloc_extradata_entries( exhp, entry_count ) )
+                    goto fail_parsing;
+                exhp->current_index = get_parsed_initial_extradata_index( &parser, codec_type );
+                for( int i = 0; i < exhp->entry_count; i++ )
                 {
-                    audio_duration += frame_length;
-                    if( audio_duration > INT32_MAX )
+                    if( scan_extradata( index, buf, codec_type, &exhp->entries[i] ) < 0 )
                         break;
-                    uint32_t audio_frame_number = audio_sample_count - helper->delay_count + i;
-                    audio_info[audio_frame_number].length = frame_length;
-                    if( audio_frame_number > 1
-                     && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                        constant_frame_length = 0;
+                    if( !fgets( buf, sizeof(buf), index )   /* new line ('\n') */
+                     || !fgets( buf, sizeof(buf), index ) ) /* the first line of the next entry */
+                        goto fail_parsing;
                 }
-                print_index( index, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=-1,PTS=%"PRId64",DTS=%"PRId64",EDI=-1\n"
-                             "Channels=0:0x0,Rate=0,Format=none,BPS=0,Length=%d\n",
-                             stream_index, AVMEDIA_TYPE_AUDIO, pkt_ctx->codec_id,
-                             format_ctx->streams[stream_index]->time_base.num,
-                             format_ctx->streams[stream_index]->time_base.den,
-                             AV_NOPTS_VALUE, AV_NOPTS_VALUE, frame_length );
             }
+            else
+                for( int i = 0; i < entry_count; i++ )
+                {
+                    /* extradata size */
+                    int extradata_size;
+                    if( sscanf( buf, "Size=%d", &extradata_size ) != 1 )
+                        goto fail_parsing;
+                    /* extradata */
+                    for( int i = 0; i < extradata_size; i++ )
+                        if( fgetc( index ) == EOF )
+                            goto fail_parsing;
+                    if( !fgets( buf, sizeof(buf), index )   /* new line ('\n') */
+                     || !fgets( buf, sizeof(buf), index ) ) /* the first line of the next entry */
+                        goto fail_parsing;
+                }
         }
+        if( strncmp( buf, "</ExtraDataList>", strlen( "</ExtraDataList>" ) ) )
+            goto fail_parsing;
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
     }
-    print_index( index, "</LibavReaderIndex>\n" );
-    /* Deallocate video frame info if no active video stream. */
-    if( vdhp->stream_index < 0 )
-        lw_freep( &video_info );
-    /* Deallocate audio frame info if no active audio stream. */
-    if( adhp->stream_index < 0 )
-        lw_freep( &audio_info );
-    else
+    if( !strncmp( buf, "</LibavReaderIndexFile>", strlen( "</LibavReaderIndexFile>" ) ) )
     {
-        /* Check the active stream is DV in AVI Type-1 or not. */
-        if( adhp->dv_in_avi == 1 && format_ctx->streams[ adhp->stream_index ]->nb_index_entries == 0 )
+        if( finish_parsing( &parser ) < 0 )
+            goto fail_parsing;
+        if( vdhp->stream_index != active_video_index || adhp->stream_index != active_audio_index )
         {
-            /* DV in AVI Type-1 */
-            audio_sample_count = video_info ? MIN( video_sample_count, audio_sample_count ) : 0;
-            for( uint32_t i = 1; i <= audio_sample_count; i++ )
-            {
-                audio_info[i].keyframe        = !!(video_info[i].flags & LW_VFRAME_FLAG_KEY);
-                audio_info[i].sample_number   = video_info[i].sample_number;
-                audio_info[i].pts             = video_info[i].pts;
-                audio_info[i].dts             = video_info[i].dts;
-                audio_info[i].file_offset     = video_info[i].file_offset;
-                audio_info[i].extradata_index = video_info[i].extradata_index;
-            }
+            /* Update the active stream indexes when specifying different stream indexes. */
+            lw_fseek( index, active_index_pos, SEEK_SET );
+            fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", vdhp->stream_index );
+            fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", adhp->stream_index );
         }
-        else
+        return 0;
+    }
+fail_parsing:
+    abort_parsing( &parser );
+    return -1;
+}
+
+typedef struct
+{
+    FILE             *file;
+    int               version;
+    int64_t           file_size;
+    int               active_video_index;
+    int               active_audio_index;
+    int               key_video_index;
+    int               key_audio_index;
+    int               finalized;
+    int               section_count;
+    lwindex_section_t section[LWINDEX_MAX_SECTIONS];
+} lwindex_reader_t;
+
+/* The binary magic has already been read from 'file'. */
+static int open_index_reader
+(
+    lwindex_reader_t *reader,
+    FILE             *file
+)
+{
+    memset( reader, 0, sizeof(lwindex_reader_t) );
+    reader->file = file;
+    uint8_t header[LWINDEX_HEADER_SIZE];
+    memcpy( header, LWINDEX_BINARY_MAGIC, LWINDEX_MAGIC_SIZE );
+    if( fread( header + LWINDEX_MAGIC_SIZE, 1, LWINDEX_HEADER_SIZE - LWINDEX_MAGIC_SIZE, file ) != LWINDEX_HEADER_SIZE - LWINDEX_MAGIC_SIZE )
+        return -1;
+    reader->version = lwindex_get_le32( header + 8 );
+    if( reader->version != INDEX_FILE_VERSION
+     || lwindex_get_le32( header + 12 ) != LWINDEX_HEADER_SIZE
+     || lwindex_get_le32( header + 16 ) != LIBAVUTIL_VERSION_MAJOR
+     || lwindex_get_le32( header + 20 ) != LIBAVCODEC_VERSION_MAJOR )
+        return -1;
+    reader->active_video_index    = (int32_t)lwindex_get_le32( header + 24 );
+    reader->active_audio_index    = (int32_t)lwindex_get_le32( header + 28 );
+    reader->key_video_index       = (int32_t)lwindex_get_le32( header + 32 );
+    reader->key_audio_index       = (int32_t)lwindex_get_le32( header + 36 );
+    reader->finalized             = lwindex_get_le32( header + 40 );
+    reader->section_count         = lwindex_get_le32( header + 44 );
+    if( reader->section_count > LWINDEX_MAX_SECTIONS )
+        return -1;
+    if( lw_fseek( file, 0, SEEK_END )
+     || (reader->file_size = lw_ftell( file )) < 0 )
+        return -1;
+    for( int i = 0; i < reader->section_count; i++ )
+    {
+        const uint8_t     *p       = header + 48 + i * 24;
+        lwindex_section_t *section = &reader->section[i];
+        section->tag         = lwindex_get_le32( p +  0 );
+        section->record_size = lwindex_get_le32( p +  4 );
+        section->offset      = lwindex_get_le64( p +  8 );
+        section->count       = lwindex_get_le64( p + 16 );
+        /* Check the section is within the file. */
+        if( section->record_size == 0
+         || section->offset > (uint64_t)reader->file_size
+         || section->count  > ((uint64_t)reader->file_size - section->offset) / section->record_size )
+            return -1;
+    }
+    return 0;
+}
+
+static lwindex_section_t *find_index_section
+(
+    lwindex_reader_t *reader,
+    uint32_t          tag,
+    uint32_t          record_size
+)
+{
+    for( int i = 0; i < reader->section_count; i++ )
+        if( reader->section[i].tag == tag )
+            return reader->section[i].record_size == record_size ? &reader->section[i] : NULL;
+    return NULL;
+}
+
+/* Read records [first, first + count) of 'section'.
+ * If 'decode' is NULL, raw records are stored into 'dst'. */
+static int read_index_records
+(
+    lwindex_reader_t  *reader,
+    lwindex_section_t *section,
+    uint64_t           first,
+    uint64_t           count,
+    void              *dst,
+    size_t             dst_size,
+    void (*decode)( const uint8_t *, void * )
+)
+{
+    if( first + count > section->count
+     || lw_fseek( reader->file, (int64_t)(section->offset + first * section->record_size), SEEK_SET ) )
+        return -1;
+    if( !decode )
+        return fread( dst, section->record_size, (size_t)count, reader->file ) == count ? 0 : -1;
+    uint8_t  buf[LWINDEX_IO_BUFFER_SIZE];
+    uint64_t max_count = sizeof(buf) / section->record_size;
+    uint8_t *out       = (uint8_t *)dst;
+    while( count )
+    {
+        uint64_t n = MIN( count, max_count );
+        if( fread( buf, section->record_size, (size_t)n, reader->file ) != n )
+            return -1;
+        for( uint64_t i = 0; i < n; i++ )
         {
-            if( adhp->dv_in_avi == 1 && opt->force_video && opt->force_video_index == -1 )
-            {
-                /* Disable DV video stream. */
-                disable_video_stream( vdhp );
-                video_info = NULL;
-            }
-            adhp->dv_in_avi = 0;
+            decode( buf + i * section->record_size, out );
+            out += dst_size;
         }
+        count -= n;
     }
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    return 0;
+}
+
+/* Find the records of 'kind' owned by the stream and return the first record number of them. */
+static int64_t find_index_group
+(
+    lwindex_reader_t *reader,
+    int               kind,
+    int               stream_index,
+    int               codec_type,
+    int              *count
+)
+{
+    *count = 0;
+    lwindex_section_t *section = find_index_section( reader, LWINDEX_SECTION_GRPS, LWINDEX_GROUP_RECORD_SIZE );
+    if( !section )
+        return -1;
+    int64_t first = 0;
+    for( uint64_t i = 0; i < section->count; i++ )
     {
-        AVStream *stream = format_ctx->streams[stream_index];
-        if( stream->codec->codec_type == AVMEDIA_TYPE_VIDEO )
+        lwindex_group_t group;
+        if( read_index_records( reader, section, i, 1, &group, sizeof(lwindex_group_t), decode_group_record ) < 0 )
+            return -1;
+        if( group.kind != kind )
+            continue;
+        if( group.stream_index == stream_index && group.codec_type == codec_type )
         {
-            print_index( index, "<StreamIndexEntries=%d,%d,%d>\n", stream_index, AVMEDIA_TYPE_VIDEO, stream->nb_index_entries );
-            if( vdhp->stream_index != stream_index )
-                for( int i = 0; i < stream->nb_index_entries; i++ )
-                    write_av_index_entry( index, &stream->index_entries[i] );
-            else if( stream->nb_index_entries > 0 )
-            {
-                vdhp->index_entries = (AVIndexEntry *)av_malloc( stream->index_entries_allocated_size );
-                if( !vdhp->index_entries )
-                    goto fail_index;
-                for( int i = 0; i < stream->nb_index_entries; i++ )
-                {
-                    AVIndexEntry *ie = &stream->index_entries[i];
-                    vdhp->index_entries[i] = *ie;
-                    write_av_index_entry( index, ie );
-                }
-                vdhp->index_entries_count = stream->nb_index_entries;
-            }
-            print_index( index, "</StreamIndexEntries>\n" );
+            *count = group.count;
+            return first;
         }
-        else if( stream->codec->codec_type == AVMEDIA_TYPE_AUDIO )
+        first += group.count;
+    }
+    return first;
+}
+
+static AVIndexEntry *read_index_entry_group
+(
+    lwindex_reader_t *reader,
+    int64_t           first,
+    int               count
+)
+{
+    lwindex_section_t *section = find_index_section( reader, LWINDEX_SECTION_IDXE, LWINDEX_ENTRY_RECORD_SIZE );
+    if( !section )
+        return NULL;
+    AVIndexEntry *entries = (AVIndexEntry *)av_malloc( count * sizeof(AVIndexEntry) );
+    if( !entries )
+        return NULL;
+    if( read_index_records( reader, section, first, count, entries, sizeof(AVIndexEntry), decode_index_entry_record ) < 0 )
+        av_freep( &entries );
+    return entries;
+}
+
+static int read_index_extradata_group
+(
+    lwindex_reader_t            *reader,
+    int64_t                      first,
+    int                          count,
+    lwlibav_extradata_handler_t *exhp
+)
+{
+    lwindex_section_t *section = find_index_section( reader, LWINDEX_SECTION_EXTD, LWINDEX_EXTRADATA_RECORD_SIZE );
+    lwindex_section_t *blob    = find_index_section( reader, LWINDEX_SECTION_BLOB, 1 );
+    if( !section || !blob || !alloc_extradata_entries( exhp, count ) )
+        return -1;
+    for( int i = 0; i < count; i++ )
+    {
+        lwlibav_extradata_t *entry = &exhp->entries[i];
+        uint8_t p[LWINDEX_EXTRADATA_RECORD_SIZE];
+        if( read_index_records( reader, section, first + i, 1, p, 0, NULL ) < 0 )
+            goto fail;
+        entry->extradata_size  = (int32_t)lwindex_get_le32( p +  0 );
+        entry->codec_id        = (enum AVCodecID)(int32_t)lwindex_get_le32( p +  4 );
+        entry->codec_tag       = lwindex_get_le32( p +  8 );
+        entry->width           = (int32_t)lwindex_get_le32( p + 12 );
+        entry->height          = (int32_t)lwindex_get_le32( p + 16 );
+        entry->pixel_format    = (enum AVPixelFormat)(int32_t)lwindex_get_le32( p + 20 );
+        entry->channel_layout  = lwindex_get_le64( p + 24 );
+        entry->sample_rate     = (int32_t)lwindex_get_le32( p + 32 );
+        entry->sample_format   = (enum AVSampleFormat)(int32_t)lwindex_get_le32( p + 36 );
+        entry->bits_per_sample = (int32_t)lwindex_get_le32( p + 40 );
+        entry->block_align     = (int32_t)lwindex_get_le32( p + 44 );
+        if( entry->extradata_size < 0 )
+            goto fail;
+        if( entry->extradata_size > 0 )
         {
-            print_index( index, "<StreamIndexEntries=%d,%d,%d>\n", stream_index, AVMEDIA_TYPE_AUDIO, stream->nb_index_entries );
-            if( adhp->stream_index != stream_index )
-                for( int i = 0; i < stream->nb_index_entries; i++ )
-                    write_av_index_entry( index, &stream->index_entries[i] );
-            else if( stream->nb_index_entries > 0 )
-            {
-                /* Audio stream in matroska container requires index_entries for seeking.
-                 * This avoids for re-reading the file to create index_entries since the file will be closed once. */
-                adhp->index_entries = (AVIndexEntry *)av_malloc( stream->index_entries_allocated_size );
-                if( !adhp->index_entries )
-                    goto fail_index;
-                for( int i = 0; i < stream->nb_index_entries; i++ )
-                {
-                    AVIndexEntry *ie = &stream->index_entries[i];
-                    adhp->index_entries[i] = *ie;
-                    write_av_index_entry( index, ie );
-                }
-                adhp->index_entries_count = stream->nb_index_entries;
-            }
-            print_index( index, "</StreamIndexEntries>\n" );
+            entry->extradata = (uint8_t *)av_malloc( entry->extradata_size + FF_INPUT_BUFFER_PADDING_SIZE );
+            if( !entry->extradata
+             || read_index_records( reader, blob, lwindex_get_le64( p + 48 ), entry->extradata_size, entry->extradata, 1, NULL ) < 0 )
+                goto fail;
+            memset( entry->extradata + entry->extradata_size, 0, FF_INPUT_BUFFER_PADDING_SIZE );
         }
     }
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    return 0;
+fail:
+    free_extradata_entries( exhp );
+    return -1;
+}
+
+static int load_index_entries
+(
+    lwindex_reader_t         *reader,
+    lwlibav_decode_handler_t *dhp,
+    int                       codec_type
+)
+{
+    int     count;
+    int64_t first = find_index_group( reader, LWINDEX_GROUP_INDEX_ENTRIES, dhp->stream_index, codec_type, &count );
+    if( first < 0 )
+        return -1;
+    if( count <= 0 )
+        return 0;
+    dhp->index_entries = read_index_entry_group( reader, first, count );
+    if( !dhp->index_entries )
+        return -1;
+    dhp->index_entries_count = count;
+    return 0;
+}
+
+static int load_index_extradata
+(
+    lwindex_reader_t            *reader,
+    lwlibav_extradata_handler_t *exhp,
+    int                          stream_index,
+    int                          codec_type
+)
+{
+    int     count;
+    int64_t first = find_index_group( reader, LWINDEX_GROUP_EXTRADATA, stream_index, codec_type, &count );
+    if( first < 0 )
+        return -1;
+    if( count <= 0 )
+        return 0;
+    return read_index_extradata_group( reader, first, count, exhp );
+}
+
+/* Load the finalized video and audio tables as they are. */
+static int load_finalized_tables
+(
+    lwindex_reader_t               *reader,
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt
+)
+{
+    AVRational video_time_base = { 0, 0 };
+    AVRational audio_time_base = { 0, 0 };
+    int        audio_sample_rate = 0;
+    uint8_t    info[LWINDEX_AUDIO_INFO_SIZE];
+    lwindex_section_t *section;
+    /* No VINF or AINF means the stream has been disabled. */
+    lwindex_section_t *video_section = find_index_section( reader, LWINDEX_SECTION_VINF, LWINDEX_VIDEO_INFO_SIZE );
+    lwindex_section_t *audio_section = find_index_section( reader, LWINDEX_SECTION_AINF, LWINDEX_AUDIO_INFO_SIZE );
+    vdhp->stream_index = -1;
+    adhp->stream_index = -1;
+    adhp->dv_in_avi    = 0;
+    if( video_section )
     {
-        AVStream *stream = format_ctx->streams[stream_index];
-        if( stream->codec->codec_type == AVMEDIA_TYPE_VIDEO || stream->codec->codec_type == AVMEDIA_TYPE_AUDIO )
+        if( read_index_records( reader, video_section, 0, 1, info, 0, NULL ) < 0 )
+            return -1;
+        vdhp->stream_index       = (int32_t)lwindex_get_le32( info +  0 );
+        vdhp->codec_id           = (enum AVCodecID)(int32_t)lwindex_get_le32( info +  4 );
+        vdhp->lw_seek_flags      = (int32_t)lwindex_get_le32( info +  8 );
+        vdhp->frame_count        = lwindex_get_le32( info + 12 );
+        vdhp->initial_width      = (int32_t)lwindex_get_le32( info + 16 );
+        vdhp->initial_height     = (int32_t)lwindex_get_le32( info + 20 );
+        vdhp->max_width          = (int32_t)lwindex_get_le32( info + 24 );
+        vdhp->max_height         = (int32_t)lwindex_get_le32( info + 28 );
+        vdhp->initial_pix_fmt    = (enum AVPixelFormat)(int32_t)lwindex_get_le32( info + 32 );
+        vdhp->initial_colorspace = (enum AVColorSpace)(int32_t)lwindex_get_le32( info + 36 );
+        video_time_base.num      = (int32_t)lwindex_get_le32( info + 40 );
+        video_time_base.den      = (int32_t)lwindex_get_le32( info + 44 );
+        int has_order_converter  = lwindex_get_le32( info + 52 );
+        uint32_t frame_count = vdhp->frame_count;
+        /* Check the frame count read from the file against the sections before allocating by it.
+         * The section counts are bounded by the file size, so the list size never wraps around. */
+        lwindex_section_t *frame_section = find_index_section( reader, LWINDEX_SECTION_VFRM, LWINDEX_VIDEO_FRAME_RECORD_SIZE );
+        lwindex_section_t *key_section   = find_index_section( reader, LWINDEX_SECTION_VKEY, 1 );
+        lwindex_section_t *order_section = has_order_converter ? find_index_section( reader, LWINDEX_SECTION_VORD, 4 ) : NULL;
+        if( !frame_section || frame_section->count != frame_count
+         || !key_section   || key_section->count   != (uint64_t)frame_count + 1
+         || (has_order_converter && (!order_section || order_section->count != (uint64_t)frame_count + 1)) )
+            return -1;
+        size_t list_size = (size_t)frame_count + 1;
+        vdhp->frame_list    = (video_frame_info_t *)lw_malloc_zero( list_size * sizeof(video_frame_info_t) );
+        vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( list_size * sizeof(uint8_t) );
+        if( !vdhp->frame_list || !vdhp->keyframe_list )
+            return -1;
+        video_frame_info_t *video_info = (video_frame_info_t *)vdhp->frame_list;
+        if( read_index_records( reader, frame_section, 0, frame_count, &video_info[1], sizeof(video_frame_info_t), decode_video_frame_record ) < 0
+         || read_index_records( reader, key_section, 0, list_size, vdhp->keyframe_list, 1, NULL ) < 0
+         || create_video_rap_list( vdhp, frame_count ) < 0 )
+            return -1;
+        if( has_order_converter )
         {
-            lwindex_helper_t *helper = (lwindex_helper_t *)stream->codec->opaque;
-            if( !helper )
-                continue;
-            lwlibav_extradata_handler_t *list = &helper->exh;
-            void (*write_av_extradata)( FILE *, lwlibav_extradata_t * ) = stream->codec->codec_type == AVMEDIA_TYPE_VIDEO
-                                                                        ? write_video_extradata
-                                                                        : write_audio_extradata;
-            print_index( index, "<ExtraDataList=%d,%d,%d>\n", stream_index, stream->codec->codec_type, list->entry_count );
-            if( (stream->codec->codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
-             || (stream->codec->codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index) )
-            {
-                for( int i = 0; i < list->entry_count; i++ )
-                    write_av_extradata( index, &list->entries[i] );
-                lwlibav_extradata_handler_t *exhp = stream->codec->codec_type == AVMEDIA_TYPE_VIDEO ? &vdhp->exh : &adhp->exh;
-                exhp->entry_count   = list->entry_count;
-                exhp->entries       = list->entries;
-                exhp->current_index = stream->codec->codec_type == AVMEDIA_TYPE_VIDEO
-                                    ? video_info[1].extradata_index
-                                    : audio_info[1].extradata_index;
-                /* Avoid freeing entries. */
-                list->entry_count = 0;
-                list->entries     = NULL;
-            }
-            else
-                for( int i = 0; i < list->entry_count; i++ )
-                    write_av_extradata( index, &list->entries[i] );
-            print_index( index, "</ExtraDataList>\n" );
+            vdhp->order_converter = (order_converter_t *)lw_malloc_zero( list_size * sizeof(order_converter_t) );
+            if( !vdhp->order_converter
+             || read_index_records( reader, order_section, 0, list_size, vdhp->order_converter, sizeof(order_converter_t), decode_order_converter_record ) < 0 )
+                return -1;
         }
+        if( load_index_entries( reader, (lwlibav_decode_handler_t *)vdhp, AVMEDIA_TYPE_VIDEO ) < 0
+         || load_index_extradata( reader, &vdhp->exh, vdhp->stream_index, AVMEDIA_TYPE_VIDEO ) < 0 )
+            return -1;
+        vdhp->exh.current_index = (int32_t)lwindex_get_le32( info + 48 );
+        /* Create the repeat control info. */
+        create_video_frame_order_list( vdhp, vohp, opt );
+    }
+    if( audio_section )
+    {
+        if( read_index_records( reader, audio_section, 0, 1, info, 0, NULL ) < 0 )
+            return -1;
+        adhp->stream_index           = (int32_t)lwindex_get_le32( info +  0 );
+        adhp->codec_id               = (enum AVCodecID)(int32_t)lwindex_get_le32( info +  4 );
+        adhp->lw_seek_flags          = (int32_t)lwindex_get_le32( info +  8 );
+        adhp->frame_count            = lwindex_get_le32( info + 12 );
+        adhp->frame_length           = (int32_t)lwindex_get_le32( info + 16 );
+        adhp->dv_in_avi              = (int32_t)lwindex_get_le32( info + 20 );
+        audio_time_base.num          = (int32_t)lwindex_get_le32( info + 24 );
+        audio_time_base.den          = (int32_t)lwindex_get_le32( info + 28 );
+        audio_sample_rate            = (int32_t)lwindex_get_le32( info + 32 );
+        aohp->output_channel_layout  = lwindex_get_le64( info + 40 );
+        aohp->output_sample_format   = (enum AVSampleFormat)(int32_t)lwindex_get_le32( info + 48 );
+        aohp->output_sample_rate     = (int32_t)lwindex_get_le32( info + 52 );
+        aohp->output_bits_per_sample = (int32_t)lwindex_get_le32( info + 56 );
+        uint32_t frame_count = adhp->frame_count;
+        if( !(section = find_index_section( reader, LWINDEX_SECTION_AFRM, LWINDEX_AUDIO_FRAME_RECORD_SIZE ))
+         || section->count != frame_count )
+            return -1;
+        adhp->frame_list = (audio_frame_info_t *)lw_malloc_zero( ((size_t)frame_count + 1) * sizeof(audio_frame_info_t) );
+        if( !adhp->frame_list
+         || read_index_records( reader, section, 0, frame_count, &((audio_frame_info_t *)adhp->frame_list)[1],
+                                sizeof(audio_frame_info_t), decode_audio_frame_record ) < 0 )
+            return -1;
+        if( load_index_entries( reader, (lwlibav_decode_handler_t *)adhp, AVMEDIA_TYPE_AUDIO ) < 0
+         || load_index_extradata( reader, &adhp->exh, adhp->stream_index, AVMEDIA_TYPE_AUDIO ) < 0 )
+            return -1;
+        adhp->exh.current_index = (int32_t)lwindex_get_le32( info + 36 );
+        if( opt->av_sync && vdhp->stream_index >= 0 )
+            lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp, video_time_base, audio_time_base, audio_sample_rate );
+    }
+    return 0;
+}
+
+static void release_loaded_tables
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp
+)
+{
+    lw_freep( &vdhp->frame_list );
+    lw_freep( &vdhp->keyframe_list );
+    lw_freep( &vdhp->rap_list );
+    lw_freep( &vdhp->order_converter );
+    lw_freep( &adhp->frame_list );
+    av_freep( &vdhp->index_entries );
+    av_freep( &adhp->index_entries );
+    vdhp->index_entries_count = 0;
+    adhp->index_entries_count = 0;
+    free_extradata_entries( &vdhp->exh );
+    free_extradata_entries( &adhp->exh );
+    vdhp->frame_count            = 0;
+    adhp->frame_count            = 0;
+    vdhp->initial_width          = 0;
+    vdhp->initial_height         = 0;
+    vdhp->max_width              = 0;
+    vdhp->max_height             = 0;
+    aohp->output_channel_layout  = 0;
+    aohp->output_sample_rate     = 0;
+    aohp->output_bits_per_sample = 0;
+}
+
+/* Rebuild the tables from the packet records for the stream selection different from the finalized one. */
+static int rebuild_index_tables
+(
+    lwindex_reader_t               *reader,
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt
+)
+{
+    lwindex_section_t *section = find_index_section( reader, LWINDEX_SECTION_PKTS, LWINDEX_PACKET_RECORD_SIZE );
+    if( !section )
+        return -1;
+    lwindex_packet_record_t records[128];
+    lwindex_parser_t parser;
+    if( init_index_parser( &parser, lwhp, vdhp, vohp, adhp, aohp, opt, reader->active_video_index, reader->active_audio_index ) < 0 )
+        goto fail_parsing;
+    for( uint64_t i = 0; i < section->count; )
+    {
+        uint64_t n = MIN( section->count - i, sizeof(records) / sizeof(records[0]) );
+        if( read_index_records( reader, section, i, n, records, sizeof(lwindex_packet_record_t), decode_packet_record ) < 0 )
+            goto fail_parsing;
+        for( uint64_t j = 0; j < n; j++ )
+            if( parse_packet_record( &parser, &records[j] ) < 0 )
+                goto fail_parsing;
+        i += n;
     }
-    print_index( index, "</LibavReaderIndexFile>\n" );
+    if( check_parsed_streams( &parser ) < 0 )
+        goto fail_parsing;  /* Need to re-create the index file. */
     if( vdhp->stream_index >= 0 )
     {
-        vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (video_sample_count + 1) * sizeof(uint8_t) );
-        if( !vdhp->keyframe_list )
-            goto fail_index;
-        vdhp->frame_list      = video_info;
-        vdhp->frame_count     = video_sample_count;
-        vdhp->initial_pix_fmt = vdhp->ctx->pix_fmt;
-        if( decide_video_seek_method( lwhp, vdhp, video_sample_count, format_ctx->streams[ vdhp->stream_index ]->time_base ) )
-            goto fail_index;
-        /* Create the repeat control info. */
-        create_video_frame_order_list( vdhp, vohp, opt );
+        if( load_index_entries( reader, (lwlibav_decode_handler_t *)vdhp, AVMEDIA_TYPE_VIDEO ) < 0
+         || load_index_extradata( reader, &vdhp->exh, vdhp->stream_index, AVMEDIA_TYPE_VIDEO ) < 0 )
+            goto fail_parsing;
+        if( vdhp->exh.entry_count > 0 )
+            vdhp->exh.current_index = get_parsed_initial_extradata_index( &parser, AVMEDIA_TYPE_VIDEO );
     }
     if( adhp->stream_index >= 0 )
     {
-        adhp->frame_list   = audio_info;
-        adhp->frame_count  = audio_sample_count;
-        adhp->frame_length = constant_frame_length ? adhp->frame_list[1].length : 0;
-        decide_audio_seek_method( lwhp, adhp, audio_sample_count );
-        if( opt->av_sync && vdhp->stream_index >= 0 )
-            lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp,
-                                             format_ctx->streams[ vdhp->stream_index ]->time_base,
-                                             format_ctx->streams[ adhp->stream_index ]->time_base,
-                                             audio_sample_rate );
+        if( load_index_entries( reader, (lwlibav_decode_handler_t *)adhp, AVMEDIA_TYPE_AUDIO ) < 0
+         || load_index_extradata( reader, &adhp->exh, adhp->stream_index, AVMEDIA_TYPE_AUDIO ) < 0 )
+            goto fail_parsing;
+        if( adhp->exh.entry_count > 0 )
+            adhp->exh.current_index = get_parsed_initial_extradata_index( &parser, AVMEDIA_TYPE_AUDIO );
     }
-    cleanup_index_helpers( format_ctx );
-    if( index )
-        fclose( index );
-    if( indicator->close )
-        indicator->close( php );
-    vdhp->format = NULL;
-    adhp->format = NULL;
-    return;
-fail_index:
-    cleanup_index_helpers( format_ctx );
-    free( video_info );
-    free( audio_info );
-    if( index )
-        fclose( index );
-    if( indicator->close )
-        indicator->close( php );
-    vdhp->format = NULL;
-    adhp->format = NULL;
-    return;
+    if( finish_parsing( &parser ) < 0 )
+        goto fail_parsing;
+    return 0;
+fail_parsing:
+    abort_parsing( &parser );
+    return -1;
 }
 
-static int parse_index
+/* Read the input file path and the demuxer information from the INFO section.
+ * The returned strings are allocated by lw_malloc_zero(). */
+static int read_index_file_info
+(
+    lwindex_reader_t *reader,
+    char            **file_path,
+    char            **format_name,
+    int              *format_flags,
+    int              *raw_demuxer
+)
+{
+    *file_path   = NULL;
+    *format_name = NULL;
+    uint8_t info[LWINDEX_INFO_SIZE];
+    lwindex_section_t *section = find_index_section( reader, LWINDEX_SECTION_INFO, 1 );
+    if( !section
+     || read_index_records( reader, section, 0, LWINDEX_INFO_SIZE, info, 1, NULL ) < 0 )
+        return -1;
+    uint32_t file_path_length   = lwindex_get_le32( info +  8 );
+    uint32_t format_name_length = lwindex_get_le32( info + 12 );
+    if( (uint64_t)LWINDEX_INFO_SIZE + file_path_length + format_name_length > section->count )
+        return -1;
+    *file_path   = (char *)lw_malloc_zero( file_path_length   + 1 );
+    *format_name = (char *)lw_malloc_zero( format_name_length + 1 );
+    if( !*file_path || !*format_name
+     || read_index_records( reader, section, LWINDEX_INFO_SIZE, file_path_length, *file_path, 1, NULL ) < 0
+     || read_index_records( reader, section, LWINDEX_INFO_SIZE + file_path_length, format_name_length, *format_name, 1, NULL ) < 0 )
+    {
+        lw_freep( file_path );
+        lw_freep( format_name );
+        return -1;
+    }
+    *format_flags = (int32_t)lwindex_get_le32( info + 0 );
+    *raw_demuxer  = (int32_t)lwindex_get_le32( info + 4 );
+    return 0;
+}
+
+static int parse_binary_index
 (
     lwlibav_file_handler_t         *lwhp,
     lwlibav_video_decode_handler_t *vdhp,
@@ -2079,467 +4776,1046 @@ static int parse_index
     FILE                           *index
 )
 {
-    /* Test to open the target file. */
-    char file_path[512] = { 0 };
-    if( fscanf( index, "<InputFilePath>%[^\n<]</InputFilePath>\n", file_path ) != 1 )
+    lwindex_reader_t reader;
+    char *file_path;
+    char *format_name;
+    if( open_index_reader( &reader, index ) < 0
+     || read_index_file_info( &reader, &file_path, &format_name, &lwhp->format_flags, &lwhp->raw_demuxer ) < 0 )
         return -1;
+    /* Test to open the target file. */
     FILE *target = fopen( file_path, "rb" );
     if( !target )
+    {
+        lw_freep( &file_path );
+        lw_freep( &format_name );
         return -1;
+    }
     fclose( target );
-    int file_path_length = strlen( file_path );
-    lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
-    if( !lwhp->file_path )
+    lwhp->file_path   = file_path;
+    lwhp->format_name = format_name;
+    int video_index = opt->force_video ? opt->force_video_index : reader.active_video_index;
+    int audio_index = opt->force_audio ? opt->force_audio_index : reader.active_audio_index;
+    int finalized   = LWINDEX_FINALIZED
+                    | (opt->force_video ? LWINDEX_FINALIZED_FORCE_VIDEO : 0)
+                    | (opt->force_audio ? LWINDEX_FINALIZED_FORCE_AUDIO : 0);
+    int ret;
+    if( reader.finalized   == finalized
+     && reader.key_video_index == video_index
+     && reader.key_audio_index == audio_index )
+    {
+        /* The finalized tables were made for this stream selection. */
+        ret = load_finalized_tables( &reader, lwhp, vdhp, vohp, adhp, aohp, opt );
+        if( ret < 0 )
+            release_loaded_tables( vdhp, adhp, aohp );
+    }
+    else
+        ret = rebuild_index_tables( &reader, lwhp, vdhp, vohp, adhp, aohp, opt );
+    if( ret == 0 && (video_index != reader.active_video_index || audio_index != reader.active_audio_index) )
+    {
+        /* Update the active stream indexes when specifying different stream indexes. */
+        uint8_t active[8];
+        lwindex_put_le32( active + 0, video_index );
+        lwindex_put_le32( active + 4, audio_index );
+        if( lw_fseek( index, 24, SEEK_SET ) == 0 )
+            fwrite( active, 1, 8, index );
+    }
+    /* The demuxer name is needed only while parsing. */
+    lwhp->format_name = NULL;
+    lw_freep( &format_name );
+    return ret;
+}
+
+#define LWINDEX_CACHE_DIR_ENV       "LWLIBAV_INDEX_CACHE_DIR"
+#define LWINDEX_CACHE_KEY_CHUNK_SIZE (1 << 20)  /* arbitrary */
+
+static uint64_t update_fnv1a_hash
+(
+    uint64_t    hash,
+    const void *data,
+    size_t      size
+)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    for( size_t i = 0; i < size; i++ )
+    {
+        hash ^= p[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+/* Compute the key of the cached index file from the path, the size and the last modification time
+ * of the source file, and the data at its head and tail.
+ * Return -1 if the source file is inaccessible. */
+static int compute_index_cache_key
+(
+    const char *file_path,
+    uint64_t   *key
+)
+{
+#ifdef _WIN32
+    struct _stati64 st;
+    if( _stati64( file_path, &st ) )
         return -1;
-    memcpy( lwhp->file_path, file_path, file_path_length );
-    /* Parse the index file. */
-    char format_name[256];
-    int active_video_index;
-    int active_audio_index;
-    if( fscanf( index, "<LibavReaderIndex=0x%x,%d,%[^>]>\n", &lwhp->format_flags, &lwhp->raw_demuxer, format_name ) != 3 )
+#else
+    struct stat st;
+    if( stat( file_path, &st ) )
         return -1;
-    int32_t active_index_pos = ftell( index );
-    if( fscanf( index, "<ActiveVideoStreamIndex>%d</ActiveVideoStreamIndex>\n", &active_video_index ) != 1
-     || fscanf( index, "<ActiveAudioStreamIndex>%d</ActiveAudioStreamIndex>\n", &active_audio_index ) != 1 )
+#endif
+    FILE *file = fopen( file_path, "rb" );
+    if( !file )
         return -1;
-    lwhp->format_name = format_name;
-    adhp->dv_in_avi = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
-    int video_present = (active_video_index >= 0);
-    int audio_present = (active_audio_index >= 0);
-    vdhp->stream_index = opt->force_video ? opt->force_video_index : active_video_index;
-    adhp->stream_index = opt->force_audio ? opt->force_audio_index : active_audio_index;
-    uint32_t video_info_count = 1 << 16;
-    uint32_t audio_info_count = 1 << 16;
-    video_frame_info_t *video_info = NULL;
-    audio_frame_info_t *audio_info = NULL;
-    if( vdhp->stream_index >= 0 )
+    uint8_t *buf = (uint8_t *)malloc( LWINDEX_CACHE_KEY_CHUNK_SIZE );
+    if( !buf )
+    {
+        fclose( file );
+        return -1;
+    }
+    uint64_t file_size = (uint64_t)st.st_size;
+    uint8_t  attributes[16];
+    lwindex_put_le64( attributes + 0, file_size );
+    lwindex_put_le64( attributes + 8, (uint64_t)st.st_mtime );
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    hash = update_fnv1a_hash( hash, file_path, strlen( file_path ) );
+    hash = update_fnv1a_hash( hash, attributes, sizeof(attributes) );
+    /* head */
+    size_t size = fread( buf, 1, LWINDEX_CACHE_KEY_CHUNK_SIZE, file );
+    hash = update_fnv1a_hash( hash, buf, size );
+    /* tail, not overlapping with the head */
+    if( file_size > LWINDEX_CACHE_KEY_CHUNK_SIZE )
+    {
+        int64_t tail_size = (int64_t)MIN( file_size - LWINDEX_CACHE_KEY_CHUNK_SIZE, LWINDEX_CACHE_KEY_CHUNK_SIZE );
+        if( lw_fseek( file, -tail_size, SEEK_END ) == 0 )
+        {
+            size = fread( buf, 1, tail_size, file );
+            hash = update_fnv1a_hash( hash, buf, size );
+        }
+    }
+    free( buf );
+    fclose( file );
+    *key = hash;
+    return 0;
+}
+
+/* Get the path of the index file for the source. The returned string is allocated by lw_malloc_zero().
+ * If an index cache directory is given by the option or the environment variable LWLIBAV_INDEX_CACHE_DIR,
+ * the index file is placed in it and named after the key of the source file, so that the index of a source
+ * on read-only storage can be created once and shared among processes. Otherwise it is placed beside the source. */
+static char *get_index_file_path
+(
+    const char *file_path,
+    const char *cache_dir
+)
+{
+    if( !cache_dir || !cache_dir[0] )
+        cache_dir = getenv( LWINDEX_CACHE_DIR_ENV );
+    uint64_t key;
+    size_t   file_path_length = strlen( file_path );
+    if( cache_dir && cache_dir[0] && compute_index_cache_key( file_path, &key ) == 0 )
+    {
+        size_t dir_length = strlen( cache_dir );
+        int    separator  = cache_dir[dir_length - 1] != '/' && cache_dir[dir_length - 1] != '\\';
+        char  *index_file_path = (char *)lw_malloc_zero( dir_length + 32 );
+        if( !index_file_path )
+            return NULL;
+        sprintf( index_file_path, "%s%s%08x%08x.lwi", cache_dir, separator ? "/" : "",
+                 (unsigned int)(key >> 32), (unsigned int)(key & 0xffffffff) );
+        return index_file_path;
+    }
+    char *index_file_path = (char *)lw_malloc_zero( file_path_length + 5 );
+    if( !index_file_path )
+        return NULL;
+    memcpy( index_file_path, file_path, file_path_length );
+    memcpy( index_file_path + file_path_length, ".lwi", strlen( ".lwi" ) );
+    return index_file_path;
+}
+
+/* Extend the index file of a growing source file.
+ * The packet records preceding the resume point recorded in the RSUM section are taken over,
+ * and only the rest of the source is demuxed from the resume point. The tables are rebuilt from the packet records.
+ * Return 0 if succeeded, 1 if not applicable and -1 if failed. */
+static int append_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lw_log_handler_t               *lhp,
+    lwlibav_option_t               *opt,
+    const char                     *index_path,
+    progress_indicator_t           *indicator,
+    progress_handler_t             *php
+)
+{
+    FILE *index = fopen( index_path, "rb" );
+    if( !index )
+        return 1;
+    char               magic[LWINDEX_MAGIC_SIZE];
+    uint8_t            resume[LWINDEX_RESUME_INFO_SIZE];
+    lwindex_reader_t   reader;
+    lwindex_section_t *section;
+    char              *file_path   = NULL;
+    char              *format_name = NULL;
+    int                format_flags;
+    int                raw_demuxer;
+    if( fread( magic, 1, LWINDEX_MAGIC_SIZE, index ) != LWINDEX_MAGIC_SIZE
+     || memcmp( magic, LWINDEX_BINARY_MAGIC, LWINDEX_MAGIC_SIZE )
+     || open_index_reader( &reader, index ) < 0
+     || !(section = find_index_section( &reader, LWINDEX_SECTION_RSUM, LWINDEX_RESUME_INFO_SIZE ))
+     || read_index_records( &reader, section, 0, 1, resume, 0, NULL ) < 0
+     || read_index_file_info( &reader, &file_path, &format_name, &format_flags, &raw_demuxer ) < 0 )
     {
-        video_info = (video_frame_info_t *)lw_malloc_zero( video_info_count * sizeof(video_frame_info_t) );
-        if( !video_info )
-            goto fail_parsing;
+        fclose( index );
+        return 1;
     }
-    if( adhp->stream_index >= 0 )
+    int64_t  source_size   = (int64_t)lwindex_get_le64( resume +  0 );
+    int64_t  resume_pos    = (int64_t)lwindex_get_le64( resume +  8 );
+    uint64_t resume_record = lwindex_get_le64( resume + 16 );
+    uint32_t resume_hash   = lwindex_get_le32( resume + 24 );
+    uint32_t source_hash;
+    /* Check the source file has grown since indexing, and the bytes described by the packet records taken over are unchanged.
+     * Otherwise, e.g. if the source has been replaced by another larger file, the whole source is indexed again. */
+#ifdef _WIN32
+    struct _stati64 st;
+    if( _stati64( file_path, &st ) || (int64_t)st.st_size <= source_size
+#else
+    struct stat st;
+    if( stat( file_path, &st ) || (int64_t)st.st_size <= source_size
+#endif
+     || resume_pos < 0 || resume_pos >= source_size
+     || hash_resume_point( file_path, source_size, resume_pos, &source_hash ) < 0
+     || source_hash != resume_hash )
     {
-        audio_info = (audio_frame_info_t *)lw_malloc_zero( audio_info_count * sizeof(audio_frame_info_t) );
-        if( !audio_info )
-            goto fail_parsing;
+        lw_freep( &file_path );
+        lw_freep( &format_name );
+        fclose( index );
+        return 1;
     }
-    vdhp->codec_id             = AV_CODEC_ID_NONE;
-    adhp->codec_id             = AV_CODEC_ID_NONE;
-    vdhp->initial_pix_fmt      = AV_PIX_FMT_NONE;
-    vdhp->initial_colorspace   = AVCOL_SPC_NB;
-    aohp->output_sample_format = AV_SAMPLE_FMT_NONE;
-    uint32_t video_sample_count    = 0;
-    int64_t  last_keyframe_pts     = AV_NOPTS_VALUE;
-    uint32_t audio_sample_count    = 0;
-    int      audio_sample_rate     = 0;
-    int      constant_frame_length = 1;
-    uint64_t audio_duration        = 0;
-    AVRational video_time_base     = { 0, 0 };
-    AVRational audio_time_base     = { 0, 0 };
-    char buf[1024];
-    while( fgets( buf, sizeof(buf), index ) )
+    lwindex_writer_t             writer;
+    lwindex_parser_t             parser;
+    lwindex_pipeline_t           pipeline;
+    AVFormatContext             *format_ctx  = NULL;
+    lwlibav_extradata_handler_t *initial_exh = NULL;
+    int                          stream_count = 0;
+    int64_t                      filesize     = 0;
+    lwindex_packet_record_t      records[128];
+    memset( &pipeline, 0, sizeof(lwindex_pipeline_t) );
+    writer.file = NULL;
+    lwhp->file_path    = file_path;
+    lwhp->format_flags = format_flags;
+    lwhp->raw_demuxer  = raw_demuxer;
+    lwhp->threads      = opt->threads;
+    av_register_all();
+    avcodec_register_all();
+    if( lavf_open_file( &format_ctx, file_path, lhp )
+     || strcmp( format_ctx->iformat->name, format_name )
+     || !is_index_appendable( format_ctx ) )
     {
-        int stream_index;
-        int codec_type;
-        int codec_id;
-        int extradata_index;
-        AVRational time_base;
-        int64_t pos;
-        int64_t pts;
-        int64_t dts;
-        if( sscanf( buf, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%"SCNd64",PTS=%"SCNd64",DTS=%"SCNd64",EDI=%d",
-                    &stream_index, &codec_type, &codec_id, &time_base.num, &time_base.den, &pos, &pts, &dts, &extradata_index ) != 9 )
-            break;
-        if( codec_type == AVMEDIA_TYPE_VIDEO )
+        if( format_ctx )
+            lavf_close_file( &format_ctx );
+        lw_freep( &lwhp->file_path );
+        lw_freep( &format_name );
+        fclose( index );
+        return 1;
+    }
+    lw_freep( &format_name );
+    lwhp->format_name = (char *)format_ctx->iformat->name;
+    vdhp->format      = format_ctx;
+    adhp->format      = format_ctx;
+    if( indicator->open )
+        indicator->open( php );
+    init_index_parser( &parser, lwhp, vdhp, vohp, adhp, aohp, opt, reader.active_video_index, reader.active_audio_index );
+    /* Take over AVIndexEntrys and extradata lists of the preceding indexing. */
+    stream_count = format_ctx->nb_streams;
+    initial_exh  = (lwlibav_extradata_handler_t *)lw_malloc_zero( stream_count * sizeof(lwlibav_extradata_handler_t) );
+    if( !initial_exh )
+        goto fail_append;
+    for( int stream_index = 0; stream_index < stream_count; stream_index++ )
+    {
+        AVStream *stream     = format_ctx->streams[stream_index];
+        int       codec_type = stream->codec->codec_type;
+        if( codec_type != AVMEDIA_TYPE_VIDEO && codec_type != AVMEDIA_TYPE_AUDIO )
+            continue;
+        int     count;
+        int64_t first = find_index_group( &reader, LWINDEX_GROUP_INDEX_ENTRIES, stream_index, codec_type, &count );
+        if( first < 0 )
+            goto fail_append;
+        if( count > 0 )
         {
-            if( !fgets( buf, sizeof(buf), index ) )
-                goto fail_parsing;
-            if( adhp->dv_in_avi == -1 && codec_id == AV_CODEC_ID_DVVIDEO && !opt->force_audio )
-            {
-                adhp->dv_in_avi = 1;
-                if( vdhp->stream_index == -1 )
-                {
-                    vdhp->stream_index = stream_index;
-                    video_info = (video_frame_info_t *)lw_malloc_zero( video_info_count * sizeof(video_frame_info_t) );
-                    if( !video_info )
-                        goto fail_parsing;
-                }
-            }
-            if( stream_index == vdhp->stream_index )
-            {
-                int pict_type;
-                int poc;
-                int repeat_pict;
-                int field_info;
-                int key;
-                int width;
-                int height;
-                int colorspace;
-                char pix_fmt[64];
-                if( sscanf( buf, "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d,Width=%d,Height=%d,Format=%[^,],ColorSpace=%d",
-                            &key, &pict_type, &poc, &repeat_pict, &field_info, &width, &height, pix_fmt, &colorspace ) != 9 )
-                    goto fail_parsing;
-                if( vdhp->codec_id == AV_CODEC_ID_NONE )
-                    vdhp->codec_id = (enum AVCodecID)codec_id;
-                if( (key | width | height) || pict_type == -1 || colorspace != AVCOL_SPC_NB )
-                {
-                    if( vdhp->initial_width == 0 || vdhp->initial_height == 0 )
-                    {
-                        vdhp->initial_width  = width;
-                        vdhp->initial_height = height;
-                        vdhp->max_width      = width;
-                        vdhp->max_height     = height;
-                    }
-                    else
-                    {
-                        if( vdhp->max_width  < width )
-                            vdhp->max_width  = width;
-                        if( vdhp->max_height < width )
-                            vdhp->max_height = height;
-                    }
-                    if( vdhp->initial_pix_fmt == AV_PIX_FMT_NONE )
-                        vdhp->initial_pix_fmt = av_get_pix_fmt( (const char *)pix_fmt );
-                    if( vdhp->initial_colorspace == AVCOL_SPC_NB )
-                        vdhp->initial_colorspace = (enum AVColorSpace)colorspace;
-                    if( video_time_base.num == 0 || video_time_base.den == 0 )
-                    {
-                        video_time_base.num = time_base.num;
-                        video_time_base.den = time_base.den;
-                    }
-                    ++video_sample_count;
-                    video_info[video_sample_count].pts             = pts;
-                    video_info[video_sample_count].dts             = dts;
-                    video_info[video_sample_count].file_offset     = pos;
-                    video_info[video_sample_count].sample_number   = video_sample_count;
-                    video_info[video_sample_count].extradata_index = extradata_index;
-                    video_info[video_sample_count].pict_type       = pict_type;
-                    video_info[video_sample_count].poc             = poc;
-                    video_info[video_sample_count].repeat_pict     = repeat_pict;
-                    video_info[video_sample_count].field_info      = (lw_field_info_t)field_info;
-                    if( pts != AV_NOPTS_VALUE && last_keyframe_pts != AV_NOPTS_VALUE && pts < last_keyframe_pts )
-                        video_info[video_sample_count].flags |= LW_VFRAME_FLAG_LEADING;
-                    if( key )
-                    {
-                        video_info[video_sample_count].flags |= LW_VFRAME_FLAG_KEY;
-                        last_keyframe_pts = pts;
-                    }
-                    if( repeat_pict == 0 && field_info == LW_FIELD_INFO_UNKNOWN
-                     && av_get_pix_fmt( (const char *)pix_fmt ) == AV_PIX_FMT_NONE
-                     && ((enum AVCodecID)codec_id == AV_CODEC_ID_H264 || (enum AVCodecID)codec_id == AV_CODEC_ID_HEVC)
-                     && (width == 0 || height == 0) )
-                        video_info[video_sample_count].flags |= LW_VFRAME_FLAG_CORRUPT;
-                }
-                if( video_sample_count + 1 == video_info_count )
+            AVIndexEntry *entries = read_index_entry_group( &reader, first, count );
+            if( !entries )
+                goto fail_append;
+            for( int i = 0; i < count; i++ )
+                if( av_add_index_entry( stream, entries[i].pos, entries[i].timestamp, entries[i].size,
+                                        entries[i].min_distance, entries[i].flags ) < 0 )
                 {
-                    video_info_count <<= 1;
-                    video_frame_info_t *temp = (video_frame_info_t *)realloc( video_info, video_info_count * sizeof(video_frame_info_t) );
-                    if( !temp )
-                        goto fail_parsing;
-                    video_info = temp;
+                    av_free( entries );
+                    goto fail_append;
                 }
-            }
+            av_free( entries );
         }
-        else if( codec_type == AVMEDIA_TYPE_AUDIO )
+        if( load_index_extradata( &reader, &initial_exh[stream_index], stream_index, codec_type ) < 0 )
+            goto fail_append;
+    }
+    if( av_seek_frame( format_ctx, -1, resume_pos, AVSEEK_FLAG_BYTE ) < 0 )
+        goto fail_append;
+    filesize = avio_size( format_ctx->pb );
+    if( open_index_writer( &writer, index_path, 0 ) < 0 )
+        goto fail_append;
+    writer.source_path = lwhp->file_path;
+    writer.source_size = filesize;
+    write_index_file_info( &writer, lwhp->file_path, lwhp->format_flags, lwhp->raw_demuxer, lwhp->format_name );
+    write_index_active_stream( &writer, AVMEDIA_TYPE_VIDEO, vdhp->stream_index );
+    write_index_active_stream( &writer, AVMEDIA_TYPE_AUDIO, adhp->stream_index );
+    /* Take over the packet records read before the resume point. */
+    if( !(section = find_index_section( &reader, LWINDEX_SECTION_PKTS, LWINDEX_PACKET_RECORD_SIZE ))
+     || resume_record > section->count )
+        goto fail_append;
+    for( uint64_t i = 0; i < section->count; )
+    {
+        uint64_t n = MIN( section->count - i, sizeof(records) / sizeof(records[0]) );
+        if( read_index_records( &reader, section, i, n, records, sizeof(lwindex_packet_record_t), decode_packet_record ) < 0 )
+            goto fail_append;
+        for( uint64_t j = 0; j < n; j++ )
         {
-            if( !fgets( buf, sizeof(buf), index ) )
-                goto fail_parsing;
-            if( stream_index == adhp->stream_index )
-            {
-                uint64_t layout;
-                int      channels;
-                int      sample_rate;
-                char     sample_fmt[64];
-                int      bits_per_sample;
-                int      frame_length;
-                if( sscanf( buf, "Channels=%d:0x%"SCNx64",Rate=%d,Format=%[^,],BPS=%d,Length=%d",
-                            &channels, &layout, &sample_rate, sample_fmt, &bits_per_sample, &frame_length ) != 6 )
-                    goto fail_parsing;
-                if( adhp->codec_id == AV_CODEC_ID_NONE )
-                    adhp->codec_id = (enum AVCodecID)codec_id;
-                if( (channels | layout | sample_rate | bits_per_sample) && audio_duration <= INT32_MAX )
-                {
-                    if( audio_sample_rate == 0 )
-                        audio_sample_rate = sample_rate;
-                    if( audio_time_base.num == 0 || audio_time_base.den == 0 )
-                    {
-                        audio_time_base.num = time_base.num;
-                        audio_time_base.den = time_base.den;
-                    }
-                    if( layout == 0 )
-                        layout = av_get_default_channel_layout( channels );
-                    if( av_get_channel_layout_nb_channels( layout )
-                      > av_get_channel_layout_nb_channels( aohp->output_channel_layout ) )
-                        aohp->output_channel_layout = layout;
-                    aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format,
-                                                                                av_get_sample_fmt( (const char *)sample_fmt ) );
-                    aohp->output_sample_rate     = MAX( aohp->output_sample_rate, audio_sample_rate );
-                    aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, bits_per_sample );
-                    ++audio_sample_count;
-                    audio_info[audio_sample_count].pts             = pts;
-                    audio_info[audio_sample_count].dts             = dts;
-                    audio_info[audio_sample_count].file_offset     = pos;
-                    audio_info[audio_sample_count].sample_number   = audio_sample_count;
-                    audio_info[audio_sample_count].extradata_index = extradata_index;
-                    audio_info[audio_sample_count].sample_rate     = sample_rate;
-                }
-                else
-                    for( uint32_t i = 1; i <= adhp->exh.delay_count; i++ )
-                    {
-                        uint32_t audio_frame_number = audio_sample_count - adhp->exh.delay_count + i;
-                        if( audio_frame_number > audio_sample_count )
-                            goto fail_parsing;
-                        audio_info[audio_frame_number].length = frame_length;
-                        if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                            constant_frame_length = 0;
-                        audio_duration += frame_length;
-                    }
-                if( audio_sample_count + 1 == audio_info_count )
-                {
-                    audio_info_count <<= 1;
-                    audio_frame_info_t *temp = (audio_frame_info_t *)realloc( audio_info, audio_info_count * sizeof(audio_frame_info_t) );
-                    if( !temp )
-                        goto fail_parsing;
-                    audio_info = temp;
-                }
-                if( frame_length == -1 )
-                    ++ adhp->exh.delay_count;
-                else if( audio_sample_count > adhp->exh.delay_count )
-                {
-                    uint32_t audio_frame_number = audio_sample_count - adhp->exh.delay_count;
-                    audio_info[audio_frame_number].length = frame_length;
-                    if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                        constant_frame_length = 0;
-                    audio_duration += frame_length;
-                }
-            }
+            lwindex_packet_record_t *record = &records[j];
+            /* The packets at or after the resume point are demuxed again. */
+            if( i + j >= resume_record && (record->pos < 0 || record->pos >= resume_pos) )
+                continue;
+            write_index_packet( &writer, record );
+            if( parse_packet_record( &parser, record ) < 0 )
+                goto fail_append;
+            if( record->extradata_index >= 0 && record->stream_index < stream_count )
+                initial_exh[ record->stream_index ].current_index = record->extradata_index;
         }
+        i += n;
     }
-    if( video_present && opt->force_video && opt->force_video_index != -1
-     && (video_sample_count == 0 || vdhp->initial_pix_fmt == AV_PIX_FMT_NONE || vdhp->initial_width == 0 || vdhp->initial_height == 0) )
-        goto fail_parsing;  /* Need to re-create the index file. */
-    if( audio_present && opt->force_audio && opt->force_audio_index != -1 && (audio_sample_count == 0 || audio_duration == 0) )
-        goto fail_parsing;  /* Need to re-create the index file. */
-    if( strncmp( buf, "</LibavReaderIndex>", strlen( "</LibavReaderIndex>" ) ) )
-        goto fail_parsing;
-    /* Parse AVIndexEntry. */
-    if( !fgets( buf, sizeof(buf), index ) )
-        goto fail_parsing;
-    while( !strncmp( buf, "<StreamIndexEntries=", strlen( "<StreamIndexEntries=" ) ) )
+    settle_delayed_audio_frames( &parser );
+    /* Demux the rest of the source. */
+    if( start_index_pipeline( &pipeline, lwhp, format_ctx, initial_exh, stream_count ) < 0 )
+        goto fail_append;
+    while( 1 )
     {
-        int stream_index;
-        int codec_type;
-        int index_entries_count;
-        if( sscanf( buf, "<StreamIndexEntries=%d,%d,%d>", &stream_index, &codec_type, &index_entries_count ) != 3 )
-            goto fail_parsing;
-        if( !fgets( buf, sizeof(buf), index ) )
-            goto fail_parsing;
-        if( index_entries_count > 0 )
+        lwindex_job_t *job = get_index_job( &pipeline );
+        if( !job )
         {
-            if( codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index )
-            {
-                vdhp->index_entries_count = index_entries_count;
-                vdhp->index_entries = (AVIndexEntry *)av_malloc( vdhp->index_entries_count * sizeof(AVIndexEntry) );
-                if( !vdhp->index_entries )
-                    goto fail_parsing;
-                for( int i = 0; i < vdhp->index_entries_count; i++ )
-                {
-                    AVIndexEntry ie;
-                    int size;
-                    int flags;
-                    if( sscanf( buf, "POS=%"SCNd64",TS=%"SCNd64",Flags=%x,Size=%d,Distance=%d",
-                                &ie.pos, &ie.timestamp, &flags, &size, &ie.min_distance ) != 5 )
-                        break;
-                    ie.size  = size;
-                    ie.flags = flags;
-                    vdhp->index_entries[i] = ie;
-                    if( !fgets( buf, sizeof(buf), index ) )
-                        goto fail_parsing;
-                }
-            }
-            else if( codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index )
-            {
-                adhp->index_entries_count = index_entries_count;
-                adhp->index_entries = (AVIndexEntry *)av_malloc( adhp->index_entries_count * sizeof(AVIndexEntry) );
-                if( !adhp->index_entries )
-                    goto fail_parsing;
-                for( int i = 0; i < adhp->index_entries_count; i++ )
-                {
-                    AVIndexEntry ie;
-                    int size;
-                    int flags;
-                    if( sscanf( buf, "POS=%"SCNd64",TS=%"SCNd64",Flags=%x,Size=%d,Distance=%d",
-                                &ie.pos, &ie.timestamp, &flags, &size, &ie.min_distance ) != 5 )
-                        break;
-                    ie.size  = size;
-                    ie.flags = flags;
-                    adhp->index_entries[i] = ie;
-                    if( !fgets( buf, sizeof(buf), index ) )
-                        goto fail_parsing;
-                }
-            }
-            else
-                for( int i = 0; i < index_entries_count; i++ )
-                    if( !fgets( buf, sizeof(buf), index ) )
-                        goto fail_parsing;
+            if( pipeline.error )
+                goto fail_append;
+            break;
         }
-        if( strncmp( buf, "</StreamIndexEntries>", strlen( "</StreamIndexEntries>" ) ) )
-            goto fail_parsing;
-        if( !fgets( buf, sizeof(buf), index ) )
-            goto fail_parsing;
+        lwindex_packet_record_t *record = &job->record;
+        int error = job->error;
+        if( !error && (record->pos < 0 || record->pos >= resume_pos) )
+        {
+            write_index_packet( &writer, record );
+            error = parse_packet_record( &parser, record ) < 0;
+        }
+        int abort = 0;
+        if( !error && indicator->update )
+            abort = indicator->update( php, "Appending to Index file",
+                                       filesize > 0 && record->pos > 0 ? (int)(100.0 * ((double)record->pos / filesize) + 0.5) : 0 );
+        release_index_job( &pipeline, job );
+        if( error || abort )
+            goto fail_append;
     }
-    /* Parse extradata. */
-    while( !strncmp( buf, "<ExtraDataList=", strlen( "<ExtraDataList=" ) ) )
+    stop_index_pipeline( &pipeline );
+    /* Handle delay derived from the audio decoder. */
+    for( int worker_index = 0; worker_index < pipeline.worker_count; worker_index++ )
     {
-        int stream_index;
-        int codec_type;
-        int entry_count;
-        if( sscanf( buf, "<ExtraDataList=%d,%d,%d>", &stream_index, &codec_type, &entry_count ) != 3 )
-            goto fail_parsing;
-        if( !fgets( buf, sizeof(buf), index ) )
-            goto fail_parsing;
-        if( entry_count > 0 )
+        lwindex_worker_t *worker = pipeline.worker[worker_index];
+        if( !worker || !worker->helper || !worker->helper->decode || worker->ctx->codec_type != AVMEDIA_TYPE_AUDIO )
+            continue;
+        for( uint32_t i = 1; i <= worker->helper->delay_count; i++ )
         {
-            if( (codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
-             || (codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index) )
-            {
-                lwlibav_extradata_handler_t *exhp = codec_type == AVMEDIA_TYPE_VIDEO ? &vdhp->exh : &adhp->exh;
-                if( !alloc_extradata_entries( exhp, entry_count ) )
-                    goto fail_parsing;
-                exhp->current_index = codec_type == AVMEDIA_TYPE_VIDEO
-                                    ? video_info[1].extradata_index
-                                    : audio_info[1].extradata_index;
-                for( int i = 0; i < exhp->entry_count; i++ )
-                {
-                    lwlibav_extradata_t *entry = &exhp->entries[i];
-                    /* Get extradata size and others. */
-                    int codec_id;
-                    if( codec_type == AVMEDIA_TYPE_VIDEO )
-                    {
-                        char pix_fmt[64];
-                        if( sscanf( buf, "Size=%d,Codec=%d,4CC=0x%x,Width=%d,Height=%d,Format=%[^,],BPS=%d",
-                                    &entry->extradata_size, &codec_id, &entry->codec_tag,
-                                    &entry->width, &entry->height,
-                                    pix_fmt, &entry->bits_per_sample ) != 7 )
-                            break;
-                        entry->pixel_format = av_get_pix_fmt( (const char *)pix_fmt );
-                    }
-                    else
-                    {
-                        char sample_fmt[64];
-                        if( sscanf( buf, "Size=%d,Codec=%d,4CC=0x%x,Layout=0x%"SCNx64",Rate=%d,Format=%[^,],BPS=%d,Align=%d",
-                                    &entry->extradata_size, &codec_id, &entry->codec_tag,
-                                    &entry->channel_layout, &entry->sample_rate,
-                                    sample_fmt, &entry->bits_per_sample, &entry->block_align ) != 8 )
-                            break;
-                        entry->sample_format = av_get_sample_fmt( (const char *)sample_fmt );
-                    }
-                    entry->codec_id = (enum AVCodecID)codec_id;
-                    /* Get extradata. */
-                    if( entry->extradata_size > 0 )
-                    {
-                        entry->extradata = (uint8_t *)av_malloc( entry->extradata_size + FF_INPUT_BUFFER_PADDING_SIZE );
-                        if( !entry->extradata )
-                            goto fail_parsing;
-                        if( fread( entry->extradata, 1, entry->extradata_size, index ) != entry->extradata_size )
-                        {
-                            av_free( entry->extradata );
-                            goto fail_parsing;
-                        }
-                        memset( entry->extradata + entry->extradata_size, 0, FF_INPUT_BUFFER_PADDING_SIZE );
-                    }
-                    if( !fgets( buf, sizeof(buf), index )   /* new line ('\n') */
-                     || !fgets( buf, sizeof(buf), index ) ) /* the first line of the next entry */
-                        goto fail_parsing;
-                }
-            }
-            else
-                for( int i = 0; i < entry_count; i++ )
-                {
-                    /* extradata size */
-                    int extradata_size;
-                    if( sscanf( buf, "Size=%d", &extradata_size ) != 1 )
-                        goto fail_parsing;
-                    /* extradata */
-                    for( int i = 0; i < extradata_size; i++ )
-                        if( fgetc( index ) == EOF )
-                            goto fail_parsing;
-                    if( !fgets( buf, sizeof(buf), index )   /* new line ('\n') */
-                     || !fgets( buf, sizeof(buf), index ) ) /* the first line of the next entry */
-                        goto fail_parsing;
-                }
+            lwindex_packet_record_t record;
+            if( drain_index_audio_frame( worker, &record ) < 0 )
+                continue;
+            write_index_packet( &writer, &record );
+            if( parse_packet_record( &parser, &record ) < 0 )
+                goto fail_append;
         }
-        if( strncmp( buf, "</ExtraDataList>", strlen( "</ExtraDataList>" ) ) )
-            goto fail_parsing;
-        if( !fgets( buf, sizeof(buf), index ) )
-            goto fail_parsing;
     }
-    if( !strncmp( buf, "</LibavReaderIndexFile>", strlen( "</LibavReaderIndexFile>" ) ) )
+    end_index_packets( &writer );
+    if( check_parsed_streams( &parser ) < 0 )
+        goto fail_append;
+    for( int stream_index = 0; stream_index < stream_count; stream_index++ )
+    {
+        AVStream *stream     = format_ctx->streams[stream_index];
+        int       codec_type = stream->codec->codec_type;
+        if( codec_type != AVMEDIA_TYPE_VIDEO && codec_type != AVMEDIA_TYPE_AUDIO )
+            continue;
+        write_index_entries( &writer, stream_index, codec_type, stream->index_entries, stream->nb_index_entries );
+        lwlibav_decode_handler_t *dhp = codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index ? (lwlibav_decode_handler_t *)vdhp
+                                      : codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index ? (lwlibav_decode_handler_t *)adhp
+                                      : NULL;
+        if( dhp && stream->nb_index_entries > 0 )
+        {
+            dhp->index_entries = (AVIndexEntry *)av_malloc( stream->nb_index_entries * sizeof(AVIndexEntry) );
+            if( !dhp->index_entries )
+                goto fail_append;
+            memcpy( dhp->index_entries, stream->index_entries, stream->nb_index_entries * sizeof(AVIndexEntry) );
+            dhp->index_entries_count = stream->nb_index_entries;
+        }
+    }
+    for( int stream_index = 0; stream_index < stream_count; stream_index++ )
+    {
+        AVStream *stream     = format_ctx->streams[stream_index];
+        int       codec_type = stream->codec->codec_type;
+        if( codec_type != AVMEDIA_TYPE_VIDEO && codec_type != AVMEDIA_TYPE_AUDIO )
+            continue;
+        /* The list stays in 'initial_exh' if no packet of the stream has been demuxed after the resume point. */
+        lwindex_helper_t            *helper = (lwindex_helper_t *)stream->codec->opaque;
+        lwlibav_extradata_handler_t *list   = helper ? &helper->exh : &initial_exh[stream_index];
+        write_index_extradata_list( &writer, stream_index, codec_type, list->entries, list->entry_count );
+        if( (codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
+         || (codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index) )
+        {
+            lwlibav_extradata_handler_t *exhp = codec_type == AVMEDIA_TYPE_VIDEO ? &vdhp->exh : &adhp->exh;
+            exhp->entry_count   = list->entry_count;
+            exhp->entries       = list->entries;
+            exhp->current_index = get_parsed_initial_extradata_index( &parser, codec_type );
+            /* Avoid freeing entries. */
+            list->entry_count = 0;
+            list->entries     = NULL;
+        }
+    }
+    if( finish_parsing( &parser ) < 0 )
+        goto fail_append;
+    if( vdhp->stream_index >= 0 )
+        write_index_video_tables( &writer, vdhp, parser.video_time_base );
+    if( adhp->stream_index >= 0 )
+        write_index_audio_tables( &writer, adhp, aohp, parser.audio_time_base, parser.audio_sample_rate );
+    /* The preceding index file has to be closed before being replaced. */
+    fclose( index );
+    close_index_pipeline( &pipeline );
+    cleanup_index_helpers( format_ctx );
+    for( int stream_index = 0; stream_index < stream_count; stream_index++ )
+        free_extradata_entries( &initial_exh[stream_index] );
+    free( initial_exh );
+    lavf_close_file( &format_ctx );
+    close_index_writer( &writer, LWINDEX_FINALIZED
+                               | (opt->force_video ? LWINDEX_FINALIZED_FORCE_VIDEO : 0)
+                               | (opt->force_audio ? LWINDEX_FINALIZED_FORCE_AUDIO : 0) );
+    if( indicator->close )
+        indicator->close( php );
+    lwhp->format_name = NULL;
+    vdhp->format      = NULL;
+    adhp->format      = NULL;
+    return 0;
+fail_append:
+    fclose( index );
+    close_index_pipeline( &pipeline );
+    cleanup_index_helpers( format_ctx );
+    abort_parsing( &parser );
+    if( initial_exh )
+    {
+        for( int stream_index = 0; stream_index < stream_count; stream_index++ )
+            free_extradata_entries( &initial_exh[stream_index] );
+        free( initial_exh );
+    }
+    lavf_close_file( &format_ctx );
+    if( writer.file )
+    {
+        writer.error = 1;
+        close_index_writer( &writer, 0 );
+    }
+    if( indicator->close )
+        indicator->close( php );
+    lw_freep( &lwhp->file_path );
+    lwhp->format_name = NULL;
+    vdhp->format      = NULL;
+    adhp->format      = NULL;
+    return -1;
+}
+
+/* Set up the only extradata entry from the global header and the parameters of the stream. */
+static int import_stream_extradata
+(
+    lwlibav_extradata_handler_t *exhp,
+    AVCodecContext              *ctx
+)
+{
+    lwlibav_extradata_t *entry = alloc_extradata_entries( exhp, 1 );
+    if( !entry )
+        return -1;
+    exhp->current_index = 0;
+    if( ctx->extradata && ctx->extradata_size > 0 )
+    {
+        entry->extradata = (uint8_t *)av_malloc( ctx->extradata_size + FF_INPUT_BUFFER_PADDING_SIZE );
+        if( !entry->extradata )
+            return -1;
+        entry->extradata_size = ctx->extradata_size;
+        memcpy( entry->extradata, ctx->extradata, ctx->extradata_size );
+        memset( entry->extradata + ctx->extradata_size, 0, FF_INPUT_BUFFER_PADDING_SIZE );
+    }
+    entry->codec_id  = ctx->codec_id;
+    entry->codec_tag = ctx->codec_tag;
+    if( ctx->codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        entry->width           = ctx->width;
+        entry->height          = ctx->height;
+        entry->pixel_format    = ctx->pix_fmt;
+        entry->bits_per_sample = ctx->bits_per_coded_sample;
+    }
+    else
+    {
+        entry->channel_layout  = ctx->channel_layout ? ctx->channel_layout : av_get_default_channel_layout( ctx->channels );
+        entry->sample_rate     = ctx->sample_rate;
+        entry->sample_format   = ctx->sample_fmt;
+        entry->bits_per_sample = get_audio_bits_per_sample( ctx );
+        entry->block_align     = ctx->block_align;
+    }
+    return 0;
+}
+
+/* Container-native index import
+ * Some demuxers, e.g. MP4/MOV and AVI, list every packet of a stream in AVIndexEntrys when opening the file.
+ * Then, the frame tables can be built from them without reading the packets, but the per-frame info obtained
+ * by parsing or decoding, e.g. picture type, POC, repeat_pict and audio frame length, is unavailable.
+ * So this is used only for the streams which don't need it, and create_index() is used otherwise. */
+static int is_complete_av_index
+(
+    AVStream *stream
+)
+{
+    if( stream->nb_frames <= 0
+     || stream->nb_index_entries != stream->nb_frames
+     || !(stream->index_entries[0].flags & AVINDEX_KEYFRAME) )
+        return 0;
+    for( int i = 0; i < stream->nb_index_entries; i++ )
+        if( stream->index_entries[i].size <= 0
+         || (i > 0 && stream->index_entries[i].timestamp <= stream->index_entries[i - 1].timestamp) )
+            return 0;
+    return 1;
+}
+
+static int is_video_index_importable
+(
+    AVStream         *stream,
+    lwlibav_option_t *opt,
+    const char       *format_name
+)
+{
+    AVCodecContext *ctx = stream->codec;
+    /* Reordered frames have no PTS in AVIndexEntry.
+     * PTS generation and repeat control require picture types and repeat_pict.
+     * Leading pictures of HEVC and field coded pictures of H.264 require POC. */
+    if( opt->apply_repeat_flag
+     || ctx->has_b_frames > 0
+     || ctx->codec_id == AV_CODEC_ID_MPEG1VIDEO || ctx->codec_id == AV_CODEC_ID_MPEG2VIDEO
+     || ctx->codec_id == AV_CODEC_ID_VC1        || ctx->codec_id == AV_CODEC_ID_WMV3
+     || ctx->codec_id == AV_CODEC_ID_VC1IMAGE   || ctx->codec_id == AV_CODEC_ID_WMV3IMAGE
+     || ctx->codec_id == AV_CODEC_ID_HEVC
+     || (ctx->codec_id == AV_CODEC_ID_H264 && ctx->field_order != AV_FIELD_UNKNOWN && ctx->field_order != AV_FIELD_PROGRESSIVE)
+     || (ctx->codec_id == AV_CODEC_ID_DVVIDEO && !strcmp( format_name, "avi" ))   /* DV in AVI Type-1 */
+     || ctx->width <= 0 || ctx->height <= 0 || ctx->pix_fmt == AV_PIX_FMT_NONE )
+        return 0;
+    return is_complete_av_index( stream );
+}
+
+static int is_audio_index_importable
+(
+    AVStream *stream
+)
+{
+    AVCodecContext *ctx = stream->codec;
+    if( ctx->frame_size <= 0 || ctx->sample_rate <= 0 || !is_complete_av_index( stream ) )
+        return 0;
+    /* Every packet shall be an audio frame of the constant length since the frame length is not obtained by decoding.
+     * The last frame is excluded since it may be shorter. */
+    AVRational sample_time_base = { 1, ctx->sample_rate };
+    for( int i = 1; i < stream->nb_index_entries - 1; i++ )
+        if( av_rescale_q( stream->index_entries[i].timestamp - stream->index_entries[i - 1].timestamp,
+                          stream->time_base, sample_time_base ) != ctx->frame_size )
+            return 0;
+    return 1;
+}
+
+static int import_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    AVFormatContext                *format_ctx,
+    lwlibav_option_t               *opt,
+    const char                     *index_path
+)
+{
+    /* Select the active streams in the same way as create_index(). */
+    int video_index      = -1;
+    int audio_index      = -1;
+    int video_resolution = 0;
+    int is_attached_pic  = 0;
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
     {
-        if( vdhp->stream_index >= 0 )
-        {
-            vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (video_sample_count + 1) * sizeof(uint8_t) );
-            if( !vdhp->keyframe_list )
-                goto fail_parsing;
-            vdhp->frame_list  = video_info;
-            vdhp->frame_count = video_sample_count;
-            if( decide_video_seek_method( lwhp, vdhp, video_sample_count, video_time_base ) )
-                goto fail_parsing;
-            /* Create the repeat control info. */
-            create_video_frame_order_list( vdhp, vohp, opt );
-        }
-        if( adhp->stream_index >= 0 )
+        AVStream       *stream = format_ctx->streams[stream_index];
+        AVCodecContext *ctx    = stream->codec;
+        if( ctx->codec_type == AVMEDIA_TYPE_VIDEO )
         {
-            if( adhp->dv_in_avi == 1 && adhp->index_entries_count == 0 )
+            if( opt->force_video )
             {
-                /* DV in AVI Type-1 */
-                audio_sample_count = MIN( video_sample_count, audio_sample_count );
-                for( uint32_t i = 0; i <= audio_sample_count; i++ )
-                {
-                    audio_info[i].keyframe        = !!(video_info[i].flags & LW_VFRAME_FLAG_KEY);
-                    audio_info[i].sample_number   = video_info[i].sample_number;
-                    audio_info[i].pts             = video_info[i].pts;
-                    audio_info[i].dts             = video_info[i].dts;
-                    audio_info[i].file_offset     = video_info[i].file_offset;
-                    audio_info[i].extradata_index = video_info[i].extradata_index;
-                }
+                if( (int)stream_index == opt->force_video_index )
+                    video_index = stream_index;
             }
-            else
+            else if( video_index == -1
+                  || ctx->width * ctx->height > video_resolution
+                  || (is_attached_pic && !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)) )
             {
-                if( adhp->dv_in_avi == 1 && ((!opt->force_video && active_video_index == -1) || (opt->force_video && opt->force_video_index == -1)) )
-                {
-                    /* Disable DV video stream. */
-                    disable_video_stream( vdhp );
-                    video_info = NULL;
-                }
-                adhp->dv_in_avi = 0;
+                video_index      = stream_index;
+                video_resolution = ctx->width * ctx->height;
+                is_attached_pic  = !!(stream->disposition & AV_DISPOSITION_ATTACHED_PIC);
             }
-            adhp->frame_list   = audio_info;
-            adhp->frame_count  = audio_sample_count;
-            adhp->frame_length = constant_frame_length ? audio_info[1].length : 0;
-            decide_audio_seek_method( lwhp, adhp, audio_sample_count );
-            if( opt->av_sync && vdhp->stream_index >= 0 )
-                lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp, video_time_base, audio_time_base, audio_sample_rate );
         }
-        if( vdhp->stream_index != active_video_index || adhp->stream_index != active_audio_index )
+        else if( ctx->codec_type == AVMEDIA_TYPE_AUDIO )
         {
-            /* Update the active stream indexes when specifying different stream indexes. */
-            fseek( index, active_index_pos, SEEK_SET );
-            fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", vdhp->stream_index );
-            fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", adhp->stream_index );
+            if( opt->force_audio ? (int)stream_index == opt->force_audio_index : audio_index == -1 )
+                audio_index = stream_index;
+        }
+    }
+    const char *format_name   = format_ctx->iformat->name;
+    AVStream   *video_stream  = video_index >= 0 ? format_ctx->streams[video_index] : NULL;
+    AVStream   *audio_stream  = audio_index >= 0 ? format_ctx->streams[audio_index] : NULL;
+    if( (!video_stream && !audio_stream)
+     || format_ctx->iformat->raw_codec_id
+     || (video_stream && !is_video_index_importable( video_stream, opt, format_name ))
+     || (audio_stream && !is_audio_index_importable( audio_stream )) )
+        return -1;
+    lwindex_writer_t writer;
+    if( open_index_writer( &writer, !opt->no_create_index ? index_path : NULL, 0 ) < 0 )
+        return -1;
+    lwhp->format_name  = (char *)format_name;
+    lwhp->format_flags = format_ctx->iformat->flags;
+    lwhp->raw_demuxer  = 0;
+    adhp->dv_in_avi    = 0;
+    write_index_file_info( &writer, lwhp->file_path, lwhp->format_flags, lwhp->raw_demuxer, lwhp->format_name );
+    if( video_stream )
+    {
+        AVCodecContext *ctx         = video_stream->codec;
+        uint32_t        frame_count = video_stream->nb_index_entries;
+        write_index_active_stream( &writer, AVMEDIA_TYPE_VIDEO, video_index );
+        vdhp->stream_index  = video_index;
+        vdhp->frame_list    = (video_frame_info_t *)lw_malloc_zero( (frame_count + 1) * sizeof(video_frame_info_t) );
+        vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (frame_count + 1) * sizeof(uint8_t) );
+        vdhp->index_entries = (AVIndexEntry *)av_memdup( video_stream->index_entries, frame_count * sizeof(AVIndexEntry) );
+        if( !vdhp->frame_list || !vdhp->keyframe_list || !vdhp->index_entries
+         || import_stream_extradata( &vdhp->exh, ctx ) < 0 )
+            goto fail;
+        vdhp->index_entries_count = frame_count;
+        for( uint32_t i = 1; i <= frame_count; i++ )
+        {
+            AVIndexEntry       *ie   = &video_stream->index_entries[i - 1];
+            video_frame_info_t *info = &vdhp->frame_list[i];
+            /* Frames are not reordered, so PTS is equal to DTS. */
+            info->pts             = ie->timestamp;
+            info->dts             = ie->timestamp;
+            info->file_offset     = ie->pos;
+            info->sample_number   = i;
+            info->extradata_index = 0;
+            info->repeat_pict     = 1;
+            if( ie->flags & AVINDEX_KEYFRAME )
+                info->flags |= LW_VFRAME_FLAG_KEY;
         }
+        vdhp->codec_id           = ctx->codec_id;
+        vdhp->frame_count        = frame_count;
+        vdhp->initial_width      = ctx->width;
+        vdhp->initial_height     = ctx->height;
+        vdhp->max_width          = ctx->width;
+        vdhp->max_height         = ctx->height;
+        vdhp->initial_pix_fmt    = ctx->pix_fmt;
+        vdhp->initial_colorspace = ctx->colorspace;
+        if( decide_video_seek_method( lwhp, vdhp, frame_count, video_stream->time_base ) )
+            goto fail;
+    }
+    if( audio_stream )
+    {
+        AVCodecContext *ctx         = audio_stream->codec;
+        uint32_t        frame_count = audio_stream->nb_index_entries;
+        write_index_active_stream( &writer, AVMEDIA_TYPE_AUDIO, audio_index );
+        adhp->stream_index  = audio_index;
+        adhp->frame_list    = (audio_frame_info_t *)lw_malloc_zero( (frame_count + 1) * sizeof(audio_frame_info_t) );
+        adhp->index_entries = (AVIndexEntry *)av_memdup( audio_stream->index_entries, frame_count * sizeof(AVIndexEntry) );
+        if( !adhp->frame_list || !adhp->index_entries
+         || import_stream_extradata( &adhp->exh, ctx ) < 0 )
+            goto fail;
+        adhp->index_entries_count = frame_count;
+        for( uint32_t i = 1; i <= frame_count; i++ )
+        {
+            AVIndexEntry       *ie   = &audio_stream->index_entries[i - 1];
+            audio_frame_info_t *info = &adhp->frame_list[i];
+            info->pts             = ie->timestamp;
+            info->dts             = ie->timestamp;
+            info->file_offset     = ie->pos;
+            info->sample_number   = i;
+            info->extradata_index = 0;
+            info->sample_rate     = ctx->sample_rate;
+            info->length          = ctx->frame_size;
+        }
+        lwlibav_extradata_t *entry = &adhp->exh.entries[0];
+        adhp->codec_id               = ctx->codec_id;
+        adhp->frame_count            = frame_count;
+        adhp->frame_length           = ctx->frame_size;
+        aohp->output_channel_layout  = entry->channel_layout;
+        aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format, ctx->sample_fmt );
+        aohp->output_sample_rate     = MAX( aohp->output_sample_rate, ctx->sample_rate );
+        aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, entry->bits_per_sample );
+        decide_audio_seek_method( lwhp, adhp, frame_count );
+    }
+    end_index_packets( &writer );
+    if( video_stream )
+    {
+        write_index_entries( &writer, video_index, AVMEDIA_TYPE_VIDEO, vdhp->index_entries, vdhp->index_entries_count );
+        write_index_extradata_list( &writer, video_index, AVMEDIA_TYPE_VIDEO, vdhp->exh.entries, vdhp->exh.entry_count );
+    }
+    if( audio_stream )
+    {
+        write_index_entries( &writer, audio_index, AVMEDIA_TYPE_AUDIO, adhp->index_entries, adhp->index_entries_count );
+        write_index_extradata_list( &writer, audio_index, AVMEDIA_TYPE_AUDIO, adhp->exh.entries, adhp->exh.entry_count );
+    }
+    if( video_stream )
+    {
+        write_index_video_tables( &writer, vdhp, video_stream->time_base );
+        /* Create the repeat control info. */
+        create_video_frame_order_list( vdhp, vohp, opt );
+    }
+    if( audio_stream )
+    {
+        write_index_audio_tables( &writer, adhp, aohp, audio_stream->time_base, audio_stream->codec->sample_rate );
+        if( opt->av_sync && video_stream )
+            lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp,
+                                             video_stream->time_base,
+                                             audio_stream->time_base,
+                                             audio_stream->codec->sample_rate );
+    }
+    close_index_writer( &writer, LWINDEX_FINALIZED
+                               | (opt->force_video ? LWINDEX_FINALIZED_FORCE_VIDEO : 0)
+                               | (opt->force_audio ? LWINDEX_FINALIZED_FORCE_AUDIO : 0) );
+    return 0;
+fail:
+    release_loaded_tables( vdhp, adhp, aohp );
+    vdhp->stream_index = -1;
+    adhp->stream_index = -1;
+    if( writer.file )
+    {
+        writer.error = 1;
+        close_index_writer( &writer, 0 );
+    }
+    return -1;
+}
+
+/* Sparse index mode
+ * Creating the index reads the whole source file, which takes long time for a huge one.
+ * In this mode, the video frame table is made up only from the keyframes listed in the demuxer's own index,
+ * or found by probing at regular byte intervals, and the frames between keyframes are assumed to be
+ * at constant frame rate. So the frame accuracy holds only for constant frame rate streams without dropped frames.
+ * The index file is created in background at the same time and used instead when opening the source next time. */
+#define LWINDEX_SPARSE_PROBE_STRIDE  (32 << 20) /* arbitrary */
+#define LWINDEX_SPARSE_MAX_PROBES    4096       /* arbitrary */
+#define LWINDEX_SPARSE_PROBE_PACKETS 4096       /* the maximum number of packets read to find a keyframe for each probe; arbitrary */
+
+typedef struct
+{
+    int64_t ts;
+    int64_t pos;
+} lwindex_sparse_keyframe_t;
+
+typedef struct
+{
+    lwindex_sparse_keyframe_t *entries;
+    int                        count;
+    int                        capacity;
+} lwindex_sparse_keyframe_list_t;
+
+static int add_sparse_keyframe
+(
+    lwindex_sparse_keyframe_list_t *list,
+    int64_t                         ts,
+    int64_t                         pos
+)
+{
+    if( list->count > 0 && ts <= list->entries[ list->count - 1 ].ts )
+        /* Already listed, e.g. found again by the next probe. */
         return 0;
+    if( list->count == list->capacity )
+    {
+        int capacity = list->capacity ? list->capacity * 2 : 256;
+        lwindex_sparse_keyframe_t *temp = (lwindex_sparse_keyframe_t *)realloc( list->entries, capacity * sizeof(lwindex_sparse_keyframe_t) );
+        if( !temp )
+            return -1;
+        list->entries  = temp;
+        list->capacity = capacity;
     }
-fail_parsing:
-    vdhp->frame_list = NULL;
-    adhp->frame_list = NULL;
-    if( video_info )
-        free( video_info );
-    if( audio_info )
-        free( audio_info );
+    list->entries[ list->count ].ts  = ts;
+    list->entries[ list->count ].pos = pos;
+    ++ list->count;
+    return 0;
+}
+
+/* Find the first keyframe after each probe position.
+ * The timestamps are DTS if present since probing finds keyframes in decoding order. */
+static int probe_sparse_keyframes
+(
+    AVFormatContext                *format_ctx,
+    int                             stream_index,
+    lwindex_sparse_keyframe_list_t *list
+)
+{
+    int64_t filesize = avio_size( format_ctx->pb );
+    if( filesize <= 0 )
+        return -1;
+    int64_t stride = MAX( filesize / LWINDEX_SPARSE_MAX_PROBES, LWINDEX_SPARSE_PROBE_STRIDE );
+    AVPacket pkt = { 0 };
+    av_init_packet( &pkt );
+    for( int64_t probe_pos = 0; probe_pos < filesize; probe_pos += stride )
+    {
+        if( av_seek_frame( format_ctx, stream_index, probe_pos, AVSEEK_FLAG_BYTE ) < 0 )
+            continue;
+        for( int i = 0; i < LWINDEX_SPARSE_PROBE_PACKETS && read_av_frame( format_ctx, &pkt ) >= 0; i++ )
+        {
+            int64_t ts  = pkt.dts != AV_NOPTS_VALUE ? pkt.dts : pkt.pts;
+            int64_t pos = pkt.pos;
+            int     key = pkt.stream_index == stream_index && (pkt.flags & AV_PKT_FLAG_KEY) && pos >= 0 && ts != AV_NOPTS_VALUE;
+            av_free_packet( &pkt );
+            if( key )
+            {
+                if( add_sparse_keyframe( list, ts, pos ) < 0 )
+                    return -1;
+                break;
+            }
+        }
+    }
+    /* Rewind for the full indexing in case of failure. */
+    av_seek_frame( format_ctx, stream_index, 0, AVSEEK_FLAG_BYTE );
+    return list->count > 0 ? 0 : -1;
+}
+
+static int create_sparse_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    AVFormatContext                *format_ctx,
+    lwlibav_option_t               *opt
+)
+{
+    lwhp->format_name  = (char *)format_ctx->iformat->name;
+    lwhp->format_flags = format_ctx->iformat->flags;
+    lwhp->raw_demuxer  = !!format_ctx->iformat->raw_codec_id;
+    int stream_index = opt->force_video
+                     ? opt->force_video_index
+                     : av_find_best_stream( format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0 );
+    if( lwhp->raw_demuxer || stream_index < 0 || stream_index >= (int)format_ctx->nb_streams )
+        return -1;
+    AVStream       *stream     = format_ctx->streams[stream_index];
+    AVCodecContext *ctx        = stream->codec;
+    AVRational      frame_rate = stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0
+                               ? stream->avg_frame_rate
+                               : stream->r_frame_rate;
+    if( ctx->codec_type != AVMEDIA_TYPE_VIDEO
+     || (stream->disposition & AV_DISPOSITION_ATTACHED_PIC)
+     || ctx->width <= 0 || ctx->height <= 0
+     || frame_rate.num <= 0 || frame_rate.den <= 0 )
+        return -1;
+    /* Estimate the number of frames. */
+    int64_t frame_count = stream->nb_frames;
+    if( frame_count <= 0 )
+        frame_count = stream->duration != AV_NOPTS_VALUE && stream->duration > 0
+                    ? av_rescale_q( stream->duration, stream->time_base, av_inv_q( frame_rate ) )
+                    : format_ctx->duration > 0
+                    ? av_rescale( format_ctx->duration, frame_rate.num, (int64_t)frame_rate.den * AV_TIME_BASE )
+                    : 0;
+    if( frame_count <= 0 || frame_count >= UINT32_MAX )
+        return -1;
+    /* Gather keyframes from the demuxer's own index.
+     * The demuxer seeks by the timestamps of its index, so seek by them too. */
+    lwindex_sparse_keyframe_list_t keyframes  = { NULL, 0, 0 };
+    int                            seek_flags = SEEK_PTS_BASED;
+    video_frame_info_t            *info;
+    for( int i = 0; i < stream->nb_index_entries; i++ )
+        if( (stream->index_entries[i].flags & AVINDEX_KEYFRAME)
+         && add_sparse_keyframe( &keyframes, stream->index_entries[i].timestamp, stream->index_entries[i].pos ) < 0 )
+            goto fail;
+    if( keyframes.count == 0 )
+    {
+        /* No index is present. Probe keyframes if the demuxer can start reading at any byte position. */
+        if( !(lineup_seek_base_candidates( lwhp ) & SEEK_POS_BASED)
+         || (lwhp->format_flags & AVFMT_NO_BYTE_SEEK)
+         || probe_sparse_keyframes( format_ctx, stream_index, &keyframes ) < 0 )
+            goto fail;
+        seek_flags = SEEK_POS_BASED;
+    }
+    /* Set up the frame info at constant frame rate from the first keyframe. */
+    info = (video_frame_info_t *)lw_malloc_zero( (frame_count + 1) * sizeof(video_frame_info_t) );
+    vdhp->frame_list    = info;
+    vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (frame_count + 1) * sizeof(uint8_t) );
+    if( !vdhp->frame_list || !vdhp->keyframe_list || import_stream_extradata( &vdhp->exh, ctx ) < 0 )
+        goto fail;
+    for( uint32_t i = 1; i <= frame_count; i++ )
+    {
+        info[i].pts             = keyframes.entries[0].ts + av_rescale_q( i - 1, av_inv_q( frame_rate ), stream->time_base );
+        info[i].dts             = AV_NOPTS_VALUE;
+        info[i].file_offset     = -1;
+        info[i].sample_number   = i;
+        info[i].extradata_index = 0;
+        info[i].repeat_pict     = 1;
+    }
+    for( int i = 0; i < keyframes.count; i++ )
+    {
+        int64_t number = 1 + av_rescale_q( keyframes.entries[i].ts - keyframes.entries[0].ts, stream->time_base, av_inv_q( frame_rate ) );
+        if( number > frame_count )
+            break;
+        info[number].flags       |= LW_VFRAME_FLAG_KEY;
+        info[number].file_offset  = keyframes.entries[i].pos;
+        if( seek_flags & SEEK_PTS_BASED )
+            info[number].pts = keyframes.entries[i].ts;
+        vdhp->keyframe_list[number] = 1;
+    }
+    lw_freep( &keyframes.entries );
+    if( stream->nb_index_entries > 0 )
+    {
+        vdhp->index_entries = (AVIndexEntry *)av_memdup( stream->index_entries, stream->nb_index_entries * sizeof(AVIndexEntry) );
+        if( !vdhp->index_entries )
+            goto fail;
+        vdhp->index_entries_count = stream->nb_index_entries;
+    }
+    vdhp->stream_index       = stream_index;
+    vdhp->codec_id           = ctx->codec_id;
+    vdhp->frame_count        = frame_count;
+    vdhp->lw_seek_flags      = seek_flags;
+    vdhp->initial_width      = ctx->width;
+    vdhp->initial_height     = ctx->height;
+    vdhp->max_width          = ctx->width;
+    vdhp->max_height         = ctx->height;
+    vdhp->initial_pix_fmt    = ctx->pix_fmt;
+    vdhp->initial_colorspace = ctx->colorspace;
+    if( create_video_rap_list( vdhp, vdhp->frame_count ) < 0 )
+        goto fail;
+    create_video_frame_order_list( vdhp, vohp, opt );
+    return 0;
+fail:
+    lw_freep( &keyframes.entries );
+    lw_freep( &vdhp->frame_list );
+    lw_freep( &vdhp->keyframe_list );
+    lw_freep( &vdhp->rap_list );
+    av_freep( &vdhp->index_entries );
+    vdhp->index_entries_count = 0;
+    vdhp->frame_count         = 0;
+    vdhp->stream_index        = -1;
+    free_extradata_entries( &vdhp->exh );
     return -1;
 }
 
+struct lwlibav_background_indexer_tag
+{
+    lw_thread_t      thread;
+    lw_mutex_t       mutex;
+    int              abort;
+    char            *file_path;
+    char            *index_path;
+    lwlibav_option_t opt;
+};
+
+static int update_background_indexing
+(
+    progress_handler_t *php,
+    const char         *message,
+    int                 percent
+)
+{
+    lwlibav_background_indexer_t *indexer = (lwlibav_background_indexer_t *)php;
+    lw_mutex_lock( &indexer->mutex );
+    int abort = indexer->abort;
+    lw_mutex_unlock( &indexer->mutex );
+    return abort;
+}
+
+static void *background_indexing_thread
+(
+    void *arg
+)
+{
+    lwlibav_background_indexer_t  *indexer = (lwlibav_background_indexer_t *)arg;
+    lwlibav_file_handler_t         lwh = { 0 };
+    lwlibav_video_decode_handler_t vdh = { 0 };
+    lwlibav_video_output_handler_t voh = { 0 };
+    lwlibav_audio_decode_handler_t adh = { 0 };
+    lwlibav_audio_output_handler_t aoh = { 0 };
+    lw_log_handler_t               lh  = { 0 };
+    AVFormatContext *format_ctx = NULL;
+    if( lavf_open_file( &format_ctx, indexer->file_path, &lh ) == 0 )
+    {
+        /* Abort via the progress indicator. */
+        progress_indicator_t indicator = { NULL, update_background_indexing, NULL };
+        lwh.file_path    = indexer->file_path;
+        vdh.stream_index = -1;
+        adh.stream_index = -1;
+        create_index( &lwh, &vdh, &voh, &adh, &aoh, format_ctx, &indexer->opt, indexer->index_path,
+                      &indicator, (progress_handler_t *)indexer );
+    }
+    if( format_ctx )
+        lavf_close_file( &format_ctx );
+    /* Only the index file is wanted. */
+    vdh.ctx = NULL;
+    adh.ctx = NULL;
+    lwlibav_cleanup_video_decode_handler( &vdh );
+    lwlibav_cleanup_video_output_handler( &voh );
+    lwlibav_cleanup_audio_decode_handler( &adh );
+    lwlibav_cleanup_audio_output_handler( &aoh );
+    return NULL;
+}
+
+static void start_background_indexing
+(
+    lwlibav_file_handler_t *lwhp,
+    lwlibav_option_t       *opt,
+    const char             *index_path
+)
+{
+    lwlibav_background_indexer_t *indexer = (lwlibav_background_indexer_t *)lw_malloc_zero( sizeof(lwlibav_background_indexer_t) );
+    if( !indexer )
+        return;
+    indexer->file_path  = (char *)lw_memdup( lwhp->file_path, strlen( lwhp->file_path ) + 1 );
+    indexer->index_path = (char *)lw_memdup( (void *)index_path, strlen( index_path ) + 1 );
+    if( !indexer->file_path || !indexer->index_path || lw_mutex_init( &indexer->mutex ) < 0 )
+        goto fail;
+    indexer->opt              = *opt;
+    indexer->opt.file_path    = indexer->file_path;
+    indexer->opt.cache_dir    = NULL;
+    indexer->opt.sparse_index = 0;
+    if( lw_thread_create( &indexer->thread, background_indexing_thread, indexer ) < 0 )
+    {
+        lw_mutex_destroy( &indexer->mutex );
+        goto fail;
+    }
+    lwhp->background_indexer = indexer;
+    return;
+fail:
+    /* Not fatal. The index file will be created next time. */
+    lw_freep( &indexer->file_path );
+    lw_freep( &indexer->index_path );
+    free( indexer );
+}
+
+void lwlibav_stop_background_indexing
+(
+    lwlibav_file_handler_t *lwhp
+)
+{
+    lwlibav_background_indexer_t *indexer = lwhp->background_indexer;
+    if( !indexer )
+        return;
+    lw_mutex_lock( &indexer->mutex );
+    indexer->abort = 1;
+    lw_mutex_unlock( &indexer->mutex );
+    lw_thread_join( &indexer->thread );
+    lw_mutex_destroy( &indexer->mutex );
+    lw_freep( &indexer->file_path );
+    lw_freep( &indexer->index_path );
+    lw_freep( &lwhp->background_indexer );
+}
+
 int lwlibav_construct_index
 (
     lwlibav_file_handler_t         *lwhp,
@@ -2553,6 +5829,10 @@ int lwlibav_construct_index
     progress_handler_t             *php
 )
 {
+    /* The index pipeline and the background indexing open decoders on their own threads
+     * concurrently with the decoders of the caller. */
+    if( lw_register_lock_manager() < 0 )
+        return -1;
     /* Allocate frame buffer. */
     vdhp->frame_buffer = av_frame_alloc();
     if( !vdhp->frame_buffer )
@@ -2565,35 +5845,57 @@ int lwlibav_construct_index
     }
     /* Try to open the index file. */
     int file_path_length = strlen( opt->file_path );
-    char *index_file_path = (char *)lw_malloc_zero(file_path_length + 5);
+    const char *ext = file_path_length >= 5 ? &opt->file_path[file_path_length - 4] : NULL;
+    int has_lwi_ext = ext && !strncmp( ext, ".lwi", strlen( ".lwi" ) );
+    char *index_file_path = NULL;
+    if( has_lwi_ext )
+    {
+        index_file_path = (char *)lw_malloc_zero( file_path_length + 1 );
+        if( index_file_path )
+            memcpy( index_file_path, opt->file_path, file_path_length );
+    }
+    else
+        index_file_path = get_index_file_path( opt->file_path, opt->cache_dir );
     if( !index_file_path )
     {
         av_frame_free( &vdhp->frame_buffer );
         av_frame_free( &adhp->frame_buffer );
         return -1;
     }
-    memcpy( index_file_path, opt->file_path, file_path_length );
-    const char *ext = file_path_length >= 5 ? &opt->file_path[file_path_length - 4] : NULL;
-    int has_lwi_ext = ext && !strncmp( ext, ".lwi", strlen( ".lwi" ) );
-    if( has_lwi_ext )
-        index_file_path[file_path_length] = '\0';
-    else
+    if( !opt->no_create_index )
     {
-        memcpy( index_file_path + file_path_length, ".lwi", strlen( ".lwi" ) );
-        index_file_path[file_path_length + 4] = '\0';
+        /* Extend the index file if the source has grown since indexing. */
+        int ret = append_index( lwhp, vdhp, vohp, adhp, aohp, lhp, opt, index_file_path, indicator, php );
+        if( ret == 0 )
+        {
+            free( index_file_path );
+            return 0;
+        }
+        if( ret < 0 )
+            release_loaded_tables( vdhp, adhp, aohp );
     }
     FILE *index = fopen( index_file_path, (opt->force_video || opt->force_audio) ? "r+b" : "rb" );
-    free( index_file_path );
     if( index )
     {
-        int version = 0;
-        int ret = fscanf( index, "<LibavReaderIndexFile=%d>\n", &version );
-        if( ret == 1
-         && version == INDEX_FILE_VERSION
-         && parse_index( lwhp, vdhp, vohp, adhp, aohp, opt, index ) == 0 )
+        char magic[LWINDEX_MAGIC_SIZE];
+        int  ret = -1;
+        if( fread( magic, 1, LWINDEX_MAGIC_SIZE, index ) == LWINDEX_MAGIC_SIZE
+         && !memcmp( magic, LWINDEX_BINARY_MAGIC, LWINDEX_MAGIC_SIZE ) )
+            ret = parse_binary_index( lwhp, vdhp, vohp, adhp, aohp, opt, index );
+        else
+        {
+            /* Text index file exported by lwlibav_export_index_text(). */
+            int version = 0;
+            rewind( index );
+            if( fscanf( index, "<LibavReaderIndexFile=%d>\n", &version ) == 1
+             && version == INDEX_FILE_VERSION )
+                ret = parse_index( lwhp, vdhp, vohp, adhp, aohp, opt, index );
+        }
+        if( ret == 0 )
         {
             /* Opening and parsing the index file succeeded. */
             fclose( index );
+            free( index_file_path );
             av_register_all();
             avcodec_register_all();
             lwhp->threads = opt->threads;
@@ -2623,8 +5925,30 @@ int lwlibav_construct_index
     lwhp->threads      = opt->threads;
     vdhp->stream_index = -1;
     adhp->stream_index = -1;
-    /* Create the index file. */
-    create_index( lwhp, vdhp, vohp, adhp, aohp, format_ctx, opt, indicator, php );
+    /* Create the index file.
+     * When the given path is the index file itself, the source file is re-indexed into the default location. */
+    if( has_lwi_ext )
+    {
+        lw_freep( &index_file_path );
+        index_file_path = get_index_file_path( lwhp->file_path, opt->cache_dir );
+        if( !index_file_path )
+        {
+            lavf_close_file( &format_ctx );
+            goto fail;
+        }
+    }
+    /* Import the index of the container if complete. Otherwise, read the whole file. */
+    if( import_index( lwhp, vdhp, vohp, adhp, aohp, format_ctx, opt, index_file_path ) < 0 )
+    {
+        if( opt->sparse_index && create_sparse_index( lwhp, vdhp, vohp, format_ctx, opt ) == 0 )
+        {
+            if( !opt->no_create_index )
+                start_background_indexing( lwhp, opt, index_file_path );
+        }
+        else
+            create_index( lwhp, vdhp, vohp, adhp, aohp, format_ctx, opt, index_file_path, indicator, php );
+    }
+    free( index_file_path );
     /* Close file.
      * By opening file for video and audio separately, indecent work about frame reading can be avoidable. */
     lavf_close_file( &format_ctx );
@@ -2632,6 +5956,7 @@ int lwlibav_construct_index
     adhp->ctx = NULL;
     return 0;
 fail:
+    free( index_file_path );
     if( vdhp->frame_buffer )
         av_frame_free( &vdhp->frame_buffer );
     if( adhp->frame_buffer )
@@ -2641,6 +5966,7 @@ fail:
     return -1;
 }
 
+
 int lwlibav_import_av_index_entry
 (
     lwlibav_decode_handler_t *dhp
@@ -2663,3 +5989,194 @@ int lwlibav_import_av_index_entry
     }
     return 0;
 }
+
+int lwlibav_export_index_text
+(
+    const char *index_path,
+    const char *text_path
+)
+{
+    FILE *index = fopen( index_path, "rb" );
+    if( !index )
+        return -1;
+    char magic[LWINDEX_MAGIC_SIZE];
+    lwindex_reader_t reader;
+    char *file_path   = NULL;
+    char *format_name = NULL;
+    int   format_flags;
+    int   raw_demuxer;
+    if( fread( magic, 1, LWINDEX_MAGIC_SIZE, index ) != LWINDEX_MAGIC_SIZE
+     || memcmp( magic, LWINDEX_BINARY_MAGIC, LWINDEX_MAGIC_SIZE )
+     || open_index_reader( &reader, index ) < 0
+     || read_index_file_info( &reader, &file_path, &format_name, &format_flags, &raw_demuxer ) < 0 )
+    {
+        fclose( index );
+        return -1;
+    }
+    lwindex_writer_t writer;
+    if( open_index_writer( &writer, text_path, 1 ) < 0 )
+    {
+        lw_freep( &file_path );
+        lw_freep( &format_name );
+        fclose( index );
+        return -1;
+    }
+    write_index_file_info( &writer, file_path, format_flags, raw_demuxer, format_name );
+    write_index_active_stream( &writer, AVMEDIA_TYPE_VIDEO, reader.active_video_index );
+    write_index_active_stream( &writer, AVMEDIA_TYPE_AUDIO, reader.active_audio_index );
+    lw_freep( &file_path );
+    lw_freep( &format_name );
+    /* Packet records */
+    lwindex_section_t *section = find_index_section( &reader, LWINDEX_SECTION_PKTS, LWINDEX_PACKET_RECORD_SIZE );
+    if( !section )
+        writer.error = 1;
+    else
+        for( uint64_t i = 0; i < section->count && !writer.error; i++ )
+        {
+            lwindex_packet_record_t record;
+            if( read_index_records( &reader, section, i, 1, &record, sizeof(lwindex_packet_record_t), decode_packet_record ) < 0 )
+                writer.error = 1;
+            else
+                write_index_packet( &writer, &record );
+        }
+    end_index_packets( &writer );
+    /* AVIndexEntry records and extradata records in the order of the groups.
+     * Every AVIndexEntry group precedes every extradata group. */
+    section = find_index_section( &reader, LWINDEX_SECTION_GRPS, LWINDEX_GROUP_RECORD_SIZE );
+    if( !section )
+        writer.error = 1;
+    else
+    {
+        int64_t first[2] = { 0, 0 };
+        for( uint64_t i = 0; i < section->count && !writer.error; i++ )
+        {
+            lwindex_group_t group;
+            if( read_index_records( &reader, section, i, 1, &group, sizeof(lwindex_group_t), decode_group_record ) < 0
+             || group.count < 0 )
+            {
+                writer.error = 1;
+                break;
+            }
+            if( group.kind == LWINDEX_GROUP_INDEX_ENTRIES )
+            {
+                AVIndexEntry *entries = group.count > 0 ? read_index_entry_group( &reader, first[0], group.count ) : NULL;
+                if( group.count > 0 && !entries )
+                    writer.error = 1;
+                else
+                    write_index_entries( &writer, group.stream_index, group.codec_type, entries, group.count );
+                av_freep( &entries );
+                first[0] += group.count;
+            }
+            else
+            {
+                lwlibav_extradata_handler_t exh = { 0 };
+                if( group.count > 0 && read_index_extradata_group( &reader, first[1], group.count, &exh ) < 0 )
+                    writer.error = 1;
+                else
+                    write_index_extradata_list( &writer, group.stream_index, group.codec_type, exh.entries, group.count );
+                free_extradata_entries( &exh );
+                first[1] += group.count;
+            }
+        }
+    }
+    fclose( index );
+    return close_index_writer( &writer, 0 );
+}
+
+int lwlibav_import_index_text
+(
+    const char *text_path,
+    const char *index_path
+)
+{
+    FILE *text = fopen( text_path, "rb" );
+    if( !text )
+        return -1;
+    int  version = 0;
+    int  format_flags;
+    int  raw_demuxer;
+    int  active_video_index;
+    int  active_audio_index;
+    char *file_path = NULL;
+    char format_name[256];
+    if( fscanf( text, "<LibavReaderIndexFile=%d>\n", &version ) != 1
+     || version != INDEX_FILE_VERSION
+     || !(file_path = scan_input_file_path( text ))
+     || fscanf( text, "<LibavReaderIndex=0x%x,%d,%[^>]>\n", &format_flags, &raw_demuxer, format_name ) != 3
+     || fscanf( text, "<ActiveVideoStreamIndex>%d</ActiveVideoStreamIndex>\n", &active_video_index ) != 1
+     || fscanf( text, "<ActiveAudioStreamIndex>%d</ActiveAudioStreamIndex>\n", &active_audio_index ) != 1 )
+    {
+        lw_freep( &file_path );
+        fclose( text );
+        return -1;
+    }
+    lwindex_writer_t writer;
+    if( open_index_writer( &writer, index_path, 0 ) < 0 )
+    {
+        lw_freep( &file_path );
+        fclose( text );
+        return -1;
+    }
+    write_index_file_info( &writer, file_path, format_flags, raw_demuxer, format_name );
+    lw_freep( &file_path );
+    write_index_active_stream( &writer, AVMEDIA_TYPE_VIDEO, active_video_index );
+    write_index_active_stream( &writer, AVMEDIA_TYPE_AUDIO, active_audio_index );
+    char buf[1024];
+    int  ret = 1;
+    while( !writer.error && fgets( buf, sizeof(buf), text ) )
+    {
+        lwindex_packet_record_t record;
+        ret = scan_packet_record( text, buf, sizeof(buf), &record );
+        if( ret != 0 )
+            break;
+        write_index_packet( &writer, &record );
+    }
+    if( ret < 0 || strncmp( buf, "</LibavReaderIndex>", strlen( "</LibavReaderIndex>" ) ) )
+        writer.error = 1;
+    end_index_packets( &writer );
+    while( !writer.error && fgets( buf, sizeof(buf), text ) )
+    {
+        int stream_index;
+        int codec_type;
+        int count;
+        if( sscanf( buf, "<StreamIndexEntries=%d,%d,%d>", &stream_index, &codec_type, &count ) == 3 )
+        {
+            AVIndexEntry *entries = count > 0 ? (AVIndexEntry *)av_malloc( count * sizeof(AVIndexEntry) ) : NULL;
+            if( count < 0 || (count > 0 && !entries) )
+                writer.error = 1;
+            for( int i = 0; i < count && !writer.error; i++ )
+                if( !fgets( buf, sizeof(buf), text ) || scan_av_index_entry( buf, &entries[i] ) < 0 )
+                    writer.error = 1;
+            if( !writer.error
+             && (!fgets( buf, sizeof(buf), text ) || strncmp( buf, "</StreamIndexEntries>", strlen( "</StreamIndexEntries>" ) )) )
+                writer.error = 1;
+            write_index_entries( &writer, stream_index, codec_type, entries, count );
+            av_freep( &entries );
+        }
+        else if( sscanf( buf, "<ExtraDataList=%d,%d,%d>", &stream_index, &codec_type, &count ) == 3 )
+        {
+            lwlibav_extradata_handler_t exh = { 0 };
+            if( count < 0 || (count > 0 && !alloc_extradata_entries( &exh, count )) )
+                writer.error = 1;
+            for( int i = 0; i < count && !writer.error; i++ )
+                if( !fgets( buf, sizeof(buf), text )
+                 || scan_extradata( text, buf, codec_type, &exh.entries[i] ) < 0
+                 || !fgets( buf, sizeof(buf), text ) )  /* new line ('\n') */
+                    writer.error = 1;
+            if( !writer.error
+             && (!fgets( buf, sizeof(buf), text ) || strncmp( buf, "</ExtraDataList>", strlen( "</ExtraDataList>" ) )) )
+                writer.error = 1;
+            write_index_extradata_list( &writer, stream_index, codec_type, exh.entries, count );
+            free_extradata_entries( &exh );
+        }
+        else if( !strncmp( buf, "</LibavReaderIndexFile>", strlen( "</LibavReaderIndexFile>" ) ) )
+            break;
+        else
+            writer.error = 1;
+    }
+    if( strncmp( buf, "</LibavReaderIndexFile>", strlen( "</LibavReaderIndexFile>" ) ) )
+        writer.error = 1;
+    fclose( text );
+    /* The finalized tables are not present, so they are rebuilt from the packet records when opening. */
+    return close_index_writer( &writer, 0 );
+}
@@ -20,11 +20,12 @@
 
 /* This file is available under an ISC license. */
 
-#define INDEX_FILE_VERSION 12
+#define INDEX_FILE_VERSION 13
 
 typedef struct
 {
     const char *file_path;
+    const char *cache_dir;          /* directory of index files; NULL means the environment variable or beside the source */
     int         threads;
     int         av_sync;
     int         no_create_index;
@@ -34,6 +35,7 @@ typedef struct
     int         force_audio_index;
     int         apply_repeat_flag;
     int         field_dominance;
+    int         sparse_index;       /* Open with a keyframe-only index if no index file, and create the index file in background. */
 } lwlibav_option_t;
 
 int lwlibav_construct_index
@@ -49,7 +51,28 @@ int lwlibav_construct_index
     progress_handler_t             *php
 );
 
+/* Stop the indexing started in background by the sparse index mode.
+ * The index file is not created if the indexing has not completed yet. */
+void lwlibav_stop_background_indexing
+(
+    lwlibav_file_handler_t *lwhp
+);
+
 int lwlibav_import_av_index_entry
 (
     lwlibav_decode_handler_t *dhp
 );
+
+/* Dump the binary index file into the text layout for debugging and inspection. Used by tools/lwindexconv. */
+int lwlibav_export_index_text
+(
+    const char *index_path,
+    const char *text_path
+);
+
+/* Convert the text layout back into the binary index file. */
+int lwlibav_import_index_text
+(
+    const char *text_path,
+    const char *index_path
+);
@@ -52,8 +52,8 @@ int lwlibav_get_desired_audio_track
     int error = adhp->stream_index < 0
              || adhp->frame_count == 0
              || lavf_open_file( &adhp->format, file_path, &adhp->lh );
-    AVCodecContext *ctx = !error ? adhp->format->streams[ adhp->stream_index ]->codec : NULL;
-    if( error || open_decoder( ctx, adhp->codec_id, threads ) )
+    AVCodecContext *ctx = !error ? open_stream_decoder( adhp->format->streams[ adhp->stream_index ], adhp->codec_id, threads ) : NULL;
+    if( !ctx )
     {
         if( adhp->index_entries )
             av_freep( &adhp->index_entries );
@@ -66,42 +66,70 @@ int lwlibav_get_desired_audio_track
         }
         return -1;
     }
+    if( adhp->dv_in_avi != 1 )
+        lavf_discard_other_streams( adhp->format, adhp->stream_index );
     adhp->ctx = ctx;
     return 0;
 }
 
-uint64_t lwlibav_count_overall_pcm_samples
+/* Build the table of the output PCM sample positions at the end of each frame.
+ * A new sequence starts where the sample rate or the frame length changes,
+ * and the PCM samples are resampled per sequence. */
+static int build_audio_frame_pos_list
 (
     lwlibav_audio_decode_handler_t *adhp,
     int                             output_sample_rate
 )
 {
-    audio_frame_info_t *frame_list    = adhp->frame_list;
-    int      current_sample_rate      = frame_list[1].sample_rate > 0 ? frame_list[1].sample_rate : adhp->ctx->sample_rate;
-    uint32_t current_frame_length     = frame_list[1].length;
-    uint64_t pcm_sample_count         = 0;
-    uint64_t overall_pcm_sample_count = 0;
+    if( adhp->frame_pos_list && adhp->frame_pos_sample_rate == output_sample_rate )
+        return 0;
+    audio_frame_pos_t *pos_list = (audio_frame_pos_t *)realloc( adhp->frame_pos_list, (adhp->frame_count + 1) * sizeof(audio_frame_pos_t) );
+    if( !pos_list )
+    {
+        if( adhp->lh.show_log )
+            adhp->lh.show_log( &adhp->lh, LW_LOG_FATAL, "Failed to allocate the audio sample position table." );
+        return -1;
+    }
+    adhp->frame_pos_list        = pos_list;
+    adhp->frame_pos_sample_rate = output_sample_rate;
+    audio_frame_info_t *frame_list = adhp->frame_list;
+    int      current_sample_rate             = frame_list[1].sample_rate > 0 ? frame_list[1].sample_rate : adhp->ctx->sample_rate;
+    int      current_frame_length            = frame_list[1].length;
+    uint64_t resampled_sample_count          = 0;   /* the number of accumulated PCM samples after resampling per sequence */
+    uint64_t pcm_sample_count                = 0;   /* the number of accumulated PCM samples before resampling per sequence */
+    uint64_t prior_sequences_resampled_count = 0;   /* the number of accumulated PCM samples of all prior sequences */
+    pos_list[0].end_pos     = 0;
+    pos_list[0].sample_rate = current_sample_rate;
     for( uint32_t i = 1; i <= adhp->frame_count; i++ )
     {
         if( (current_sample_rate != frame_list[i].sample_rate && frame_list[i].sample_rate > 0)
          || current_frame_length != frame_list[i].length )
         {
-            uint64_t resampled_sample_count = output_sample_rate == current_sample_rate || pcm_sample_count == 0
-                                            ? pcm_sample_count
-                                            : (pcm_sample_count * output_sample_rate - 1) / current_sample_rate + 1;
-            overall_pcm_sample_count += resampled_sample_count;
-            pcm_sample_count     = 0;
+            /* Encountered a new sequence. */
+            prior_sequences_resampled_count += resampled_sample_count;
+            pcm_sample_count = 0;
             current_sample_rate  = frame_list[i].sample_rate > 0 ? frame_list[i].sample_rate : adhp->ctx->sample_rate;
             current_frame_length = frame_list[i].length;
         }
-        pcm_sample_count += frame_list[i].length;
+        pcm_sample_count += (uint64_t)current_frame_length;
+        resampled_sample_count = output_sample_rate == current_sample_rate || pcm_sample_count == 0
+                               ? pcm_sample_count
+                               : (pcm_sample_count * output_sample_rate - 1) / current_sample_rate + 1;
+        pos_list[i].end_pos     = prior_sequences_resampled_count + resampled_sample_count;
+        pos_list[i].sample_rate = current_sample_rate;
     }
-    current_sample_rate = frame_list[ adhp->frame_count ].sample_rate > 0
-                        ? frame_list[ adhp->frame_count ].sample_rate
-                        : adhp->ctx->sample_rate;
-    if( pcm_sample_count )
-        overall_pcm_sample_count += (pcm_sample_count * output_sample_rate - 1) / current_sample_rate + 1;
-    return overall_pcm_sample_count;
+    return 0;
+}
+
+uint64_t lwlibav_count_overall_pcm_samples
+(
+    lwlibav_audio_decode_handler_t *adhp,
+    int                             output_sample_rate
+)
+{
+    if( build_audio_frame_pos_list( adhp, output_sample_rate ) < 0 )
+        return 0;
+    return adhp->frame_pos_list[ adhp->frame_count ].end_pos;
 }
 
 static int find_start_audio_frame
@@ -113,36 +141,22 @@ static int find_start_audio_frame
 )
 {
     audio_frame_info_t *frame_list = adhp->frame_list;
-    uint32_t frame_number                    = 1;
-    uint64_t current_frame_pos               = 0;
-    uint64_t next_frame_pos                  = 0;
-    int      current_sample_rate             = frame_list[frame_number].sample_rate > 0 ? frame_list[frame_number].sample_rate : adhp->ctx->sample_rate;
-    int      current_frame_length            = frame_list[frame_number].length;
-    uint64_t resampled_sample_count          = 0;   /* the number of accumulated PCM samples after resampling per sequence */
-    uint64_t pcm_sample_count                = 0;   /* the number of accumulated PCM samples before resampling per sequence */
-    uint64_t prior_sequences_resampled_count = 0;   /* the number of accumulated PCM samples of all prior sequences */
-    do
+    audio_frame_pos_t  *pos_list   = adhp->frame_pos_list;
+    /* Find the first frame ending after the start position by binary search. */
+    uint32_t low  = 1;
+    uint32_t high = adhp->frame_count;
+    while( low < high )
     {
-        current_frame_pos = next_frame_pos;
-        if( (current_sample_rate != frame_list[frame_number].sample_rate && frame_list[frame_number].sample_rate > 0)
-         || current_frame_length != frame_list[frame_number].length )
-        {
-            /* Encountered a new sequence. */
-            prior_sequences_resampled_count += resampled_sample_count;
-            pcm_sample_count = 0;
-            current_sample_rate  = frame_list[frame_number].sample_rate > 0 ? frame_list[frame_number].sample_rate : adhp->ctx->sample_rate;
-            current_frame_length = frame_list[frame_number].length;
-        }
-        pcm_sample_count += (uint64_t)current_frame_length;
-        resampled_sample_count = output_sample_rate == current_sample_rate || pcm_sample_count == 0
-                               ? pcm_sample_count
-                               : (pcm_sample_count * output_sample_rate - 1) / current_sample_rate + 1;
-        next_frame_pos = prior_sequences_resampled_count + resampled_sample_count;
-        if( start_frame_pos < next_frame_pos )
-            break;
-        ++frame_number;
-    } while( frame_number <= adhp->frame_count );
-    *start_offset = start_frame_pos - current_frame_pos;
+        uint32_t middle = low + (high - low) / 2;
+        if( start_frame_pos < pos_list[middle].end_pos )
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    uint32_t frame_number        = low;
+    uint64_t current_frame_pos   = pos_list[frame_number - 1].end_pos;
+    int      current_sample_rate = pos_list[frame_number].sample_rate;
+    *start_offset = start_frame_pos > current_frame_pos ? start_frame_pos - current_frame_pos : 0;
     if( *start_offset && current_sample_rate != output_sample_rate )
         *start_offset = (*start_offset * current_sample_rate - 1) / output_sample_rate + 1;
     if( frame_number > 1 )
@@ -255,13 +269,12 @@ retry_seek:;
      * Note: av_seek_frame() for DV in AVI Type-1 requires stream_index = 0. */
     int flags = (adhp->lw_seek_flags & SEEK_POS_BASED) ? AVSEEK_FLAG_BYTE : adhp->lw_seek_flags == 0 ? AVSEEK_FLAG_FRAME : 0;
     int stream_index = adhp->dv_in_avi == 1 ? 0 : adhp->stream_index;
-    if( av_seek_frame( adhp->format, stream_index, rap_pos, flags | AVSEEK_FLAG_BACKWARD ) < 0 )
-        av_seek_frame( adhp->format, stream_index, rap_pos, flags | AVSEEK_FLAG_BACKWARD | AVSEEK_FLAG_ANY );
+    lwlibav_seek_frame( (lwlibav_decode_handler_t *)adhp, stream_index, rap_pos, flags | AVSEEK_FLAG_BACKWARD );
     /* Seek to the target audio frame and get it. */
     int match = 0;
     for( uint32_t i = rap_number; i <= frame_number; )
     {
-        if( lwlibav_get_av_frame( adhp->format, adhp->stream_index, i, pkt ) )
+        if( lwlibav_get_av_frame( (lwlibav_decode_handler_t *)adhp, i, pkt ) )
             break;
         if( !match && error_count <= MAX_ERROR_COUNT )
         {
@@ -349,6 +362,11 @@ uint64_t lwlibav_get_pcm_audio_samples
             aohp->request_length -= silence_length;
             start_frame_pos = 0;
         }
+        if( build_audio_frame_pos_list( adhp, aohp->output_sample_rate ) < 0 )
+        {
+            adhp->error = 1;
+            return 0;
+        }
         frame_number = find_start_audio_frame( adhp, aohp->output_sample_rate, start_frame_pos, &aohp->output_sample_offset );
 retry_seek:
         av_free_packet( pkt );
@@ -405,7 +423,7 @@ retry_seek:
         else if( alter_pkt->size <= 0 )
         {
             /* Getting an audio packet must be after flushing all remaining samples in resampler's FIFO buffer. */
-            lwlibav_get_av_frame( adhp->format, adhp->stream_index, frame_number, pkt );
+            lwlibav_get_av_frame( (lwlibav_decode_handler_t *)adhp, frame_number, pkt );
             *alter_pkt = *pkt;
         }
         /* Decode and output from an audio packet. */
@@ -459,15 +477,15 @@ void lwlibav_cleanup_audio_decode_handler( lwlibav_audio_decode_handler_t *adhp
     av_free_packet( &adhp->packet );
     if( adhp->frame_list )
         lw_freep( &adhp->frame_list );
+    if( adhp->frame_pos_list )
+        lw_freep( &adhp->frame_pos_list );
     if( adhp->index_entries )
         av_freep( &adhp->index_entries );
     if( adhp->frame_buffer )
         av_frame_free( &adhp->frame_buffer );
     if( adhp->ctx )
-    {
-        avcodec_close( adhp->ctx );
-        adhp->ctx = NULL;
-    }
+        close_stream_decoder( &adhp->ctx );
+    lwlibav_stop_readahead( (lwlibav_decode_handler_t *)adhp );
     if( adhp->format )
         lavf_close_file( &adhp->format );
 }
@@ -479,7 +497,7 @@ void set_audio_basic_settings
 )
 {
     lwlibav_audio_decode_handler_t *adhp = (lwlibav_audio_decode_handler_t *)dhp;
-    AVCodecContext *ctx = adhp->format->streams[ adhp->stream_index ]->codec;
+    AVCodecContext *ctx = adhp->ctx;
     lwlibav_extradata_t *entry = &adhp->exh.entries[ adhp->frame_list[frame_number].extradata_index ];
     ctx->sample_rate           = entry->sample_rate;
     ctx->channel_layout        = entry->channel_layout;
@@ -503,9 +521,7 @@ int try_decode_audio_frame
         return -1;
     }
     lwlibav_audio_decode_handler_t *adhp = (lwlibav_audio_decode_handler_t *)dhp;
-    AVFormatContext *format_ctx   = adhp->format;
-    int              stream_index = adhp->stream_index;
-    AVCodecContext  *ctx          = format_ctx->streams[stream_index]->codec;
+    AVCodecContext  *ctx          = adhp->ctx;
     uint32_t         start_frame  = frame_number;
     do
     {
@@ -520,7 +536,7 @@ int try_decode_audio_frame
             seek_audio( adhp, frame_number, 0, &pkt );
         else
         {
-            int ret = lwlibav_get_av_frame( format_ctx, stream_index, frame_number, &pkt );
+            int ret = lwlibav_get_av_frame( dhp, frame_number, &pkt );
             if( ret > 0 )
                 break;
             else if( ret < 0 )
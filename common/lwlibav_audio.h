@@ -34,6 +34,12 @@ typedef struct
     int      sample_rate;
 } audio_frame_info_t;
 
+typedef struct
+{
+    uint64_t end_pos;       /* the number of output PCM samples accumulated up to the end of this frame */
+    int      sample_rate;   /* the sample rate of the sequence this frame belongs to */
+} audio_frame_pos_t;
+
 typedef struct
 {
     /* common */
@@ -52,12 +58,15 @@ typedef struct
     uint32_t            frame_count;
     AVFrame            *frame_buffer;
     audio_frame_info_t *frame_list;
+    lwlibav_readahead_t *readahead;
     /* */
     AVPacket            packet;         /* for getting and freeing */
     AVPacket            alter_packet;   /* for consumed by the decoder instead of 'packet'. */
     uint32_t            frame_length;
     uint32_t            last_frame_number;
     uint64_t            next_pcm_sample_number;
+    audio_frame_pos_t  *frame_pos_list;         /* cumulative output PCM sample table for seeking */
+    int                 frame_pos_sample_rate;  /* the output sample rate which frame_pos_list is built for */
 } lwlibav_audio_decode_handler_t;
 
 int lwlibav_get_desired_audio_track
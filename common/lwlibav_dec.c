@@ -33,16 +33,111 @@ extern "C"
 #endif  /* __cplusplus */
 
 #include "utils.h"
+#include "lwthread.h"
 #include "lwlibav_dec.h"
 
-void lwlibav_flush_buffers
+/* States of a packet consumer of a demuxer thread */
+#define READAHEAD_ATTACHED 0    /* served by the demuxer thread */
+#define READAHEAD_SKIPPING 1    /* dropping packets up to the one queued last, since another consumer sought the demuxer */
+#define READAHEAD_DETACHED 2    /* reading the demuxer of the decode handler after draining the queue */
+
+typedef struct lwlibav_demuxer_tag lwlibav_demuxer_t;
+
+struct lwlibav_readahead_tag
+{
+    lwlibav_demuxer_t   *demuxer;
+    lwlibav_readahead_t *next;
+    int                  stream_index;
+    int                  state;
+    int                  waiting;   /* 1 = waiting for a packet */
+    AVPacket            *ring;
+    int                  size;      /* the maximum number of packets read ahead */
+    int                  head;      /* position of the oldest packet in the ring */
+    int                  count;
+    int                  queued;    /* 1 = 'last_pos' and 'last_dts' are of the packet queued last */
+    int                  resync;    /* 1 = the demuxer of the decode handler has to be sought to the packet queued last */
+    int64_t              last_pos;
+    int64_t              last_dts;
+};
+
+struct lwlibav_demuxer_tag
+{
+    lw_thread_t          thread;
+    lw_mutex_t           mutex;
+    lw_cond_t            cond;
+    lw_mutex_t           seek_mutex;    /* held by a consumer throughout seeking so that seeks on 'format' never overlap */
+    AVFormatContext     *format;
+    char                *file_path; /* not NULL if shared among decode handlers */
+    int                  ref_count;
+    int                  eof;       /* 1 = the demuxer reached the end or failed */
+    int                  paused;    /* the number of decoding threads using the demuxer */
+    int                  busy;      /* 1 = the demuxer thread is reading a packet */
+    int                  quit;
+    lwlibav_readahead_t *consumers;
+    lwlibav_demuxer_t   *next;
+};
+
+/* Demuxers shared among decode handlers opened on the same file */
+static lw_static_mutex_t  shared_demuxer_mutex = LW_STATIC_MUTEX_INITIALIZER;
+static lwlibav_demuxer_t *shared_demuxers      = NULL;
+
+static lw_static_mutex_t lock_manager_mutex      = LW_STATIC_MUTEX_INITIALIZER;
+static int               lock_manager_registered = 0;
+
+static int lock_manager
+(
+    void         **mutex,
+    enum AVLockOp  op
+)
+{
+    switch( op )
+    {
+        case AV_LOCK_CREATE :
+            *mutex = lw_malloc_zero( sizeof(lw_mutex_t) );
+            if( !*mutex )
+                return 1;
+            if( lw_mutex_init( (lw_mutex_t *)*mutex ) < 0 )
+            {
+                lw_freep( mutex );
+                return 1;
+            }
+            return 0;
+        case AV_LOCK_OBTAIN :
+            lw_mutex_lock( (lw_mutex_t *)*mutex );
+            return 0;
+        case AV_LOCK_RELEASE :
+            lw_mutex_unlock( (lw_mutex_t *)*mutex );
+            return 0;
+        case AV_LOCK_DESTROY :
+            lw_mutex_destroy( (lw_mutex_t *)*mutex );
+            lw_freep( mutex );
+            return 0;
+        default :
+            return 1;
+    }
+}
+
+int lw_register_lock_manager( void )
+{
+    int ret = 0;
+    lw_static_mutex_lock( &lock_manager_mutex );
+    if( !lock_manager_registered )
+    {
+        if( av_lockmgr_register( lock_manager ) < 0 )
+            ret = -1;
+        else
+            lock_manager_registered = 1;
+    }
+    lw_static_mutex_unlock( &lock_manager_mutex );
+    return ret;
+}
+
+static void reopen_decoder
 (
     lwlibav_decode_handler_t *dhp
 )
 {
-    /* Close and reopen the decoder even if the decoder implements avcodec_flush_buffers().
-     * It seems this brings about more stable composition when seeking. */
-    AVCodecContext *ctx   = dhp->format->streams[ dhp->stream_index ]->codec;
+    AVCodecContext *ctx   = dhp->ctx;
     const AVCodec  *codec = ctx->codec;
     avcodec_close( ctx );
     ctx->codec_id = AV_CODEC_ID_NONE;   /* AVCodecContext.codec_id is supposed to be set properly in avcodec_open2().
@@ -61,6 +156,16 @@ void lwlibav_flush_buffers
     dhp->exh.delay_count = 0;
 }
 
+void lwlibav_flush_buffers
+(
+    lwlibav_decode_handler_t *dhp
+)
+{
+    /* Close and reopen the decoder even if the decoder implements avcodec_flush_buffers().
+     * It seems this brings about more stable composition when seeking. */
+    reopen_decoder( dhp );
+}
+
 void lwlibav_update_configuration
 (
     lwlibav_decode_handler_t *dhp,
@@ -77,8 +182,9 @@ void lwlibav_update_configuration
         lwlibav_flush_buffers( dhp );
         return;
     }
-    AVCodecContext *ctx = dhp->format->streams[ dhp->stream_index ]->codec;
+    AVCodecContext *ctx = dhp->ctx;
     void *app_specific = ctx->opaque;
+    int   emu_edge     = ctx->flags & CODEC_FLAG_EMU_EDGE;  /* required by direct rendering */
     avcodec_close( ctx );
     if( ctx->extradata )
     {
@@ -120,7 +226,7 @@ void lwlibav_update_configuration
         memset( ctx->extradata + ctx->extradata_size, 0, FF_INPUT_BUFFER_PADDING_SIZE );
     }
     /* AVCodecContext.codec_id is supposed to be set properly in avcodec_open2().
-     * See lwlibav_flush_buffers(), why this is needed. */
+     * See reopen_decoder(), why this is needed. */
     ctx->codec_id  = AV_CODEC_ID_NONE;
     /* This is needed by some CODECs such as UtVideo and raw video. */
     ctx->codec_tag = entry->codec_tag;
@@ -139,11 +245,12 @@ void lwlibav_update_configuration
       ? try_decode_video_frame( dhp, frame_number, rap_pos, error_string ) < 0
       : try_decode_audio_frame( dhp, frame_number, error_string ) < 0 )
         goto fail;
-    /* Reopen/flush with the requested number of threads. */
+    /* Reopen with the requested number of threads. */
     ctx->thread_count = thread_count;
+    ctx->flags       |= emu_edge;
     int width  = ctx->width;
     int height = ctx->height;
-    lwlibav_flush_buffers( dhp );
+    reopen_decoder( dhp );
     ctx->get_buffer2 = exhp->get_buffer;
     ctx->opaque      = app_specific;
     /* avcodec_open2() may have changed resolution unexpectedly. */
@@ -158,20 +265,534 @@ fail:
                           "%sIt is recommended you reopen the file.", error_string );
 }
 
+static void flush_readahead_queue
+(
+    lwlibav_readahead_t *rap
+)
+{
+    for( ; rap->count; rap->count-- )
+    {
+        av_free_packet( &rap->ring[ rap->head ] );
+        rap->head = (rap->head + 1) % rap->size;
+    }
+    rap->head = 0;
+}
+
+static void detach_readahead
+(
+    lwlibav_readahead_t *rap
+)
+{
+    rap->state  = READAHEAD_DETACHED;
+    rap->resync = rap->queued;
+}
+
+/* Return a negative value, 0 or a positive value if 'pkt' was read before, is or was read after the packet queued last.
+ * Return INT_MAX if they are incomparable. */
+static int compare_with_queued_packet
+(
+    lwlibav_readahead_t *rap,
+    AVPacket            *pkt
+)
+{
+    if( pkt->pos >= 0 && rap->last_pos >= 0 && pkt->pos != rap->last_pos )
+        return pkt->pos < rap->last_pos ? -1 : 1;
+    if( pkt->dts != AV_NOPTS_VALUE && rap->last_dts != AV_NOPTS_VALUE )
+        return pkt->dts < rap->last_dts ? -1 : pkt->dts > rap->last_dts ? 1 : 0;
+    return pkt->pos >= 0 && rap->last_pos >= 0 ? 0 : INT_MAX;
+}
+
+/* Return 1 if the demuxer thread can read the next packet.
+ * A consumer whose queue is full is detached if another consumer is starving. */
+static int readahead_has_room
+(
+    lwlibav_demuxer_t *demuxer
+)
+{
+    int active = 0;
+    for( lwlibav_readahead_t *rap = demuxer->consumers; rap; rap = rap->next )
+    {
+        if( rap->state == READAHEAD_DETACHED )
+            continue;
+        if( rap->count == rap->size )
+        {
+            lwlibav_readahead_t *other;
+            for( other = demuxer->consumers; other; other = other->next )
+                if( other != rap && other->state != READAHEAD_DETACHED && other->waiting )
+                    break;
+            if( !other )
+                return 0;
+            /* The accesses of the consumers have diverged. */
+            detach_readahead( rap );
+            continue;
+        }
+        active = 1;
+    }
+    return active;
+}
+
+static void dispatch_packet
+(
+    lwlibav_demuxer_t *demuxer,
+    AVPacket          *pkt
+)
+{
+    for( lwlibav_readahead_t *rap = demuxer->consumers; rap; rap = rap->next )
+    {
+        if( rap->stream_index != pkt->stream_index || rap->state == READAHEAD_DETACHED )
+            continue;
+        if( rap->state == READAHEAD_SKIPPING )
+        {
+            int cmp = compare_with_queued_packet( rap, pkt );
+            if( cmp == 0 )
+                /* Reached the packet queued last. */
+                rap->state = READAHEAD_ATTACHED;
+            else if( cmp > 0 )
+                /* The demuxer was sought after the packet queued last. */
+                detach_readahead( rap );
+            continue;
+        }
+        AVPacket *dst = &rap->ring[ (rap->head + rap->count) % rap->size ];
+        if( av_copy_packet( dst, pkt ) < 0 )
+        {
+            detach_readahead( rap );
+            continue;
+        }
+        ++ rap->count;
+        rap->queued   = 1;
+        rap->last_pos = pkt->pos;
+        rap->last_dts = pkt->dts;
+    }
+}
+
+static void *readahead_thread
+(
+    void *arg
+)
+{
+    lwlibav_demuxer_t *demuxer = (lwlibav_demuxer_t *)arg;
+    lw_mutex_lock( &demuxer->mutex );
+    while( 1 )
+    {
+        while( !demuxer->quit && (demuxer->paused || demuxer->eof || !readahead_has_room( demuxer )) )
+            lw_cond_wait( &demuxer->cond, &demuxer->mutex );
+        if( demuxer->quit )
+            break;
+        demuxer->busy = 1;
+        lw_mutex_unlock( &demuxer->mutex );
+        AVPacket pkt;
+        av_init_packet( &pkt );
+        int ret = read_av_frame( demuxer->format, &pkt );
+        lw_mutex_lock( &demuxer->mutex );
+        demuxer->busy = 0;
+        if( ret < 0 )
+            demuxer->eof = 1;
+        else
+        {
+            /* The packet data might be owned by the demuxer until the next read, so the consumers get copies. */
+            dispatch_packet( demuxer, &pkt );
+            av_free_packet( &pkt );
+        }
+        lw_cond_broadcast( &demuxer->cond );
+    }
+    lw_mutex_unlock( &demuxer->mutex );
+    return NULL;
+}
+
+/* Wait for the demuxer thread to leave the demuxer.
+ * The demuxer thread stays paused until every pause is paired with resume_demuxer().
+ * Call these with the mutex locked. */
+static void pause_demuxer
+(
+    lwlibav_demuxer_t *demuxer
+)
+{
+    ++ demuxer->paused;
+    while( demuxer->busy )
+        lw_cond_wait( &demuxer->cond, &demuxer->mutex );
+}
+
+static void resume_demuxer
+(
+    lwlibav_demuxer_t *demuxer
+)
+{
+    if( -- demuxer->paused == 0 )
+        lw_cond_broadcast( &demuxer->cond );
+}
+
+static void destroy_demuxer
+(
+    lwlibav_demuxer_t *demuxer
+)
+{
+    lw_mutex_lock( &demuxer->mutex );
+    demuxer->quit = 1;
+    lw_cond_broadcast( &demuxer->cond );
+    lw_mutex_unlock( &demuxer->mutex );
+    lw_thread_join( &demuxer->thread );
+    lw_cond_destroy( &demuxer->cond );
+    lw_mutex_destroy( &demuxer->seek_mutex );
+    lw_mutex_destroy( &demuxer->mutex );
+    if( demuxer->file_path )
+    {
+        lavf_close_file( &demuxer->format );
+        free( demuxer->file_path );
+    }
+    free( demuxer );
+}
+
+/* Return the shared demuxer of the file with a new reference.
+ * Call this with shared_demuxer_mutex locked. */
+static lwlibav_demuxer_t *find_shared_demuxer
+(
+    const char *shared_path
+)
+{
+    for( lwlibav_demuxer_t *demuxer = shared_demuxers; demuxer; demuxer = demuxer->next )
+        if( !strcmp( demuxer->file_path, shared_path ) )
+        {
+            ++ demuxer->ref_count;
+            return demuxer;
+        }
+    return NULL;
+}
+
+static lwlibav_demuxer_t *create_demuxer
+(
+    AVFormatContext  *format_ctx,
+    const char       *shared_path,
+    lw_log_handler_t *lhp
+)
+{
+    lwlibav_demuxer_t *demuxer = (lwlibav_demuxer_t *)lw_malloc_zero( sizeof(lwlibav_demuxer_t) );
+    if( !demuxer )
+        return NULL;
+    if( shared_path )
+    {
+        demuxer->file_path = (char *)lw_malloc_zero( strlen( shared_path ) + 1 );
+        if( !demuxer->file_path )
+            goto fail_alloc;
+        strcpy( demuxer->file_path, shared_path );
+        /* Nothing is demuxed until a consumer is attached. */
+        if( lavf_open_file( &demuxer->format, shared_path, lhp ) < 0 )
+            goto fail_open;
+        lavf_discard_other_streams( demuxer->format, -1 );
+    }
+    else
+        demuxer->format = format_ctx;
+    if( lw_mutex_init( &demuxer->mutex ) < 0 )
+        goto fail_mutex;
+    if( lw_mutex_init( &demuxer->seek_mutex ) < 0 )
+        goto fail_seek_mutex;
+    if( lw_cond_init( &demuxer->cond ) < 0 )
+        goto fail_cond;
+    if( lw_thread_create( &demuxer->thread, readahead_thread, demuxer ) < 0 )
+        goto fail_thread;
+    demuxer->ref_count = 1;
+    return demuxer;
+fail_thread:
+    lw_cond_destroy( &demuxer->cond );
+fail_cond:
+    lw_mutex_destroy( &demuxer->seek_mutex );
+fail_seek_mutex:
+    lw_mutex_destroy( &demuxer->mutex );
+fail_mutex:
+fail_open:
+    if( demuxer->format && demuxer->file_path )
+        lavf_close_file( &demuxer->format );
+    free( demuxer->file_path );
+fail_alloc:
+    free( demuxer );
+    return NULL;
+}
+
+/* Let the consumer get packets from the demuxer.
+ * Call this with the demuxer paused. */
+static int attach_readahead
+(
+    lwlibav_demuxer_t        *demuxer,
+    lwlibav_readahead_t      *rap,
+    lwlibav_decode_handler_t *dhp
+)
+{
+    if( demuxer->file_path )
+    {
+        /* Enable the stream of the consumer and make seeking as accurate as the demuxer of the handler. */
+        AVStream *src = dhp->format->streams[ rap->stream_index ];
+        AVStream *dst = demuxer->format->streams[ rap->stream_index ];
+        if( dhp->dv_in_avi == 1 )
+            /* The audio is demuxed from the packets of the video stream. */
+            for( unsigned int i = 0; i < demuxer->format->nb_streams; i++ )
+                demuxer->format->streams[i]->discard = AVDISCARD_DEFAULT;
+        dst->discard = AVDISCARD_DEFAULT;
+        for( int i = 0; i < src->nb_index_entries; i++ )
+        {
+            AVIndexEntry *ie = &src->index_entries[i];
+            if( av_add_index_entry( dst, ie->pos, ie->timestamp, ie->size, ie->min_distance, ie->flags ) < 0 )
+                return -1;
+        }
+    }
+    rap->demuxer       = demuxer;
+    rap->next          = demuxer->consumers;
+    demuxer->consumers = rap;
+    return 0;
+}
+
+int lwlibav_start_readahead
+(
+    lwlibav_decode_handler_t *dhp,
+    int                       max_packets,
+    const char               *shared_path
+)
+{
+    if( max_packets <= 0 || dhp->readahead )
+        return 0;
+    lwlibav_readahead_t *rap = (lwlibav_readahead_t *)lw_malloc_zero( sizeof(lwlibav_readahead_t) );
+    if( !rap )
+        return -1;
+    rap->ring = (AVPacket *)lw_malloc_zero( max_packets * sizeof(AVPacket) );
+    if( !rap->ring )
+    {
+        free( rap );
+        return -1;
+    }
+    rap->stream_index = dhp->stream_index;
+    rap->size         = max_packets;
+    rap->last_pos     = -1;
+    rap->last_dts     = AV_NOPTS_VALUE;
+    lwlibav_demuxer_t *demuxer;
+    if( shared_path )
+    {
+        lw_static_mutex_lock( &shared_demuxer_mutex );
+        demuxer = find_shared_demuxer( shared_path );
+        lw_static_mutex_unlock( &shared_demuxer_mutex );
+        if( !demuxer )
+        {
+            /* Opening the file takes a while, so do it without blocking the handlers of the other files. */
+            lwlibav_demuxer_t *created = create_demuxer( NULL, shared_path, &dhp->lh );
+            lwlibav_demuxer_t *raced   = NULL;
+            if( created )
+            {
+                lw_static_mutex_lock( &shared_demuxer_mutex );
+                demuxer = find_shared_demuxer( shared_path );
+                if( demuxer )
+                    /* Another handler has shared the same file meanwhile. */
+                    raced = created;
+                else
+                {
+                    demuxer         = created;
+                    demuxer->next   = shared_demuxers;
+                    shared_demuxers = demuxer;
+                }
+                lw_static_mutex_unlock( &shared_demuxer_mutex );
+            }
+            if( raced )
+                destroy_demuxer( raced );
+        }
+    }
+    else
+        demuxer = create_demuxer( dhp->format, NULL, &dhp->lh );
+    if( !demuxer )
+    {
+        free( rap->ring );
+        free( rap );
+        return -1;
+    }
+    lw_mutex_lock( &demuxer->mutex );
+    pause_demuxer( demuxer );
+    int ret = attach_readahead( demuxer, rap, dhp );
+    resume_demuxer( demuxer );
+    lw_mutex_unlock( &demuxer->mutex );
+    dhp->readahead = rap;
+    if( ret < 0 )
+    {
+        lwlibav_stop_readahead( dhp );
+        return -1;
+    }
+    return 0;
+}
+
+void lwlibav_stop_readahead
+(
+    lwlibav_decode_handler_t *dhp
+)
+{
+    lwlibav_readahead_t *rap = dhp->readahead;
+    if( !rap )
+        return;
+    lwlibav_demuxer_t *demuxer = rap->demuxer;
+    int                shared  = !!demuxer->file_path;
+    if( shared )
+        lw_static_mutex_lock( &shared_demuxer_mutex );
+    lw_mutex_lock( &demuxer->mutex );
+    for( lwlibav_readahead_t **p = &demuxer->consumers; *p; p = &(*p)->next )
+        if( *p == rap )
+        {
+            *p = rap->next;
+            break;
+        }
+    flush_readahead_queue( rap );
+    lw_cond_broadcast( &demuxer->cond );
+    lw_mutex_unlock( &demuxer->mutex );
+    int unused = -- demuxer->ref_count == 0;
+    if( unused && shared )
+        for( lwlibav_demuxer_t **p = &shared_demuxers; *p; p = &(*p)->next )
+            if( *p == demuxer )
+            {
+                *p = demuxer->next;
+                break;
+            }
+    if( shared )
+        lw_static_mutex_unlock( &shared_demuxer_mutex );
+    /* Closing the file is done outside the global lock as well as opening. */
+    if( unused )
+        destroy_demuxer( demuxer );
+    free( rap->ring );
+    free( rap );
+    dhp->readahead = NULL;
+}
+
+int lwlibav_seek_frame
+(
+    lwlibav_decode_handler_t *dhp,
+    int                       stream_index,
+    int64_t                   timestamp,
+    int                       flags
+)
+{
+    lwlibav_readahead_t *rap        = dhp->readahead;
+    AVFormatContext     *format_ctx = dhp->format;
+    if( rap )
+    {
+        lwlibav_demuxer_t *demuxer = rap->demuxer;
+        lw_mutex_lock( &demuxer->seek_mutex );
+        lw_mutex_lock( &demuxer->mutex );
+        pause_demuxer( demuxer );
+        flush_readahead_queue( rap );
+        rap->queued = 0;
+        rap->resync = 0;
+        /* A detached consumer keeps reading the demuxer of the handler while another consumer uses the shared one.
+         * Also, a consumer which has no packet queued since its seek expects the demuxer to stay where it was sought,
+         * so the demuxer of the handler is sought instead. */
+        int others  = 0;
+        int pending = 0;
+        for( lwlibav_readahead_t *other = demuxer->consumers; other; other = other->next )
+            if( other != rap && other->state != READAHEAD_DETACHED )
+            {
+                others  = 1;
+                pending |= !other->queued;
+            }
+        if( pending )
+            rap->state = READAHEAD_DETACHED;
+        else if( rap->state != READAHEAD_DETACHED || !others )
+        {
+            /* The other consumers continue after the packets queued last. */
+            for( lwlibav_readahead_t *other = demuxer->consumers; other; other = other->next )
+                if( other != rap && other->state != READAHEAD_DETACHED )
+                    other->state = READAHEAD_SKIPPING;
+            rap->state   = READAHEAD_ATTACHED;
+            demuxer->eof = 0;
+            format_ctx   = demuxer->format;
+        }
+        lw_mutex_unlock( &demuxer->mutex );
+    }
+    int ret = av_seek_frame( format_ctx, stream_index, timestamp, flags );
+    if( ret < 0 )
+        ret = av_seek_frame( format_ctx, stream_index, timestamp, flags | AVSEEK_FLAG_ANY );
+    if( rap )
+    {
+        lw_mutex_lock( &rap->demuxer->mutex );
+        resume_demuxer( rap->demuxer );
+        lw_mutex_unlock( &rap->demuxer->mutex );
+        lw_mutex_unlock( &rap->demuxer->seek_mutex );
+    }
+    return ret;
+}
+
+/* Seek the demuxer of the handler to the packet queued last by the demuxer thread and skip it.
+ * Return 1 if the packet next to it was missed and 'pkt' holds the first packet after it, otherwise return 0. */
+static int resync_detached_readahead
+(
+    lwlibav_decode_handler_t *dhp,
+    lwlibav_readahead_t      *rap,
+    AVPacket                 *pkt
+)
+{
+    AVFormatContext *format_ctx = dhp->format;
+    if( rap->last_dts != AV_NOPTS_VALUE )
+        av_seek_frame( format_ctx, rap->stream_index, rap->last_dts, AVSEEK_FLAG_BACKWARD );
+    else if( !(format_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK) )
+        av_seek_frame( format_ctx, -1, rap->last_pos, AVSEEK_FLAG_BYTE | AVSEEK_FLAG_BACKWARD );
+    rap->resync = 0;
+    while( read_av_frame( format_ctx, pkt ) >= 0 )
+    {
+        if( pkt->stream_index != rap->stream_index )
+        {
+            av_free_packet( pkt );
+            continue;
+        }
+        int cmp = compare_with_queued_packet( rap, pkt );
+        if( cmp < 0 )
+        {
+            av_free_packet( pkt );
+            continue;
+        }
+        if( cmp == 0 )
+        {
+            av_free_packet( pkt );
+            return 0;
+        }
+        /* Missed the packet queued last. Continue from here anyway. */
+        if( dhp->lh.show_log )
+            dhp->lh.show_log( &dhp->lh, LW_LOG_WARNING, "Failed to resume demuxing exactly." );
+        return 1;
+    }
+    return 0;
+}
+
 int lwlibav_get_av_frame
 (
-    AVFormatContext *format_ctx,
-    int              stream_index,
-    uint32_t         frame_number,
-    AVPacket        *pkt
+    lwlibav_decode_handler_t *dhp,
+    uint32_t                  frame_number,
+    AVPacket                 *pkt
 )
 {
     av_free_packet( pkt );
     av_init_packet( pkt );
+    lwlibav_readahead_t *rap = dhp->readahead;
+    if( rap )
+    {
+        lwlibav_demuxer_t *demuxer = rap->demuxer;
+        lw_mutex_lock( &demuxer->mutex );
+        rap->waiting = 1;
+        lw_cond_broadcast( &demuxer->cond );
+        while( rap->count == 0 && rap->state != READAHEAD_DETACHED && !demuxer->eof )
+            lw_cond_wait( &demuxer->cond, &demuxer->mutex );
+        rap->waiting = 0;
+        if( rap->count )
+        {
+            *pkt = rap->ring[ rap->head ];
+            rap->head = (rap->head + 1) % rap->size;
+            if( rap->count-- == rap->size )
+                lw_cond_broadcast( &demuxer->cond );
+            lw_mutex_unlock( &demuxer->mutex );
+            return 0;
+        }
+        if( rap->state == READAHEAD_SKIPPING )
+            /* The demuxer reached the end before the packet queued last. */
+            detach_readahead( rap );
+        int detached = rap->state == READAHEAD_DETACHED;
+        lw_mutex_unlock( &demuxer->mutex );
+        if( !detached )
+            goto null_packet;
+        if( rap->resync && resync_detached_readahead( dhp, rap, pkt ) )
+            return 0;
+    }
     /* Get a packet as the requested frame physically. */
-    while( read_av_frame( format_ctx, pkt ) >= 0 )
+    while( read_av_frame( dhp->format, pkt ) >= 0 )
     {
-        if( pkt->stream_index != stream_index )
+        if( pkt->stream_index != dhp->stream_index )
         {
             av_free_packet( pkt );
             continue;
@@ -180,6 +801,7 @@ int lwlibav_get_av_frame
          * So, you might get a returnable packet exceeding frame_count and, if present, return it. */
         return 0;
     }
+null_packet:
     /* Return a null packet. */
     pkt->data = NULL;
     pkt->size = 0;
@@ -26,6 +26,9 @@
 #define SEEK_POS_CORRECTION 0x00000008
 #define SEEK_PTS_GENERATED  0x00000010
 
+/* Full indexing in background started by the sparse index mode. See lwlibav_construct_index(). */
+typedef struct lwlibav_background_indexer_tag lwlibav_background_indexer_t;
+
 typedef struct
 {
     char   *file_path;
@@ -34,6 +37,7 @@ typedef struct
     int     raw_demuxer;
     int     threads;
     int64_t av_gap;
+    lwlibav_background_indexer_t *background_indexer;
 } lwlibav_file_handler_t;
 
 typedef struct
@@ -64,6 +68,9 @@ typedef struct
     int (*get_buffer)( struct AVCodecContext *, AVFrame *, int );
 } lwlibav_extradata_handler_t;
 
+/* Packet read-ahead by a demuxer thread. See lwlibav_start_readahead(). */
+typedef struct lwlibav_readahead_tag lwlibav_readahead_t;
+
 typedef struct
 {
     /* common */
@@ -82,6 +89,7 @@ typedef struct
     uint32_t                    frame_count;
     AVFrame                    *frame_buffer;
     void                       *frame_list;
+    lwlibav_readahead_t        *readahead;
 } lwlibav_decode_handler_t;
 
 static inline int lavf_open_file
@@ -106,6 +114,19 @@ static inline int lavf_open_file
     return 0;
 }
 
+/* Let the demuxer skip building packets of the streams other than the given one.
+ * Note: the audio of 'DV in AVI Type-1' is demuxed from the packets of the video stream, so don't use this for it. */
+static inline void lavf_discard_other_streams
+(
+    AVFormatContext *format_ctx,
+    int              stream_index
+)
+{
+    for( unsigned int index = 0; index < format_ctx->nb_streams; index++ )
+        if( (int)index != stream_index )
+            format_ctx->streams[index]->discard = AVDISCARD_ALL;
+}
+
 static inline void lavf_close_file( AVFormatContext **format_ctx )
 {
     for( unsigned int index = 0; index < (*format_ctx)->nb_streams; index++ )
@@ -128,6 +149,45 @@ static inline int open_decoder
     return (avcodec_open2( ctx, codec, NULL ) < 0) ? -1 : 0;
 }
 
+/* Open a decoder on a private copy of the codec context of the stream.
+ * The codec context of the stream is used by the parser of the demuxer, which may run on another thread,
+ * so it must not be closed or reconfigured by decoding. */
+static inline AVCodecContext *open_stream_decoder
+(
+    AVStream       *stream,
+    enum AVCodecID  codec_id,
+    int             threads
+)
+{
+    AVCodecContext *ctx = avcodec_alloc_context3( NULL );
+    if( !ctx )
+        return NULL;
+    if( avcodec_copy_context( ctx, stream->codec ) < 0
+     || open_decoder( ctx, codec_id, threads ) )
+    {
+        av_freep( &ctx->extradata );
+        av_freep( &ctx->intra_matrix );
+        av_freep( &ctx->inter_matrix );
+        av_freep( &ctx->rc_override );
+        av_freep( &ctx->subtitle_header );
+        av_freep( &ctx );
+        return NULL;
+    }
+    return ctx;
+}
+
+/* Close a decoder opened by open_stream_decoder() and free its codec context. */
+static inline void close_stream_decoder( AVCodecContext **ctx )
+{
+    avcodec_close( *ctx );
+    av_freep( &(*ctx)->extradata );
+    av_freep( &(*ctx)->intra_matrix );
+    av_freep( &(*ctx)->inter_matrix );
+    av_freep( &(*ctx)->rc_override );
+    av_freep( &(*ctx)->subtitle_header );
+    av_freep( ctx );
+}
+
 static inline uint32_t get_decoder_delay( AVCodecContext *ctx )
 {
     return ctx->has_b_frames + ((ctx->active_thread_type & FF_THREAD_FRAME) ? ctx->thread_count - 1 : 0);
@@ -148,6 +208,12 @@ static inline int read_av_frame
     } while( 1 );
 }
 
+/* Register the lock manager of libavcodec once per process.
+ * This must be called before any thread which opens or closes decoders is started,
+ * since avcodec_open2() and avcodec_close() are not thread-safe without it.
+ * Return 0 if registered, otherwise return -1. */
+int lw_register_lock_manager( void );
+
 void lwlibav_flush_buffers
 (
     lwlibav_decode_handler_t *dhp
@@ -155,10 +221,38 @@ void lwlibav_flush_buffers
 
 int lwlibav_get_av_frame
 (
-    AVFormatContext *format_ctx,
-    int              stream_index,
-    uint32_t         frame_number,
-    AVPacket        *pkt
+    lwlibav_decode_handler_t *dhp,
+    uint32_t                  frame_number,
+    AVPacket                 *pkt
+);
+
+/* Seek the demuxer, and retry with AVSEEK_FLAG_ANY if failed.
+ * Packets read ahead are discarded. */
+int lwlibav_seek_frame
+(
+    lwlibav_decode_handler_t *dhp,
+    int                       stream_index,
+    int64_t                   timestamp,
+    int                       flags
+);
+
+/* Start a demuxer thread which reads up to 'max_packets' packets of the active stream ahead of the decoder.
+ * If 'shared_path' is not NULL, the demuxer thread and its own demuxer of the file are shared among all handlers
+ * started with the same path, so the file is read once while their accesses go together.
+ * A handler whose access diverges from the others falls back on its own demuxer until it seeks alone.
+ * After this, the demuxer of the handler must be accessed only through lwlibav_get_av_frame() and lwlibav_seek_frame()
+ * until lwlibav_stop_readahead() is called.
+ * Return 0 if started or 'max_packets' is 0, otherwise return -1. */
+int lwlibav_start_readahead
+(
+    lwlibav_decode_handler_t *dhp,
+    int                       max_packets,
+    const char               *shared_path
+);
+
+void lwlibav_stop_readahead
+(
+    lwlibav_decode_handler_t *dhp
 );
 
 void lwlibav_update_configuration
@@ -52,8 +52,8 @@ int lwlibav_get_desired_video_track
     int error = vdhp->stream_index < 0
              || vdhp->frame_count == 0
              || lavf_open_file( &vdhp->format, file_path, &vdhp->lh );
-    AVCodecContext *ctx = !error ? vdhp->format->streams[ vdhp->stream_index ]->codec : NULL;
-    if( error || open_decoder( ctx, vdhp->codec_id, threads ) )
+    AVCodecContext *ctx = !error ? open_stream_decoder( vdhp->format->streams[ vdhp->stream_index ], vdhp->codec_id, threads ) : NULL;
+    if( !ctx )
     {
         if( vdhp->index_entries )
             av_freep( &vdhp->index_entries );
@@ -63,6 +63,8 @@ int lwlibav_get_desired_video_track
             lw_freep( &vdhp->order_converter );
         if( vdhp->keyframe_list )
             lw_freep( &vdhp->keyframe_list );
+        if( vdhp->rap_list )
+            lw_freep( &vdhp->rap_list );
         if( vdhp->format )
         {
             lavf_close_file( &vdhp->format );
@@ -70,11 +72,74 @@ int lwlibav_get_desired_video_track
         }
         return -1;
     }
+    lavf_discard_other_streams( vdhp->format, vdhp->stream_index );
     vdhp->ctx = ctx;
     ctx->refcounted_frames = 1;
     return 0;
 }
 
+int lwlibav_open_video_decoder_instance
+(
+    lwlibav_video_decode_handler_t *dst,
+    lwlibav_video_decode_handler_t *src,
+    const char                     *file_path,
+    int                             threads
+)
+{
+    /* Take over the settings and the frame/index tables, and then drop the per-instance resources. */
+    *dst = *src;
+    dst->format                = NULL;
+    dst->readahead             = NULL;
+    dst->ctx                   = NULL;
+    dst->error                 = 0;
+    dst->index_entries         = NULL;
+    dst->frame_buffer          = NULL;
+    dst->first_valid_frame     = NULL;
+    dst->last_frame_buffer     = NULL;
+    dst->movable_frame_buffer  = NULL;
+    dst->reserved_frame_buffer = NULL;
+    dst->backward_seek_count   = 0;
+    dst->gop_buffer_start      = 0;
+    dst->gop_buffer_count      = 0;
+    dst->gop_buffer_size       = 0;
+    dst->gop_buffer            = NULL;
+    av_init_packet( &dst->packet );
+    dst->packet.data = NULL;
+    dst->packet.size = 0;
+    /* AVIndexEntrys are consumed by each demuxer. */
+    if( src->index_entries )
+    {
+        dst->index_entries = (AVIndexEntry *)av_memdup( src->index_entries, src->index_entries_count * sizeof(AVIndexEntry) );
+        if( !dst->index_entries )
+            return -1;
+    }
+    dst->frame_buffer = av_frame_alloc();
+    if( !dst->frame_buffer
+     || lavf_open_file( &dst->format, file_path, &dst->lh ) )
+        return -1;
+    AVCodecContext *ctx = open_stream_decoder( dst->format->streams[ dst->stream_index ], dst->codec_id, threads );
+    if( !ctx )
+        return -1;
+    lavf_discard_other_streams( dst->format, dst->stream_index );
+    dst->ctx = ctx;
+    ctx->refcounted_frames = 1;
+    return 0;
+}
+
+void lwlibav_close_video_decoder_instance
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    /* The shared tables are owned by the source handler. */
+    vdhp->exh.entries     = NULL;
+    vdhp->frame_list      = NULL;
+    vdhp->order_converter = NULL;
+    vdhp->keyframe_list   = NULL;
+    vdhp->rap_list        = NULL;
+    lwlibav_cleanup_video_decode_handler( vdhp );
+}
+
 void lwlibav_setup_timestamp_info
 (
     lwlibav_file_handler_t         *lwhp,
@@ -270,7 +335,7 @@ static int decode_video_picture
     /* Get a packet containing a frame. */
     uint32_t frame_number = *current;
     AVPacket *pkt = &vdhp->packet;
-    int ret = lwlibav_get_av_frame( vdhp->format, vdhp->stream_index, frame_number, pkt );
+    int ret = lwlibav_get_av_frame( (lwlibav_decode_handler_t *)vdhp, frame_number, pkt );
     if( ret > 0 )
         return ret;
     /* Correct the current frame number in order to match DTS since libavformat might have sought wrong position. */
@@ -291,7 +356,7 @@ static int decode_video_picture
     /* Avoid decoding frames until the seek correction caused by too backward is done. */
     while( correction_distance )
     {
-        ret = lwlibav_get_av_frame( vdhp->format, vdhp->stream_index, ++frame_number, pkt );
+        ret = lwlibav_get_av_frame( (lwlibav_decode_handler_t *)vdhp, ++frame_number, pkt );
         if( ret > 0 )
             return ret;
         if( pkt->flags & AV_PKT_FLAG_KEY )
@@ -329,43 +394,149 @@ void lwlibav_find_random_accessible_point
     uint32_t                       *rap_number
 )
 {
-    int is_leading = !!(vdhp->frame_list[presentation_sample_number].flags & LW_VFRAME_FLAG_LEADING);
     if( decoding_sample_number == 0 )
         decoding_sample_number = vdhp->frame_list[presentation_sample_number].sample_number;
-    *rap_number = decoding_sample_number;
-    while( *rap_number )
-    {
-        if( vdhp->keyframe_list[ *rap_number ] )
-        {
-            if( !is_leading )
-                break;
-            /* Shall be decoded from more past random access point. */
-            is_leading = 0;
-        }
-        --(*rap_number);
-    }
+    *rap_number = vdhp->rap_list[decoding_sample_number];
+    if( *rap_number && (vdhp->frame_list[presentation_sample_number].flags & LW_VFRAME_FLAG_LEADING) )
+        /* Shall be decoded from more past random access point. */
+        *rap_number = vdhp->rap_list[*rap_number - 1];
     if( *rap_number == 0 )
         *rap_number = 1;
 }
 
+uint32_t lwlibav_get_presentation_rap_number
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        rap_number
+)
+{
+    return vdhp->order_converter
+         ? vdhp->order_converter[rap_number].decoding_to_presentation
+         : rap_number;
+}
+
 int64_t lwlibav_get_random_accessible_point_position
 (
     lwlibav_video_decode_handler_t *vdhp,
     uint32_t                        rap_number
 )
 {
-    uint32_t presentation_rap_number = vdhp->order_converter
-                                     ? vdhp->order_converter[rap_number].decoding_to_presentation
-                                     : rap_number;
+    uint32_t presentation_rap_number = lwlibav_get_presentation_rap_number( vdhp, rap_number );
     return (vdhp->lw_seek_flags & SEEK_POS_BASED) ? vdhp->frame_list[presentation_rap_number].file_offset
          : (vdhp->lw_seek_flags & SEEK_PTS_BASED) ? vdhp->frame_list[presentation_rap_number].pts
          : (vdhp->lw_seek_flags & SEEK_DTS_BASED) ? vdhp->frame_list[presentation_rap_number].dts
          :                                          vdhp->frame_list[presentation_rap_number].sample_number;
 }
 
+#define GOP_BUFFER_MAX_FRAMES 64            /* arbitrary */
+#define GOP_BUFFER_MAX_SIZE   (256 << 20)   /* bytes used when the frame cache is disabled; arbitrary */
+
+static void release_gop_buffer
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    if( !vdhp->gop_buffer )
+        return;
+    for( uint32_t i = 0; i < vdhp->gop_buffer_count; i++ )
+        if( vdhp->gop_buffer[i] )
+            av_frame_free( &vdhp->gop_buffer[i] );
+    lw_freep( &vdhp->gop_buffer );
+    vdhp->gop_buffer_start = 0;
+    vdhp->gop_buffer_count = 0;
+    vdhp->gop_buffer_size  = 0;
+}
+
+/* Prepare the buffer to retain frames output while decoding from a random accessible point to the requested frame.
+ * Only the frames closest to the requested one are retained if the GOP is too long. */
+static void prepare_gop_buffer
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        rap_number,
+    uint32_t                        frame_number
+)
+{
+    release_gop_buffer( vdhp );
+    /* The buffer is indexed by presentation frame number. */
+    uint32_t presentation_rap_number = lwlibav_get_presentation_rap_number( vdhp, rap_number );
+    if( presentation_rap_number > frame_number )
+        presentation_rap_number = frame_number;
+    uint32_t first_number = frame_number - presentation_rap_number >= GOP_BUFFER_MAX_FRAMES
+                          ? frame_number - GOP_BUFFER_MAX_FRAMES + 1
+                          : presentation_rap_number;
+    uint32_t count = frame_number - first_number + 1;
+    vdhp->gop_buffer = (AVFrame **)lw_malloc_zero( count * sizeof(AVFrame *) );
+    if( !vdhp->gop_buffer )
+        return;
+    vdhp->gop_buffer_start = first_number;
+    vdhp->gop_buffer_count = count;
+}
+
+static inline int is_in_gop_buffer
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        frame_number
+)
+{
+    return vdhp->gop_buffer
+        && frame_number >= vdhp->gop_buffer_start
+        && frame_number -  vdhp->gop_buffer_start < vdhp->gop_buffer_count;
+}
+
+/* Retain a new reference to the picture in the GOP buffer.
+ * The GOP buffer shares the byte budget of the frame cache, or is limited to GOP_BUFFER_MAX_SIZE if the frame cache is disabled.
+ * Since frames are output in ascending order, the retained frames of the smallest numbers are dropped to fit the budget,
+ * and the ones closest to the requested frame remain. Failure to retain is not an error since the frame can be decoded again. */
+static void retain_gop_picture
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lw_video_frame_cache_t         *cache,
+    AVFrame                        *picture,
+    uint32_t                        frame_number
+)
+{
+    AVFrame **entry = &vdhp->gop_buffer[frame_number - vdhp->gop_buffer_start];
+    if( *entry || !picture->buf[0] )
+        return;
+    size_t max_size = cache->max_size ? cache->max_size : GOP_BUFFER_MAX_SIZE;
+    size_t size     = lw_get_video_frame_buffer_size( picture );
+    if( size > max_size )
+        return;
+    for( AVFrame **oldest = vdhp->gop_buffer; oldest < entry && vdhp->gop_buffer_size + size > max_size; oldest++ )
+        if( *oldest )
+        {
+            vdhp->gop_buffer_size -= lw_get_video_frame_buffer_size( *oldest );
+            av_frame_free( oldest );
+        }
+    if( vdhp->gop_buffer_size + size > max_size )
+        return;
+    *entry = av_frame_clone( picture );
+    if( *entry )
+        vdhp->gop_buffer_size += size;
+}
+
+/* Put a decoded picture into the frame cache and the GOP buffer if the picture is surely a whole frame of the given frame number. */
+static inline void cache_decoded_picture
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lw_video_frame_cache_t         *cache,
+    AVFrame                        *picture,
+    uint32_t                        frame_number
+)
+{
+    if( frame_number == 0 || frame_number > vdhp->frame_count
+     || vdhp->frame_list[frame_number].repeat_pict == 0
+     || (vdhp->frame_list[frame_number].flags & LW_VFRAME_FLAG_LEADING) )
+        return;
+    lw_cache_video_frame( cache, frame_number, picture );
+    if( is_in_gop_buffer( vdhp, frame_number ) )
+        retain_gop_picture( vdhp, cache, picture, frame_number );
+}
+
 static uint32_t seek_video
 (
     lwlibav_video_decode_handler_t *vdhp,
+    lw_video_frame_cache_t         *cache,
     AVFrame                        *picture,
     uint32_t                        presentation_sample_number,
     uint32_t                        rap_number,
@@ -383,8 +554,7 @@ static uint32_t seek_video
         lwlibav_flush_buffers( (lwlibav_decode_handler_t *)vdhp );
     if( vdhp->error )
         return 0;
-    if( av_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags ) < 0 )
-        av_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags | AVSEEK_FLAG_ANY );
+    lwlibav_seek_frame( (lwlibav_decode_handler_t *)vdhp, vdhp->stream_index, rap_pos, vdhp->av_seek_flags );
     int      got_picture = 0;
     int64_t  rap_pts = AV_NOPTS_VALUE;
     uint32_t current;
@@ -421,6 +591,9 @@ static uint32_t seek_video
             exhp->delay_count = MIN( decoder_delay, current - rap_number );
             uint32_t frame_number = current - exhp->delay_count;
             vdhp->last_half_frame = (frame_number <= vdhp->frame_count && vdhp->frame_list[frame_number].repeat_pict == 0);
+            /* Frames decoded on the way to the requested one are cached only after the decoder delay is filled. */
+            if( ret == 0 && !error_ignorance && current - rap_number >= decoder_delay )
+                cache_decoded_picture( vdhp, cache, picture, frame_number );
         }
         /* Some decoders return -1 when feeding a leading sample.
          * We don't consider as an error if the return value -1 is caused by a leading sample since it's not fatal at all. */
@@ -471,6 +644,7 @@ static inline int copy_last_frame
 static int get_picture
 (
     lwlibav_video_decode_handler_t *vdhp,
+    lw_video_frame_cache_t         *cache,
     AVFrame                        *picture,
     uint32_t                        current,
     uint32_t                        goal,
@@ -501,6 +675,7 @@ static int get_picture
             /* frame coded picture or first field of PAFF field coded picture. */
             vdhp->last_half_frame  = (frame_number <= vdhp->frame_count && vdhp->frame_list[frame_number].repeat_pict == 0);
             vdhp->last_half_offset = 0;
+            cache_decoded_picture( vdhp, cache, picture, frame_number );
         }
         else
         {
@@ -571,6 +746,7 @@ static int get_picture
 static int get_requested_picture
 (
     lwlibav_video_decode_handler_t *vdhp,
+    lw_video_frame_cache_t         *cache,
     AVFrame                        *picture,
     uint32_t                        frame_number
 )
@@ -601,6 +777,37 @@ static int get_requested_picture
         extradata_index = vdhp->frame_list[ vdhp->first_valid_frame_number ].extradata_index;
         goto return_frame;
     }
+    /* Frames outside the GOP buffer mean that the backward access has finished. */
+    if( vdhp->gop_buffer && !is_in_gop_buffer( vdhp, frame_number ) )
+        release_gop_buffer( vdhp );
+    AVFrame *cached_frame = is_in_gop_buffer( vdhp, frame_number )
+                          ? vdhp->gop_buffer[frame_number - vdhp->gop_buffer_start]
+                          : NULL;
+    if( !cached_frame )
+        cached_frame = lw_get_cached_video_frame( cache, frame_number );
+    if( cached_frame )
+    {
+        if( picture == vdhp->last_frame_buffer )
+        {
+            /* Move the last output frame aside since the subsequent requests might continue decoding from it. */
+            if( !vdhp->reserved_frame_buffer )
+            {
+                vdhp->reserved_frame_buffer = av_frame_alloc();
+                if( !vdhp->reserved_frame_buffer )
+                    goto video_fail;
+            }
+            av_frame_unref( vdhp->reserved_frame_buffer );
+            av_frame_move_ref( vdhp->reserved_frame_buffer, picture );
+            vdhp->last_frame_buffer = vdhp->reserved_frame_buffer;
+        }
+        av_frame_unref( picture );
+        if( av_frame_ref( picture, cached_frame ) < 0 )
+            goto video_fail;
+        vdhp->ctx->width  = cached_frame->width;
+        vdhp->ctx->height = cached_frame->height;
+        extradata_index = vdhp->frame_list[frame_number].extradata_index;
+        goto return_frame;
+    }
     uint32_t start_number;  /* number of sample, for normal decoding, where decoding starts excluding decoding delay */
     uint32_t rap_number;    /* number of sample, for seeking, where decoding starts excluding decoding delay */
     uint32_t last_frame_number = vdhp->last_frame_number + vdhp->last_half_offset;
@@ -619,16 +826,25 @@ static int get_requested_picture
             start_number = last_frame_number + 1 + vdhp->exh.delay_count;
         else
         {
+            /* Stepping backward within the same GOP requires decoding from the random accessible sample every time.
+             * Once such a descending access pattern is detected, retain the frames up to the requested one at a time. */
+            if( rap_number == vdhp->last_rap_number && frame_number < last_frame_number )
+            {
+                if( ++ vdhp->backward_seek_count >= 2 )
+                    prepare_gop_buffer( vdhp, rap_number, frame_number );
+            }
+            else
+                vdhp->backward_seek_count = 0;
             /* Require starting to decode from random accessible sample. */
             rap_pos = lwlibav_get_random_accessible_point_position( vdhp, rap_number );
             vdhp->last_rap_number = rap_number;
-            start_number = seek_video( vdhp, picture, frame_number, rap_number, rap_pos, seek_mode != SEEK_MODE_NORMAL );
+            start_number = seek_video( vdhp, cache, picture, frame_number, rap_number, rap_pos, seek_mode != SEEK_MODE_NORMAL );
         }
     }
     /* Get requested picture. */
     int error_count = 0;
     while( start_number == 0
-        || get_picture( vdhp, picture, start_number, frame_number + vdhp->exh.delay_count, rap_number ) < 0 )
+        || get_picture( vdhp, cache, picture, start_number, frame_number + vdhp->exh.delay_count, rap_number ) < 0 )
     {
         /* Failed to get desired picture. */
         if( vdhp->error || seek_mode == SEEK_MODE_AGGRESSIVE )
@@ -647,7 +863,7 @@ static int get_requested_picture
             rap_pos = lwlibav_get_random_accessible_point_position( vdhp, rap_number );
             vdhp->last_rap_number = rap_number;
         }
-        start_number = seek_video( vdhp, picture, frame_number, rap_number, rap_pos, seek_mode != SEEK_MODE_NORMAL );
+        start_number = seek_video( vdhp, cache, picture, frame_number, rap_number, rap_pos, seek_mode != SEEK_MODE_NORMAL );
     }
     vdhp->last_frame_number = frame_number;
     vdhp->last_frame_buffer = picture;
@@ -658,6 +874,7 @@ static int get_requested_picture
         vdhp->last_frame_number -= 1;
         vdhp->last_half_frame    = 1;
     }
+    lw_cache_video_frame( cache, frame_number, picture );
     extradata_index = vdhp->frame_list[frame_number].extradata_index;
 return_frame:;
     /* Don't exceed the maximum presentation size specified for each sequence. */
@@ -763,7 +980,7 @@ int lwlibav_get_video_frame
 )
 {
     if( !vohp->repeat_control )
-        return get_requested_picture( vdhp, vdhp->frame_buffer, frame_number );
+        return get_requested_picture( vdhp, &vohp->frame_cache, vdhp->frame_buffer, frame_number );
     /* Get picture to applied the repeat control. */
     uint32_t t = vohp->frame_order_list[frame_number].top;
     uint32_t b = vohp->frame_order_list[frame_number].bottom;
@@ -791,7 +1008,7 @@ int lwlibav_get_video_frame
          && first_field_number != vohp->frame_order_list[frame_number + 1].top
          && first_field_number != vohp->frame_order_list[frame_number + 1].bottom )
         {
-            if( get_requested_picture( vdhp, vdhp->frame_buffer, first_field_number ) < 0 )
+            if( get_requested_picture( vdhp, &vohp->frame_cache, vdhp->frame_buffer, first_field_number ) < 0 )
                 return -1;
             /* Treat this frame as interlaced. */
             vdhp->frame_buffer->interlaced_frame = 1;
@@ -823,10 +1040,10 @@ int lwlibav_get_video_frame
     if( repeat_control == REPEAT_CONTROL_DECODE_BOTH_FIELDS )
     {
         /* Decode 2 frames, and copy each a top and bottom fields. */
-        if( get_requested_picture( vdhp, vohp->frame_cache_buffers[0], first_field_number ) < 0 )
+        if( get_requested_picture( vdhp, &vohp->frame_cache, vohp->frame_cache_buffers[0], first_field_number ) < 0 )
             return -1;
         vohp->frame_cache_numbers[0] = first_field_number;
-        if( get_requested_picture( vdhp, vohp->frame_cache_buffers[1], second_field_number ) < 0 )
+        if( get_requested_picture( vdhp, &vohp->frame_cache, vohp->frame_cache_buffers[1], second_field_number ) < 0 )
             return -1;
         vohp->frame_cache_numbers[1] = second_field_number;
         if( check_frame_buffer_identical( vohp->frame_cache_buffers[0], vohp->frame_cache_buffers[1] ) )
@@ -842,7 +1059,7 @@ int lwlibav_get_video_frame
         int decode_number = repeat_control == REPEAT_CONTROL_DECODE_ONE_FRAME ? first_field_number
                           : repeat_control == REPEAT_CONTROL_DECODE_TOP_FIELD ? t : b;
         int idx = vohp->frame_cache_numbers[0] > vohp->frame_cache_numbers[1] ? 1 : 0;
-        if( get_requested_picture( vdhp, vohp->frame_cache_buffers[idx], decode_number ) < 0 )
+        if( get_requested_picture( vdhp, &vohp->frame_cache, vohp->frame_cache_buffers[idx], decode_number ) < 0 )
             return -1;
         vohp->frame_cache_numbers[idx] = decode_number;
         if( repeat_control == REPEAT_CONTROL_DECODE_ONE_FRAME )
@@ -853,6 +1070,83 @@ int lwlibav_get_video_frame
     }
 }
 
+/* Return the forward seek threshold to be used for the next request of a batch.
+ * If the decoder has already passed the random accessible point of the requested frame,
+ * continuing to decode is never slower than seeking back to it, so the whole GOP is decoded only once. */
+static uint32_t get_batch_forward_seek_threshold
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    uint32_t                        frame_number
+)
+{
+    uint32_t first_number = frame_number;
+    uint32_t last_number  = frame_number;
+    if( vohp->repeat_control )
+    {
+        lw_video_frame_order_t *order = &vohp->frame_order_list[frame_number];
+        first_number = MIN( order->top, order->bottom );
+        last_number  = MAX( order->top, order->bottom );
+    }
+    first_number = MIN( first_number, vdhp->frame_count );
+    last_number  = MIN( last_number,  vdhp->frame_count );
+    uint32_t last_frame_number = vdhp->last_frame_number + vdhp->last_half_offset;
+    if( last_frame_number < vdhp->first_valid_frame_number
+     || last_frame_number > vdhp->frame_count
+     || first_number <= last_frame_number )
+        return vdhp->forward_seek_threshold;
+    uint32_t rap_number;
+    lwlibav_find_random_accessible_point( vdhp, first_number, 0, &rap_number );
+    if( rap_number > vdhp->frame_list[last_frame_number].sample_number )
+        return vdhp->forward_seek_threshold;
+    return MAX( vdhp->forward_seek_threshold, last_number - last_frame_number );
+}
+
+int lwlibav_get_video_frames
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    const uint32_t                 *frame_numbers,
+    uint32_t                        count,
+    lw_video_frame_handler_t        handler,
+    void                           *priv
+)
+{
+    if( count == 0 )
+        return 0;
+    uint32_t  plan_count;
+    uint32_t *plan = lw_plan_video_frame_batch( frame_numbers, count, &plan_count );
+    if( !plan )
+    {
+        if( vdhp->lh.show_log )
+            vdhp->lh.show_log( &vdhp->lh, LW_LOG_ERROR, "Failed to allocate the batch of requested video frames." );
+        return -1;
+    }
+    uint32_t forward_seek_threshold = vdhp->forward_seek_threshold;
+    int      ret = 0;
+    for( uint32_t i = 0; i < plan_count && ret == 0; i++ )
+    {
+        vdhp->forward_seek_threshold = get_batch_forward_seek_threshold( vdhp, vohp, plan[i] );
+        ret = lwlibav_get_video_frame( vdhp, vohp, plan[i] );
+        vdhp->forward_seek_threshold = forward_seek_threshold;
+        if( ret == 0 && handler( priv, plan[i], vdhp->frame_buffer ) < 0 )
+            ret = -1;
+    }
+    lw_freep( &plan );
+    return ret;
+}
+
+/* A frame is a random accessible point if the closest past one in decoding order is itself. */
+static inline int is_random_accessible_point
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        presentation_sample_number
+)
+{
+    uint32_t decoding_sample_number = vdhp->frame_list[presentation_sample_number].sample_number;
+    return vdhp->rap_list[decoding_sample_number] == decoding_sample_number;
+}
+
 int lwlibav_is_keyframe
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -865,10 +1159,166 @@ int lwlibav_is_keyframe
     {
         lw_video_frame_order_t *curr = &vohp->frame_order_list[frame_number    ];
         lw_video_frame_order_t *prev = &vohp->frame_order_list[frame_number - 1];
-        return ((vdhp->frame_list[ curr->top    ].flags & LW_VFRAME_FLAG_KEY) && curr->top    != prev->top && curr->top    != prev->bottom)
-            || ((vdhp->frame_list[ curr->bottom ].flags & LW_VFRAME_FLAG_KEY) && curr->bottom != prev->top && curr->bottom != prev->bottom);
+        return (is_random_accessible_point( vdhp, curr->top    ) && curr->top    != prev->top && curr->top    != prev->bottom)
+            || (is_random_accessible_point( vdhp, curr->bottom ) && curr->bottom != prev->top && curr->bottom != prev->bottom);
+    }
+    return is_random_accessible_point( vdhp, frame_number );
+}
+
+static inline uint32_t get_presentation_number
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        decoding_sample_number
+)
+{
+    return vdhp->order_converter
+         ? vdhp->order_converter[decoding_sample_number].decoding_to_presentation
+         : decoding_sample_number;
+}
+
+uint32_t lwlibav_find_nearest_keyframe
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        frame_number
+)
+{
+    if( frame_number > vdhp->frame_count )
+        frame_number = vdhp->frame_count;
+    if( frame_number == 0 )
+        frame_number = 1;
+    uint32_t decoding_sample_number = vdhp->frame_list[frame_number].sample_number;
+    uint32_t prev_number = vdhp->rap_list[decoding_sample_number];
+    uint32_t next_number;
+    for( next_number = decoding_sample_number + 1; next_number <= vdhp->frame_count; next_number++ )
+        if( vdhp->keyframe_list[next_number] )
+            break;
+    if( prev_number == 0 )
+    {
+        if( next_number > vdhp->frame_count )
+            return vdhp->first_valid_frame_number;
+        return get_presentation_number( vdhp, next_number );
     }
-    return !!(vdhp->frame_list[frame_number].flags & LW_VFRAME_FLAG_KEY);
+    prev_number = get_presentation_number( vdhp, prev_number );
+    if( next_number > vdhp->frame_count )
+        return prev_number;
+    next_number = get_presentation_number( vdhp, next_number );
+    uint32_t prev_distance = prev_number > frame_number ? prev_number - frame_number : frame_number - prev_number;
+    uint32_t next_distance = next_number > frame_number ? next_number - frame_number : frame_number - next_number;
+    return next_distance < prev_distance ? next_number : prev_number;
+}
+
+/* Return the number in decoding order of the keyframe decoded into picture, or 0 if no picture is output. */
+static uint32_t decode_keyframe
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    AVFrame                        *picture,
+    uint32_t                        rap_number
+)
+{
+    int64_t rap_pos = lwlibav_get_random_accessible_point_position( vdhp, rap_number );
+    lwlibav_extradata_handler_t *exhp = &vdhp->exh;
+    int extradata_index = vdhp->frame_list[rap_number].extradata_index;
+    if( extradata_index != exhp->current_index )
+        lwlibav_update_configuration( (lwlibav_decode_handler_t *)vdhp, rap_number, extradata_index, rap_pos );
+    else
+        lwlibav_flush_buffers( (lwlibav_decode_handler_t *)vdhp );
+    if( vdhp->error )
+        return 0;
+    /* Skip everything except keyframes and their deblocking since the output is just a preview. */
+    AVCodecContext *ctx              = vdhp->ctx;
+    enum AVDiscard  skip_frame       = ctx->skip_frame;
+    enum AVDiscard  skip_loop_filter = ctx->skip_loop_filter;
+    ctx->skip_frame       = AVDISCARD_NONKEY;
+    ctx->skip_loop_filter = AVDISCARD_ALL;
+    lwlibav_seek_frame( (lwlibav_decode_handler_t *)vdhp, vdhp->stream_index, rap_pos, vdhp->av_seek_flags );
+    AVPacket *pkt         = &vdhp->packet;
+    uint32_t  key_number  = 0;
+    int       got_picture = 0;
+    for( uint32_t i = rap_number; i <= vdhp->frame_count; i++ )
+    {
+        if( lwlibav_get_av_frame( (lwlibav_decode_handler_t *)vdhp, i, pkt ) > 0 )
+            break;
+        if( !(pkt->flags & AV_PKT_FLAG_KEY) )
+            continue;
+        /* libavformat might have sought a wrong position, so identify the keyframe by its DTS. */
+        key_number = (vdhp->lw_seek_flags & SEEK_DTS_BASED)
+                   ? correct_current_frame_number( vdhp, pkt, rap_number, vdhp->frame_count )
+                   : rap_number;
+        if( key_number == 0 )
+            key_number = rap_number;
+        int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        av_frame_unref( picture );
+        if( avcodec_decode_video2( ctx, picture, &got_picture, pkt ) < 0 )
+            got_picture = 0;
+        picture->pts = pts;
+        break;
+    }
+    /* Drain the decoder instead of feeding the subsequent samples since they are discarded anyway. */
+    for( uint32_t i = 0; key_number && !got_picture && i <= get_decoder_delay( ctx ); i++ )
+    {
+        AVPacket null_pkt;
+        av_init_packet( &null_pkt );
+        null_pkt.data = NULL;
+        null_pkt.size = 0;
+        av_frame_unref( picture );
+        if( avcodec_decode_video2( ctx, picture, &got_picture, &null_pkt ) < 0 )
+            break;
+    }
+    ctx->skip_frame       = skip_frame;
+    ctx->skip_loop_filter = skip_loop_filter;
+    /* The drained decoder is not usable for the normal decoding. */
+    lwlibav_flush_buffers( (lwlibav_decode_handler_t *)vdhp );
+    return got_picture ? key_number : 0;
+}
+
+int lwlibav_get_video_keyframe
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        frame_number,
+    uint32_t                       *output_number
+)
+{
+    if( frame_number > vdhp->frame_count )
+        frame_number = vdhp->frame_count;
+    AVFrame *picture = vdhp->frame_buffer;
+    uint32_t extradata_index;
+    if( frame_number < vdhp->first_valid_frame_number || vdhp->frame_count == 1 )
+    {
+        /* Copy the first valid video frame data. */
+        av_frame_unref( picture );
+        if( av_frame_ref( picture, vdhp->first_valid_frame ) < 0 )
+            goto video_fail;
+        *output_number  = vdhp->first_valid_frame_number;
+        extradata_index = vdhp->frame_list[ vdhp->first_valid_frame_number ].extradata_index;
+    }
+    else
+    {
+        /* Decode only the random accessible sample without going back further for leading samples. */
+        uint32_t rap_number = vdhp->rap_list[ vdhp->frame_list[frame_number].sample_number ];
+        uint32_t key_number = decode_keyframe( vdhp, picture, rap_number ? rap_number : 1 );
+        /* The output frame is a preview quality one, so force seeking at the next access. */
+        vdhp->last_rap_number  = 0;
+        vdhp->last_half_frame  = 0;
+        vdhp->last_half_offset = 0;
+        if( key_number == 0 )
+            goto video_fail;
+        *output_number  = get_presentation_number( vdhp, key_number );
+        extradata_index = vdhp->frame_list[*output_number].extradata_index;
+    }
+    vdhp->last_frame_number = vdhp->frame_count + 1;
+    vdhp->last_frame_buffer = picture;
+    /* Don't exceed the maximum presentation size specified for each sequence. */
+    if( vdhp->ctx->width > vdhp->exh.entries[extradata_index].width )
+        vdhp->ctx->width = vdhp->exh.entries[extradata_index].width;
+    if( vdhp->ctx->height > vdhp->exh.entries[extradata_index].height )
+        vdhp->ctx->height = vdhp->exh.entries[extradata_index].height;
+    return 0;
+video_fail:
+    vdhp->last_frame_number = vdhp->frame_count + 1;
+    vdhp->last_frame_buffer = picture;
+    if( vdhp->lh.show_log )
+        vdhp->lh.show_log( &vdhp->lh, LW_LOG_ERROR, "Couldn't get the requested keyframe." );
+    return -1;
 }
 
 void lwlibav_cleanup_video_decode_handler
@@ -891,6 +1341,8 @@ void lwlibav_cleanup_video_decode_handler
         lw_freep( &vdhp->order_converter );
     if( vdhp->keyframe_list )
         lw_freep( &vdhp->keyframe_list );
+    if( vdhp->rap_list )
+        lw_freep( &vdhp->rap_list );
     if( vdhp->index_entries )
         av_freep( &vdhp->index_entries );
     if( vdhp->frame_buffer )
@@ -899,11 +1351,12 @@ void lwlibav_cleanup_video_decode_handler
         av_frame_free( &vdhp->first_valid_frame );
     if( vdhp->movable_frame_buffer )
         av_frame_free( &vdhp->movable_frame_buffer );
+    if( vdhp->reserved_frame_buffer )
+        av_frame_free( &vdhp->reserved_frame_buffer );
+    release_gop_buffer( vdhp );
     if( vdhp->ctx )
-    {
-        avcodec_close( vdhp->ctx );
-        vdhp->ctx = NULL;
-    }
+        close_stream_decoder( &vdhp->ctx );
+    lwlibav_stop_readahead( (lwlibav_decode_handler_t *)vdhp );
     if( vdhp->format )
         lavf_close_file( &vdhp->format );
 }
@@ -925,15 +1378,14 @@ int lwlibav_find_first_valid_video_frame
         uint32_t rap_number;
         lwlibav_find_random_accessible_point( vdhp, 1, 0, &rap_number );
         int64_t rap_pos = lwlibav_get_random_accessible_point_position( vdhp, rap_number );
-        if( av_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags ) < 0 )
-            av_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags | AVSEEK_FLAG_ANY );
+        lwlibav_seek_frame( (lwlibav_decode_handler_t *)vdhp, vdhp->stream_index, rap_pos, vdhp->av_seek_flags );
     }
     uint32_t decoder_delay = get_decoder_delay( vdhp->ctx );
     uint32_t thread_delay  = decoder_delay - vdhp->ctx->has_b_frames;
     AVPacket *pkt = &vdhp->packet;
     for( uint32_t i = 1; i <= vdhp->frame_count + vdhp->exh.delay_count; i++ )
     {
-        lwlibav_get_av_frame( vdhp->format, vdhp->stream_index, i, pkt );
+        lwlibav_get_av_frame( (lwlibav_decode_handler_t *)vdhp, i, pkt );
         av_frame_unref( vdhp->frame_buffer );
         int got_picture;
         int ret = avcodec_decode_video2( vdhp->ctx, vdhp->frame_buffer, &got_picture, pkt );
@@ -979,7 +1431,7 @@ void set_video_basic_settings
 )
 {
     lwlibav_video_decode_handler_t *vdhp = (lwlibav_video_decode_handler_t *)dhp;
-    AVCodecContext *ctx = vdhp->format->streams[ vdhp->stream_index ]->codec;
+    AVCodecContext *ctx = vdhp->ctx;
     lwlibav_extradata_t *entry = &vdhp->exh.entries[ vdhp->frame_list[frame_number].extradata_index ];
     ctx->width                 = entry->width;
     ctx->height                = entry->height;
@@ -1002,12 +1454,10 @@ int try_decode_video_frame
         return -1;
     }
     lwlibav_video_decode_handler_t *vdhp = (lwlibav_video_decode_handler_t *)dhp;
-    AVFormatContext *format_ctx   = vdhp->format;
     int              stream_index = vdhp->stream_index;
-    AVCodecContext  *ctx          = format_ctx->streams[stream_index]->codec;
+    AVCodecContext  *ctx          = vdhp->ctx;
     ctx->refcounted_frames = 1;
-    if( av_seek_frame( format_ctx, stream_index, rap_pos, vdhp->av_seek_flags ) < 0 )
-        av_seek_frame( format_ctx, stream_index, rap_pos, vdhp->av_seek_flags | AVSEEK_FLAG_ANY );
+    lwlibav_seek_frame( dhp, stream_index, rap_pos, vdhp->av_seek_flags );
     do
     {
         if( frame_number > vdhp->frame_count )
@@ -1017,7 +1467,7 @@ int try_decode_video_frame
         int extradata_index = vdhp->frame_list[frame_number].extradata_index;
         if( extradata_index != vdhp->exh.current_index )
             break;
-        int ret = lwlibav_get_av_frame( format_ctx, stream_index, frame_number, &pkt );
+        int ret = lwlibav_get_av_frame( dhp, frame_number, &pkt );
         if( ret > 0 )
             break;
         else if( ret < 0 )
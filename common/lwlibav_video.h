@@ -41,11 +41,12 @@ typedef struct
     int64_t         file_offset;
     uint32_t        sample_number;      /* unique value in decoding order */
     int             extradata_index;
-    int             flags;
-    int             pict_type;          /* may be stored as enum AVPictureType */
     int             poc;
-    int             repeat_pict;
-    lw_field_info_t field_info;
+    int16_t         repeat_pict;
+    /* Packed into a single byte since the frame list is kept for the whole source. */
+    uint8_t         flags      : 3;     /* LW_VFRAME_FLAG_* */
+    uint8_t         field_info : 2;     /* may be stored as lw_field_info_t */
+    uint8_t         pict_type  : 3;     /* may be stored as enum AVPictureType */
 } video_frame_info_t;
 
 typedef struct
@@ -71,6 +72,7 @@ typedef struct
     uint32_t            frame_count;
     AVFrame            *frame_buffer;
     video_frame_info_t *frame_list;         /* stored in presentation order */
+    lwlibav_readahead_t *readahead;
     /* */
     uint32_t            forward_seek_threshold;
     int                 seek_mode;
@@ -83,6 +85,7 @@ typedef struct
     AVPacket            packet;
     order_converter_t  *order_converter;    /* stored in decoding order */
     uint8_t            *keyframe_list;      /* stored in decoding order */
+    uint32_t           *rap_list;           /* stored in decoding order: the closest past random accessible point */
     uint32_t            last_half_frame;
     uint32_t            last_half_offset;
     uint32_t            last_frame_number;
@@ -91,6 +94,13 @@ typedef struct
     AVFrame            *first_valid_frame;
     AVFrame            *last_frame_buffer;
     AVFrame            *movable_frame_buffer;
+    AVFrame            *reserved_frame_buffer;  /* keeps the last output frame while its buffer holds a cached frame */
+    /* backward access */
+    uint32_t            backward_seek_count;    /* number of consecutive backward seeks within the same GOP */
+    uint32_t            gop_buffer_start;       /* frame number of the first entry of gop_buffer */
+    uint32_t            gop_buffer_count;
+    size_t              gop_buffer_size;        /* total size of the retained frame buffers in bytes */
+    AVFrame           **gop_buffer;             /* stored in presentation order */
 } lwlibav_video_decode_handler_t;
 
 int lwlibav_get_desired_video_track
@@ -100,6 +110,21 @@ int lwlibav_get_desired_video_track
     int                             threads
 );
 
+/* Open another decoder instance, which has its own demuxer and decoder, of the same stream as src.
+ * The frame and index tables of src are shared read-only, so src shall outlive dst. */
+int lwlibav_open_video_decoder_instance
+(
+    lwlibav_video_decode_handler_t *dst,
+    lwlibav_video_decode_handler_t *src,
+    const char                     *file_path,
+    int                             threads
+);
+
+void lwlibav_close_video_decoder_instance
+(
+    lwlibav_video_decode_handler_t *vdhp
+);
+
 void lwlibav_setup_timestamp_info
 (
     lwlibav_file_handler_t         *lwhp,
@@ -117,6 +142,14 @@ void lwlibav_find_random_accessible_point
     uint32_t                       *rap_number
 );
 
+/* Convert the random accessible point given in decoding order by lwlibav_find_random_accessible_point()
+ * into presentation order. */
+uint32_t lwlibav_get_presentation_rap_number
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        rap_number
+);
+
 int64_t lwlibav_get_random_accessible_point_position
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -130,6 +163,20 @@ int lwlibav_get_video_frame
     uint32_t                        frame_number
 );
 
+/* Get the frames listed in frame_numbers in a single pass and deliver each to the handler in ascending order.
+ * Duplicated numbers are delivered once. Frames sharing a GOP are decoded by one continuous decoding
+ * instead of seeking for each request, which suits prefetching and every-Nth-frame extraction.
+ * Return 0 if all the frames were delivered, or -1 on failure or abort by the handler. */
+int lwlibav_get_video_frames
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    const uint32_t                 *frame_numbers,
+    uint32_t                        count,
+    lw_video_frame_handler_t        handler,
+    void                           *priv
+);
+
 int lwlibav_is_keyframe
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -137,6 +184,26 @@ int lwlibav_is_keyframe
     uint32_t                        frame_number
 );
 
+/* Return the number of the keyframe closest to frame_number in presentation order.
+ * The preceding keyframe is preferred when both neighbours are equally distant. */
+uint32_t lwlibav_find_nearest_keyframe
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        frame_number
+);
+
+/* Seek to the random accessible point of frame_number and output its picture into vdhp->frame_buffer
+ * decoding only keyframes without the loop filter, e.g. for thumbnails and contact sheets.
+ * The number of the frame actually produced is stored into output_number.
+ * The picture is a preview quality one, so it is never cached and the next normal access always seeks.
+ * Frame numbers are of the decoder, i.e. not applied the repeat control. */
+int lwlibav_get_video_keyframe
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        frame_number,
+    uint32_t                       *output_number
+);
+
 void lwlibav_cleanup_video_decode_handler
 (
     lwlibav_video_decode_handler_t *vdhp
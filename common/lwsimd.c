@@ -22,7 +22,16 @@
 
 #include <stdint.h>
 
-#ifdef __GNUC__
+#include "lwsimd.h"
+
+#if !LW_SIMD_X86
+static void __cpuid(int CPUInfo[4], int prm)
+{
+    /* No x86 SIMD feature is reported. */
+    CPUInfo[0] = CPUInfo[1] = CPUInfo[2] = CPUInfo[3] = 0;
+    return;
+}
+#elif defined(__GNUC__)
 static void __cpuid(int CPUInfo[4], int prm)
 {
     asm volatile ( "cpuid" :"=a"(CPUInfo[0]), "=b"(CPUInfo[1]), "=c"(CPUInfo[2]), "=d"(CPUInfo[3]) :"a"(prm) );
@@ -30,13 +39,13 @@ static void __cpuid(int CPUInfo[4], int prm)
 }
 #else
 #include <intrin.h>
-#endif /* __GNUC__ */
+#endif
 
 static int check_xgetbv( void )
 {
 #if defined(_MSC_VER) && defined(_XCR_XFEATURE_ENABLED_MASK)
     uint64_t eax = _xgetbv( _XCR_XFEATURE_ENABLED_MASK );
-#elif defined(__GNUC__)
+#elif defined(__GNUC__) && LW_SIMD_X86
     uint32_t eax;
     uint32_t edx;
     asm volatile ( ".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0) );
@@ -78,3 +87,25 @@ int lw_check_avx2()
     }
 	return 0;
 }
+
+int lw_get_simd_flags( void )
+{
+    /* Racing initializations are harmless since all of them store the same value. */
+    static volatile int simd_flags = -1;
+    if( simd_flags == -1 )
+    {
+        int flags = 0;
+        if( lw_check_sse2() )
+        {
+            flags |= LW_SIMD_SSE2;
+            if( lw_check_ssse3() )
+                flags |= LW_SIMD_SSSE3;
+            if( lw_check_sse41() )
+                flags |= LW_SIMD_SSE41;
+            if( LW_SIMD_AVX2_ENABLED && lw_check_avx2() )
+                flags |= LW_SIMD_AVX2;
+        }
+        simd_flags = flags;
+    }
+    return simd_flags;
+}
@@ -30,7 +30,30 @@
 #define LW_FORCEINLINE __forceinline
 #endif
 
+/* Whether the target is x86 or not. The SIMD kernels are available only if so. */
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define LW_SIMD_X86 1
+#else
+#define LW_SIMD_X86 0
+#endif
+
+/* Whether the compiler is able to generate AVX2 code or not. */
+#if LW_SIMD_X86 && ((defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))) || (defined(_MSC_VER) && _MSC_VER >= 1700))
+#define LW_SIMD_AVX2_ENABLED 1
+#else
+#define LW_SIMD_AVX2_ENABLED 0
+#endif
+
+#define LW_SIMD_SSE2  0x01
+#define LW_SIMD_SSSE3 0x02
+#define LW_SIMD_SSE41 0x04
+#define LW_SIMD_AVX2  0x08
+
 int lw_check_sse2();
 int lw_check_ssse3();
 int lw_check_sse41();
 int lw_check_avx2();
+
+/* Return the set of LW_SIMD_* available on the running CPU.
+ * The CPU is checked only at the first call, and kernels shall be dispatched by this instead of checking for each call. */
+int lw_get_simd_flags( void );
@@ -0,0 +1,140 @@
+/*****************************************************************************
+ * lwthread.h
+ *****************************************************************************
+ * Copyright (C) 2014 L-SMASH Works project
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *****************************************************************************/
+
+/* This file is available under an ISC license. */
+
+/* Minimal thread, mutex and condition variable wrappers.
+ * Native Win32 primitives are used on Windows (condition variables require Vista or later),
+ * and POSIX threads are used elsewhere. */
+
+#ifndef LW_THREAD_H
+#define LW_THREAD_H
+
+#ifdef _WIN32
+#if !defined( _WIN32_WINNT ) || _WIN32_WINNT < 0x0600
+#undef  _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
+#include <windows.h>
+#include <process.h>
+
+typedef struct
+{
+    HANDLE handle;
+    void *(*func)( void * );
+    void  *arg;
+} lw_thread_t;
+
+typedef CRITICAL_SECTION   lw_mutex_t;
+typedef CONDITION_VARIABLE lw_cond_t;
+
+static unsigned __stdcall lw_thread_entry( void *arg )
+{
+    lw_thread_t *thread = (lw_thread_t *)arg;
+    thread->func( thread->arg );
+    return 0;
+}
+
+static inline int lw_thread_create( lw_thread_t *thread, void *(*func)( void * ), void *arg )
+{
+    thread->func   = func;
+    thread->arg    = arg;
+    thread->handle = (HANDLE)_beginthreadex( NULL, 0, lw_thread_entry, thread, 0, NULL );
+    return thread->handle ? 0 : -1;
+}
+
+static inline void lw_thread_join( lw_thread_t *thread )
+{
+    WaitForSingleObject( thread->handle, INFINITE );
+    CloseHandle( thread->handle );
+}
+
+static inline int  lw_mutex_init   ( lw_mutex_t *mutex ) { InitializeCriticalSection( mutex ); return 0; }
+static inline void lw_mutex_destroy( lw_mutex_t *mutex ) { DeleteCriticalSection( mutex ); }
+static inline void lw_mutex_lock   ( lw_mutex_t *mutex ) { EnterCriticalSection( mutex ); }
+static inline void lw_mutex_unlock ( lw_mutex_t *mutex ) { LeaveCriticalSection( mutex ); }
+
+static inline int  lw_cond_init     ( lw_cond_t *cond ) { InitializeConditionVariable( cond ); return 0; }
+static inline void lw_cond_destroy  ( lw_cond_t *cond ) { (void)cond; }
+static inline void lw_cond_signal   ( lw_cond_t *cond ) { WakeConditionVariable( cond ); }
+static inline void lw_cond_broadcast( lw_cond_t *cond ) { WakeAllConditionVariable( cond ); }
+static inline void lw_cond_wait     ( lw_cond_t *cond, lw_mutex_t *mutex ) { SleepConditionVariableCS( cond, mutex, INFINITE ); }
+
+/* Mutex usable without initialization at runtime, e.g. for guarding process-wide data. */
+typedef SRWLOCK lw_static_mutex_t;
+#define LW_STATIC_MUTEX_INITIALIZER SRWLOCK_INIT
+static inline void lw_static_mutex_lock  ( lw_static_mutex_t *mutex ) { AcquireSRWLockExclusive( mutex ); }
+static inline void lw_static_mutex_unlock( lw_static_mutex_t *mutex ) { ReleaseSRWLockExclusive( mutex ); }
+
+static inline int lw_get_cpu_count( void )
+{
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct
+{
+    pthread_t handle;
+} lw_thread_t;
+
+typedef pthread_mutex_t lw_mutex_t;
+typedef pthread_cond_t  lw_cond_t;
+
+static inline int lw_thread_create( lw_thread_t *thread, void *(*func)( void * ), void *arg )
+{
+    return pthread_create( &thread->handle, NULL, func, arg ) ? -1 : 0;
+}
+
+static inline void lw_thread_join( lw_thread_t *thread )
+{
+    pthread_join( thread->handle, NULL );
+}
+
+static inline int  lw_mutex_init   ( lw_mutex_t *mutex ) { return pthread_mutex_init( mutex, NULL ) ? -1 : 0; }
+static inline void lw_mutex_destroy( lw_mutex_t *mutex ) { pthread_mutex_destroy( mutex ); }
+static inline void lw_mutex_lock   ( lw_mutex_t *mutex ) { pthread_mutex_lock( mutex ); }
+static inline void lw_mutex_unlock ( lw_mutex_t *mutex ) { pthread_mutex_unlock( mutex ); }
+
+static inline int  lw_cond_init     ( lw_cond_t *cond ) { return pthread_cond_init( cond, NULL ) ? -1 : 0; }
+static inline void lw_cond_destroy  ( lw_cond_t *cond ) { pthread_cond_destroy( cond ); }
+static inline void lw_cond_signal   ( lw_cond_t *cond ) { pthread_cond_signal( cond ); }
+static inline void lw_cond_broadcast( lw_cond_t *cond ) { pthread_cond_broadcast( cond ); }
+static inline void lw_cond_wait     ( lw_cond_t *cond, lw_mutex_t *mutex ) { pthread_cond_wait( cond, mutex ); }
+
+/* Mutex usable without initialization at runtime, e.g. for guarding process-wide data. */
+typedef pthread_mutex_t lw_static_mutex_t;
+#define LW_STATIC_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+static inline void lw_static_mutex_lock  ( lw_static_mutex_t *mutex ) { pthread_mutex_lock( mutex ); }
+static inline void lw_static_mutex_unlock( lw_static_mutex_t *mutex ) { pthread_mutex_unlock( mutex ); }
+
+static inline int lw_get_cpu_count( void )
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf( _SC_NPROCESSORS_ONLN );
+    return count > 0 ? (int)count : 1;
+#else
+    return 1;
+#endif
+}
+#endif  /* _WIN32 */
+
+#endif  /* LW_THREAD_H */
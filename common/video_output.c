@@ -22,6 +22,8 @@
 
 #include "cpp_compat.h"
 
+#include <string.h>
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -29,11 +31,13 @@ extern "C"
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #ifdef __cplusplus
 }
 #endif  /* __cplusplus */
 
 #include "utils.h"
+#include "lwthread.h"
 #include "video_output.h"
 
 /* If YUV is treated as full range, return 1.
@@ -76,21 +80,10 @@ int initialize_scaler_handler
     int yuv_range = avoid_yuv_scale_conversion( &ctx->pix_fmt );
     if( ctx->color_range == AVCOL_RANGE_MPEG || ctx->color_range == AVCOL_RANGE_JPEG )
         yuv_range = (ctx->color_range == AVCOL_RANGE_JPEG);
-    vshp->sws_ctx = update_scaler_configuration( NULL, flags,
-                                                 ctx->width, ctx->height,
-                                                 ctx->pix_fmt, output_pixel_format,
-                                                 ctx->colorspace, yuv_range );
-    if( !vshp->sws_ctx )
-        return -1;
     vshp->enabled             = enabled;
     vshp->flags               = flags;
-    vshp->input_width         = ctx->width;
-    vshp->input_height        = ctx->height;
-    vshp->input_pixel_format  = ctx->pix_fmt;
     vshp->output_pixel_format = output_pixel_format;
-    vshp->input_colorspace    = ctx->colorspace;
-    vshp->input_yuv_range     = yuv_range;
-    return 0;
+    return update_scaler_handler( vshp, ctx->width, ctx->height, ctx->pix_fmt, ctx->colorspace, yuv_range );
 }
 
 struct SwsContext *update_scaler_configuration
@@ -130,6 +123,756 @@ struct SwsContext *update_scaler_configuration
     return sws_ctx;
 }
 
+static void free_slice_scalers
+(
+    lw_video_scaler_cache_entry_t *entry
+)
+{
+    if( entry->slice_sws_ctx )
+    {
+        for( int i = 0; i < entry->slice_num; i++ )
+            sws_freeContext( entry->slice_sws_ctx[i] );
+        lw_freep( &entry->slice_sws_ctx );
+    }
+    entry->slice_num = 0;
+}
+
+static void free_scaler_cache_entry
+(
+    lw_video_scaler_cache_entry_t *entry
+)
+{
+    sws_freeContext( entry->sws_ctx );
+    entry->sws_ctx = NULL;
+    free_slice_scalers( entry );
+}
+
+int update_scaler_handler
+(
+    lw_video_scaler_handler_t *vshp,
+    int                        width,
+    int                        height,
+    enum AVPixelFormat         input_pixel_format,
+    enum AVColorSpace          colorspace,
+    int                        yuv_range
+)
+{
+    /* Look for a scaler initialized for the same configuration. */
+    int i;
+    for( i = 0; i < vshp->cache_count; i++ )
+    {
+        lw_video_scaler_cache_entry_t *entry = &vshp->cache[i];
+        if( entry->flags               == vshp->flags
+         && entry->width               == width
+         && entry->height              == height
+         && entry->input_pixel_format  == input_pixel_format
+         && entry->output_pixel_format == vshp->output_pixel_format
+         && entry->colorspace          == colorspace
+         && entry->yuv_range           == yuv_range )
+            break;
+    }
+    lw_video_scaler_cache_entry_t hit;
+    if( i < vshp->cache_count )
+        hit = vshp->cache[i];
+    else
+    {
+        hit.sws_ctx = update_scaler_configuration( NULL, vshp->flags,
+                                                   width, height,
+                                                   input_pixel_format, vshp->output_pixel_format,
+                                                   colorspace, yuv_range );
+        if( !hit.sws_ctx )
+            return -1;
+        hit.flags               = vshp->flags;
+        hit.width               = width;
+        hit.height              = height;
+        hit.input_pixel_format  = input_pixel_format;
+        hit.output_pixel_format = vshp->output_pixel_format;
+        hit.colorspace          = colorspace;
+        hit.yuv_range           = yuv_range;
+        hit.slice_num           = 0;
+        hit.slice_sws_ctx       = NULL;
+        /* Evict the least recently used scaler if the cache is full. */
+        if( vshp->cache_count == SCALER_CACHE_NUM )
+            free_scaler_cache_entry( &vshp->cache[--i] );
+        else
+            ++ vshp->cache_count;
+    }
+    /* Move the scaler to the front. */
+    memmove( &vshp->cache[1], &vshp->cache[0], i * sizeof(lw_video_scaler_cache_entry_t) );
+    vshp->cache[0] = hit;
+    vshp->sws_ctx            = hit.sws_ctx;
+    vshp->input_width        = width;
+    vshp->input_height       = height;
+    vshp->input_pixel_format = input_pixel_format;
+    vshp->input_colorspace   = colorspace;
+    vshp->input_yuv_range    = yuv_range;
+    return 0;
+}
+
+/* The height of the horizontal bands is a multiple of this value except for the last band.
+ * This is a multiple of the vertical chroma subsampling and the height of the dither matrices of swscale,
+ * so that each band is converted just like in the whole picture. */
+#define LW_VIDEO_SLICE_ALIGNMENT 16
+
+typedef struct
+{
+    lw_video_slice_pool_t *pool;
+    int                    thread_id;
+    lw_thread_t            thread;
+} lw_video_slice_worker_t;
+
+struct lw_video_slice_pool_tag
+{
+    int                      thread_num;
+    int                      worker_count;
+    lw_video_slice_worker_t *workers;
+    lw_mutex_t               mutex;
+    lw_cond_t                work_cond;     /* signaled when a new job is posted or the pool is destroyed */
+    lw_cond_t                done_cond;     /* signaled when all workers finished the current job */
+    uint32_t                 job_id;
+    int                      pending;
+    int                      quit;
+    func_video_slice        *func;
+    void                    *param1;
+    void                    *param2;
+};
+
+static void *video_slice_worker_main
+(
+    void *arg
+)
+{
+    lw_video_slice_worker_t *worker = (lw_video_slice_worker_t *)arg;
+    lw_video_slice_pool_t   *pool   = worker->pool;
+    uint32_t                 job_id = 0;
+    lw_mutex_lock( &pool->mutex );
+    while( 1 )
+    {
+        while( !pool->quit && pool->job_id == job_id )
+            lw_cond_wait( &pool->work_cond, &pool->mutex );
+        if( pool->quit )
+            break;
+        job_id = pool->job_id;
+        func_video_slice *func   = pool->func;
+        void             *param1 = pool->param1;
+        void             *param2 = pool->param2;
+        lw_mutex_unlock( &pool->mutex );
+        func( worker->thread_id, pool->thread_num, param1, param2 );
+        lw_mutex_lock( &pool->mutex );
+        if( --pool->pending == 0 )
+            lw_cond_signal( &pool->done_cond );
+    }
+    lw_mutex_unlock( &pool->mutex );
+    return NULL;
+}
+
+static void destroy_video_slice_pool
+(
+    lw_video_slice_pool_t *pool
+)
+{
+    if( !pool )
+        return;
+    lw_mutex_lock( &pool->mutex );
+    pool->quit = 1;
+    lw_cond_broadcast( &pool->work_cond );
+    lw_mutex_unlock( &pool->mutex );
+    for( int i = 0; i < pool->worker_count; i++ )
+        lw_thread_join( &pool->workers[i].thread );
+    lw_cond_destroy( &pool->done_cond );
+    lw_cond_destroy( &pool->work_cond );
+    lw_mutex_destroy( &pool->mutex );
+    free( pool->workers );
+    free( pool );
+}
+
+static lw_video_slice_pool_t *create_video_slice_pool
+(
+    int thread_num
+)
+{
+    lw_video_slice_pool_t *pool = (lw_video_slice_pool_t *)lw_malloc_zero( sizeof(lw_video_slice_pool_t) );
+    if( !pool )
+        return NULL;
+    pool->workers = (lw_video_slice_worker_t *)lw_malloc_zero( (thread_num - 1) * sizeof(lw_video_slice_worker_t) );
+    if( !pool->workers )
+        goto fail_alloc;
+    if( lw_mutex_init( &pool->mutex ) < 0 )
+        goto fail_alloc;
+    if( lw_cond_init( &pool->work_cond ) < 0 )
+        goto fail_work_cond;
+    if( lw_cond_init( &pool->done_cond ) < 0 )
+        goto fail_done_cond;
+    pool->thread_num = thread_num;
+    /* The calling thread processes the first slice, so the workers take the others. */
+    for( int i = 0; i < thread_num - 1; i++ )
+    {
+        lw_video_slice_worker_t *worker = &pool->workers[i];
+        worker->pool      = pool;
+        worker->thread_id = i + 1;
+        if( lw_thread_create( &worker->thread, video_slice_worker_main, worker ) < 0 )
+        {
+            destroy_video_slice_pool( pool );
+            return NULL;
+        }
+        ++ pool->worker_count;
+    }
+    return pool;
+fail_done_cond:
+    lw_cond_destroy( &pool->work_cond );
+fail_work_cond:
+    lw_mutex_destroy( &pool->mutex );
+fail_alloc:
+    free( pool->workers );
+    free( pool );
+    return NULL;
+}
+
+int lw_setup_video_slice_threads
+(
+    lw_video_scaler_handler_t *vshp,
+    int                        threads
+)
+{
+    destroy_video_slice_pool( vshp->slice_pool );
+    vshp->slice_pool = NULL;
+    /* The bands depend on the number of threads. */
+    for( int i = 0; i < vshp->cache_count; i++ )
+        free_slice_scalers( &vshp->cache[i] );
+    if( threads <= 0 )
+        threads = lw_get_cpu_count();
+    if( threads == 1 )
+        return 0;
+    vshp->slice_pool = create_video_slice_pool( threads );
+    return vshp->slice_pool ? 0 : -1;
+}
+
+void lw_run_video_slices
+(
+    lw_video_scaler_handler_t *vshp,
+    func_video_slice          *func,
+    void                      *param1,
+    void                      *param2
+)
+{
+    lw_video_slice_pool_t *pool = vshp->slice_pool;
+    if( !pool )
+    {
+        func( 0, 1, param1, param2 );
+        return;
+    }
+    lw_mutex_lock( &pool->mutex );
+    pool->func    = func;
+    pool->param1  = param1;
+    pool->param2  = param2;
+    pool->pending = pool->worker_count;
+    ++ pool->job_id;
+    lw_cond_broadcast( &pool->work_cond );
+    lw_mutex_unlock( &pool->mutex );
+    func( 0, pool->thread_num, param1, param2 );
+    lw_mutex_lock( &pool->mutex );
+    while( pool->pending )
+        lw_cond_wait( &pool->done_cond, &pool->mutex );
+    lw_mutex_unlock( &pool->mutex );
+}
+
+void lw_get_video_slice_range
+(
+    int  height,
+    int  thread_id,
+    int  thread_num,
+    int *start,
+    int *end
+)
+{
+    *start = thread_id == 0              ? 0      : (int)((int64_t)height *  thread_id      / thread_num) & ~(LW_VIDEO_SLICE_ALIGNMENT - 1);
+    *end   = thread_id == thread_num - 1 ? height : (int)((int64_t)height * (thread_id + 1) / thread_num) & ~(LW_VIDEO_SLICE_ALIGNMENT - 1);
+}
+
+/* Return 1 if converting each horizontal band separately gives the same result as converting the whole picture.
+ * Otherwise, return 0. */
+static int is_sliceable_conversion
+(
+    lw_video_scaler_cache_entry_t *entry,
+    int                            thread_num
+)
+{
+    const AVPixFmtDescriptor *input_desc  = av_pix_fmt_desc_get( entry->input_pixel_format );
+    const AVPixFmtDescriptor *output_desc = av_pix_fmt_desc_get( entry->output_pixel_format );
+    if( !input_desc || !output_desc || (input_desc->flags & AV_PIX_FMT_FLAG_HWACCEL) )
+        return 0;
+    /* Vertical chroma resampling would refer to the lines across the band boundaries. */
+    if( input_desc->log2_chroma_h != output_desc->log2_chroma_h )
+        return 0;
+    return entry->height >= thread_num * LW_VIDEO_SLICE_ALIGNMENT;
+}
+
+static int setup_slice_scalers
+(
+    lw_video_scaler_cache_entry_t *entry,
+    int                            thread_num
+)
+{
+    if( !is_sliceable_conversion( entry, thread_num ) )
+    {
+        entry->slice_num = -1;
+        return -1;
+    }
+    entry->slice_sws_ctx = (struct SwsContext **)lw_malloc_zero( thread_num * sizeof(struct SwsContext *) );
+    if( !entry->slice_sws_ctx )
+    {
+        entry->slice_num = -1;
+        return -1;
+    }
+    entry->slice_num = thread_num;
+    for( int i = 0; i < thread_num; i++ )
+    {
+        int start;
+        int end;
+        lw_get_video_slice_range( entry->height, i, thread_num, &start, &end );
+        entry->slice_sws_ctx[i] = update_scaler_configuration( NULL, entry->flags,
+                                                               entry->width, end - start,
+                                                               entry->input_pixel_format, entry->output_pixel_format,
+                                                               entry->colorspace, entry->yuv_range );
+        if( !entry->slice_sws_ctx[i] )
+        {
+            /* Give up converting in parallel for this configuration. */
+            free_slice_scalers( entry );
+            entry->slice_num = -1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Get the plane pointers to the given line of a picture. */
+static void get_slice_planes
+(
+    uint8_t                **slice_data,
+    const uint8_t * const   *data,
+    const int               *linesize,
+    enum AVPixelFormat       pixel_format,
+    int                      y
+)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get( pixel_format );
+    int planes = av_pix_fmt_count_planes( pixel_format );
+    for( int i = 0; i < 4; i++ )
+        if( i < planes && data[i] )
+        {
+            int plane_y = (i == 1 || i == 2) ? y >> desc->log2_chroma_h : y;
+            slice_data[i] = (uint8_t *)data[i] + (intptr_t)plane_y * linesize[i];
+        }
+        else
+            /* e.g. the palette of PAL8 */
+            slice_data[i] = (uint8_t *)data[i];
+}
+
+typedef struct
+{
+    lw_video_scaler_cache_entry_t *entry;
+    const uint8_t * const         *src_data;
+    const int                     *src_linesize;
+    uint8_t * const               *dst_data;
+    const int                     *dst_linesize;
+} lw_video_slice_scale_t;
+
+static void scale_video_slice
+(
+    int   thread_id,
+    int   thread_num,
+    void *param1,
+    void *param2
+)
+{
+    lw_video_slice_scale_t        *slice = (lw_video_slice_scale_t *)param1;
+    lw_video_scaler_cache_entry_t *entry = slice->entry;
+    int start;
+    int end;
+    lw_get_video_slice_range( entry->height, thread_id, thread_num, &start, &end );
+    uint8_t *src_data[4];
+    uint8_t *dst_data[4];
+    get_slice_planes( src_data, slice->src_data, slice->src_linesize, entry->input_pixel_format, start );
+    get_slice_planes( dst_data, (const uint8_t * const *)slice->dst_data, slice->dst_linesize, entry->output_pixel_format, start );
+    sws_scale( entry->slice_sws_ctx[thread_id],
+               (const uint8_t * const *)src_data, slice->src_linesize, 0, end - start,
+               dst_data, slice->dst_linesize );
+}
+
+int lw_scale_video_frame
+(
+    lw_video_scaler_handler_t *vshp,
+    const uint8_t * const     *src_data,
+    const int                 *src_linesize,
+    uint8_t * const           *dst_data,
+    const int                 *dst_linesize
+)
+{
+    if( vshp->cache_count == 0 )
+        return -1;
+    lw_video_scaler_cache_entry_t *entry = &vshp->cache[0];
+    if( vshp->slice_pool
+     && (entry->slice_num > 0 || (entry->slice_num == 0 && setup_slice_scalers( entry, vshp->slice_pool->thread_num ) == 0)) )
+    {
+        lw_video_slice_scale_t slice;
+        slice.entry        = entry;
+        slice.src_data     = src_data;
+        slice.src_linesize = src_linesize;
+        slice.dst_data     = dst_data;
+        slice.dst_linesize = dst_linesize;
+        lw_run_video_slices( vshp, scale_video_slice, &slice, NULL );
+        return entry->height;
+    }
+    return sws_scale( entry->sws_ctx, src_data, src_linesize, 0, entry->height, dst_data, dst_linesize );
+}
+
+#if (LIBAVUTIL_VERSION_MICRO >= 100) && (LIBSWSCALE_VERSION_MICRO >= 100)
+#define FFMPEG_HIGH_DEPTH_SUPPORT 1
+#else
+#define FFMPEG_HIGH_DEPTH_SUPPORT 0
+#endif
+
+lw_dr_layout_t lw_get_dr_layout
+(
+    AVCodecContext     *ctx,
+    enum AVPixelFormat  pixel_format,
+    int                 host_caps,
+    enum AVPixelFormat *host_pixel_format
+)
+{
+    static const struct
+    {
+        enum AVPixelFormat pixel_format;
+        int                host_cap;
+        lw_dr_layout_t     layout;
+        enum AVPixelFormat host_pixel_format;
+    } dr_support_table[] =
+        {
+            { AV_PIX_FMT_YUV420P,     LW_DR_CAP_PLANAR_YUV,       LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV420P     },
+            { AV_PIX_FMT_YUV422P,     LW_DR_CAP_PLANAR_YUV,       LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV422P     },
+            { AV_PIX_FMT_YUV444P,     LW_DR_CAP_PLANAR_YUV,       LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV444P     },
+            { AV_PIX_FMT_YUV410P,     LW_DR_CAP_PLANAR_YUV,       LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV410P     },
+            { AV_PIX_FMT_YUV411P,     LW_DR_CAP_PLANAR_YUV,       LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV411P     },
+            { AV_PIX_FMT_YUV440P,     LW_DR_CAP_PLANAR_YUV440,    LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV440P     },
+            { AV_PIX_FMT_YUV420P9LE,  LW_DR_CAP_PLANAR_YUV_DEEP,  LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV420P9LE  },
+            { AV_PIX_FMT_YUV422P9LE,  LW_DR_CAP_PLANAR_YUV_DEEP,  LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV422P9LE  },
+            { AV_PIX_FMT_YUV444P9LE,  LW_DR_CAP_PLANAR_YUV_DEEP,  LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV444P9LE  },
+            { AV_PIX_FMT_YUV420P10LE, LW_DR_CAP_PLANAR_YUV_DEEP,  LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV420P10LE },
+            { AV_PIX_FMT_YUV422P10LE, LW_DR_CAP_PLANAR_YUV_DEEP,  LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV422P10LE },
+            { AV_PIX_FMT_YUV444P10LE, LW_DR_CAP_PLANAR_YUV_DEEP,  LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV444P10LE },
+            { AV_PIX_FMT_YUV420P16LE, LW_DR_CAP_PLANAR_YUV_DEEP,  LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV420P16LE },
+            { AV_PIX_FMT_YUV422P16LE, LW_DR_CAP_PLANAR_YUV_DEEP,  LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV422P16LE },
+            { AV_PIX_FMT_YUV444P16LE, LW_DR_CAP_PLANAR_YUV_DEEP,  LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV444P16LE },
+#if FFMPEG_HIGH_DEPTH_SUPPORT
+            { AV_PIX_FMT_YUV420P12LE, LW_DR_CAP_PLANAR_YUV_12_14, LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV420P12LE },
+            { AV_PIX_FMT_YUV422P12LE, LW_DR_CAP_PLANAR_YUV_12_14, LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV422P12LE },
+            { AV_PIX_FMT_YUV444P12LE, LW_DR_CAP_PLANAR_YUV_12_14, LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV444P12LE },
+            { AV_PIX_FMT_YUV420P14LE, LW_DR_CAP_PLANAR_YUV_12_14, LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV420P14LE },
+            { AV_PIX_FMT_YUV422P14LE, LW_DR_CAP_PLANAR_YUV_12_14, LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV422P14LE },
+            { AV_PIX_FMT_YUV444P14LE, LW_DR_CAP_PLANAR_YUV_12_14, LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUV444P14LE },
+#endif
+            { AV_PIX_FMT_GBRP,        LW_DR_CAP_PLANAR_RGB,       LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_GBRP        },
+            { AV_PIX_FMT_GBRP9LE,     LW_DR_CAP_PLANAR_RGB,       LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_GBRP9LE     },
+            { AV_PIX_FMT_GBRP10LE,    LW_DR_CAP_PLANAR_RGB,       LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_GBRP10LE    },
+            { AV_PIX_FMT_GBRP16LE,    LW_DR_CAP_PLANAR_RGB,       LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_GBRP16LE    },
+            { AV_PIX_FMT_GRAY8,       LW_DR_CAP_GRAY8,            LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_GRAY8       },
+            { AV_PIX_FMT_YUYV422,     LW_DR_CAP_PACKED_YUV422,    LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_YUYV422     },
+            { AV_PIX_FMT_BGR24,       LW_DR_CAP_PACKED_RGB,       LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_BGR24       },
+            { AV_PIX_FMT_BGRA,        LW_DR_CAP_PACKED_RGB,       LW_DR_LAYOUT_DIRECT,      AV_PIX_FMT_BGRA        },
+            { AV_PIX_FMT_NV12,        LW_DR_CAP_SEMI_PLANAR,      LW_DR_LAYOUT_SEMI_PLANAR, AV_PIX_FMT_YUV420P     },
+            { AV_PIX_FMT_NV21,        LW_DR_CAP_SEMI_PLANAR,      LW_DR_LAYOUT_SEMI_PLANAR, AV_PIX_FMT_YUV420P     },
+            { AV_PIX_FMT_NONE,        0,                          LW_DR_LAYOUT_NONE,        AV_PIX_FMT_NONE        }
+        };
+    if( host_pixel_format )
+        *host_pixel_format = AV_PIX_FMT_NONE;
+    if( !ctx->codec || !(ctx->codec->capabilities & CODEC_CAP_DR1) )
+        return LW_DR_LAYOUT_NONE;
+    for( int i = 0; dr_support_table[i].pixel_format != AV_PIX_FMT_NONE; i++ )
+        if( dr_support_table[i].pixel_format == pixel_format )
+        {
+            if( !(dr_support_table[i].host_cap & host_caps) )
+                break;
+            if( host_pixel_format )
+                *host_pixel_format = dr_support_table[i].host_pixel_format;
+            return dr_support_table[i].layout;
+        }
+    return LW_DR_LAYOUT_NONE;
+}
+
+int lw_alloc_dr_chroma_plane
+(
+    lw_video_output_handler_t *vohp,
+    AVFrame                   *av_frame,
+    int                        width,
+    int                        height
+)
+{
+    /* The decoder may write a little beyond the last line, so keep some padding like avcodec_default_get_buffer2(). */
+    int linesize = FFALIGN( ((width + 1) >> 1) * 2, 64 );
+    int size     = linesize * ((height + 1) >> 1) + 64;
+    if( !vohp->dr_chroma_pool || vohp->dr_chroma_pool_size != size )
+    {
+        /* Buffers still referenced by frames remain valid after the pool is uninitialized. */
+        av_buffer_pool_uninit( &vohp->dr_chroma_pool );
+        vohp->dr_chroma_pool      = av_buffer_pool_init( size, av_buffer_alloc );
+        vohp->dr_chroma_pool_size = vohp->dr_chroma_pool ? size : 0;
+        if( !vohp->dr_chroma_pool )
+            return -1;
+    }
+    av_frame->buf[1] = av_buffer_pool_get( vohp->dr_chroma_pool );
+    if( !av_frame->buf[1] )
+        return -1;
+    av_frame->data    [1] = av_frame->buf[1]->data;
+    av_frame->linesize[1] = linesize;
+    return 0;
+}
+
+static void split_dr_chroma_slice
+(
+    int   thread_id,
+    int   thread_num,
+    void *param1,
+    void *param2
+)
+{
+    AVFrame              *av_frame = (AVFrame *)param1;
+    lw_dr_chroma_split_t *split    = (lw_dr_chroma_split_t *)param2;
+    /* NV12 interleaves Cb first, and NV21 interleaves Cr first. */
+    int first  = (av_frame->format == AV_PIX_FMT_NV21);
+    int second = !first;
+    int start;
+    int end;
+    lw_get_video_slice_range( split->height, thread_id, thread_num, &start, &end );
+    for( int y = start; y < end; y++ )
+    {
+        const uint8_t *src  = av_frame->data[1]     + y * av_frame->linesize[1];
+        uint8_t       *dst0 = split->data[first]  + y * split->linesize[first];
+        uint8_t       *dst1 = split->data[second] + y * split->linesize[second];
+        for( int x = 0; x < split->width; x++ )
+        {
+            dst0[x] = src[2 * x];
+            dst1[x] = src[2 * x + 1];
+        }
+    }
+}
+
+void lw_split_dr_chroma
+(
+    lw_video_scaler_handler_t *vshp,
+    AVFrame                   *av_frame,
+    lw_dr_chroma_split_t      *split
+)
+{
+    if( !split->pending )
+        return;
+    lw_run_video_slices( vshp, split_dr_chroma_slice, av_frame, split );
+    split->pending = 0;
+}
+
+#define LW_VIDEO_FRAME_CACHE_HASH_SIZE 256   /* must be a power of 2 */
+
+struct lw_video_frame_cache_entry_tag
+{
+    uint32_t                      frame_number;
+    size_t                        size;
+    AVFrame                      *frame;
+    lw_video_frame_cache_entry_t *prev;         /* more recently used */
+    lw_video_frame_cache_entry_t *next;         /* less recently used */
+    lw_video_frame_cache_entry_t *hash_next;
+};
+
+static inline lw_video_frame_cache_entry_t **get_frame_cache_bucket
+(
+    lw_video_frame_cache_t *cache,
+    uint32_t                frame_number
+)
+{
+    return &cache->hash[frame_number & (LW_VIDEO_FRAME_CACHE_HASH_SIZE - 1)];
+}
+
+/* Return the total size of the reference-counted buffers of a frame in bytes. */
+size_t lw_get_video_frame_buffer_size
+(
+    AVFrame *frame
+)
+{
+    size_t size = 0;
+    for( int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++ )
+        size += frame->buf[i]->size;
+    for( int i = 0; i < frame->nb_extended_buf; i++ )
+        size += frame->extended_buf[i]->size;
+    return size;
+}
+
+static void unlink_frame_cache_entry
+(
+    lw_video_frame_cache_t       *cache,
+    lw_video_frame_cache_entry_t *entry
+)
+{
+    if( entry->prev )
+        entry->prev->next = entry->next;
+    else
+        cache->head = entry->next;
+    if( entry->next )
+        entry->next->prev = entry->prev;
+    else
+        cache->tail = entry->prev;
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void push_frame_cache_entry
+(
+    lw_video_frame_cache_t       *cache,
+    lw_video_frame_cache_entry_t *entry
+)
+{
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if( cache->head )
+        cache->head->prev = entry;
+    else
+        cache->tail = entry;
+    cache->head = entry;
+}
+
+static void remove_frame_cache_entry
+(
+    lw_video_frame_cache_t       *cache,
+    lw_video_frame_cache_entry_t *entry
+)
+{
+    lw_video_frame_cache_entry_t **link = get_frame_cache_bucket( cache, entry->frame_number );
+    while( *link != entry )
+        link = &(*link)->hash_next;
+    *link = entry->hash_next;
+    unlink_frame_cache_entry( cache, entry );
+    cache->size -= entry->size;
+    av_frame_free( &entry->frame );
+    lw_freep( &entry );
+}
+
+void lw_setup_video_frame_cache
+(
+    lw_video_frame_cache_t *cache,
+    int                     cache_mb
+)
+{
+    lw_clear_video_frame_cache( cache );
+    cache->max_size = cache_mb > 0 ? (size_t)cache_mb << 20 : 0;
+}
+
+/* Return the cached frame of the given presentation frame number and mark it as the most recently used one.
+ * Return NULL if not cached. */
+AVFrame *lw_get_cached_video_frame
+(
+    lw_video_frame_cache_t *cache,
+    uint32_t                frame_number
+)
+{
+    if( !cache->hash )
+        return NULL;
+    for( lw_video_frame_cache_entry_t *entry = *get_frame_cache_bucket( cache, frame_number ); entry; entry = entry->hash_next )
+        if( entry->frame_number == frame_number )
+        {
+            if( entry != cache->head )
+            {
+                unlink_frame_cache_entry( cache, entry );
+                push_frame_cache_entry( cache, entry );
+            }
+            return entry->frame;
+        }
+    return NULL;
+}
+
+/* Put a new reference to the given frame into the cache, and then evict the least recently used frames exceeding the budget.
+ * Failure to cache is not an error since the frame can be decoded again. */
+void lw_cache_video_frame
+(
+    lw_video_frame_cache_t *cache,
+    uint32_t                frame_number,
+    AVFrame                *frame
+)
+{
+    if( cache->max_size == 0 || !frame->buf[0] )
+        return;
+    size_t size = lw_get_video_frame_buffer_size( frame );
+    if( size > cache->max_size )
+        return;
+    if( !cache->hash )
+    {
+        cache->hash = (lw_video_frame_cache_entry_t **)lw_malloc_zero( LW_VIDEO_FRAME_CACHE_HASH_SIZE * sizeof(lw_video_frame_cache_entry_t *) );
+        if( !cache->hash )
+            return;
+    }
+    if( lw_get_cached_video_frame( cache, frame_number ) )
+        /* Already cached. The entry became the most recently used one. */
+        return;
+    lw_video_frame_cache_entry_t *entry = (lw_video_frame_cache_entry_t *)lw_malloc_zero( sizeof(lw_video_frame_cache_entry_t) );
+    if( !entry )
+        return;
+    entry->frame = av_frame_alloc();
+    if( !entry->frame || av_frame_ref( entry->frame, frame ) < 0 )
+    {
+        av_frame_free( &entry->frame );
+        lw_freep( &entry );
+        return;
+    }
+    while( cache->tail && cache->size + size > cache->max_size )
+        remove_frame_cache_entry( cache, cache->tail );
+    lw_video_frame_cache_entry_t **bucket = get_frame_cache_bucket( cache, frame_number );
+    entry->frame_number = frame_number;
+    entry->size         = size;
+    entry->hash_next    = *bucket;
+    *bucket = entry;
+    push_frame_cache_entry( cache, entry );
+    cache->size += size;
+}
+
+void lw_clear_video_frame_cache
+(
+    lw_video_frame_cache_t *cache
+)
+{
+    while( cache->tail )
+        remove_frame_cache_entry( cache, cache->tail );
+    if( cache->hash )
+        lw_freep( &cache->hash );
+    cache->size = 0;
+}
+
+static int compare_frame_number
+(
+    const uint32_t *a,
+    const uint32_t *b
+)
+{
+    return *a > *b ? 1 : (*a == *b ? 0 : -1);
+}
+
+uint32_t *lw_plan_video_frame_batch
+(
+    const uint32_t *frame_numbers,
+    uint32_t        count,
+    uint32_t       *unique_count
+)
+{
+    *unique_count = 0;
+    if( !frame_numbers || count == 0 )
+        return NULL;
+    uint32_t *plan = (uint32_t *)lw_memdup( (void *)frame_numbers, count * sizeof(uint32_t) );
+    if( !plan )
+        return NULL;
+    qsort( plan, count, sizeof(uint32_t), (int(*)( const void *, const void * ))compare_frame_number );
+    uint32_t n = 1;
+    for( uint32_t i = 1; i < count; i++ )
+        if( plan[i] != plan[n - 1] )
+            plan[n++] = plan[i];
+    *unique_count = n;
+    return plan;
+}
+
 void lw_cleanup_video_output_handler
 (
     lw_video_output_handler_t *vohp
@@ -143,9 +886,14 @@ void lw_cleanup_video_output_handler
     for( int i = 0; i < REPEAT_CONTROL_CACHE_NUM; i++ )
         if( vohp->frame_cache_buffers[i] )
             av_frame_free( &vohp->frame_cache_buffers[i] );
-    if( vohp->scaler.sws_ctx )
-    {
-        sws_freeContext( vohp->scaler.sws_ctx );
-        vohp->scaler.sws_ctx = NULL;
-    }
+    lw_clear_video_frame_cache( &vohp->frame_cache );
+    av_buffer_pool_uninit( &vohp->dr_chroma_pool );
+    vohp->dr_chroma_pool_size = 0;
+    lw_video_scaler_handler_t *vshp = &vohp->scaler;
+    for( int i = 0; i < vshp->cache_count; i++ )
+        free_scaler_cache_entry( &vshp->cache[i] );
+    vshp->cache_count = 0;
+    vshp->sws_ctx     = NULL;
+    destroy_video_slice_pool( vshp->slice_pool );
+    vshp->slice_pool = NULL;
 }
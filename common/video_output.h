@@ -21,20 +21,45 @@
 /* This file is available under an ISC license. */
 
 #define REPEAT_CONTROL_CACHE_NUM 2
+#define SCALER_CACHE_NUM         4
 
 typedef int func_get_buffer_t( struct AVCodecContext *, AVFrame *, int );
 
 typedef struct
 {
-    int                enabled;
-    int                flags;
-    int                input_width;
-    int                input_height;
-    enum AVPixelFormat input_pixel_format;
-    enum AVPixelFormat output_pixel_format;
-    enum AVColorSpace  input_colorspace;
-    int                input_yuv_range;
-    struct SwsContext *sws_ctx;
+    int                 flags;
+    int                 width;
+    int                 height;
+    enum AVPixelFormat  input_pixel_format;
+    enum AVPixelFormat  output_pixel_format;
+    enum AVColorSpace   colorspace;
+    int                 yuv_range;
+    struct SwsContext  *sws_ctx;
+    /* Scalers for the horizontal bands of the picture converted in parallel.
+     * slice_num is 0 if not set up yet, and -1 if the conversion cannot be split. */
+    int                 slice_num;
+    struct SwsContext **slice_sws_ctx;
+} lw_video_scaler_cache_entry_t;
+
+typedef struct lw_video_slice_pool_tag lw_video_slice_pool_t;
+
+typedef struct
+{
+    int                           enabled;
+    int                           flags;
+    int                           input_width;
+    int                           input_height;
+    enum AVPixelFormat            input_pixel_format;
+    enum AVPixelFormat            output_pixel_format;
+    enum AVColorSpace             input_colorspace;
+    int                           input_yuv_range;
+    struct SwsContext            *sws_ctx;      /* the scaler for the current configuration */
+    /* Initialized scalers in most recently used order.
+     * The first entry is the current one. */
+    int                           cache_count;
+    lw_video_scaler_cache_entry_t cache[SCALER_CACHE_NUM];
+    /* Worker threads for slice-parallel conversion */
+    lw_video_slice_pool_t        *slice_pool;
 } lw_video_scaler_handler_t;
 
 typedef struct
@@ -43,6 +68,45 @@ typedef struct
     uint32_t bottom;
 } lw_video_frame_order_t;
 
+/* Host frame buffer layouts available for direct rendering */
+#define LW_DR_CAP_PLANAR_YUV       0x0001   /* 8-bit planar YUV 4:2:0, 4:2:2, 4:4:4, 4:1:0 and 4:1:1 */
+#define LW_DR_CAP_PLANAR_YUV440    0x0002   /* 8-bit planar YUV 4:4:0 */
+#define LW_DR_CAP_PLANAR_YUV_DEEP  0x0004   /* 9, 10 and 16-bit little-endian planar YUV 4:2:0, 4:2:2 and 4:4:4 */
+#define LW_DR_CAP_PLANAR_YUV_12_14 0x0008   /* 12 and 14-bit little-endian planar YUV 4:2:0, 4:2:2 and 4:4:4 */
+#define LW_DR_CAP_PLANAR_RGB       0x0010   /* 8, 9, 10 and 16-bit little-endian planar GBR */
+#define LW_DR_CAP_GRAY8            0x0020   /* 8-bit luma only */
+#define LW_DR_CAP_PACKED_YUV422    0x0040   /* packed YUYV 4:2:2 */
+#define LW_DR_CAP_PACKED_RGB       0x0080   /* packed BGR24 and BGRA */
+#define LW_DR_CAP_SEMI_PLANAR      0x0100   /* NV12 and NV21 rendered into 8-bit planar YUV 4:2:0 */
+
+typedef enum
+{
+    LW_DR_LAYOUT_NONE        = 0,   /* direct rendering is not available */
+    LW_DR_LAYOUT_DIRECT      = 1,   /* the decoder writes all planes into the host frame */
+    LW_DR_LAYOUT_SEMI_PLANAR = 2    /* the decoder writes luma into the host frame and interleaved chroma into an intermediate buffer */
+} lw_dr_layout_t;
+
+/* Host chroma planes filled from the interleaved chroma of a semi-planar frame on demand */
+typedef struct
+{
+    int      pending;
+    int      width;         /* chroma samples per line */
+    int      height;        /* chroma lines */
+    uint8_t *data[2];       /* Cb and Cr planes of the host frame */
+    int      linesize[2];
+} lw_dr_chroma_split_t;
+
+typedef struct lw_video_frame_cache_entry_tag lw_video_frame_cache_entry_t;
+
+typedef struct
+{
+    size_t                         max_size;    /* budget in bytes; 0 means disabled */
+    size_t                         size;        /* total size of cached frame buffers in bytes */
+    lw_video_frame_cache_entry_t  *head;        /* most recently used */
+    lw_video_frame_cache_entry_t  *tail;        /* least recently used */
+    lw_video_frame_cache_entry_t **hash;
+} lw_video_frame_cache_t;
+
 typedef struct
 {
     lw_video_scaler_handler_t scaler;
@@ -58,6 +122,11 @@ typedef struct
     lw_video_frame_order_t   *frame_order_list;
     AVFrame                  *frame_cache_buffers[REPEAT_CONTROL_CACHE_NUM];
     uint32_t                  frame_cache_numbers[REPEAT_CONTROL_CACHE_NUM];
+    /* Decoded frame cache */
+    lw_video_frame_cache_t    frame_cache;
+    /* Direct rendering */
+    AVBufferPool             *dr_chroma_pool;       /* interleaved chroma planes of semi-planar frames */
+    int                       dr_chroma_pool_size;
     /* Application private extension */
     void                     *private_handler;
     void (*free_private_handler)( void *private_handler );
@@ -86,6 +155,135 @@ struct SwsContext *update_scaler_configuration
     int                yuv_range
 );
 
+/* Switch the scaler to the given input configuration.
+ * A scaler initialized for the same configuration before is reused if it is still cached.
+ * Return 0 if successful, otherwise return -1. */
+int update_scaler_handler
+(
+    lw_video_scaler_handler_t *vshp,
+    int                        width,
+    int                        height,
+    enum AVPixelFormat         input_pixel_format,
+    enum AVColorSpace          colorspace,
+    int                        yuv_range
+);
+
+/* Called for each horizontal band of a picture by lw_run_video_slices().
+ * thread_id ranges from 0 to thread_num - 1. */
+typedef void func_video_slice( int thread_id, int thread_num, void *param1, void *param2 );
+
+/* Set up the worker threads converting pictures in parallel by horizontal bands.
+ * If threads is 0, the number of logical processors is used. If threads is 1, no worker thread is created.
+ * Return 0 if successful, otherwise return -1. */
+int lw_setup_video_slice_threads
+(
+    lw_video_scaler_handler_t *vshp,
+    int                        threads
+);
+
+/* Call func once per slice thread and wait for all of them to return.
+ * The calling thread processes the first slice by itself.
+ * If no worker thread is set up, func is called only once with thread_num 1. */
+void lw_run_video_slices
+(
+    lw_video_scaler_handler_t *vshp,
+    func_video_slice          *func,
+    void                      *param1,
+    void                      *param2
+);
+
+/* Get the lines [start, end) of the given horizontal band of a picture of the given height. */
+void lw_get_video_slice_range
+(
+    int  height,
+    int  thread_id,
+    int  thread_num,
+    int *start,
+    int *end
+);
+
+/* Convert a picture through the current scaler, in parallel by horizontal bands if possible.
+ * Return the height of the output picture if successful, otherwise return a negative value. */
+int lw_scale_video_frame
+(
+    lw_video_scaler_handler_t *vshp,
+    const uint8_t * const     *src_data,
+    const int                 *src_linesize,
+    uint8_t * const           *dst_data,
+    const int                 *dst_linesize
+);
+
+/* Get the layout for direct rendering of the given pixel format into a host supporting host_caps (LW_DR_CAP_*).
+ * The pixel format of the host frame buffer is set to *host_pixel_format if available. */
+lw_dr_layout_t lw_get_dr_layout
+(
+    AVCodecContext     *ctx,
+    enum AVPixelFormat  pixel_format,
+    int                 host_caps,
+    enum AVPixelFormat *host_pixel_format
+);
+
+/* Allocate the intermediate interleaved chroma plane of a semi-planar frame of the given size into av_frame->buf[1].
+ * Return 0 if successful, otherwise return -1. */
+int lw_alloc_dr_chroma_plane
+(
+    lw_video_output_handler_t *vohp,
+    AVFrame                   *av_frame,
+    int                        width,
+    int                        height
+);
+
+/* Split the interleaved chroma of a semi-planar frame into the host planes if not done yet. */
+void lw_split_dr_chroma
+(
+    lw_video_scaler_handler_t *vshp,
+    AVFrame                   *av_frame,
+    lw_dr_chroma_split_t      *split
+);
+
+size_t lw_get_video_frame_buffer_size
+(
+    AVFrame *frame
+);
+
+void lw_setup_video_frame_cache
+(
+    lw_video_frame_cache_t *cache,
+    int                     cache_mb
+);
+
+AVFrame *lw_get_cached_video_frame
+(
+    lw_video_frame_cache_t *cache,
+    uint32_t                frame_number
+);
+
+void lw_cache_video_frame
+(
+    lw_video_frame_cache_t *cache,
+    uint32_t                frame_number,
+    AVFrame                *frame
+);
+
+void lw_clear_video_frame_cache
+(
+    lw_video_frame_cache_t *cache
+);
+
+/* Called for each frame delivered by a batched frame request.
+ * The frame is owned by the decoder and valid only until the callback returns.
+ * Return a negative value to abort the rest of the batch. */
+typedef int (*lw_video_frame_handler_t)( void *priv, uint32_t frame_number, AVFrame *frame );
+
+/* Return a copy of frame_numbers sorted in ascending order without duplicates, or NULL on failure.
+ * The returned list shall be deallocated by lw_freep(). */
+uint32_t *lw_plan_video_frame_batch
+(
+    const uint32_t *frame_numbers,
+    uint32_t        count,
+    uint32_t       *unique_count
+);
+
 void lw_cleanup_video_output_handler
 (
     lw_video_output_handler_t *vohp
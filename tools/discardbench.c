@@ -0,0 +1,226 @@
+/*****************************************************************************
+ * discardbench.c
+ *****************************************************************************
+ * Copyright (C) 2014 L-SMASH Works project
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *****************************************************************************/
+
+/* This file is available under an ISC license.
+ * However, when distributing its binary file, it will be under LGPL or GPL. */
+
+/* Measure the demuxing work saved by lavf_discard_other_streams() for multi-stream files such as TS.
+ * Each file is demuxed to the end twice in the same way as the private format contexts of the decode handlers,
+ * first keeping every stream and then discarding the streams other than the decoded one, and the numbers of
+ * packets and bytes output by av_read_frame(), heap allocations and the elapsed time are printed for both.
+ * The decoded stream is the given one, or the best video stream or else the best audio stream.
+ * The heap allocations are counted only with glibc.
+ *
+ * Usage: discardbench [-s stream_index] file ... */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+
+#include "utils.h"
+#include "lwlibav_dec.h"
+
+#ifdef __GLIBC__
+/* Count every heap allocation of this process, including the ones of libavformat and libavutil,
+ * by interposing the allocators of glibc. */
+extern void *__libc_malloc( size_t size );
+extern void *__libc_calloc( size_t nmemb, size_t size );
+extern void *__libc_realloc( void *ptr, size_t size );
+extern void *__libc_memalign( size_t alignment, size_t size );
+
+static uint64_t alloc_count = 0;
+
+void *malloc( size_t size )
+{
+    ++alloc_count;
+    return __libc_malloc( size );
+}
+
+void *calloc( size_t nmemb, size_t size )
+{
+    ++alloc_count;
+    return __libc_calloc( nmemb, size );
+}
+
+void *realloc( void *ptr, size_t size )
+{
+    ++alloc_count;
+    return __libc_realloc( ptr, size );
+}
+
+void *memalign( size_t alignment, size_t size )
+{
+    ++alloc_count;
+    return __libc_memalign( alignment, size );
+}
+
+void *aligned_alloc( size_t alignment, size_t size )
+{
+    ++alloc_count;
+    return __libc_memalign( alignment, size );
+}
+
+int posix_memalign( void **memptr, size_t alignment, size_t size )
+{
+    ++alloc_count;
+    void *ptr = __libc_memalign( alignment, size );
+    if( !ptr )
+        return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+#define ALLOC_COUNT_AVAILABLE 1
+#else
+static uint64_t alloc_count = 0;
+#define ALLOC_COUNT_AVAILABLE 0
+#endif
+
+typedef struct
+{
+    uint64_t packets;           /* output by av_read_frame() */
+    uint64_t bytes;
+    uint64_t dropped_packets;   /* of the streams other than the decoded one */
+    uint64_t dropped_bytes;
+    uint64_t allocations;
+    double   seconds;
+} demux_stats_t;
+
+static double get_time( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Return the index of the decoded stream, or -1 if none. */
+static int select_stream
+(
+    AVFormatContext *format_ctx,
+    int              stream_index
+)
+{
+    if( stream_index >= 0 )
+        return stream_index < (int)format_ctx->nb_streams ? stream_index : -1;
+    stream_index = av_find_best_stream( format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0 );
+    if( stream_index < 0 )
+        stream_index = av_find_best_stream( format_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0 );
+    return stream_index < 0 ? -1 : stream_index;
+}
+
+static int demux_file
+(
+    const char    *file_path,
+    int           *stream_index,
+    int            discard,
+    demux_stats_t *stats
+)
+{
+    AVFormatContext *format_ctx = NULL;
+    if( avformat_open_input( &format_ctx, file_path, NULL, NULL ) < 0
+     || avformat_find_stream_info( format_ctx, NULL ) < 0 )
+    {
+        fprintf( stderr, "%s: failed to open.\n", file_path );
+        if( format_ctx )
+            avformat_close_input( &format_ctx );
+        return -1;
+    }
+    *stream_index = select_stream( format_ctx, *stream_index );
+    if( *stream_index < 0 )
+    {
+        fprintf( stderr, "%s: no stream to decode.\n", file_path );
+        avformat_close_input( &format_ctx );
+        return -1;
+    }
+    /* The handlers discard the other streams after avformat_find_stream_info(). */
+    if( discard )
+        lavf_discard_other_streams( format_ctx, *stream_index );
+    memset( stats, 0, sizeof(demux_stats_t) );
+    uint64_t alloc_start = alloc_count;
+    double   time_start  = get_time();
+    AVPacket pkt;
+    av_init_packet( &pkt );
+    while( av_read_frame( format_ctx, &pkt ) >= 0 )
+    {
+        ++ stats->packets;
+        stats->bytes += pkt.size;
+        if( pkt.stream_index != *stream_index )
+        {
+            ++ stats->dropped_packets;
+            stats->dropped_bytes += pkt.size;
+        }
+        av_free_packet( &pkt );
+        av_init_packet( &pkt );
+    }
+    stats->seconds     = get_time() - time_start;
+    stats->allocations = alloc_count - alloc_start;
+    avformat_close_input( &format_ctx );
+    return 0;
+}
+
+static void print_stats
+(
+    const char          *mode,
+    const demux_stats_t *stats
+)
+{
+    printf( "  %-8s %10"PRIu64" packets %14"PRIu64" bytes (other streams: %10"PRIu64" packets %14"PRIu64" bytes)",
+            mode, stats->packets, stats->bytes, stats->dropped_packets, stats->dropped_bytes );
+    if( ALLOC_COUNT_AVAILABLE )
+        printf( " %10"PRIu64" allocations", stats->allocations );
+    printf( " %9.3f s\n", stats->seconds );
+}
+
+int main( int argc, char *argv[] )
+{
+    int stream_index = -1;
+    int i = 1;
+    if( i + 1 < argc && !strcmp( argv[i], "-s" ) )
+    {
+        stream_index = atoi( argv[i + 1] );
+        i += 2;
+    }
+    if( i >= argc )
+    {
+        fprintf( stderr, "Usage: discardbench [-s stream_index] file ...\n" );
+        return 2;
+    }
+    av_register_all();
+    int ret = 0;
+    for( ; i < argc; i++ )
+    {
+        int           index = stream_index;
+        demux_stats_t all;
+        demux_stats_t discarded;
+        if( demux_file( argv[i], &index, 0, &all ) < 0
+         || demux_file( argv[i], &index, 1, &discarded ) < 0 )
+        {
+            ret = 1;
+            continue;
+        }
+        printf( "%s: stream %d\n", argv[i], index );
+        print_stats( "all", &all );
+        print_stats( "discard", &discarded );
+    }
+    return ret;
+}
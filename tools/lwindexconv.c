@@ -0,0 +1,67 @@
+/*****************************************************************************
+ * lwindexconv.c
+ *****************************************************************************
+ * Copyright (C) 2014 L-SMASH Works project
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *****************************************************************************/
+
+/* This file is available under an ISC license.
+ * However, when distributing its binary file, it will be under LGPL or GPL. */
+
+/* Convert between the binary index file (.lwi) and its text layout.
+ * The text layout is for debugging and inspection, and can be edited and converted back.
+ * The LWLibav sources also open the text layout directly, in which case the finalized tables are rebuilt.
+ *
+ * Usage: lwindexconv -d index.lwi text   (dump the binary index file into the text layout)
+ *        lwindexconv -i text index.lwi   (convert the text layout into the binary index file) */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavresample/avresample.h>
+
+#include "utils.h"
+#include "video_output.h"
+#include "audio_output.h"
+#include "lwlibav_dec.h"
+#include "lwlibav_video.h"
+#include "lwlibav_audio.h"
+#include "progress.h"
+#include "lwindex.h"
+
+int main( int argc, char *argv[] )
+{
+    if( argc != 4 || (strcmp( argv[1], "-d" ) && strcmp( argv[1], "-i" )) )
+    {
+        fprintf( stderr, "Usage: lwindexconv -d index.lwi text\n"
+                         "       lwindexconv -i text index.lwi\n" );
+        return 2;
+    }
+    if( !strcmp( argv[1], "-d" ) )
+    {
+        if( lwlibav_export_index_text( argv[2], argv[3] ) < 0 )
+        {
+            fprintf( stderr, "Failed to dump %s into %s.\n", argv[2], argv[3] );
+            return 1;
+        }
+    }
+    else if( lwlibav_import_index_text( argv[2], argv[3] ) < 0 )
+    {
+        fprintf( stderr, "Failed to convert %s into %s.\n", argv[2], argv[3] );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,660 @@
+/*****************************************************************************
+ * simdcheck.c
+ *****************************************************************************
+ * Copyright (C) 2014 L-SMASH Works project
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *****************************************************************************/
+
+/* This file is available under an ISC license. */
+
+/* Check that every SIMD kernel of colorspace_simd.c gives bit-exactly the same output as its C version
+ * over various frame sizes, and optionally measure their speed on a 1920x1080 frame.
+ * The kernels not supported by the running CPU are skipped.
+ *
+ * Usage: simdcheck [-b] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "utils.h"
+#include "lwsimd.h"
+#include "colorspace_simd.h"
+
+#define ALIGNMENT     64
+#define PADDING       256    /* bytes SIMD kernels may read or write beyond the row */
+#define BENCH_WIDTH   1920
+#define BENCH_HEIGHT  1080
+#define BENCH_SECONDS 0.5
+
+typedef struct
+{
+    uint8_t *data;
+    uint8_t *origin;
+    int      linesize;
+    int      height;
+} plane_t;
+
+static uint32_t random_state = 12345;
+
+static uint32_t get_random( void )
+{
+    random_state = random_state * 1664525 + 1013904223;
+    return random_state >> 8;
+}
+
+static int alloc_plane
+(
+    plane_t *plane,
+    int      rowsize,
+    int      height
+)
+{
+    plane->linesize = (rowsize + PADDING + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    plane->height   = height;
+    plane->origin   = (uint8_t *)malloc( plane->linesize * (height + 4) + ALIGNMENT );
+    if( !plane->origin )
+        return -1;
+    plane->data = (uint8_t *)(((uintptr_t)plane->origin + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1));
+    return 0;
+}
+
+static void free_plane
+(
+    plane_t *plane
+)
+{
+    free( plane->origin );
+    plane->origin = NULL;
+    plane->data   = NULL;
+}
+
+/* Fill with random samples of 'bit_depth' bits. 16-bit samples are stored in little-endian. */
+static void fill_plane
+(
+    plane_t *plane,
+    int      bit_depth
+)
+{
+    int size = plane->linesize * (plane->height + 4);
+    if( bit_depth <= 8 )
+        for( int i = 0; i < size; i++ )
+            plane->data[i] = (uint8_t)get_random();
+    else
+        for( int i = 0; i < size / 2; i++ )
+            ((uint16_t *)plane->data)[i] = (uint16_t)(get_random() & ((1 << bit_depth) - 1));
+}
+
+/* Fill with a value which the kernels never output so that a missing write is detected. */
+static void clear_plane
+(
+    plane_t *plane
+)
+{
+    memset( plane->data, 0xA5, plane->linesize * (plane->height + 4) );
+}
+
+/* Return the first line differing within 'rowsize' bytes, or -1 if identical. */
+static int compare_planes
+(
+    plane_t *a,
+    plane_t *b,
+    int      rowsize,
+    int      height
+)
+{
+    for( int y = 0; y < height; y++ )
+        if( memcmp( a->data + y * a->linesize, b->data + y * b->linesize, rowsize ) )
+            return y;
+    return -1;
+}
+
+static double get_time( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int failures = 0;
+static int bench    = 0;
+
+static void report
+(
+    const char *kernel,
+    int         width,
+    int         height,
+    const char *variant,
+    int         line
+)
+{
+    if( line < 0 )
+        return;
+    fprintf( stderr, "FAIL: %s (%s) %dx%d differs from the C version at line %d.\n", kernel, variant, width, height, line );
+    ++failures;
+}
+
+static void print_speed
+(
+    const char *kernel,
+    const char *variant,
+    double      c_time,
+    double      time
+)
+{
+    printf( "  %-40s %-7s %8.3f ms/frame  x%.2f\n", kernel, variant, time * 1e3, c_time / time );
+}
+
+/*---------------------------------------------------------------------------------------------
+ * YUV 4:4:4 16-bit into YC48
+ *---------------------------------------------------------------------------------------------*/
+typedef void func_yuv16le_to_yc48( uint8_t *, int, uint8_t **, int *, int, int, int );
+
+static const struct
+{
+    const char           *name;
+    int                   flag;
+    func_yuv16le_to_yc48 *func;
+} yc48_variants[] =
+{
+#if LW_SIMD_X86
+    { "sse2",   LW_SIMD_SSE2,  convert_yuv16le_to_yc48_sse2   },
+    { "sse4.1", LW_SIMD_SSE41, convert_yuv16le_to_yc48_sse4_1 },
+#endif
+    { NULL, 0, NULL }
+};
+
+static double run_yuv16le_to_yc48
+(
+    func_yuv16le_to_yc48 *func,
+    plane_t              *dst,
+    plane_t              *src,
+    int                   width,
+    int                   height,
+    int                   full_range,
+    int                   loops
+)
+{
+    uint8_t *src_data    [3] = { src[0].data,     src[1].data,     src[2].data     };
+    int      src_linesize[3] = { src[0].linesize, src[1].linesize, src[2].linesize };
+    double start = get_time();
+    for( int i = 0; i < loops; i++ )
+        func( dst->data, dst->linesize, src_data, src_linesize, width * 6, height, full_range );
+    return (get_time() - start) / loops;
+}
+
+static int check_yuv16le_to_yc48( int simd_flags )
+{
+    static const int widths [] = { 1, 7, 16, 17, 48, 63, 640, 1921 };
+    static const int heights[] = { 1, 2, 9 };
+    for( int w = 0; w < sizeof(widths) / sizeof(widths[0]); w++ )
+        for( int h = 0; h < sizeof(heights) / sizeof(heights[0]); h++ )
+        {
+            int width  = widths [w];
+            int height = heights[h];
+            plane_t src[3], ref, out;
+            for( int i = 0; i < 3; i++ )
+            {
+                if( alloc_plane( &src[i], width * 2, height ) < 0 )
+                    return -1;
+                fill_plane( &src[i], 16 );
+            }
+            if( alloc_plane( &ref, width * 6, height ) < 0
+             || alloc_plane( &out, width * 6, height ) < 0 )
+                return -1;
+            for( int full_range = 0; full_range < 2; full_range++ )
+            {
+                clear_plane( &ref );
+                run_yuv16le_to_yc48( convert_yuv16le_to_yc48, &ref, src, width, height, full_range, 1 );
+                for( int v = 0; yc48_variants[v].func; v++ )
+                {
+                    if( !(simd_flags & yc48_variants[v].flag) )
+                        continue;
+                    clear_plane( &out );
+                    run_yuv16le_to_yc48( yc48_variants[v].func, &out, src, width, height, full_range, 1 );
+                    report( full_range ? "yuv16le_to_yc48 (full range)" : "yuv16le_to_yc48", width, height,
+                            yc48_variants[v].name, compare_planes( &ref, &out, width * 6, height ) );
+                }
+            }
+            for( int i = 0; i < 3; i++ )
+                free_plane( &src[i] );
+            free_plane( &ref );
+            free_plane( &out );
+        }
+    return 0;
+}
+
+/*---------------------------------------------------------------------------------------------
+ * Interlaced YV12 into YUY2
+ *---------------------------------------------------------------------------------------------*/
+typedef void func_yv12i_to_yuy2( uint8_t *, int, uint8_t **, int *, int, int );
+
+static const struct
+{
+    const char         *name;
+    int                 flag;
+    func_yv12i_to_yuy2 *func;
+} yuy2_variants[] =
+{
+#if LW_SIMD_X86
+    { "ssse3", LW_SIMD_SSSE3, convert_yv12i_to_yuy2_ssse3 },
+#if LW_SIMD_AVX2_ENABLED
+    { "avx2",  LW_SIMD_AVX2,  convert_yv12i_to_yuy2_avx2  },
+#endif
+#endif
+    { NULL, 0, NULL }
+};
+
+static double run_yv12i_to_yuy2
+(
+    func_yv12i_to_yuy2 *func,
+    plane_t            *dst,
+    plane_t            *src,
+    int                 width,
+    int                 height,
+    int                 loops
+)
+{
+    uint8_t *src_data    [3] = { src[0].data,     src[1].data,     src[2].data     };
+    int      src_linesize[3] = { src[0].linesize, src[1].linesize, src[2].linesize };
+    double start = get_time();
+    for( int i = 0; i < loops; i++ )
+        func( dst->data, dst->linesize, src_data, src_linesize, width * 2, height );
+    return (get_time() - start) / loops;
+}
+
+static int check_yv12i_to_yuy2( int simd_flags )
+{
+    /* The width is even and the height is a multiple of 4 for interlaced 4:2:0. */
+    static const int widths [] = { 2, 30, 32, 34, 64, 96, 126, 640, 1922 };
+    static const int heights[] = { 4, 8, 12, 36 };
+    for( int w = 0; w < sizeof(widths) / sizeof(widths[0]); w++ )
+        for( int h = 0; h < sizeof(heights) / sizeof(heights[0]); h++ )
+        {
+            int width  = widths [w];
+            int height = heights[h];
+            plane_t src[3], ref, out;
+            if( alloc_plane( &src[0], width, height ) < 0
+             || alloc_plane( &src[1], width / 2, height / 2 ) < 0
+             || alloc_plane( &src[2], width / 2, height / 2 ) < 0
+             || alloc_plane( &ref, width * 2, height ) < 0
+             || alloc_plane( &out, width * 2, height ) < 0 )
+                return -1;
+            /* The chroma planes share the linesize. */
+            src[2].linesize = src[1].linesize;
+            for( int i = 0; i < 3; i++ )
+                fill_plane( &src[i], 8 );
+            clear_plane( &ref );
+            run_yv12i_to_yuy2( convert_yv12i_to_yuy2, &ref, src, width, height, 1 );
+            for( int v = 0; yuy2_variants[v].func; v++ )
+            {
+                if( !(simd_flags & yuy2_variants[v].flag) )
+                    continue;
+                clear_plane( &out );
+                run_yv12i_to_yuy2( yuy2_variants[v].func, &out, src, width, height, 1 );
+                report( "yv12i_to_yuy2", width, height, yuy2_variants[v].name, compare_planes( &ref, &out, width * 2, height ) );
+            }
+            for( int i = 0; i < 3; i++ )
+                free_plane( &src[i] );
+            free_plane( &ref );
+            free_plane( &out );
+        }
+    return 0;
+}
+
+/*---------------------------------------------------------------------------------------------
+ * Interlaced YUV 4:2:0 9/10/16-bit into YUV 4:4:4 16-bit
+ *---------------------------------------------------------------------------------------------*/
+static const struct
+{
+    const char                              *name;
+    int                                      bit_depth;
+    func_convert_yuv420ple_i_to_yuv444p16le *c;
+    func_convert_yuv420ple_i_to_yuv444p16le *sse41;
+} yuv444_kernels[] =
+{
+#if LW_SIMD_X86
+    { "yuv420p9le_i_to_yuv444p16le",  9,  convert_yuv420p9le_i_to_yuv444p16le,  convert_yuv420p9le_i_to_yuv444p16le_sse41  },
+    { "yuv420p10le_i_to_yuv444p16le", 10, convert_yuv420p10le_i_to_yuv444p16le, convert_yuv420p10le_i_to_yuv444p16le_sse41 },
+    { "yuv420p16le_i_to_yuv444p16le", 16, convert_yuv420p16le_i_to_yuv444p16le, convert_yuv420p16le_i_to_yuv444p16le_sse41 },
+#else
+    { "yuv420p9le_i_to_yuv444p16le",  9,  convert_yuv420p9le_i_to_yuv444p16le,  NULL },
+    { "yuv420p10le_i_to_yuv444p16le", 10, convert_yuv420p10le_i_to_yuv444p16le, NULL },
+    { "yuv420p16le_i_to_yuv444p16le", 16, convert_yuv420p16le_i_to_yuv444p16le, NULL },
+#endif
+    { NULL, 0, NULL, NULL }
+};
+
+static double run_yuv420ple_i_to_yuv444p16le
+(
+    func_convert_yuv420ple_i_to_yuv444p16le *func,
+    plane_t                                 *dst,
+    plane_t                                 *src,
+    int                                      width,
+    int                                      height,
+    int                                      loops
+)
+{
+    uint8_t *dst_data    [3] = { dst[0].data,     dst[1].data,     dst[2].data     };
+    int      dst_linesize[3] = { dst[0].linesize, dst[1].linesize, dst[2].linesize };
+    uint8_t *src_data    [3] = { src[0].data,     src[1].data,     src[2].data     };
+    int      src_linesize[3] = { src[0].linesize, src[1].linesize, src[2].linesize };
+    double start = get_time();
+    for( int i = 0; i < loops; i++ )
+        func( dst_data, dst_linesize, src_data, src_linesize, width * 2, height );
+    return (get_time() - start) / loops;
+}
+
+static int check_yuv420ple_i_to_yuv444p16le( int simd_flags )
+{
+    static const int widths [] = { 2, 14, 16, 18, 32, 34, 126, 640, 1922 };
+    static const int heights[] = { 4, 8, 12, 36 };
+    if( !(simd_flags & LW_SIMD_SSE41) )
+        return 0;
+    for( int k = 0; yuv444_kernels[k].name; k++ )
+        for( int w = 0; w < sizeof(widths) / sizeof(widths[0]); w++ )
+            for( int h = 0; h < sizeof(heights) / sizeof(heights[0]); h++ )
+            {
+                int width  = widths [w];
+                int height = heights[h];
+                plane_t src[3], ref[3], out[3];
+                for( int i = 0; i < 3; i++ )
+                {
+                    int src_width = i ? width / 2 : width;
+                    int src_height = i ? height / 2 : height;
+                    if( alloc_plane( &src[i], src_width * 2, src_height ) < 0
+                     || alloc_plane( &ref[i], width * 2, height ) < 0
+                     || alloc_plane( &out[i], width * 2, height ) < 0 )
+                        return -1;
+                    fill_plane( &src[i], yuv444_kernels[k].bit_depth );
+                    clear_plane( &ref[i] );
+                    clear_plane( &out[i] );
+                }
+                run_yuv420ple_i_to_yuv444p16le( yuv444_kernels[k].c,     ref, src, width, height, 1 );
+                run_yuv420ple_i_to_yuv444p16le( yuv444_kernels[k].sse41, out, src, width, height, 1 );
+                for( int i = 0; i < 3; i++ )
+                {
+                    report( yuv444_kernels[k].name, width, height, "sse4.1", compare_planes( &ref[i], &out[i], width * 2, height ) );
+                    free_plane( &src[i] );
+                    free_plane( &ref[i] );
+                    free_plane( &out[i] );
+                }
+            }
+    return 0;
+}
+
+/*---------------------------------------------------------------------------------------------
+ * Packed RGB into planar RGB
+ *---------------------------------------------------------------------------------------------*/
+static const struct
+{
+    const char                             *name;
+    int                                     flag;
+    func_deinterleave_packed_rgb_to_planar *func;
+} deinterleave_variants[] =
+{
+#if LW_SIMD_X86
+    { "ssse3", LW_SIMD_SSSE3, deinterleave_packed_rgb_to_planar_ssse3 },
+#if LW_SIMD_AVX2_ENABLED
+    { "avx2",  LW_SIMD_AVX2,  deinterleave_packed_rgb_to_planar_avx2  },
+#endif
+#endif
+    { NULL, 0, NULL }
+};
+
+static double run_deinterleave_packed_rgb
+(
+    func_deinterleave_packed_rgb_to_planar *func,
+    plane_t                                *dst,
+    plane_t                                *src,
+    int                                     width,
+    int                                     height,
+    int                                     num_components,
+    int                                     sample_size,
+    const int                              *component_offset,
+    int                                     loops
+)
+{
+    /* The planes share the linesize. */
+    uint8_t *dst_data[3] = { dst[0].data, dst[1].data, dst[2].data };
+    double start = get_time();
+    for( int i = 0; i < loops; i++ )
+        func( dst_data, dst[0].linesize, src->data, src->linesize, width, height, num_components, sample_size, component_offset );
+    return (get_time() - start) / loops;
+}
+
+static int check_deinterleave_packed_rgb( int simd_flags )
+{
+    static const int widths [] = { 1, 5, 15, 16, 17, 31, 32, 33, 63, 64, 65, 641, 1921 };
+    static const int heights[] = { 1, 3 };
+    for( int num_components = 3; num_components <= 4; num_components++ )
+        for( int sample_size = 1; sample_size <= 2; sample_size++ )
+            /* every layout, i.e. every assignment of distinct positions in a pixel to R, G and B */
+            for( int r = 0; r < num_components; r++ )
+                for( int g = 0; g < num_components; g++ )
+                    for( int b = 0; b < num_components; b++ )
+                    {
+                        if( r == g || g == b || b == r )
+                            continue;
+                        const int component_offset[3] = { r, g, b };
+                        char name[96];
+                        sprintf( name, "deinterleave_packed_rgb %dx%d-bit {%d,%d,%d}",
+                                 num_components, 8 * sample_size, r, g, b );
+                        for( int w = 0; w < sizeof(widths) / sizeof(widths[0]); w++ )
+                            for( int h = 0; h < sizeof(heights) / sizeof(heights[0]); h++ )
+                            {
+                                int width  = widths [w];
+                                int height = heights[h];
+                                plane_t src, ref[3], out[3];
+                                if( alloc_plane( &src, width * num_components * sample_size, height ) < 0 )
+                                    return -1;
+                                fill_plane( &src, 8 );
+                                for( int i = 0; i < 3; i++ )
+                                {
+                                    if( alloc_plane( &ref[i], width * sample_size, height ) < 0
+                                     || alloc_plane( &out[i], width * sample_size, height ) < 0 )
+                                        return -1;
+                                    clear_plane( &ref[i] );
+                                }
+                                run_deinterleave_packed_rgb( deinterleave_packed_rgb_to_planar_c, ref, &src, width, height,
+                                                             num_components, sample_size, component_offset, 1 );
+                                for( int v = 0; deinterleave_variants[v].func; v++ )
+                                {
+                                    if( !(simd_flags & deinterleave_variants[v].flag) )
+                                        continue;
+                                    for( int i = 0; i < 3; i++ )
+                                        clear_plane( &out[i] );
+                                    run_deinterleave_packed_rgb( deinterleave_variants[v].func, out, &src, width, height,
+                                                                 num_components, sample_size, component_offset, 1 );
+                                    for( int i = 0; i < 3; i++ )
+                                        report( name, width, height, deinterleave_variants[v].name,
+                                                compare_planes( &ref[i], &out[i], width * sample_size, height ) );
+                                }
+                                free_plane( &src );
+                                for( int i = 0; i < 3; i++ )
+                                {
+                                    free_plane( &ref[i] );
+                                    free_plane( &out[i] );
+                                }
+                            }
+                    }
+    return 0;
+}
+
+/*---------------------------------------------------------------------------------------------
+ * Benchmark
+ *---------------------------------------------------------------------------------------------*/
+/* Return the number of loops which take about BENCH_SECONDS in total. */
+static int get_bench_loops( double one )
+{
+    int loops = one > 0 ? (int)(BENCH_SECONDS / one) : 1000;
+    return loops < 1 ? 1 : loops;
+}
+
+static int bench_kernels( int simd_flags )
+{
+    const int width  = BENCH_WIDTH;
+    const int height = BENCH_HEIGHT;
+    printf( "%dx%d\n", width, height );
+    /* yuv16le_to_yc48 */
+    {
+        plane_t src[3], dst;
+        for( int i = 0; i < 3; i++ )
+        {
+            if( alloc_plane( &src[i], width * 2, height ) < 0 )
+                return -1;
+            fill_plane( &src[i], 16 );
+        }
+        if( alloc_plane( &dst, width * 6, height ) < 0 )
+            return -1;
+        int loops = get_bench_loops( run_yuv16le_to_yc48( convert_yuv16le_to_yc48, &dst, src, width, height, 0, 1 ) );
+        double c_time = run_yuv16le_to_yc48( convert_yuv16le_to_yc48, &dst, src, width, height, 0, loops );
+        print_speed( "yuv16le_to_yc48", "c", c_time, c_time );
+        for( int v = 0; yc48_variants[v].func; v++ )
+            if( simd_flags & yc48_variants[v].flag )
+                print_speed( "yuv16le_to_yc48", yc48_variants[v].name, c_time,
+                             run_yuv16le_to_yc48( yc48_variants[v].func, &dst, src, width, height, 0, loops ) );
+        for( int i = 0; i < 3; i++ )
+            free_plane( &src[i] );
+        free_plane( &dst );
+    }
+    /* yv12i_to_yuy2 */
+    {
+        plane_t src[3], dst;
+        if( alloc_plane( &src[0], width, height ) < 0
+         || alloc_plane( &src[1], width / 2, height / 2 ) < 0
+         || alloc_plane( &src[2], width / 2, height / 2 ) < 0
+         || alloc_plane( &dst, width * 2, height ) < 0 )
+            return -1;
+        for( int i = 0; i < 3; i++ )
+            fill_plane( &src[i], 8 );
+        func_yv12i_to_yuy2 *c = convert_yv12i_to_yuy2;
+        int loops = get_bench_loops( run_yv12i_to_yuy2( c, &dst, src, width, height, 1 ) );
+        double c_time = run_yv12i_to_yuy2( c, &dst, src, width, height, loops );
+        print_speed( "yv12i_to_yuy2", "c", c_time, c_time );
+        for( int v = 0; yuy2_variants[v].func; v++ )
+            if( simd_flags & yuy2_variants[v].flag )
+                print_speed( "yv12i_to_yuy2", yuy2_variants[v].name, c_time,
+                             run_yv12i_to_yuy2( yuy2_variants[v].func, &dst, src, width, height, loops ) );
+        for( int i = 0; i < 3; i++ )
+            free_plane( &src[i] );
+        free_plane( &dst );
+    }
+    /* yuv420ple_i_to_yuv444p16le */
+    for( int k = 0; yuv444_kernels[k].name; k++ )
+    {
+        plane_t src[3], dst[3];
+        for( int i = 0; i < 3; i++ )
+        {
+            if( alloc_plane( &src[i], (i ? width / 2 : width) * 2, i ? height / 2 : height ) < 0
+             || alloc_plane( &dst[i], width * 2, height ) < 0 )
+                return -1;
+            fill_plane( &src[i], yuv444_kernels[k].bit_depth );
+        }
+        int loops = get_bench_loops( run_yuv420ple_i_to_yuv444p16le( yuv444_kernels[k].c, dst, src, width, height, 1 ) );
+        double c_time = run_yuv420ple_i_to_yuv444p16le( yuv444_kernels[k].c, dst, src, width, height, loops );
+        print_speed( yuv444_kernels[k].name, "c", c_time, c_time );
+        if( simd_flags & LW_SIMD_SSE41 )
+            print_speed( yuv444_kernels[k].name, "sse4.1", c_time,
+                         run_yuv420ple_i_to_yuv444p16le( yuv444_kernels[k].sse41, dst, src, width, height, loops ) );
+        for( int i = 0; i < 3; i++ )
+        {
+            free_plane( &src[i] );
+            free_plane( &dst[i] );
+        }
+    }
+    /* deinterleave_packed_rgb_to_planar */
+    {
+        static const struct
+        {
+            const char *name;
+            int         num_components;
+            int         sample_size;
+            int         component_offset[3];
+        } layouts[] =
+        {
+            { "deinterleave_packed_rgb RGB24",  3, 1, { 0, 1, 2 } },
+            { "deinterleave_packed_rgb BGRA",   4, 1, { 2, 1, 0 } },
+            { "deinterleave_packed_rgb ARGB",   4, 1, { 1, 2, 3 } },
+            { "deinterleave_packed_rgb BGR48",  3, 2, { 2, 1, 0 } },
+            { "deinterleave_packed_rgb RGBA64", 4, 2, { 0, 1, 2 } },
+        };
+        for( int l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++ )
+        {
+            const int num_components = layouts[l].num_components;
+            const int sample_size    = layouts[l].sample_size;
+            const int *offset        = layouts[l].component_offset;
+            plane_t src, dst[3];
+            if( alloc_plane( &src, width * num_components * sample_size, height ) < 0 )
+                return -1;
+            fill_plane( &src, 8 );
+            for( int i = 0; i < 3; i++ )
+                if( alloc_plane( &dst[i], width * sample_size, height ) < 0 )
+                    return -1;
+            func_deinterleave_packed_rgb_to_planar *c = deinterleave_packed_rgb_to_planar_c;
+            int loops = get_bench_loops( run_deinterleave_packed_rgb( c, dst, &src, width, height, num_components, sample_size, offset, 1 ) );
+            double c_time = run_deinterleave_packed_rgb( c, dst, &src, width, height, num_components, sample_size, offset, loops );
+            print_speed( layouts[l].name, "c", c_time, c_time );
+            for( int v = 0; deinterleave_variants[v].func; v++ )
+                if( simd_flags & deinterleave_variants[v].flag )
+                    print_speed( layouts[l].name, deinterleave_variants[v].name, c_time,
+                                 run_deinterleave_packed_rgb( deinterleave_variants[v].func, dst, &src, width, height,
+                                                              num_components, sample_size, offset, loops ) );
+            free_plane( &src );
+            for( int i = 0; i < 3; i++ )
+                free_plane( &dst[i] );
+        }
+    }
+    return 0;
+}
+
+int main( int argc, char *argv[] )
+{
+    for( int i = 1; i < argc; i++ )
+        if( !strcmp( argv[i], "-b" ) )
+            bench = 1;
+        else
+        {
+            fprintf( stderr, "Usage: simdcheck [-b]\n" );
+            return 2;
+        }
+    int simd_flags = lw_get_simd_flags();
+    printf( "SIMD:%s%s%s%s\n",
+            (simd_flags & LW_SIMD_SSE2)  ? " sse2"   : "",
+            (simd_flags & LW_SIMD_SSSE3) ? " ssse3"  : "",
+            (simd_flags & LW_SIMD_SSE41) ? " sse4.1" : "",
+            (simd_flags & LW_SIMD_AVX2)  ? " avx2"   : "" );
+    if( check_yuv16le_to_yc48( simd_flags ) < 0
+     || check_yv12i_to_yuy2( simd_flags ) < 0
+     || check_yuv420ple_i_to_yuv444p16le( simd_flags ) < 0
+     || check_deinterleave_packed_rgb( simd_flags ) < 0 )
+    {
+        fprintf( stderr, "Failed to allocate memory.\n" );
+        return 2;
+    }
+    if( failures )
+    {
+        fprintf( stderr, "%d check(s) failed.\n", failures );
+        return 1;
+    }
+    printf( "All checks passed.\n" );
+    if( bench && bench_kernels( simd_flags ) < 0 )
+    {
+        fprintf( stderr, "Failed to allocate memory.\n" );
+        return 2;
+    }
+    return 0;
+}